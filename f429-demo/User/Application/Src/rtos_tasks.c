@@ -107,8 +107,16 @@ void send_demo_task(void *pvParameters) {
     printf("Welcome use message protocol! \n"
            "Press KEY0 to start. \n");
 
-    size_t size = 200;
+    /* 四个 ID 的数据区连续存放, 每个 tick 的帧批量发送 */
+    size_t size = 20 + 50 + 100 + 200;
     uint8_t *test_data = (uint8_t *)pvPortMalloc(sizeof(uint8_t) * size);
+    uint8_t *data1 = test_data;
+    uint8_t *data2 = data1 + 20;
+    uint8_t *data3 = data2 + 50;
+    uint8_t *data4 = data3 + 100;
+
+    msg_batch_item_t batch[MSG_ID_RESERVE_LEN];
+    uint32_t batch_len;
 
     /** 测试条件: 
      * ID1: 长度 20 byte, 发送频率 500 Hz.  TX2 -> RX3
@@ -166,43 +174,51 @@ void send_demo_task(void *pvParameters) {
             break;
         }
 
+        batch_len = 0;
+
         if (times % 2 == 0) {
             ++count1;
 
             for (index = 0; index < 20; ++index) {
-                test_data[index] = count1 + index;
+                data1[index] = count1 + index;
             }
 
-            message_send_data(MSG_ID_1, MSG_DATA_UINT8, test_data, 20);
+            batch[batch_len++] =
+                (msg_batch_item_t){MSG_ID_1, MSG_DATA_UINT8, data1, 20};
         }
 
         if (times % 4 == 0) {
             ++count2;
 
             for (index = 0; index < 50; ++index) {
-                test_data[index] = count2 + index;
+                data2[index] = count2 + index;
             }
-            message_send_data(MSG_ID_2, MSG_DATA_UINT8, test_data, 50);
+            batch[batch_len++] =
+                (msg_batch_item_t){MSG_ID_2, MSG_DATA_UINT8, data2, 50};
         }
 
         if (times % 5 == 0) {
             ++count3;
 
             for (index = 0; index < 100; ++index) {
-                test_data[index] = count3 + index;
+                data3[index] = count3 + index;
             }
-            message_send_data(MSG_ID_3, MSG_DATA_UINT8, test_data, 100);
+            batch[batch_len++] =
+                (msg_batch_item_t){MSG_ID_3, MSG_DATA_UINT8, data3, 100};
         }
 
         if (times % 10 == 0) {
             ++count4;
 
             for (index = 0; index < 200; ++index) {
-                test_data[index] = count4 + index;
+                data4[index] = count4 + index;
             }
-            message_send_data(MSG_ID_4, MSG_DATA_UINT8, test_data, 200);
+            batch[batch_len++] =
+                (msg_batch_item_t){MSG_ID_4, MSG_DATA_UINT8, data4, 200};
         }
 
+        message_send_batch(batch, batch_len);
+
         ++times;
         vTaskDelay(1);
     }
@@ -241,7 +257,43 @@ void send_demo_task(void *pvParameters) {
            msg_id_statistics[MSG_ID_4].id_type_err);
     LED1_OFF();
 
-    /* 更多数据下断点在 msg_protocol 中查看`msg_list`中的统计 */
+#if MSG_ENABLE_STATISTICS
+    /* 协议层统计 */
+    msg_stats_t stats;
+    for (msg_id_t id = MSG_ID_1; id < MSG_ID_RESERVE_LEN; ++id) {
+        if (message_get_stats(id, &stats) != 0) {
+            continue;
+        }
+
+        printf("id: %u, send: %u (%u bytes, %u esc), recv: %u (%u bytes, %u "
+               "esc), recv_err: %u, crc_err: %u, max_fifo: %u, "
+               "fifo_overflow: %u. \n",
+               id + 1, stats.send_count, stats.send_bytes, stats.send_escape,
+               stats.recv_success, stats.recv_bytes, stats.recv_escape,
+               stats.recv_error, stats.crc_check_error,
+               stats.max_fifo_element_len, stats.fifo_overflow);
+    }
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_LATENCY
+    /* 延迟统计, 单位为 CPU 周期 */
+    msg_latency_t latency;
+    for (msg_id_t id = MSG_ID_1; id < MSG_ID_RESERVE_LEN; ++id) {
+        if ((message_get_latency(id, &latency) != 0) ||
+            (latency.queue.count == 0) || (latency.process.count == 0)) {
+            continue;
+        }
+
+        printf("id: %u, queue avg/max: %u/%u, process avg/max: %u/%u "
+               "cycles. \n",
+               id + 1,
+               (uint32_t)(latency.queue.total / latency.queue.count),
+               latency.queue.max,
+               (uint32_t)(latency.process.total / latency.process.count),
+               latency.process.max);
+    }
+#endif /* MSG_ENABLE_LATENCY */
+
     vTaskDelay(portMAX_DELAY);
 }
 
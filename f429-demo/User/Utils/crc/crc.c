@@ -101,8 +101,19 @@ uint16_t calc_crc16(uint8_t *start_byte, uint16_t len) {
  * @return CRC8校验值
  */
 uint8_t calc_crc8(uint8_t *p, uint32_t len) {
-    uint8_t crc = 0;
-    uint16_t i;
+    return calc_crc8_update(0, p, len);
+}
+
+/**
+ * @brief CRC校验(1byte), 在上一段的校验值基础上继续计算
+ *
+ * @param crc 上一段的CRC8校验值, 第一段传0
+ * @param p 用于校验的数据
+ * @param len 用于校验的长度
+ * @return CRC8校验值
+ */
+uint8_t calc_crc8_update(uint8_t crc, uint8_t *p, uint32_t len) {
+    uint32_t i;
     for (i = 0; i < len; i++) {
         crc = crc8_table[(crc ^ *p++) & 0xff];
     }
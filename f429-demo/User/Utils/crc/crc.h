@@ -5,5 +5,6 @@
 
 uint16_t calc_crc16(uint8_t *start_byte, uint16_t len);
 uint8_t calc_crc8(uint8_t *start_byte, uint32_t len);
+uint8_t calc_crc8_update(uint8_t crc, uint8_t *start_byte, uint32_t len);
 
 #endif /* __CRC_H */
\ No newline at end of file
@@ -0,0 +1,22 @@
+/**
+ * @file    FreeRTOS.h
+ * @author  Deadline039
+ * @brief   Linux 主机端的 FreeRTOS 替代, 只提供消息协议用到的类型
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE       ((BaseType_t)0)
+#define pdTRUE        ((BaseType_t)1)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFU)
+
+#endif /* INC_FREERTOS_H */
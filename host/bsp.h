@@ -0,0 +1,219 @@
+/**
+ * @file    bsp.h
+ * @author  Deadline039
+ * @brief   Linux 主机端的板级支持包替代, 让消息协议在主机上编译
+ * @version 1.0
+ * @date    2026-10-18
+ * @note    编译时把`host`目录放在包含路径最前面, 协议层中的串口句柄就是
+ *          `msg_host_link_t`, 由`msg_host.c`实现串口收发接口
+ */
+
+#ifndef __BSP_H
+#define __BSP_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+struct msg_host_loop;
+
+/**
+ * @brief 主机端链路 (串口或伪终端), 代替串口句柄
+ */
+typedef struct msg_host_link {
+    int fd;       /*!< 文件描述符 */
+    int hold_fd;  /*!< 伪终端从端, 保持打开避免对端关闭时挂断 */
+    void *hdmatx; /*!< 始终不为`NULL`, 协议层按 DMA 方式发送 */
+    uint32_t mtu; /*!< 每个数据报的最大长度, 0 表示字节流 */
+
+    pthread_mutex_t tx_lock; /*!< 发送缓冲区锁, 发送线程和事件循环共用 */
+    uint8_t *tx_buf;         /*!< 发送缓冲区 */
+    uint32_t tx_size;        /*!< 发送缓冲区大小 */
+    uint32_t tx_len;         /*!< 发送缓冲区中未写出的字节数 */
+    uint8_t tx_armed;        /*!< 是否在等待可写事件 */
+    uint8_t tx_done;         /*!< DMA 发送已写入缓冲区, 等待事件循环报告完成 */
+
+    uint8_t *rx_buf;  /*!< 接收环形缓冲区, 只在事件循环线程中访问 */
+    uint32_t rx_mask; /*!< 接收环形缓冲区大小掩码 */
+    uint32_t rx_head; /*!< 接收读指针 */
+    uint32_t rx_tail; /*!< 接收写指针 */
+
+    struct msg_host_loop *loop; /*!< 所属事件循环 */
+    struct msg_host_link *next; /*!< 事件循环中的下一个链路 */
+} msg_host_link_t;
+
+typedef msg_host_link_t UART_HandleTypeDef;
+
+uint32_t HAL_GetTick(void);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart,
+                                        const uint8_t *pData, uint16_t Size);
+
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len);
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len);
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart);
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart);
+
+/* 协议层读 DMA 剩余计数得到串口积压的字节数, 主机上就是发送缓冲区中
+ * 未写出的字节数 */
+#define __HAL_DMA_GET_COUNTER(hdma)                                            \
+    __atomic_load_n(&((msg_host_link_t *)(hdma))->tx_len, __ATOMIC_RELAXED)
+
+/* 主机端写发送缓冲区时自己会等待空间, 上一次发送总是已经完成 */
+typedef enum { RESET = 0U, SET = !RESET } FlagStatus;
+#define UART_FLAG_TC                     0x40U
+#define __HAL_UART_GET_FLAG(huart, flag) ((void)(huart), SET)
+
+/* 主机上没有 CAN 控制器, 这里只声明协议层用到的 bxCAN 寄存器和 CSP 接口,
+ * 由模拟总线实现 (见`host/tools/can_bench.c`). 与 F429 一样有 CAN1 和 CAN2,
+ * 共用 CAN1 的 28 个过滤器组 */
+#define CAN1_ENABLE 1
+#define CAN2_ENABLE 1
+#define CAN3_ENABLE 0
+
+typedef struct {
+    uint32_t FR1;
+    uint32_t FR2;
+} CAN_FilterRegister_TypeDef;
+
+typedef struct {
+    uint32_t MCR;
+    uint32_t FMR;
+    uint32_t FM1R;
+    uint32_t FS1R;
+    uint32_t FFA1R;
+    uint32_t FA1R;
+    CAN_FilterRegister_TypeDef sFilterRegister[28];
+} CAN_TypeDef;
+
+extern CAN_TypeDef msg_host_can[2];
+#define CAN1 (&msg_host_can[0])
+#define CAN2 (&msg_host_can[1])
+
+typedef struct {
+    CAN_TypeDef *Instance;
+} CAN_HandleTypeDef;
+
+typedef struct {
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+typedef struct {
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef enum {
+    can1_selected = 0U,
+    can2_selected,
+    can3_selected
+} can_selected_t;
+
+#define CAN_ID_STD             0x00000000U
+#define CAN_ID_EXT             0x00000004U
+#define CAN_RTR_DATA           0x00000000U
+#define CAN_FILTERMODE_IDMASK  0x00000000U
+#define CAN_FILTERMODE_IDLIST  0x00000001U
+#define CAN_FILTERSCALE_16BIT  0x00000000U
+#define CAN_FILTERSCALE_32BIT  0x00000001U
+#define CAN_FILTER_DISABLE     0x00000000U
+#define CAN_FILTER_ENABLE      0x00000001U
+#define CAN_FILTER_FIFO0       0x00000000U
+#define CAN_FILTER_FIFO1       0x00000001U
+#define CAN_RX_FIFO0           0x00000000U
+#define CAN_RX_FIFO1           0x00000001U
+#define CAN_MCR_TXFP           0x00000004U
+#define CAN_FMR_FINIT          0x00000001U
+#define CAN_FMR_CAN2SB_Pos     8U
+#define CAN_FMR_CAN2SB         (0x3FU << CAN_FMR_CAN2SB_Pos)
+
+#define SET_BIT(reg, bit)   ((reg) |= (bit))
+#define CLEAR_BIT(reg, bit) ((reg) &= ~(bit))
+#define READ_BIT(reg, bit)  ((reg) & (bit))
+
+extern CAN_HandleTypeDef can1_handle;
+extern CAN_HandleTypeDef can2_handle;
+
+uint8_t can_send_message(can_selected_t can_selected, uint32_t can_ide,
+                         uint32_t id, uint8_t len, const uint8_t *msg);
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan,
+                                       const CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan,
+                                       uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader,
+                                       uint8_t aData[]);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+
+/* 时间戳使用 CLOCK_MONOTONIC, 单位 us */
+typedef struct {
+    uint32_t CYCCNT;
+    uint32_t CTRL;
+} msg_host_dwt_t;
+
+typedef struct {
+    uint32_t DEMCR;
+} msg_host_core_debug_t;
+
+msg_host_dwt_t *msg_host_dwt(void);
+extern msg_host_core_debug_t msg_host_core_debug;
+
+#define DWT                        (msg_host_dwt())
+#define CoreDebug                  (&msg_host_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk 1U
+#define DWT_CTRL_CYCCNTENA_Msk     1U
+#define SystemCoreClock            1000000U
+
+/* 不启用 RTOS 时协议层用关中断做临界区, 主机上换成全局递归锁 */
+void msg_host_critical_enter(void);
+void msg_host_critical_exit(void);
+
+static inline uint32_t __get_PRIMASK(void) {
+    return 0;
+}
+
+static inline void __disable_irq(void) {
+    msg_host_critical_enter();
+}
+
+static inline void __set_PRIMASK(uint32_t primask) {
+    (void)primask;
+    msg_host_critical_exit();
+}
+
+static inline void __DMB(void) {
+    __sync_synchronize();
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __BSP_H */
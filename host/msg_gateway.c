@@ -0,0 +1,529 @@
+/**
+ * @file    msg_gateway.c
+ * @author  Deadline039
+ * @brief   多链路主机网关, 每个链路一条解包流水线
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#define _GNU_SOURCE
+
+#include "msg_gateway.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* 每个链路至少一个 ID, 链路数不会超过 ID 数 */
+#define MSG_GATEWAY_MAX_LINKS MSG_ID_RESERVE_LEN
+
+/* 流水线没有数据时的最长等待时间, 单位 ms, 决定停止和重传检查的响应速度 */
+#define MSG_GATEWAY_POLL_MS 10
+
+/**
+ * @brief 一条解包流水线
+ */
+typedef struct {
+    msg_gateway_t *gateway;           /*!< 所属网关 */
+    msg_host_link_t *link;            /*!< 链路 */
+    msg_id_t ids[MSG_ID_RESERVE_LEN]; /*!< 链路上解包的 ID */
+    uint32_t id_count;                /*!< ID 个数 */
+    msg_id_t polling;                 /*!< 正在轮询的 ID */
+    uint32_t index;                   /*!< 链路序号 */
+    uint32_t credit;                  /*!< 未归还帧数的上限 */
+    int cpu;                          /*!< 绑定的 CPU, 负数不绑定 */
+    int credit_fd;                    /*!< 额度恢复时唤醒流水线 */
+    uint32_t pushed;                  /*!< 本轮放入队列的帧数 */
+    pthread_t thread;                 /*!< 线程 */
+    uint8_t started;                  /*!< 线程已经启动 */
+    msg_gateway_stats_t stats;        /*!< 统计信息 */
+} msg_gateway_pipe_t;
+
+/**
+ * @brief 网关
+ */
+struct msg_gateway {
+    msg_gateway_frame_t *head; /*!< 队列头, 只有消费者访问 */
+    msg_gateway_frame_t *tail; /*!< 队列尾, 生产者原子交换 */
+    msg_gateway_frame_t *stub; /*!< 队列哨兵 */
+    int event_fd;              /*!< 有新帧时唤醒消费者 */
+    uint8_t stop;              /*!< 停止标志 */
+    uint8_t started;           /*!< 已经启动 */
+    uint32_t pipe_num;         /*!< 链路数 */
+
+    msg_gateway_pipe_t pipes[MSG_GATEWAY_MAX_LINKS]; /*!< 流水线 */
+};
+
+/* ID 属于哪条流水线, 一个 ID 只能属于一个链路 */
+static msg_gateway_pipe_t *msg_gateway_owner[MSG_ID_RESERVE_LEN];
+
+/* 当前线程正在解包的流水线, 协议层回调没有上下文参数 */
+static __thread msg_gateway_pipe_t *msg_gateway_current;
+
+/**
+ * @brief 帧入队, 多个生产者无锁并发
+ *
+ * @param gateway 网关
+ * @param frame 帧
+ */
+static void msg_gateway_push(msg_gateway_t *gateway,
+                             msg_gateway_frame_t *frame) {
+    msg_gateway_frame_t *prev;
+
+    frame->next = NULL;
+    prev = __atomic_exchange_n(&gateway->tail, frame, __ATOMIC_ACQ_REL);
+    /* 在这之前消费者看不到新帧, 会把队列当成空的 */
+    __atomic_store_n(&prev->next, frame, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 帧出队, 只能在一个消费者线程中调用
+ *
+ * @param gateway 网关
+ * @return 帧, 队列空 (或者生产者正在入队) 返回`NULL`
+ */
+static msg_gateway_frame_t *msg_gateway_take(msg_gateway_t *gateway) {
+    msg_gateway_frame_t *head = gateway->head;
+    msg_gateway_frame_t *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (head == gateway->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+
+        /* 跳过哨兵 */
+        gateway->head = next;
+        head = next;
+        next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        gateway->head = next;
+        return head;
+    }
+
+    if (head != __atomic_load_n(&gateway->tail, __ATOMIC_ACQUIRE)) {
+        /* 生产者已经交换了队尾, 还没有链接, 下次再取 */
+        return NULL;
+    }
+
+    /* 只剩最后一帧, 放回哨兵才能取走 */
+    msg_gateway_push(gateway, gateway->stub);
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        gateway->head = next;
+        return head;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 协议层回调, 复制一帧放入队列
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void msg_gateway_recv(uint32_t msg_length, uint8_t msg_id_type,
+                             uint8_t *msg_data) {
+    msg_gateway_pipe_t *pipe = msg_gateway_current;
+    msg_gateway_frame_t *frame;
+    uint32_t in_flight;
+
+    if (pipe == NULL) {
+        return;
+    }
+
+    frame = malloc(sizeof(msg_gateway_frame_t) + msg_length);
+    if (frame == NULL) {
+        __atomic_add_fetch(&pipe->stats.alloc_fail, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    frame->link = pipe->index;
+    frame->len = msg_length;
+    frame->msg_id = pipe->polling;
+    frame->id_type = msg_id_type;
+    memcpy(frame->data, msg_data, msg_length);
+
+    in_flight = __atomic_add_fetch(&pipe->stats.in_flight, 1, __ATOMIC_ACQ_REL);
+    if (in_flight > pipe->stats.max_in_flight) {
+        __atomic_store_n(&pipe->stats.max_in_flight, in_flight,
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&pipe->stats.frames, 1, __ATOMIC_RELAXED);
+
+    msg_gateway_push(pipe->gateway, frame);
+    ++pipe->pushed;
+}
+
+/**
+ * @brief 轮询流水线上的所有 ID
+ *
+ * @param pipe 流水线
+ * @note 扩展 ID 不在帧头的高四位中, 回调按正在轮询的 ID 记录帧的来源
+ */
+static void msg_gateway_poll(msg_gateway_pipe_t *pipe) {
+    for (uint32_t i = 0; i < pipe->id_count; ++i) {
+        pipe->polling = pipe->ids[i];
+        message_polling_id(pipe->ids[i]);
+    }
+}
+
+/**
+ * @brief 解包链路接收缓冲区中的所有数据
+ *
+ * @param pipe 流水线
+ */
+static void msg_gateway_decode(msg_gateway_pipe_t *pipe) {
+    msg_host_link_t *link = pipe->link;
+    uint32_t pending, last;
+
+    /* 每次轮询每个 ID 最多读出一个协议层接收缓冲区, 重复到读空 */
+    pending = link->rx_tail - link->rx_head;
+    do {
+        msg_gateway_poll(pipe);
+        last = pending;
+        pending = link->rx_tail - link->rx_head;
+    } while ((pending != 0) && (pending < last));
+
+    /* 最后读出的帧在下一次轮询时才出队 */
+    msg_gateway_poll(pipe);
+}
+
+/**
+ * @brief 清空事件计数
+ *
+ * @param fd eventfd
+ */
+static void msg_gateway_drain(int fd) {
+    uint64_t count;
+
+    while ((read(fd, &count, sizeof(count)) < 0) && (errno == EINTR)) {
+    }
+}
+
+/**
+ * @brief 通知一次事件
+ *
+ * @param fd eventfd
+ */
+static void msg_gateway_notify(int fd) {
+    uint64_t one = 1;
+
+    while ((write(fd, &one, sizeof(one)) < 0) && (errno == EINTR)) {
+    }
+}
+
+/**
+ * @brief 流水线线程
+ *
+ * @param arg 流水线
+ * @return `NULL`
+ */
+static void *msg_gateway_entry(void *arg) {
+    msg_gateway_pipe_t *pipe = arg;
+    msg_gateway_t *gateway = pipe->gateway;
+    msg_host_link_t *link = pipe->link;
+    struct pollfd pfd;
+    cpu_set_t cpus;
+    uint32_t before;
+    uint8_t open = 1;
+    int ready;
+
+    if (pipe->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(pipe->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    msg_gateway_current = pipe;
+
+    while (__atomic_load_n(&gateway->stop, __ATOMIC_ACQUIRE) == 0) {
+        if (__atomic_load_n(&pipe->stats.in_flight, __ATOMIC_ACQUIRE) >=
+            pipe->credit) {
+            /* 额度用完, 不再读链路, 数据积压在内核里, 等消费者归还 */
+            __atomic_add_fetch(&pipe->stats.stalls, 1, __ATOMIC_RELAXED);
+            pfd.fd = pipe->credit_fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, MSG_GATEWAY_POLL_MS) > 0) {
+                msg_gateway_drain(pipe->credit_fd);
+            }
+            continue;
+        }
+
+        /* 链路断开以后只等待停止, 仍然轮询协议层处理重传 */
+        pfd.fd = open ? link->fd : pipe->credit_fd;
+        pfd.events = POLLIN;
+        ready = poll(&pfd, 1, MSG_GATEWAY_POLL_MS);
+
+        if (ready > 0) {
+            if (open) {
+                before = link->rx_tail;
+                open = msg_host_link_fill(link);
+                __atomic_add_fetch(&pipe->stats.rx_bytes,
+                                   link->rx_tail - before, __ATOMIC_RELAXED);
+                if (open == 0) {
+                    __atomic_store_n(&pipe->stats.closed, 1, __ATOMIC_RELEASE);
+                }
+            } else {
+                msg_gateway_drain(pipe->credit_fd);
+            }
+        }
+
+        msg_gateway_decode(pipe);
+
+        if (pipe->pushed != 0) {
+            /* 每批只唤醒一次消费者 */
+            pipe->pushed = 0;
+            msg_gateway_notify(gateway->event_fd);
+        }
+    }
+
+    msg_gateway_current = NULL;
+    return NULL;
+}
+
+/**
+ * @brief 创建网关
+ *
+ * @return 网关, 失败返回`NULL`
+ */
+msg_gateway_t *msg_gateway_create(void) {
+    msg_gateway_t *gateway = calloc(1, sizeof(msg_gateway_t));
+
+    if (gateway == NULL) {
+        return NULL;
+    }
+
+    gateway->stub = calloc(1, sizeof(msg_gateway_frame_t));
+    gateway->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((gateway->stub == NULL) || (gateway->event_fd < 0)) {
+        if (gateway->event_fd >= 0) {
+            close(gateway->event_fd);
+        }
+        free(gateway->stub);
+        free(gateway);
+        return NULL;
+    }
+
+    gateway->head = gateway->stub;
+    gateway->tail = gateway->stub;
+    return gateway;
+}
+
+/**
+ * @brief 加入链路
+ *
+ * @param gateway 网关
+ * @param link 链路, 已经对`ids`调用过`message_register_polling_uart`
+ * @param ids 链路上解包的 ID
+ * @param id_count ID 个数
+ * @param cpu 流水线绑定的 CPU, 负数不绑定
+ * @param credit 未归还帧数的上限, 达到后暂停读取链路. 一次读入的数据
+ *               解出的帧都会入队, 实际可能超出一个接收缓冲区的帧数
+ * @return 链路序号, 失败返回 -1
+ * @note 启动前调用. 网关接管这些 ID 的接收回调
+ */
+int msg_gateway_add_link(msg_gateway_t *gateway, msg_host_link_t *link,
+                         const msg_id_t *ids, uint32_t id_count, int cpu,
+                         uint32_t credit) {
+    msg_gateway_pipe_t *pipe;
+    uint32_t i, j;
+
+    if ((gateway == NULL) || (link == NULL) || (ids == NULL) ||
+        (id_count == 0) || (id_count > MSG_ID_RESERVE_LEN) || (credit == 0) ||
+        gateway->started || (gateway->pipe_num == MSG_GATEWAY_MAX_LINKS)) {
+        return -1;
+    }
+
+    for (i = 0; i < id_count; ++i) {
+        if ((ids[i] >= MSG_ID_RESERVE_LEN) ||
+            (msg_gateway_owner[ids[i]] != NULL)) {
+            return -1;
+        }
+
+        for (j = 0; j < i; ++j) {
+            if (ids[j] == ids[i]) {
+                return -1;
+            }
+        }
+    }
+
+    pipe = &gateway->pipes[gateway->pipe_num];
+    memset(pipe, 0, sizeof(msg_gateway_pipe_t));
+    pipe->credit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pipe->credit_fd < 0) {
+        return -1;
+    }
+
+    pipe->gateway = gateway;
+    pipe->link = link;
+    pipe->index = gateway->pipe_num;
+    pipe->credit = credit;
+    pipe->cpu = cpu;
+    pipe->id_count = id_count;
+    memcpy(pipe->ids, ids, id_count * sizeof(msg_id_t));
+
+    for (i = 0; i < id_count; ++i) {
+        msg_gateway_owner[ids[i]] = pipe;
+        message_register_recv_callback(ids[i], msg_gateway_recv);
+    }
+
+    return (int)gateway->pipe_num++;
+}
+
+/**
+ * @brief 启动所有流水线
+ *
+ * @param gateway 网关
+ * @return 启动状态
+ * @retval - 0: 成功
+ * @retval - 1: 失败, 已经启动的流水线在销毁时停止
+ */
+uint8_t msg_gateway_start(msg_gateway_t *gateway) {
+    msg_gateway_pipe_t *pipe;
+    uint32_t i;
+
+    if ((gateway == NULL) || gateway->started) {
+        return 1;
+    }
+
+    gateway->started = 1;
+    for (i = 0; i < gateway->pipe_num; ++i) {
+        pipe = &gateway->pipes[i];
+        if (pthread_create(&pipe->thread, NULL, msg_gateway_entry, pipe) !=
+            0) {
+            return 1;
+        }
+        pipe->started = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 取出一帧
+ *
+ * @param gateway 网关
+ * @param timeout_ms 队列空时的最长等待时间, 单位 ms, -1 一直等待
+ * @return 帧, 超时返回`NULL`. 处理完调用`msg_gateway_release`归还
+ * @note 只能在一个消费者线程中调用
+ */
+msg_gateway_frame_t *msg_gateway_pop(msg_gateway_t *gateway, int timeout_ms) {
+    msg_gateway_frame_t *frame = msg_gateway_take(gateway);
+    struct pollfd pfd = {.fd = gateway->event_fd, .events = POLLIN};
+
+    if ((frame != NULL) || (timeout_ms == 0)) {
+        return frame;
+    }
+
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        msg_gateway_drain(gateway->event_fd);
+    }
+
+    return msg_gateway_take(gateway);
+}
+
+/**
+ * @brief 归还一帧
+ *
+ * @param gateway 网关
+ * @param frame `msg_gateway_pop`取出的帧
+ */
+void msg_gateway_release(msg_gateway_t *gateway, msg_gateway_frame_t *frame) {
+    msg_gateway_pipe_t *pipe;
+
+    if ((gateway == NULL) || (frame == NULL) ||
+        (frame->link >= gateway->pipe_num)) {
+        return;
+    }
+
+    pipe = &gateway->pipes[frame->link];
+    free(frame);
+
+    if (__atomic_sub_fetch(&pipe->stats.in_flight, 1, __ATOMIC_ACQ_REL) ==
+        pipe->credit - 1) {
+        /* 刚好回到额度以内, 唤醒可能在等待的流水线 */
+        msg_gateway_notify(pipe->credit_fd);
+    }
+}
+
+/**
+ * @brief 读取链路统计信息
+ *
+ * @param gateway 网关
+ * @param link 链路序号
+ * @param[out] stats 统计信息
+ * @return 读取状态
+ * @retval - 0: 成功
+ * @retval - 1: 链路不存在
+ */
+uint8_t msg_gateway_get_stats(msg_gateway_t *gateway, uint32_t link,
+                              msg_gateway_stats_t *stats) {
+    msg_gateway_stats_t *src;
+
+    if ((gateway == NULL) || (stats == NULL) || (link >= gateway->pipe_num)) {
+        return 1;
+    }
+
+    src = &gateway->pipes[link].stats;
+    stats->rx_bytes = __atomic_load_n(&src->rx_bytes, __ATOMIC_RELAXED);
+    stats->frames = __atomic_load_n(&src->frames, __ATOMIC_RELAXED);
+    stats->stalls = __atomic_load_n(&src->stalls, __ATOMIC_RELAXED);
+    stats->alloc_fail = __atomic_load_n(&src->alloc_fail, __ATOMIC_RELAXED);
+    stats->in_flight = __atomic_load_n(&src->in_flight, __ATOMIC_RELAXED);
+    stats->max_in_flight =
+        __atomic_load_n(&src->max_in_flight, __ATOMIC_RELAXED);
+    stats->closed = __atomic_load_n(&src->closed, __ATOMIC_ACQUIRE);
+
+    return 0;
+}
+
+/**
+ * @brief 停止流水线并销毁网关, 队列中剩余的帧直接释放
+ *
+ * @param gateway 网关
+ * @note 链路不会关闭, 需要另外调用`msg_host_link_close`
+ */
+void msg_gateway_destroy(msg_gateway_t *gateway) {
+    msg_gateway_pipe_t *pipe;
+    msg_gateway_frame_t *frame;
+    uint32_t i, j;
+
+    if (gateway == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&gateway->stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < gateway->pipe_num; ++i) {
+        pipe = &gateway->pipes[i];
+        if (pipe->started) {
+            msg_gateway_notify(pipe->credit_fd);
+            pthread_join(pipe->thread, NULL);
+        }
+    }
+
+    /* 流水线都已经停止, 不会再有生产者 */
+    while ((frame = msg_gateway_take(gateway)) != NULL) {
+        free(frame);
+    }
+
+    for (i = 0; i < gateway->pipe_num; ++i) {
+        pipe = &gateway->pipes[i];
+        for (j = 0; j < pipe->id_count; ++j) {
+            message_register_recv_callback(pipe->ids[j], NULL);
+            msg_gateway_owner[pipe->ids[j]] = NULL;
+        }
+        close(pipe->credit_fd);
+    }
+
+    close(gateway->event_fd);
+    free(gateway->stub);
+    free(gateway);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file    msg_gateway.h
+ * @author  Deadline039
+ * @brief   多链路主机网关, 每个链路一条解包流水线
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ *                             ##### 如何使用 ####
+ * (#) 先打开链路, 并对链路上要解包的 ID 调用`message_register_polling_uart`.
+ *     一个 ID 只能属于一个链路, 网关接管这些 ID 的接收回调
+ *
+ * (#) `msg_gateway_create`创建网关, `msg_gateway_add_link`加入链路, 指定
+ *     链路上的 ID, 绑定的 CPU 和背压额度, 然后`msg_gateway_start`启动.
+ *     每个链路一个线程, 读链路, 解包, 把帧放入无锁多生产者单消费者队列
+ *
+ * (#) 消费者线程调用`msg_gateway_pop`取帧, 处理完调用`msg_gateway_release`
+ *     归还. 一个链路未归还的帧达到额度时, 该链路暂停读取, 数据积压在内核
+ *     和链路上, 不会丢帧, 也不会拖慢其他链路
+ *
+ * (#) `msg_gateway_get_stats`读取每个链路的统计信息
+ *
+ *****************************************************************************
+ */
+
+#ifndef __MSG_GATEWAY_H
+#define __MSG_GATEWAY_H
+
+#include "msg_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct msg_gateway msg_gateway_t;
+
+/**
+ * @brief 网关输出的一帧
+ */
+typedef struct msg_gateway_frame {
+    struct msg_gateway_frame *next; /*!< 队列链接, 内部使用 */
+    uint32_t link;                  /*!< 来源链路序号 */
+    uint32_t len;                   /*!< 数据长度 */
+    msg_id_t msg_id;                /*!< 数据含义 */
+    uint8_t id_type;                /*!< 消息 ID 和数据类型 */
+    uint8_t data[];                 /*!< 数据 */
+} msg_gateway_frame_t;
+
+/**
+ * @brief 链路统计信息
+ */
+typedef struct {
+    uint64_t rx_bytes;      /*!< 读入的字节数 */
+    uint64_t frames;        /*!< 解出的帧数 */
+    uint64_t stalls;        /*!< 额度用完暂停读取的次数 */
+    uint64_t alloc_fail;    /*!< 内存分配失败丢弃的帧数 */
+    uint32_t in_flight;     /*!< 未归还的帧数 */
+    uint32_t max_in_flight; /*!< 未归还帧数的最大值 */
+    uint8_t closed;         /*!< 链路已经断开 */
+} msg_gateway_stats_t;
+
+msg_gateway_t *msg_gateway_create(void);
+int msg_gateway_add_link(msg_gateway_t *gateway, msg_host_link_t *link,
+                         const msg_id_t *ids, uint32_t id_count, int cpu,
+                         uint32_t credit);
+uint8_t msg_gateway_start(msg_gateway_t *gateway);
+msg_gateway_frame_t *msg_gateway_pop(msg_gateway_t *gateway, int timeout_ms);
+void msg_gateway_release(msg_gateway_t *gateway, msg_gateway_frame_t *frame);
+uint8_t msg_gateway_get_stats(msg_gateway_t *gateway, uint32_t link,
+                              msg_gateway_stats_t *stats);
+void msg_gateway_destroy(msg_gateway_t *gateway);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MSG_GATEWAY_H */
@@ -0,0 +1,1233 @@
+/**
+ * @file    msg_host.c
+ * @author  Deadline039
+ * @brief   消息协议的 Linux 主机端库: 串口/伪终端链路, epoll 事件循环和
+ *          回调线程池
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#define _GNU_SOURCE
+
+#include "msg_host.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* 一次 epoll_wait 最多处理的事件数 */
+#define MSG_HOST_MAX_EVENTS 16
+
+/* UDP 数据报最大长度, 与开发板以太网链路一致 (1500 MTU - IP/UDP 头) */
+#define MSG_HOST_UDP_MTU 1472U
+
+/**
+ * @brief 判断是否是 2 的幂次方
+ *
+ * @param n 数字
+ * @retval - 0:   不是
+ * @retval - 其他: 是
+ */
+static inline uint32_t is_pow_of_2(uint32_t n) {
+    return (0 != n) && (0 == (n & (n - 1)));
+}
+
+/*****************************************************************************
+ * 时间与临界区
+ *****************************************************************************/
+
+/**
+ * @brief 单调时钟, 单位 us
+ *
+ * @return 当前时间
+ */
+static uint64_t msg_host_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+/**
+ * @brief 毫秒时基
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(msg_host_now_us() / 1000U);
+}
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 模拟 DWT 周期计数器, `SystemCoreClock`为 1 MHz, 计数单位就是 us
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static __thread msg_host_dwt_t dwt;
+    dwt.CYCCNT = (uint32_t)msg_host_now_us();
+    return &dwt;
+}
+
+static pthread_mutex_t msg_host_critical_lock =
+    PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/**
+ * @brief 进入临界区
+ */
+void msg_host_critical_enter(void) {
+    pthread_mutex_lock(&msg_host_critical_lock);
+}
+
+/**
+ * @brief 退出临界区
+ */
+void msg_host_critical_exit(void) {
+    pthread_mutex_unlock(&msg_host_critical_lock);
+}
+
+struct msg_host_mutex {
+    pthread_mutex_t lock;
+};
+
+/**
+ * @brief 创建互斥锁
+ *
+ * @return 互斥锁, 失败返回`NULL`
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    SemaphoreHandle_t mutex = malloc(sizeof(struct msg_host_mutex));
+
+    if (mutex == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&mutex->lock, NULL);
+    return mutex;
+}
+
+/**
+ * @brief 获取互斥锁
+ *
+ * @param mutex 互斥锁
+ * @param wait 等待时间, 单位 ms (主机端按 1 kHz 节拍换算)
+ * @return 成功返回`pdTRUE`
+ */
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    struct timespec ts;
+
+    if (wait == portMAX_DELAY) {
+        return pthread_mutex_lock(&mutex->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+
+    if (wait == 0) {
+        return pthread_mutex_trylock(&mutex->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += wait / 1000U;
+    ts.tv_nsec += (long)(wait % 1000U) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_mutex_timedlock(&mutex->lock, &ts) == 0 ? pdTRUE : pdFALSE;
+}
+
+/**
+ * @brief 释放互斥锁
+ *
+ * @param mutex 互斥锁
+ * @return 成功返回`pdTRUE`
+ */
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    return pthread_mutex_unlock(&mutex->lock) == 0 ? pdTRUE : pdFALSE;
+}
+
+/*****************************************************************************
+ * 链路
+ *****************************************************************************/
+
+/**
+ * @brief 回调任务, 接收数据复制一份交给工作线程
+ */
+typedef struct {
+    msg_recv_callback_t callback; /*!< 回调函数 */
+    uint32_t len;                 /*!< 数据长度 */
+    uint8_t id_type;              /*!< 消息 ID 和数据类型 */
+    uint8_t data[];               /*!< 数据 */
+} msg_host_job_t;
+
+/**
+ * @brief 工作线程, 每个线程一个有界任务队列
+ */
+typedef struct {
+    pthread_t thread;         /*!< 线程 */
+    pthread_mutex_t lock;     /*!< 队列锁 */
+    pthread_cond_t not_empty; /*!< 队列非空 */
+    pthread_cond_t not_full;  /*!< 队列未满 */
+    msg_host_job_t **jobs;    /*!< 任务队列 */
+    uint32_t mask;            /*!< 队列大小掩码 */
+    uint32_t head;            /*!< 队列读指针 */
+    uint32_t tail;            /*!< 队列写指针 */
+    uint8_t stop;             /*!< 退出标志 */
+} msg_host_worker_t;
+
+/**
+ * @brief 事件循环
+ */
+struct msg_host_loop {
+    int epfd;                   /*!< epoll 描述符 */
+    msg_host_link_t *links;     /*!< 链路链表 */
+    uint32_t worker_num;        /*!< 工作线程数 */
+    msg_host_worker_t *workers; /*!< 工作线程 */
+
+    msg_recv_callback_t callback[MSG_ID_RESERVE_LEN]; /*!< 用户回调 */
+    msg_id_t polling; /*!< 正在轮询的 ID, 扩展 ID 不在帧头的高四位中 */
+};
+
+/* 协议层回调没有上下文参数, 一个进程只有一个事件循环 */
+static msg_host_loop_t *msg_host_instance;
+
+/**
+ * @brief 修改链路关注的事件, 调用前持有发送锁
+ *
+ * @param link 链路
+ * @param armed 是否等待可写事件
+ */
+static void msg_host_link_arm(msg_host_link_t *link, uint8_t armed) {
+    struct epoll_event ev;
+
+    if ((link->loop == NULL) || (link->tx_armed == armed)) {
+        return;
+    }
+
+    ev.events = EPOLLIN | (armed ? EPOLLOUT : 0);
+    ev.data.ptr = link;
+    epoll_ctl(link->loop->epfd, EPOLL_CTL_MOD, link->fd, &ev);
+    link->tx_armed = armed;
+}
+
+/**
+ * @brief 把发送缓冲区尽量写入内核, 写不完的等可写事件. 调用前持有发送锁
+ *
+ * @param link 链路
+ * @return 本次写出的字节数
+ */
+static uint32_t msg_host_link_flush(msg_host_link_t *link) {
+    uint32_t sent = 0, len;
+    ssize_t n;
+
+    while (sent < link->tx_len) {
+        len = link->tx_len - sent;
+        if ((link->mtu != 0) && (len > link->mtu)) {
+            /* 数据报按最大长度切分, 接收端按字节流解包, 切在帧中间也没关系 */
+            len = link->mtu;
+        }
+
+        n = write(link->fd, link->tx_buf + sent, len);
+        if (n > 0) {
+            sent += (uint32_t)n;
+        } else if ((n < 0) && (errno == EINTR)) {
+            continue;
+        } else if ((n < 0) && (errno != EAGAIN)) {
+            /* 链路已经断开, 丢掉剩余数据, 避免发送方一直阻塞 */
+            sent = link->tx_len;
+        } else {
+            break;
+        }
+    }
+
+    link->tx_len -= sent;
+    if ((sent != 0) && (link->tx_len != 0)) {
+        memmove(link->tx_buf, link->tx_buf + sent, link->tx_len);
+    }
+
+    msg_host_link_arm(link, link->tx_len != 0);
+    return sent;
+}
+
+/**
+ * @brief 等待链路可写
+ *
+ * @param link 链路
+ */
+static void msg_host_link_wait(msg_host_link_t *link) {
+    struct pollfd pfd = {.fd = link->fd, .events = POLLOUT};
+
+    while ((poll(&pfd, 1, -1) < 0) && (errno == EINTR)) {
+    }
+}
+
+/**
+ * @brief 创建链路
+ *
+ * @param fd 文件描述符
+ * @param buf_size 收发缓冲区大小 (必须是 2 的幂次方! )
+ * @return 链路, 失败返回`NULL`
+ */
+static msg_host_link_t *msg_host_link_alloc(int fd, uint32_t buf_size) {
+    msg_host_link_t *link;
+
+    if (is_pow_of_2(buf_size) == 0) {
+        return NULL;
+    }
+
+    link = calloc(1, sizeof(msg_host_link_t));
+    if (link == NULL) {
+        return NULL;
+    }
+
+    link->tx_buf = malloc(buf_size);
+    link->rx_buf = malloc(buf_size);
+    if ((link->tx_buf == NULL) || (link->rx_buf == NULL)) {
+        free(link->tx_buf);
+        free(link->rx_buf);
+        free(link);
+        return NULL;
+    }
+
+    link->fd = fd;
+    link->hold_fd = -1;
+    /* 协议层只判断是否为空, 指向自己即可 */
+    link->hdmatx = link;
+    link->tx_size = buf_size;
+    link->rx_mask = buf_size - 1;
+    pthread_mutex_init(&link->tx_lock, NULL);
+
+    return link;
+}
+
+/**
+ * @brief 波特率转换为 termios 速率
+ *
+ * @param baud 波特率
+ * @return termios 速率, 不支持返回`B0`
+ */
+static speed_t msg_host_baud(uint32_t baud) {
+    switch (baud) {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        case 1000000:
+            return B1000000;
+        case 2000000:
+            return B2000000;
+        case 3000000:
+            return B3000000;
+        case 4000000:
+            return B4000000;
+        default:
+            return B0;
+    }
+}
+
+/**
+ * @brief 打开串口设备
+ *
+ * @param path 设备路径, 例如`/dev/ttyUSB0`, 也可以是伪终端对端路径
+ * @param baud 波特率
+ * @param buf_size 收发缓冲区大小 (必须是 2 的幂次方! ), 建议 64 KiB
+ * @return 链路, 失败返回`NULL`
+ */
+msg_host_link_t *msg_host_link_open(const char *path, uint32_t baud,
+                                    uint32_t buf_size) {
+    struct termios tio;
+    msg_host_link_t *link;
+    speed_t speed = msg_host_baud(baud);
+    int fd;
+
+    if (speed == B0) {
+        return NULL;
+    }
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (tcgetattr(fd, &tio) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        close(fd);
+        return NULL;
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    link = msg_host_link_alloc(fd, buf_size);
+    if (link == NULL) {
+        close(fd);
+    }
+
+    return link;
+}
+
+/**
+ * @brief 创建伪终端链路
+ *
+ * @param[out] peer 对端路径, 另一端打开这个路径通信
+ * @param peer_len `peer`缓冲区大小
+ * @param buf_size 收发缓冲区大小 (必须是 2 的幂次方! )
+ * @return 链路, 失败返回`NULL`
+ */
+msg_host_link_t *msg_host_link_openpty(char *peer, size_t peer_len,
+                                       uint32_t buf_size) {
+    struct termios tio;
+    msg_host_link_t *link;
+    int fd, hold_fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if ((grantpt(fd) != 0) || (unlockpt(fd) != 0) ||
+        (ptsname_r(fd, peer, peer_len) != 0)) {
+        close(fd);
+        return NULL;
+    }
+
+    /* 自己保持从端打开, 对端还没打开或者关闭后主端不会一直挂断 */
+    hold_fd = open(peer, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if ((hold_fd < 0) || (tcgetattr(hold_fd, &tio) != 0)) {
+        if (hold_fd >= 0) {
+            close(hold_fd);
+        }
+        close(fd);
+        return NULL;
+    }
+
+    cfmakeraw(&tio);
+    tcsetattr(hold_fd, TCSANOW, &tio);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    link = msg_host_link_alloc(fd, buf_size);
+    if (link == NULL) {
+        close(hold_fd);
+        close(fd);
+        return NULL;
+    }
+
+    link->hold_fd = hold_fd;
+    return link;
+}
+
+/**
+ * @brief 把已经打开的描述符包装成链路
+ *
+ * @param fd 文件描述符, 设置为非阻塞, 关闭链路时一起关闭
+ * @param buf_size 收发缓冲区大小 (必须是 2 的幂次方! )
+ * @return 链路, 失败返回`NULL`
+ */
+msg_host_link_t *msg_host_link_attach(int fd, uint32_t buf_size) {
+    int flags = fcntl(fd, F_GETFL);
+
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+        return NULL;
+    }
+
+    return msg_host_link_alloc(fd, buf_size);
+}
+
+/**
+ * @brief 创建 UDP 链路
+ *
+ * @param local_port 本地端口
+ * @param remote_ip 对端 IPv4 地址, 例如开发板的`msg_eth_addr_t::ip`
+ * @param remote_port 对端端口
+ * @param buf_size 收发缓冲区大小 (必须是 2 的幂次方! )
+ * @return 链路, 失败返回`NULL`
+ */
+msg_host_link_t *msg_host_link_udp(uint16_t local_port, const char *remote_ip,
+                                   uint16_t remote_port, uint32_t buf_size) {
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    msg_host_link_t *link;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(local_port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    addr.sin_port = htons(remote_port);
+    if ((inet_pton(AF_INET, remote_ip, &addr.sin_addr) != 1) ||
+        (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+        close(fd);
+        return NULL;
+    }
+
+    link = msg_host_link_alloc(fd, buf_size);
+    if (link == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    link->mtu = MSG_HOST_UDP_MTU;
+    return link;
+}
+
+/**
+ * @brief 从事件循环中移除链路
+ *
+ * @param loop 事件循环
+ * @param link 链路
+ */
+static void msg_host_loop_remove(msg_host_loop_t *loop, msg_host_link_t *link) {
+    msg_host_link_t **node;
+
+    for (node = &loop->links; *node != NULL; node = &(*node)->next) {
+        if (*node == link) {
+            *node = link->next;
+            break;
+        }
+    }
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+
+    pthread_mutex_lock(&link->tx_lock);
+    link->loop = NULL;
+    link->tx_armed = 0;
+    link->next = NULL;
+    pthread_mutex_unlock(&link->tx_lock);
+}
+
+/**
+ * @brief 关闭链路
+ *
+ * @param link 链路
+ * @note 关闭前先停止使用该链路收发的消息 ID
+ */
+void msg_host_link_close(msg_host_link_t *link) {
+    if (link == NULL) {
+        return;
+    }
+
+    if (link->loop != NULL) {
+        msg_host_loop_remove(link->loop, link);
+    }
+
+    if (link->hold_fd >= 0) {
+        close(link->hold_fd);
+    }
+    close(link->fd);
+    pthread_mutex_destroy(&link->tx_lock);
+    free(link->tx_buf);
+    free(link->rx_buf);
+    free(link);
+}
+
+/**
+ * @brief 用 readv 把内核中的数据读入接收环形缓冲区
+ *
+ * @param link 链路
+ * @return 链路断开返回 0
+ * @note 事件循环自动调用. 不使用事件循环, 自己管理读取时 (例如网关)
+ *       在描述符可读后调用
+ */
+uint8_t msg_host_link_fill(msg_host_link_t *link) {
+    struct iovec iov[2];
+    uint32_t space, offset, first;
+    ssize_t n;
+
+    for (;;) {
+        space = link->rx_mask + 1 - (link->rx_tail - link->rx_head);
+        if ((space == 0) || (space < link->mtu)) {
+            /* 缓冲区满 (数据报放不下也算满, 否则会被截断), 剩下的等解包后
+             * 下一次事件再读 */
+            return 1;
+        }
+
+        offset = link->rx_tail & link->rx_mask;
+        first = link->rx_mask + 1 - offset;
+        if (first > space) {
+            first = space;
+        }
+
+        iov[0].iov_base = link->rx_buf + offset;
+        iov[0].iov_len = first;
+        iov[1].iov_base = link->rx_buf;
+        iov[1].iov_len = space - first;
+
+        n = readv(link->fd, iov, (space > first) ? 2 : 1);
+        if (n > 0) {
+            link->rx_tail += (uint32_t)n;
+            if ((link->mtu == 0) && ((uint32_t)n < space)) {
+                /* 字节流已经读空, 数据报一次只读一个, 要读到 EAGAIN */
+                return 1;
+            }
+        } else if ((n < 0) && (errno == EINTR)) {
+            continue;
+        } else if ((n < 0) && ((errno == EAGAIN) || (errno == ECONNREFUSED))) {
+            /* 对端端口还没打开时 UDP 会报告拒绝连接, 不算断开 */
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief 把数据直接放入接收缓冲区, 回放录制的字节流时使用
+ *
+ * @param link 链路, 不能同时在事件循环中读取
+ * @param data 数据
+ * @param len 数据长度
+ * @return 放入的字节数, 缓冲区满时少于`len`
+ */
+uint32_t msg_host_link_inject(msg_host_link_t *link, const void *data,
+                              uint32_t len) {
+    uint32_t space = link->rx_mask + 1 - (link->rx_tail - link->rx_head);
+    uint32_t offset = link->rx_tail & link->rx_mask;
+    uint32_t first;
+
+    if (len > space) {
+        len = space;
+    }
+
+    first = link->rx_mask + 1 - offset;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(link->rx_buf + offset, data, first);
+    memcpy(link->rx_buf, (const uint8_t *)data + first, len - first);
+    link->rx_tail += len;
+
+    return len;
+}
+
+/**
+ * @brief 所有链路接收缓冲区中未解包的字节数
+ *
+ * @param loop 事件循环
+ * @return 字节数
+ */
+static uint32_t msg_host_loop_pending(msg_host_loop_t *loop) {
+    msg_host_link_t *link;
+    uint32_t pending = 0;
+
+    for (link = loop->links; link != NULL; link = link->next) {
+        pending += link->rx_tail - link->rx_head;
+    }
+
+    return pending;
+}
+
+/*****************************************************************************
+ * 串口接口
+ *****************************************************************************/
+
+/**
+ * @brief 读取接收缓冲区
+ *
+ * @param huart 链路
+ * @param buf 数据缓冲区
+ * @param len 缓冲区大小
+ * @return 读出的字节数
+ */
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    uint32_t avail = huart->rx_tail - huart->rx_head;
+    uint32_t offset = huart->rx_head & huart->rx_mask;
+    uint32_t first;
+
+    if (len > avail) {
+        len = avail;
+    }
+
+    first = huart->rx_mask + 1 - offset;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(buf, huart->rx_buf + offset, first);
+    memcpy((uint8_t *)buf + first, huart->rx_buf, len - first);
+    huart->rx_head += len;
+
+    return len;
+}
+
+/**
+ * @brief 写入发送缓冲区
+ *
+ * @param huart 链路
+ * @param data 数据
+ * @param len 数据长度
+ * @return 写入的字节数
+ * @note 空间不够时阻塞等待内核写出, 保证一次写入的数据不会被其他线程打断
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    const uint8_t *src = data;
+    size_t remain = len;
+    ssize_t n;
+
+    pthread_mutex_lock(&huart->tx_lock);
+
+    while ((huart->tx_len != 0) && (huart->tx_size - huart->tx_len < len)) {
+        msg_host_link_flush(huart);
+        if ((huart->tx_len == 0) || (huart->tx_size - huart->tx_len >= len)) {
+            break;
+        }
+
+        pthread_mutex_unlock(&huart->tx_lock);
+        msg_host_link_wait(huart);
+        pthread_mutex_lock(&huart->tx_lock);
+    }
+
+    if (len <= huart->tx_size - huart->tx_len) {
+        memcpy(huart->tx_buf + huart->tx_len, data, len);
+        huart->tx_len += len;
+        pthread_mutex_unlock(&huart->tx_lock);
+        return len;
+    }
+
+    /* 比整个发送缓冲区还大, 持有锁直接写出 */
+    while (remain != 0) {
+        n = write(huart->fd, src, remain);
+        if (n > 0) {
+            src += n;
+            remain -= (size_t)n;
+        } else if ((n < 0) && (errno == EAGAIN)) {
+            msg_host_link_wait(huart);
+        } else if ((n < 0) && (errno != EINTR)) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&huart->tx_lock);
+    return len - remain;
+}
+
+/**
+ * @brief 启动发送
+ *
+ * @param huart 链路
+ * @return 本次写出的字节数
+ */
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    uint32_t sent;
+
+    pthread_mutex_lock(&huart->tx_lock);
+    sent = msg_host_link_flush(huart);
+    pthread_mutex_unlock(&huart->tx_lock);
+
+    return sent;
+}
+
+/**
+ * @brief 获取发送缓冲区大小
+ *
+ * @param huart 链路
+ * @return 发送缓冲区大小
+ */
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    return huart->tx_size;
+}
+
+/**
+ * @brief 阻塞发送
+ *
+ * @param huart 链路
+ * @param pData 数据
+ * @param Size 数据长度
+ * @param Timeout 超时时间 (主机端忽略)
+ * @return 发送状态
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)Timeout;
+
+    if (uart_dmatx_write(huart, pData, Size) != Size) {
+        return HAL_ERROR;
+    }
+
+    uart_dmatx_send(huart);
+    return HAL_OK;
+}
+
+/**
+ * @brief DMA 发送
+ *
+ * @param huart 链路
+ * @param pData 数据
+ * @param Size 数据长度
+ * @return 发送状态
+ * @note 数据拷贝进发送缓冲区就算发送完成. 协议层在返回`HAL_OK`后才标记端口
+ *       忙, 不能在这里直接回调, 由事件循环下一次运行时调用
+ *       `message_uart_tx_callback`. 链路必须已经加入事件循环
+ */
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart,
+                                        const uint8_t *pData, uint16_t Size) {
+    if (uart_dmatx_write(huart, pData, Size) != Size) {
+        return HAL_ERROR;
+    }
+
+    pthread_mutex_lock(&huart->tx_lock);
+    msg_host_link_flush(huart);
+    huart->tx_done = 1;
+    /* 链路可写, 等待可写事件让阻塞中的事件循环立即返回 */
+    msg_host_link_arm(huart, 1);
+    pthread_mutex_unlock(&huart->tx_lock);
+
+    return HAL_OK;
+}
+
+/*****************************************************************************
+ * 回调线程池
+ *****************************************************************************/
+
+/**
+ * @brief 工作线程
+ *
+ * @param arg 工作线程
+ * @return `NULL`
+ */
+static void *msg_host_worker_entry(void *arg) {
+    msg_host_worker_t *worker = arg;
+    msg_host_job_t *job;
+
+    for (;;) {
+        pthread_mutex_lock(&worker->lock);
+        while ((worker->head == worker->tail) && (worker->stop == 0)) {
+            pthread_cond_wait(&worker->not_empty, &worker->lock);
+        }
+
+        if (worker->head == worker->tail) {
+            /* 已经要求退出并且队列已经处理完 */
+            pthread_mutex_unlock(&worker->lock);
+            break;
+        }
+
+        job = worker->jobs[worker->head & worker->mask];
+        ++worker->head;
+        pthread_cond_signal(&worker->not_full);
+        pthread_mutex_unlock(&worker->lock);
+
+        job->callback(job->len, job->id_type, job->data);
+        free(job);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 协议层回调, 转交给用户回调
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ * @note 同一个 ID 固定交给同一个工作线程, 保证回调顺序和接收顺序一致.
+ *       队列满时阻塞事件循环, 反压到链路
+ */
+static void msg_host_dispatch(uint32_t msg_length, uint8_t msg_id_type,
+                              uint8_t *msg_data) {
+    msg_host_loop_t *loop = msg_host_instance;
+    msg_id_t msg_id;
+    msg_recv_callback_t callback;
+    msg_host_worker_t *worker;
+    msg_host_job_t *job;
+
+    if (loop == NULL) {
+        return;
+    }
+
+    msg_id = loop->polling;
+    callback = loop->callback[msg_id];
+    if (callback == NULL) {
+        return;
+    }
+
+    if (loop->worker_num == 0) {
+        callback(msg_length, msg_id_type, msg_data);
+        return;
+    }
+
+    /* 接收数据在回调返回后会被覆盖, 复制一份 */
+    job = malloc(sizeof(msg_host_job_t) + msg_length);
+    if (job == NULL) {
+        return;
+    }
+
+    job->callback = callback;
+    job->len = msg_length;
+    job->id_type = msg_id_type;
+    memcpy(job->data, msg_data, msg_length);
+
+    worker = &loop->workers[msg_id % loop->worker_num];
+    pthread_mutex_lock(&worker->lock);
+    while (worker->tail - worker->head > worker->mask) {
+        pthread_cond_wait(&worker->not_full, &worker->lock);
+    }
+    worker->jobs[worker->tail & worker->mask] = job;
+    ++worker->tail;
+    pthread_cond_signal(&worker->not_empty);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/*****************************************************************************
+ * 事件循环
+ *****************************************************************************/
+
+/**
+ * @brief 创建事件循环
+ *
+ * @param workers 回调线程数, 0 表示在事件循环线程中直接回调
+ * @param queue_depth 每个线程的任务队列深度 (必须是 2 的幂次方! )
+ * @return 事件循环, 失败或者已经创建过返回`NULL`
+ */
+msg_host_loop_t *msg_host_loop_create(uint32_t workers, uint32_t queue_depth) {
+    msg_host_loop_t *loop;
+    msg_host_worker_t *worker;
+    uint32_t i;
+
+    if ((msg_host_instance != NULL) ||
+        ((workers != 0) && (is_pow_of_2(queue_depth) == 0))) {
+        return NULL;
+    }
+
+    loop = calloc(1, sizeof(msg_host_loop_t));
+    if (loop == NULL) {
+        return NULL;
+    }
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0) {
+        free(loop);
+        return NULL;
+    }
+
+    if (workers != 0) {
+        loop->workers = calloc(workers, sizeof(msg_host_worker_t));
+        if (loop->workers == NULL) {
+            msg_host_loop_destroy(loop);
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < workers; ++i) {
+        worker = &loop->workers[i];
+        worker->jobs = calloc(queue_depth, sizeof(msg_host_job_t *));
+        if (worker->jobs == NULL) {
+            msg_host_loop_destroy(loop);
+            return NULL;
+        }
+
+        worker->mask = queue_depth - 1;
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->not_empty, NULL);
+        pthread_cond_init(&worker->not_full, NULL);
+        if (pthread_create(&worker->thread, NULL, msg_host_worker_entry,
+                           worker) != 0) {
+            free(worker->jobs);
+            worker->jobs = NULL;
+            msg_host_loop_destroy(loop);
+            return NULL;
+        }
+
+        /* 只记录已经启动的线程, 失败时只回收这些 */
+        loop->worker_num = i + 1;
+    }
+
+    msg_host_instance = loop;
+    return loop;
+}
+
+/**
+ * @brief 把链路加入事件循环
+ *
+ * @param loop 事件循环
+ * @param link 链路
+ * @return 加入状态
+ * @retval - 0: 成功
+ * @retval - 1: 失败
+ */
+uint8_t msg_host_loop_add(msg_host_loop_t *loop, msg_host_link_t *link) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = link};
+
+    if ((loop == NULL) || (link == NULL) || (link->loop != NULL)) {
+        return 1;
+    }
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, link->fd, &ev) != 0) {
+        return 1;
+    }
+
+    link->next = loop->links;
+    loop->links = link;
+
+    pthread_mutex_lock(&link->tx_lock);
+    link->loop = loop;
+    link->tx_armed = 0;
+    msg_host_link_arm(link, (link->tx_len != 0) || link->tx_done);
+    pthread_mutex_unlock(&link->tx_lock);
+
+    return 0;
+}
+
+/**
+ * @brief 注册接收回调
+ *
+ * @param loop 事件循环
+ * @param msg_id 数据含义
+ * @param callback 回调函数, 在工作线程中执行, `NULL`取消注册
+ */
+void msg_host_register_callback(msg_host_loop_t *loop, msg_id_t msg_id,
+                                msg_recv_callback_t callback) {
+    if ((loop == NULL) || (msg_id >= MSG_ID_RESERVE_LEN)) {
+        return;
+    }
+
+    loop->callback[msg_id] = callback;
+    message_register_recv_callback(msg_id,
+                                   callback ? msg_host_dispatch : NULL);
+}
+
+/**
+ * @brief 轮询所有 ID, 记下正在轮询的 ID 供回调使用
+ *
+ * @param loop 事件循环
+ */
+static void msg_host_loop_poll(msg_host_loop_t *loop) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        loop->polling = i;
+        message_polling_id(i);
+    }
+}
+
+/**
+ * @brief 运行一次事件循环
+ *
+ * @param loop 事件循环
+ * @param timeout_ms 没有事件时的最长等待时间, 单位 ms, -1 一直等待
+ * @return 处理的事件数, 出错返回 -1
+ * @note 没有事件也会轮询一次协议层, 处理重传等定时任务
+ */
+int msg_host_loop_run(msg_host_loop_t *loop, int timeout_ms) {
+    struct epoll_event events[MSG_HOST_MAX_EVENTS];
+    msg_host_link_t *link;
+    uint32_t pending, last;
+    int i, n;
+
+    n = epoll_wait(loop->epfd, events, MSG_HOST_MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        n = 0;
+    }
+
+    for (i = 0; i < n; ++i) {
+        link = events[i].data.ptr;
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            if (msg_host_link_fill(link) == 0) {
+                /* 链路断开, 不再关注, 已经读到的数据照常解包 */
+                epoll_ctl(loop->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+            }
+        }
+
+        if (events[i].events & EPOLLOUT) {
+            uart_dmatx_send(link);
+        }
+    }
+
+#if MSG_ENABLE_MULTICAST
+    /* 报告 DMA 发送完成, 回调中可能接着发送下一个组播缓冲区. 协议层在临界区
+     * 中启动发送并标记端口忙, 和中断一样要等临界区结束后才能回调 */
+    for (link = loop->links; link != NULL; link = link->next) {
+        msg_host_critical_enter();
+        if (__atomic_exchange_n(&link->tx_done, 0, __ATOMIC_ACQ_REL)) {
+            message_uart_tx_callback(link);
+        }
+        msg_host_critical_exit();
+    }
+#endif /* MSG_ENABLE_MULTICAST */
+
+    /* 批量解包: 每次轮询每个 ID 最多读出一个协议层接收缓冲区, 重复到所有
+     * 链路读空. 没有 ID 轮询的链路读不空, 不再减少时停止 */
+    pending = msg_host_loop_pending(loop);
+    do {
+        msg_host_loop_poll(loop);
+        last = pending;
+        pending = msg_host_loop_pending(loop);
+    } while ((pending != 0) && (pending < last));
+
+    /* 最后读出的帧在下一次轮询时才出队分发 */
+    msg_host_loop_poll(loop);
+
+    return n;
+}
+
+/**
+ * @brief 销毁事件循环, 等待工作线程处理完剩余回调
+ *
+ * @param loop 事件循环
+ * @note 链路不会关闭, 需要另外调用`msg_host_link_close`
+ */
+void msg_host_loop_destroy(msg_host_loop_t *loop) {
+    msg_host_worker_t *worker;
+    uint32_t i;
+
+    if (loop == NULL) {
+        return;
+    }
+
+    for (i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        if (loop->callback[i] != NULL) {
+            message_register_recv_callback((msg_id_t)i, NULL);
+        }
+    }
+
+    while (loop->links != NULL) {
+        msg_host_loop_remove(loop, loop->links);
+    }
+
+    for (i = 0; i < loop->worker_num; ++i) {
+        worker = &loop->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stop = 1;
+        pthread_cond_signal(&worker->not_empty);
+        pthread_mutex_unlock(&worker->lock);
+        pthread_join(worker->thread, NULL);
+
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->not_empty);
+        pthread_cond_destroy(&worker->not_full);
+        free(worker->jobs);
+    }
+
+    free(loop->workers);
+    close(loop->epfd);
+
+    if (msg_host_instance == loop) {
+        msg_host_instance = NULL;
+    }
+    free(loop);
+}
+
+#if MSG_ENABLE_RECORD
+
+/*****************************************************************************
+ * 录制
+ *****************************************************************************/
+
+static FILE *msg_host_record_file;
+static pthread_mutex_t msg_host_record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief 录制钩子, 写入日志文件
+ *
+ * @param msg_id 数据含义
+ * @param stamp_us 读出时刻, 单位 us
+ * @param[in] data 原始字节
+ * @param len 字节数
+ */
+static void msg_host_record_hook(msg_id_t msg_id, uint32_t stamp_us,
+                                 const uint8_t *data, uint32_t len) {
+    uint8_t head[MSG_RECORD_HEAD_SIZE] = {
+        (uint8_t)stamp_us,         (uint8_t)(stamp_us >> 8),
+        (uint8_t)(stamp_us >> 16), (uint8_t)(stamp_us >> 24),
+        (uint8_t)len,              (uint8_t)(len >> 8),
+        (uint8_t)msg_id};
+
+    /* 网关的多个流水线会同时调用 */
+    pthread_mutex_lock(&msg_host_record_lock);
+    if (msg_host_record_file != NULL) {
+        fwrite(head, 1, sizeof(head), msg_host_record_file);
+        fwrite(data, 1, len, msg_host_record_file);
+    }
+    pthread_mutex_unlock(&msg_host_record_lock);
+}
+
+/**
+ * @brief 开始录制到日志文件
+ *
+ * @param path 文件路径, 已存在时覆盖
+ * @return 打开状态
+ * @retval - 0: 成功
+ * @retval - 1: 打开失败
+ */
+uint8_t msg_host_record_open(const char *path) {
+    static const uint8_t header[] = {'M', 'S', 'G', 'R', MSG_RECORD_VERSION};
+    FILE *file = fopen(path, "wb");
+    FILE *old;
+
+    if (file == NULL) {
+        return 1;
+    }
+
+    fwrite(header, 1, sizeof(header), file);
+
+    pthread_mutex_lock(&msg_host_record_lock);
+    old = msg_host_record_file;
+    msg_host_record_file = file;
+    pthread_mutex_unlock(&msg_host_record_lock);
+
+    if (old != NULL) {
+        fclose(old);
+    }
+
+    message_register_record_hook(msg_host_record_hook);
+    return 0;
+}
+
+/**
+ * @brief 停止录制并关闭日志文件
+ *
+ */
+void msg_host_record_close(void) {
+    message_register_record_hook(NULL);
+
+    pthread_mutex_lock(&msg_host_record_lock);
+    if (msg_host_record_file != NULL) {
+        fclose(msg_host_record_file);
+        msg_host_record_file = NULL;
+    }
+    pthread_mutex_unlock(&msg_host_record_lock);
+}
+
+#endif /* MSG_ENABLE_RECORD */
@@ -0,0 +1,81 @@
+/**
+ * @file    msg_host.h
+ * @author  Deadline039
+ * @brief   消息协议的 Linux 主机端库
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ *                             ##### 如何使用 ####
+ * (#) 编译时把`host`目录放在包含路径最前面, 与`msg_protocol.c`一起编译,
+ *     两端的`msg_protocol.h`配置必须一致 (不支持`MSG_ENABLE_DEFERRED`)
+ *
+ * (#) 链路
+ *      (##) `msg_host_link_open`打开串口设备, 设置为原始模式和指定波特率
+ *      (##) `msg_host_link_openpty`创建伪终端, 返回对端路径, 对端可以用
+ *           `msg_host_link_open`或者其他程序打开, 不需要硬件即可测试
+ *      (##) `msg_host_link_udp`创建 UDP 链路, 与开发板的以太网链路通信,
+ *           发送数据按数据报最大长度切分, 接收时把数据报拼成字节流解包
+ *      (##) `msg_host_link_attach`把已经打开的描述符 (管道, 文件, 套接字)
+ *           包装成链路, 例如把录制的字节流回放给解包
+ *      (##) 链路就是协议层的串口句柄, 直接传给`message_register_send_uart`
+ *           和`message_register_polling_uart`
+ *
+ * (#) 事件循环
+ *      (##) `msg_host_loop_create`创建事件循环和回调线程池, 每个进程只能有
+ *           一个事件循环
+ *      (##) `msg_host_loop_add`把链路加入事件循环
+ *      (##) `msg_host_register_callback`注册接收回调. 同一个 ID 的回调固定
+ *           在同一个线程中按接收顺序执行, 线程数为 0 时在事件循环线程中执行
+ *      (##) 持续调用`msg_host_loop_run`. 每次把所有可读链路读入接收缓冲区,
+ *           然后批量解包并分发回调, 最后写出未发送完的数据
+ *
+ * (#) 启用`MSG_ENABLE_RECORD`时, `msg_host_record_open`把所有链路读出的原始
+ *     字节写入日志文件, 用`tools/msg_replay.c`回放
+ *
+ * (#) 发送可以在任意线程中调用`message_send_data`, 发送缓冲区满时阻塞等待
+ *     内核写出, 不会把半帧写到链路上
+ *
+ *****************************************************************************
+ */
+
+#ifndef __MSG_HOST_H
+#define __MSG_HOST_H
+
+#include "msg_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct msg_host_loop msg_host_loop_t;
+
+msg_host_link_t *msg_host_link_open(const char *path, uint32_t baud,
+                                    uint32_t buf_size);
+msg_host_link_t *msg_host_link_openpty(char *peer, size_t peer_len,
+                                       uint32_t buf_size);
+msg_host_link_t *msg_host_link_attach(int fd, uint32_t buf_size);
+msg_host_link_t *msg_host_link_udp(uint16_t local_port, const char *remote_ip,
+                                   uint16_t remote_port, uint32_t buf_size);
+void msg_host_link_close(msg_host_link_t *link);
+uint8_t msg_host_link_fill(msg_host_link_t *link);
+uint32_t msg_host_link_inject(msg_host_link_t *link, const void *data,
+                              uint32_t len);
+
+msg_host_loop_t *msg_host_loop_create(uint32_t workers, uint32_t queue_depth);
+uint8_t msg_host_loop_add(msg_host_loop_t *loop, msg_host_link_t *link);
+void msg_host_register_callback(msg_host_loop_t *loop, msg_id_t msg_id,
+                                msg_recv_callback_t callback);
+int msg_host_loop_run(msg_host_loop_t *loop, int timeout_ms);
+void msg_host_loop_destroy(msg_host_loop_t *loop);
+
+#if MSG_ENABLE_RECORD
+uint8_t msg_host_record_open(const char *path);
+void msg_host_record_close(void);
+#endif /* MSG_ENABLE_RECORD */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MSG_HOST_H */
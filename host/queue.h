@@ -0,0 +1,14 @@
+/**
+ * @file    queue.h
+ * @author  Deadline039
+ * @brief   Linux 主机端不支持延迟分发, 回调改由`msg_host`的线程池分发
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#error "MSG_ENABLE_DEFERRED is not supported on the Linux host, use the msg_host worker pool"
+
+#endif /* QUEUE_H */
@@ -0,0 +1,32 @@
+/**
+ * @file    semphr.h
+ * @author  Deadline039
+ * @brief   Linux 主机端的互斥信号量替代, 使用 pthread 互斥锁
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct msg_host_mutex *SemaphoreHandle_t;
+
+SemaphoreHandle_t msg_host_mutex_create(void);
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex);
+
+#define xSemaphoreCreateMutex()     msg_host_mutex_create()
+#define xSemaphoreTake(mutex, wait) msg_host_mutex_take(mutex, wait)
+#define xSemaphoreGive(mutex)       msg_host_mutex_give(mutex)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* SEMAPHORE_H */
@@ -0,0 +1,37 @@
+/**
+ * @file    task.h
+ * @author  Deadline039
+ * @brief   Linux 主机端的临界区替代, 使用全局递归锁
+ * @version 1.0
+ * @date    2026-10-18
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void msg_host_critical_enter(void);
+void msg_host_critical_exit(void);
+
+#define taskENTER_CRITICAL() msg_host_critical_enter()
+#define taskEXIT_CRITICAL()  msg_host_critical_exit()
+
+/* 主机上没有中断, 中断中的临界区同样用全局递归锁, 掩码没有意义 */
+#define taskENTER_CRITICAL_FROM_ISR()                                          \
+    (msg_host_critical_enter(), (UBaseType_t)0)
+#define taskEXIT_CRITICAL_FROM_ISR(mask)                                       \
+    do {                                                                       \
+        (void)(mask);                                                          \
+        msg_host_critical_exit();                                              \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,421 @@
+/**
+ * @file    bond_bench.c
+ * @author  Deadline039
+ * @brief   多链路聚合基准测试: 在模拟的不同速率串口上聚合发送, 统计吞吐量
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   bond_bench [frames] [ber] [baud]...
+ *     frames 发送的帧数, 默认 20000
+ *     ber    每个字节出错的概率, 默认 0
+ *     baud   每条链路的波特率, 最多 3 条, 默认 115200 460800 921600
+ * MSG_ID_1 是聚合的逻辑 ID, MSG_ID_2 开始依次是各条链路. 每条链路自发
+ * 自收, 按波特率每毫秒把发送缓冲区中的字节搬到接收缓冲区, 时间是模拟的,
+ * 与主机速度无关. 发送端在某条链路积压不到 2 ms 的数据时继续发送,
+ * 最后比较有效吞吐量与所有链路速率之和, 并检查是否按顺序收到
+ * 编译 (需要在 msg_protocol.h 中启用`MSG_ENABLE_BOND`, `MSG_ENABLE_SEQUENCE`
+ * 和`MSG_ENABLE_STATISTICS`, 串口由本文件模拟, 不链接 msg_host.c):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/bond_bench.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c
+ *****************************************************************************
+ */
+
+#include "msg_protocol.h"
+
+#if MSG_ENABLE_RTOS
+#include "semphr.h"
+#endif /* MSG_ENABLE_RTOS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !MSG_ENABLE_BOND || !MSG_ENABLE_STATISTICS
+#error "bond_bench requires MSG_ENABLE_BOND and MSG_ENABLE_STATISTICS"
+#endif /* !MSG_ENABLE_BOND || !MSG_ENABLE_STATISTICS */
+
+/* 每帧数据长度, 前 4 byte 是帧计数 */
+#define BENCH_LEN       64U
+/* 一帧编码后的最大长度 */
+#define BENCH_WIRE      MSG_FRAME_WIRE_SIZE(BENCH_LEN)
+/* 重排窗口大小 */
+#define BENCH_WINDOW    64U
+/* 某条链路积压不到这么多毫秒的数据时继续发送 */
+#define BENCH_AHEAD     2U
+/* 模拟串口的收发缓冲区大小 */
+#define BENCH_BUF_SIZE  (1U << 16)
+/* 每个链路 ID 的接收缓冲区和队列大小 */
+#define BENCH_RECV_SIZE 1024U
+#define BENCH_FIFO_SIZE 4096U
+/* 最多的链路数, 受消息 ID 个数限制 */
+#define BENCH_LINKS                                                            \
+    ((MSG_ID_RESERVE_LEN - 1U < MSG_BOND_MAX_LINKS) ? MSG_ID_RESERVE_LEN - 1U \
+                                                    : MSG_BOND_MAX_LINKS)
+
+/**
+ * @brief 模拟的串口链路
+ */
+typedef struct {
+    msg_host_link_t uart; /*!< 串口句柄, 发送缓冲区按速率搬到接收缓冲区 */
+    uint32_t baud;        /*!< 波特率 */
+    double rate;          /*!< 每毫秒发出的字节数 */
+    double credit;        /*!< 本毫秒还能发出的字节数 */
+} bench_link_t;
+
+static bench_link_t bench_links[BENCH_LINKS];
+static uint32_t bench_link_num;
+static uint32_t bench_tick;
+static double bench_ber;
+
+static uint32_t bench_next;     /* 期望收到的下一个帧计数 */
+static uint32_t bench_received; /* 收到的帧数 */
+static uint32_t bench_skipped;  /* 帧计数跳过的帧数 */
+static uint32_t bench_reorder;  /* 帧计数回退的次数 */
+static uint32_t bench_corrupt;  /* 数据内容错误的帧数 */
+static uint32_t bench_last;     /* 收到最后一帧的时刻 */
+
+/**
+ * @brief 模拟的毫秒时基
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return bench_tick;
+}
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 模拟 DWT 周期计数器, 跟随模拟时基, 计数单位是 us
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static msg_host_dwt_t dwt;
+    dwt.CYCCNT = bench_tick * 1000U;
+    return &dwt;
+}
+
+/**
+ * @brief 单线程运行, 临界区不需要锁
+ */
+void msg_host_critical_enter(void) {
+}
+
+void msg_host_critical_exit(void) {
+}
+
+#if MSG_ENABLE_RTOS
+/**
+ * @brief 单线程运行, 互斥量不需要锁
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    static uint8_t dummy;
+    return (SemaphoreHandle_t)&dummy;
+}
+
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    (void)mutex;
+    (void)wait;
+    return pdTRUE;
+}
+
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    (void)mutex;
+    return pdTRUE;
+}
+#endif /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 写入发送缓冲区
+ *
+ * @param huart 串口句柄
+ * @param data 数据
+ * @param len 数据长度
+ * @return 写入的字节数, 缓冲区满时截断
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    uint32_t space = huart->tx_size - huart->tx_len;
+
+    if (len > space) {
+        len = space;
+    }
+
+    memcpy(huart->tx_buf + huart->tx_len, data, len);
+    huart->tx_len += (uint32_t)len;
+    return (uint32_t)len;
+}
+
+/**
+ * @brief 开始发送, 模拟的串口一直在按速率发送, 这里什么也不做
+ *
+ * @param huart 串口句柄
+ * @return 待发送的字节数
+ */
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    return huart->tx_len;
+}
+
+/**
+ * @brief 发送缓冲区大小
+ *
+ * @param huart 串口句柄
+ * @return 字节数
+ */
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    return huart->tx_size;
+}
+
+/**
+ * @brief 阻塞发送, 同样写入发送缓冲区
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)Timeout;
+    return (uart_dmatx_write(huart, pData, Size) == Size) ? HAL_OK : HAL_BUSY;
+}
+
+/**
+ * @brief 读出接收缓冲区
+ *
+ * @param huart 串口句柄
+ * @param buf 读出的位置
+ * @param len 最多读出的字节数
+ * @return 读出的字节数
+ */
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    uint32_t n = 0;
+
+    while ((n < len) && (huart->rx_head != huart->rx_tail)) {
+        ((uint8_t *)buf)[n++] = huart->rx_buf[huart->rx_head & huart->rx_mask];
+        ++huart->rx_head;
+    }
+
+    return n;
+}
+
+/**
+ * @brief 初始化一条模拟链路
+ *
+ * @param link 链路
+ * @param baud 波特率
+ * @return 是否成功
+ */
+static bool bench_link_init(bench_link_t *link, uint32_t baud) {
+    memset(link, 0, sizeof(bench_link_t));
+    link->uart.hdmatx = &link->uart;
+    link->uart.tx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.tx_size = BENCH_BUF_SIZE;
+    link->uart.rx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.rx_mask = BENCH_BUF_SIZE - 1U;
+    link->baud = baud;
+    /* 1 位起始位, 8 位数据, 1 位停止位 */
+    link->rate = (double)baud / 10.0 / 1000.0;
+
+    return (link->uart.tx_buf != NULL) && (link->uart.rx_buf != NULL);
+}
+
+/**
+ * @brief 模拟 1 ms: 每条链路按速率把发送缓冲区中的字节搬到接收缓冲区
+ */
+static void bench_step(void) {
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        msg_host_link_t *uart = &bench_links[i].uart;
+        uint32_t n;
+
+        bench_links[i].credit += bench_links[i].rate;
+        n = (uint32_t)bench_links[i].credit;
+        if (n > uart->tx_len) {
+            n = uart->tx_len;
+        }
+
+        for (uint32_t j = 0; j < n; ++j) {
+            uint8_t byte = uart->tx_buf[j];
+            if ((bench_ber > 0) && ((double)rand() / RAND_MAX < bench_ber)) {
+                byte ^= (uint8_t)(1U << (rand() & 7));
+            }
+            uart->rx_buf[uart->rx_tail & uart->rx_mask] = byte;
+            ++uart->rx_tail;
+        }
+
+        uart->tx_len -= n;
+        memmove(uart->tx_buf, uart->tx_buf + n, uart->tx_len);
+
+        /* 空闲时不积累发送能力 */
+        bench_links[i].credit =
+            (uart->tx_len != 0) ? bench_links[i].credit - n : 0;
+    }
+}
+
+/**
+ * @brief 是否有链路积压不到`BENCH_AHEAD`毫秒的数据
+ *
+ * @return 是否继续发送
+ */
+static bool bench_can_send(void) {
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        if ((double)bench_links[i].uart.tx_len <
+            bench_links[i].rate * BENCH_AHEAD) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 是否所有链路都发完了
+ *
+ * @return 是否空闲
+ */
+static bool bench_idle(void) {
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        if (bench_links[i].uart.tx_len != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief 聚合 ID 的接收回调, 检查帧计数是否连续和数据内容
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void bench_callback(uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data) {
+    uint32_t count;
+
+    (void)msg_id_type;
+
+    if (msg_length != BENCH_LEN) {
+        ++bench_corrupt;
+        return;
+    }
+
+    memcpy(&count, msg_data, sizeof(count));
+    for (uint32_t i = sizeof(count); i < BENCH_LEN; ++i) {
+        if (msg_data[i] != (uint8_t)(count + i)) {
+            ++bench_corrupt;
+            return;
+        }
+    }
+
+    if (count < bench_next) {
+        ++bench_reorder;
+    } else {
+        bench_skipped += count - bench_next;
+        bench_next = count + 1;
+    }
+
+    ++bench_received;
+    bench_last = bench_tick;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 20000U;
+    uint32_t bauds[BENCH_LINKS] = {115200U, 460800U, 921600U};
+    msg_bond_link_t links[BENCH_LINKS];
+    uint8_t data[BENCH_LEN];
+    uint32_t sent = 0, idle_since = 0;
+    double total_rate = 0;
+
+    bench_ber = (argc > 2) ? strtod(argv[2], NULL) : 0;
+    bench_link_num = (BENCH_LINKS < 3U) ? BENCH_LINKS : 3U;
+    if (argc > 3) {
+        bench_link_num = 0;
+        for (int i = 3; (i < argc) && (bench_link_num < BENCH_LINKS); ++i) {
+            bauds[bench_link_num++] = (uint32_t)strtoul(argv[i], NULL, 0);
+        }
+    }
+
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        msg_id_t msg_id = (msg_id_t)(MSG_ID_1 + 1 + i);
+
+        if (!bench_link_init(&bench_links[i], bauds[i])) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        message_register_send_uart(msg_id, &bench_links[i].uart, BENCH_WIRE);
+        message_register_polling_uart(msg_id, &bench_links[i].uart,
+                                      BENCH_RECV_SIZE, BENCH_FIFO_SIZE);
+        links[i].msg_id = msg_id;
+        links[i].weight = bauds[i];
+        total_rate += bench_links[i].rate;
+    }
+
+    if (message_register_bond(MSG_ID_1, links, bench_link_num, BENCH_WINDOW,
+                              BENCH_LEN) != 0) {
+        fprintf(stderr, "message_register_bond failed\n");
+        return 1;
+    }
+    message_register_recv_callback(MSG_ID_1, bench_callback);
+
+    /* 发完后再等重排超时, 让最后的缺帧也被跳过 */
+    while ((sent < frames) || !bench_idle() ||
+           (bench_tick - idle_since < MSG_BOND_TIMEOUT + 2U)) {
+        while ((sent < frames) && bench_can_send()) {
+            memcpy(data, &sent, sizeof(sent));
+            for (uint32_t i = sizeof(sent); i < BENCH_LEN; ++i) {
+                data[i] = (uint8_t)(sent + i);
+            }
+            if (message_send_data(MSG_ID_1, MSG_DATA_UINT8, data, BENCH_LEN) !=
+                0) {
+                break;
+            }
+            ++sent;
+        }
+
+        message_polling_data();
+        bench_step();
+        ++bench_tick;
+
+        if ((sent < frames) || !bench_idle()) {
+            idle_since = bench_tick;
+        }
+    }
+
+    msg_stats_t stats;
+    message_get_stats(MSG_ID_1, &stats);
+
+    printf("links:");
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        printf(" %u", bauds[i]);
+    }
+    printf(" baud, sum %.1f KB/s\n", total_rate);
+
+    for (uint32_t i = 0; i < bench_link_num; ++i) {
+        printf("  link %u: %u frames (%.1f%%)\n", i, stats.bond_frames[i],
+               100.0 * stats.bond_frames[i] / (sent ? sent : 1));
+    }
+
+    double seconds = (bench_last ? bench_last : 1) / 1000.0;
+    printf("sent %u, received %u in %u ms, skipped %u, reordered %u, "
+           "corrupt %u\n",
+           sent, bench_received, bench_last, bench_skipped, bench_reorder,
+           bench_corrupt);
+    printf("payload %.1f KB/s, wire %.1f KB/s (%.1f%% of links)\n",
+           bench_received * (double)BENCH_LEN / 1000.0 / seconds,
+           stats.send_bytes / 1000.0 / seconds,
+           100.0 * stats.send_bytes / 1000.0 / seconds / total_rate);
+    printf("buffered out of order %u, lost %u, late %u\n", stats.bond_reorder,
+           stats.seq_lost, stats.seq_duplicate);
+
+    if ((bench_ber == 0) &&
+        ((bench_received != sent) || (bench_skipped != 0) ||
+         (bench_reorder != 0) || (bench_corrupt != 0))) {
+        fprintf(stderr, "frames lost or out of order on a clean link\n");
+        return 1;
+    }
+
+    return 0;
+}
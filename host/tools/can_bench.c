@@ -0,0 +1,552 @@
+/**
+ * @file    can_bench.c
+ * @author  Deadline039
+ * @brief   CAN 传输测试: 在模拟的 bxCAN 总线上收发, 检查分段重组和硬件过滤
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   can_bench [frames] [foreign] [can2sb]
+ *     frames  每个 ID 发送的帧数, 默认 2000
+ *     foreign 每个报文之后总线上其他节点发出的报文数, 默认 2
+ *     can2sb  CSP 初始化时设置的 CAN2 起始过滤器组, 默认 14 (复位值)
+ * CAN1 和 CAN2 接在同一条总线上, 工作在回环模式, 自己发出的报文自己也能
+ * 收到. MSG_ID_1 使用 CAN1, MSG_ID_2 使用 CAN2, 数据长度从 4 到
+ * `BENCH_MAX_LEN`变化, 覆盖单帧和多帧分段. 其他节点的报文使用 0x200 开始的
+ * 标准帧 ID. 过滤器寄存器按 F4 参考手册模拟, 启动时和 CSP 一样在 0 号
+ * 过滤器组配置接收所有报文, 注册后其他节点的报文应该全部被硬件过滤,
+ * 不进入接收中断. CAN2SB 为 0 时 CAN1 没有过滤器组, 注册会失败
+ * 编译 (需要在 msg_protocol.h 中启用`MSG_ENABLE_CAN`和`MSG_ENABLE_STATISTICS`,
+ * CAN 由本文件模拟, 不链接 msg_host.c):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/can_bench.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c
+ *****************************************************************************
+ */
+
+#include "msg_protocol.h"
+
+#if MSG_ENABLE_RTOS
+#include "semphr.h"
+#endif /* MSG_ENABLE_RTOS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !MSG_ENABLE_CAN || !MSG_ENABLE_STATISTICS
+#error "can_bench requires MSG_ENABLE_CAN and MSG_ENABLE_STATISTICS"
+#endif /* !MSG_ENABLE_CAN || !MSG_ENABLE_STATISTICS */
+
+/* 最大数据长度, 前 4 byte 是帧计数 */
+#define BENCH_MAX_LEN   100U
+/* 每个 ID 的接收缓冲区和队列大小 */
+#define BENCH_RECV_SIZE 512U
+#define BENCH_FIFO_SIZE 1024U
+/* 其他节点报文的起始 ID */
+#define BENCH_FOREIGN_ID 0x200U
+/* 接收 FIFO 深度, 与 bxCAN 一样是 3 */
+#define BENCH_RX_DEPTH  3U
+
+/**
+ * @brief 接收 FIFO 中的一个报文
+ */
+typedef struct {
+    CAN_RxHeaderTypeDef header; /*!< 报文头 */
+    uint8_t data[8];            /*!< 报文数据 */
+} bench_rx_t;
+
+/**
+ * @brief 模拟的 CAN 控制器接收部分
+ */
+typedef struct {
+    bench_rx_t fifo[BENCH_RX_DEPTH]; /*!< 接收 FIFO0 */
+    uint32_t head;                   /*!< FIFO 读指针 */
+    uint32_t tail;                   /*!< FIFO 写指针 */
+    uint32_t accepted;               /*!< 通过过滤器的报文数 */
+    uint32_t rejected;               /*!< 被过滤器丢弃的报文数 */
+    uint32_t overrun;                /*!< FIFO 满丢弃的报文数 */
+    uint32_t foreign;                /*!< 进入中断的其他节点报文数 */
+} bench_can_t;
+
+CAN_TypeDef msg_host_can[2];
+CAN_HandleTypeDef can1_handle = {CAN1};
+CAN_HandleTypeDef can2_handle = {CAN2};
+
+static bench_can_t bench_cans[2];
+static uint32_t bench_foreign_per_frame;
+static uint32_t bench_foreign_sent;
+static uint64_t bench_bus_bits;
+
+/* 每个 ID 的接收检查 */
+static uint32_t bench_next[2];
+static uint32_t bench_received[2];
+static uint32_t bench_corrupt[2];
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 时间对测试没有影响, 固定为 0
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return 0;
+}
+
+/**
+ * @brief DWT 周期计数器, 固定为 0
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static msg_host_dwt_t dwt;
+    return &dwt;
+}
+
+/**
+ * @brief 单线程运行, 临界区不需要锁
+ */
+void msg_host_critical_enter(void) {
+}
+
+void msg_host_critical_exit(void) {
+}
+
+#if MSG_ENABLE_RTOS
+/**
+ * @brief 单线程运行, 互斥量不需要锁
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    static uint8_t dummy;
+    return (SemaphoreHandle_t)&dummy;
+}
+
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    (void)mutex;
+    (void)wait;
+    return pdTRUE;
+}
+
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    (void)mutex;
+    return pdTRUE;
+}
+#endif /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 没有串口, 协议层的串口接口都不会用到
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    (void)huart;
+    (void)data;
+    return (uint32_t)len;
+}
+
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    (void)huart;
+    return 0;
+}
+
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    (void)huart;
+    return 0;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)huart;
+    (void)pData;
+    (void)Size;
+    (void)Timeout;
+    return HAL_OK;
+}
+
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    (void)huart;
+    (void)buf;
+    (void)len;
+    return 0;
+}
+
+/**
+ * @brief 配置过滤器组, 与 F4 HAL 一样写 CAN1 的过滤器寄存器和 CAN2SB
+ *
+ * @param hcan CAN 句柄
+ * @param sFilterConfig 过滤器配置
+ * @return 配置结果
+ */
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan,
+                                       const CAN_FilterTypeDef *sFilterConfig) {
+    CAN_TypeDef *can_ip = CAN1;
+    uint32_t bank = sFilterConfig->FilterBank;
+    uint32_t bit = 1U << bank;
+
+    (void)hcan;
+
+    if ((bank >= 28) || (sFilterConfig->SlaveStartFilterBank >= 28)) {
+        return HAL_ERROR;
+    }
+
+    SET_BIT(can_ip->FMR, CAN_FMR_FINIT);
+    CLEAR_BIT(can_ip->FMR, CAN_FMR_CAN2SB);
+    SET_BIT(can_ip->FMR, sFilterConfig->SlaveStartFilterBank
+                             << CAN_FMR_CAN2SB_Pos);
+    CLEAR_BIT(can_ip->FA1R, bit);
+
+    if (sFilterConfig->FilterScale == CAN_FILTERSCALE_16BIT) {
+        CLEAR_BIT(can_ip->FS1R, bit);
+        can_ip->sFilterRegister[bank].FR1 =
+            ((sFilterConfig->FilterMaskIdLow & 0xFFFFU) << 16) |
+            (sFilterConfig->FilterIdLow & 0xFFFFU);
+        can_ip->sFilterRegister[bank].FR2 =
+            ((sFilterConfig->FilterMaskIdHigh & 0xFFFFU) << 16) |
+            (sFilterConfig->FilterIdHigh & 0xFFFFU);
+    } else {
+        SET_BIT(can_ip->FS1R, bit);
+        can_ip->sFilterRegister[bank].FR1 =
+            ((sFilterConfig->FilterIdHigh & 0xFFFFU) << 16) |
+            (sFilterConfig->FilterIdLow & 0xFFFFU);
+        can_ip->sFilterRegister[bank].FR2 =
+            ((sFilterConfig->FilterMaskIdHigh & 0xFFFFU) << 16) |
+            (sFilterConfig->FilterMaskIdLow & 0xFFFFU);
+    }
+
+    if (sFilterConfig->FilterMode == CAN_FILTERMODE_IDMASK) {
+        CLEAR_BIT(can_ip->FM1R, bit);
+    } else {
+        SET_BIT(can_ip->FM1R, bit);
+    }
+
+    if (sFilterConfig->FilterFIFOAssignment == CAN_FILTER_FIFO0) {
+        CLEAR_BIT(can_ip->FFA1R, bit);
+    } else {
+        SET_BIT(can_ip->FFA1R, bit);
+    }
+
+    if (sFilterConfig->FilterActivation == CAN_FILTER_ENABLE) {
+        SET_BIT(can_ip->FA1R, bit);
+    }
+
+    CLEAR_BIT(can_ip->FMR, CAN_FMR_FINIT);
+    return HAL_OK;
+}
+
+/**
+ * @brief 按过滤器组判断控制器是否接收一个标准数据帧
+ *
+ * @param index 控制器序号, 0 是 CAN1
+ * @param std_id 标准帧 ID
+ * @return 是否接收, 只模拟 FIFO0
+ */
+static bool bench_filter_match(uint32_t index, uint32_t std_id) {
+    CAN_TypeDef *can_ip = CAN1;
+    uint32_t slave_start =
+        READ_BIT(can_ip->FMR, CAN_FMR_CAN2SB) >> CAN_FMR_CAN2SB_Pos;
+    uint32_t first = (index == 0) ? 0 : slave_start;
+    uint32_t last = (index == 0) ? slave_start : 28;
+    /* 报文在 32 位和 16 位过滤器中的位置, IDE 和 RTR 为 0 */
+    uint32_t reg32 = std_id << 21;
+    uint32_t reg16 = std_id << 5;
+
+    for (uint32_t bank = first; bank < last; ++bank) {
+        uint32_t bit = 1U << bank;
+        uint32_t fr1 = can_ip->sFilterRegister[bank].FR1;
+        uint32_t fr2 = can_ip->sFilterRegister[bank].FR2;
+
+        if (!READ_BIT(can_ip->FA1R, bit) || READ_BIT(can_ip->FFA1R, bit)) {
+            continue;
+        }
+
+        bool list = READ_BIT(can_ip->FM1R, bit);
+        if (READ_BIT(can_ip->FS1R, bit)) {
+            if (list ? ((reg32 == fr1) || (reg32 == fr2))
+                     : (((reg32 ^ fr1) & fr2) == 0)) {
+                return true;
+            }
+            continue;
+        }
+
+        if (list) {
+            if ((reg16 == (fr1 & 0xFFFFU)) || (reg16 == (fr1 >> 16)) ||
+                (reg16 == (fr2 & 0xFFFFU)) || (reg16 == (fr2 >> 16))) {
+                return true;
+            }
+        } else if ((((reg16 ^ fr1) & (fr1 >> 16) & 0xFFFFU) == 0) ||
+                   (((reg16 ^ fr2) & (fr2 >> 16) & 0xFFFFU) == 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief 把一个报文放到总线上, 每个控制器按过滤器决定是否接收
+ *
+ * @param std_id 标准帧 ID
+ * @param data 报文数据
+ * @param len 报文长度
+ */
+static void bench_bus_send(uint32_t std_id, const uint8_t *data, uint8_t len) {
+    static CAN_HandleTypeDef *const handles[2] = {&can1_handle, &can2_handle};
+
+    /* 标准数据帧不计位填充 47 bit 加数据 */
+    bench_bus_bits += 47U + 8U * len;
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        bench_can_t *can = &bench_cans[i];
+
+        if (!bench_filter_match(i, std_id)) {
+            ++can->rejected;
+            continue;
+        }
+
+        ++can->accepted;
+        if (can->tail - can->head >= BENCH_RX_DEPTH) {
+            ++can->overrun;
+            continue;
+        }
+
+        bench_rx_t *rx = &can->fifo[can->tail % BENCH_RX_DEPTH];
+        memset(&rx->header, 0, sizeof(rx->header));
+        rx->header.StdId = std_id;
+        rx->header.IDE = CAN_ID_STD;
+        rx->header.RTR = CAN_RTR_DATA;
+        rx->header.DLC = len;
+        memcpy(rx->data, data, len);
+        ++can->tail;
+
+        /* 接收中断 */
+        HAL_CAN_RxFifo0MsgPendingCallback(handles[i]);
+    }
+}
+
+/**
+ * @brief 发送一个 CAN 报文, 之后总线上其他节点也发出一些报文
+ *
+ * @param can_selected 使用的 CAN
+ * @param can_ide 标准帧或扩展帧
+ * @param id 报文 ID
+ * @param len 报文长度
+ * @param msg 报文数据
+ * @return 发送结果, 0 表示成功
+ */
+uint8_t can_send_message(can_selected_t can_selected, uint32_t can_ide,
+                         uint32_t id, uint8_t len, const uint8_t *msg) {
+    uint8_t foreign[8] = {0};
+
+    if ((can_selected > can2_selected) || (can_ide != CAN_ID_STD) ||
+        (len > 8)) {
+        return 1;
+    }
+
+    bench_bus_send(id, msg, len);
+
+    for (uint32_t i = 0; i < bench_foreign_per_frame; ++i) {
+        memcpy(foreign, &bench_foreign_sent, sizeof(bench_foreign_sent));
+        bench_bus_send(BENCH_FOREIGN_ID + (bench_foreign_sent & 0x0FU),
+                       foreign, 8);
+        ++bench_foreign_sent;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 从接收 FIFO 取出一个报文
+ *
+ * @param hcan CAN 句柄
+ * @param RxFifo 接收 FIFO, 只模拟 FIFO0
+ * @param[out] pHeader 报文头
+ * @param[out] aData 报文数据
+ * @return 取出结果
+ */
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan,
+                                       uint32_t RxFifo,
+                                       CAN_RxHeaderTypeDef *pHeader,
+                                       uint8_t aData[]) {
+    bench_can_t *can = &bench_cans[(hcan == &can1_handle) ? 0 : 1];
+
+    if ((RxFifo != CAN_RX_FIFO0) || (can->head == can->tail)) {
+        return HAL_ERROR;
+    }
+
+    bench_rx_t *rx = &can->fifo[can->head % BENCH_RX_DEPTH];
+    *pHeader = rx->header;
+    memcpy(aData, rx->data, rx->header.DLC);
+    ++can->head;
+    return HAL_OK;
+}
+
+/**
+ * @brief 接收中断回调, 与开发板上的写法相同
+ *
+ * @param hcan CAN 句柄
+ */
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+    CAN_RxHeaderTypeDef header;
+    uint8_t data[8];
+    can_selected_t can =
+        (hcan == &can1_handle) ? can1_selected : can2_selected;
+
+    while (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &header, data) == HAL_OK) {
+        if (message_can_receive(can, header.StdId, data, header.DLC) != 0) {
+            if ((header.StdId & ~0x0FU) == BENCH_FOREIGN_ID) {
+                /* 应该被硬件过滤掉 */
+                ++bench_cans[can].foreign;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 和 CSP 的`can1_init`/`can2_init`一样, 在 0 号过滤器组配置接收
+ *        所有报文
+ *
+ * @param hcan CAN 句柄
+ * @param slave_start CAN2 起始过滤器组
+ */
+static void bench_csp_init(CAN_HandleTypeDef *hcan, uint32_t slave_start) {
+    CAN_FilterTypeDef can_filter_config = {0};
+
+    can_filter_config.FilterBank = 0;
+    can_filter_config.FilterMode = CAN_FILTERMODE_IDMASK;
+    can_filter_config.FilterScale = CAN_FILTERSCALE_32BIT;
+    can_filter_config.FilterActivation = CAN_FILTER_ENABLE;
+    can_filter_config.SlaveStartFilterBank = slave_start;
+    can_filter_config.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+    HAL_CAN_ConfigFilter(hcan, &can_filter_config);
+
+    if (slave_start != 0) {
+        /* CSP 给两个 CAN 都写 0 号过滤器组, CAN2SB 不为 0 时它属于 CAN1,
+         * 这里让 CAN2 的第一组也接收所有报文 */
+        can_filter_config.FilterBank = slave_start;
+        HAL_CAN_ConfigFilter(hcan, &can_filter_config);
+    }
+}
+
+/**
+ * @brief 接收回调, 检查数据内容和顺序
+ *
+ * @param index ID 序号
+ * @param msg_length 消息长度
+ * @param[in] msg_data 消息数据
+ */
+static void bench_check(uint32_t index, uint32_t msg_length,
+                        const uint8_t *msg_data) {
+    uint32_t count;
+
+    if (msg_length < sizeof(count)) {
+        ++bench_corrupt[index];
+        return;
+    }
+
+    memcpy(&count, msg_data, sizeof(count));
+    for (uint32_t i = sizeof(count); i < msg_length; ++i) {
+        if (msg_data[i] != (uint8_t)(count + i)) {
+            ++bench_corrupt[index];
+            return;
+        }
+    }
+
+    if (count != bench_next[index]) {
+        ++bench_corrupt[index];
+    }
+
+    bench_next[index] = count + 1;
+    ++bench_received[index];
+}
+
+static void bench_callback1(uint32_t msg_length, uint8_t msg_id_type,
+                            uint8_t *msg_data) {
+    (void)msg_id_type;
+    bench_check(0, msg_length, msg_data);
+}
+
+static void bench_callback2(uint32_t msg_length, uint8_t msg_id_type,
+                            uint8_t *msg_data) {
+    (void)msg_id_type;
+    bench_check(1, msg_length, msg_data);
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 2000U;
+    uint32_t slave_start = 14;
+    uint8_t data[BENCH_MAX_LEN];
+    uint64_t payload = 0;
+    bool failed = false;
+
+    bench_foreign_per_frame =
+        (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 2U;
+    if (argc > 3) {
+        slave_start = (uint32_t)strtoul(argv[3], NULL, 0);
+    }
+
+    bench_csp_init(&can1_handle, slave_start);
+    bench_csp_init(&can2_handle, slave_start);
+
+    if ((message_register_can(MSG_ID_1, can1_selected, BENCH_RECV_SIZE,
+                              BENCH_FIFO_SIZE) != 0) ||
+        (message_register_can(MSG_ID_2, can2_selected, BENCH_RECV_SIZE,
+                              BENCH_FIFO_SIZE) != 0)) {
+        fprintf(stderr, "message_register_can failed (CAN2SB %u)\n",
+                slave_start);
+        return 1;
+    }
+    message_register_recv_callback(MSG_ID_1, bench_callback1);
+    message_register_recv_callback(MSG_ID_2, bench_callback2);
+
+    printf("CAN2SB %u, filter banks active 0x%07X\n",
+           (unsigned)(READ_BIT(CAN1->FMR, CAN_FMR_CAN2SB) >>
+                      CAN_FMR_CAN2SB_Pos),
+           (unsigned)CAN1->FA1R);
+
+    for (uint32_t sent = 0; sent < frames; ++sent) {
+        uint32_t len = 4U + sent % (BENCH_MAX_LEN - 3U);
+
+        memcpy(data, &sent, sizeof(sent));
+        for (uint32_t i = sizeof(sent); i < len; ++i) {
+            data[i] = (uint8_t)(sent + i);
+        }
+
+        message_send_data(MSG_ID_1, MSG_DATA_UINT8, data, len);
+        message_send_data(MSG_ID_2, MSG_DATA_UINT8, data, len);
+        payload += 2U * len;
+        message_polling_data();
+    }
+    message_polling_data();
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        msg_stats_t stats;
+        message_get_stats((msg_id_t)(MSG_ID_1 + i), &stats);
+
+        printf("CAN%u: received %u/%u, corrupt %u, can_drop %u, "
+               "can_tx_drop %u | accepted %u, rejected %u, overrun %u, "
+               "foreign in ISR %u\n",
+               i + 1, bench_received[i], frames, bench_corrupt[i],
+               stats.can_drop, stats.can_tx_drop, bench_cans[i].accepted,
+               bench_cans[i].rejected, bench_cans[i].overrun,
+               bench_cans[i].foreign);
+
+        if ((bench_received[i] != frames) || (bench_corrupt[i] != 0) ||
+            (bench_cans[i].foreign != 0)) {
+            failed = true;
+        }
+    }
+
+    printf("foreign frames %u, payload %.1f%% of %.1f ms bus time at 1 Mbit/s\n",
+           bench_foreign_sent,
+           100.0 * (double)payload * 8.0 / (double)bench_bus_bits,
+           (double)bench_bus_bits / 1000.0);
+
+    if (failed) {
+        fprintf(stderr, "frames lost or foreign frames not filtered\n");
+        return 1;
+    }
+
+    return 0;
+}
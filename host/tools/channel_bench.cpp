@@ -0,0 +1,219 @@
+/**
+ * @file    channel_bench.cpp
+ * @author  Deadline039
+ * @brief   C++ 接口基准测试: 与 C 接口收发同样的帧, 比较耗时
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   channel_bench [rounds]
+ * C 接口使用 MSG_ID_1, C++ 接口使用 MSG_ID_2, 各自通过一条管道自发自收.
+ * 每轮发送一批帧, 然后读出并解包, 检查收到的数据, 重复几次取最快的一次.
+ * 编译:
+ *   gcc -O2 -c -Ihost -I. -If429-demo/User/Utils msg_protocol.c
+ *       f429-demo/User/Utils/crc/crc.c host/msg_host.c
+ *   g++ -std=c++17 -O2 -Ihost -I. host/tools/channel_bench.cpp *.o -lpthread
+ *****************************************************************************
+ */
+
+#include "msg_host.h"
+#include "msg_protocol.hpp"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+/* 每帧的元素个数和每轮发送的帧数 */
+#define BENCH_LEN   32U
+#define BENCH_BATCH 256U
+/* 重复测量的次数 */
+#define BENCH_TRIES 5U
+/* 接收缓冲区和队列大小, 一轮的数据都能放下 */
+#define BENCH_BUF_SIZE  4096U
+#define BENCH_FIFO_SIZE (1U << 16)
+
+using bench_channel = msg::Channel<MSG_ID_2, std::uint16_t, BENCH_LEN>;
+
+/**
+ * @brief 一条测试路径的收发状态
+ */
+typedef struct {
+    msg_host_link_t *tx; /*!< 发送链路, 管道写端 */
+    msg_host_link_t *rx; /*!< 接收链路, 管道读端 */
+    std::uint64_t frames;   /*!< 收到的帧数 */
+    std::uint64_t checksum; /*!< 收到的数据之和 */
+} bench_path_t;
+
+static bench_path_t bench_c, bench_cpp;
+
+/**
+ * @brief 当前时间
+ *
+ * @return 秒
+ */
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 创建自发自收的管道链路
+ *
+ * @param path 测试路径
+ * @return 是否成功
+ */
+static bool bench_open(bench_path_t *path) {
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+
+    path->tx = msg_host_link_attach(fds[1], 1U << 16);
+    path->rx = msg_host_link_attach(fds[0], 1U << 16);
+    return (path->tx != NULL) && (path->rx != NULL);
+}
+
+/**
+ * @brief C 接口的接收回调
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void bench_c_callback(std::uint32_t msg_length, std::uint8_t msg_id_type,
+                             std::uint8_t *msg_data) {
+    std::uint16_t value;
+
+    if ((msg_id_type & 0x0F) != MSG_DATA_UINT16) {
+        return;
+    }
+
+    ++bench_c.frames;
+    for (std::uint32_t i = 0; i + 1 < msg_length; i += 2) {
+        std::memcpy(&value, msg_data + i, sizeof(value));
+        bench_c.checksum += value;
+    }
+}
+
+/**
+ * @brief 读出并解包一条测试路径收到的所有数据
+ *
+ * @param path 测试路径
+ * @param msg_id 数据含义
+ */
+static void bench_drain(bench_path_t *path, msg_id_t msg_id) {
+    msg_host_link_fill(path->rx);
+    while (path->rx->rx_tail != path->rx->rx_head) {
+        message_polling_id(msg_id);
+        msg_host_link_fill(path->rx);
+    }
+    /* 最后一帧在下一次轮询时才出队 */
+    message_polling_id(msg_id);
+}
+
+/**
+ * @brief 通过 C 接口收发
+ *
+ * @param rounds 轮数
+ * @return 耗时, 单位 s
+ */
+static double bench_run_c(std::uint32_t rounds) {
+    std::uint16_t data[BENCH_LEN];
+    double start = bench_now();
+
+    for (std::uint32_t r = 0; r < rounds; ++r) {
+        for (std::uint32_t i = 0; i < BENCH_BATCH; ++i) {
+            for (std::uint32_t j = 0; j < BENCH_LEN; ++j) {
+                data[j] = (std::uint16_t)(r + i + j);
+            }
+            message_send_data(MSG_ID_1, MSG_DATA_UINT16, (std::uint8_t *)data,
+                              sizeof(data));
+        }
+        bench_drain(&bench_c, MSG_ID_1);
+    }
+
+    return bench_now() - start;
+}
+
+/**
+ * @brief 通过 C++ 接口收发
+ *
+ * @param rounds 轮数
+ * @return 耗时, 单位 s
+ */
+static double bench_run_cpp(std::uint32_t rounds) {
+    std::uint16_t data[BENCH_LEN];
+    double start = bench_now();
+
+    for (std::uint32_t r = 0; r < rounds; ++r) {
+        for (std::uint32_t i = 0; i < BENCH_BATCH; ++i) {
+            for (std::uint32_t j = 0; j < BENCH_LEN; ++j) {
+                data[j] = (std::uint16_t)(r + i + j);
+            }
+            bench_channel::send(data);
+        }
+        bench_drain(&bench_cpp, MSG_ID_2);
+    }
+
+    return bench_now() - start;
+}
+
+int main(int argc, char **argv) {
+    std::uint32_t rounds =
+        (argc > 1) ? (std::uint32_t)std::strtoul(argv[1], NULL, 0) : 200U;
+    double best_c = 1e9, best_cpp = 1e9, t;
+
+    if (!bench_open(&bench_c) || !bench_open(&bench_cpp)) {
+        std::perror("pipe");
+        return 1;
+    }
+
+    /* 两条路径的长度限制和缓冲区大小相同 */
+    message_register_length(MSG_ID_1, BENCH_LEN * sizeof(std::uint16_t), 0);
+    message_register_send_uart(MSG_ID_1, bench_c.tx,
+                               bench_channel::send_buf_size);
+    message_register_polling_uart(MSG_ID_1, bench_c.rx, BENCH_BUF_SIZE,
+                                  BENCH_FIFO_SIZE);
+    message_register_recv_callback(MSG_ID_1, bench_c_callback);
+
+    bench_channel::attach(bench_cpp.tx, bench_cpp.rx, BENCH_BUF_SIZE,
+                          BENCH_FIFO_SIZE);
+    bench_channel::on_receive([](msg::span<const std::uint16_t> data) {
+        ++bench_cpp.frames;
+        for (std::uint16_t value : data) {
+            bench_cpp.checksum += value;
+        }
+    });
+
+    /* 交替测量, 减少频率变化的影响 */
+    for (std::uint32_t i = 0; i < BENCH_TRIES; ++i) {
+        t = bench_run_c(rounds);
+        best_c = (t < best_c) ? t : best_c;
+        t = bench_run_cpp(rounds);
+        best_cpp = (t < best_cpp) ? t : best_cpp;
+    }
+
+    std::uint64_t frames = (std::uint64_t)rounds * BENCH_BATCH;
+    std::printf("C:   %llu frames, checksum %llx, %.1f ns/frame\n",
+                (unsigned long long)bench_c.frames,
+                (unsigned long long)bench_c.checksum, best_c / frames * 1e9);
+    std::printf("C++: %llu frames, checksum %llx, %.1f ns/frame\n",
+                (unsigned long long)bench_cpp.frames,
+                (unsigned long long)bench_cpp.checksum,
+                best_cpp / frames * 1e9);
+
+    if ((bench_c.frames != bench_cpp.frames) ||
+        (bench_c.checksum != bench_cpp.checksum)) {
+        std::fprintf(stderr, "received data differs\n");
+        return 1;
+    }
+
+    return 0;
+}
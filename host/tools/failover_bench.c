@@ -0,0 +1,436 @@
+/**
+ * @file    failover_bench.c
+ * @author  Deadline039
+ * @brief   链路冗余基准测试: 在模拟的主备串口上断开主链路, 统计切换时间
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   failover_bench [trials] [baud] [period]
+ *     trials 断开主链路的次数, 默认 20
+ *     baud   两条链路的波特率, 默认 921600
+ *     period 发送间隔, 单位 ms, 默认 1, 链路要能在这段时间内发完一帧
+ * MSG_ID_1 是冗余的逻辑 ID, MSG_ID_2 是主链路, MSG_ID_3 是备用链路.
+ * 每条链路自发自收, 按波特率每毫秒把发送缓冲区中的字节搬到接收缓冲区,
+ * 时间是模拟的, 与主机速度无关, 每毫秒轮询一次. 每次试验在不同的时刻
+ * 断开主链路 (之后发出的字节全部丢失), 记录从断开到切换到备用链路的
+ * 时间和交付中断的时间, 等主链路恢复并切回后开始下一次. 最后检查补发
+ * 之后是否每一帧都恰好交付一次
+ * 编译 (需要在 msg_protocol.h 中启用`MSG_ENABLE_FAILOVER`,
+ * `MSG_ENABLE_SEQUENCE`和`MSG_ENABLE_STATISTICS`, 串口由本文件模拟,
+ * 不链接 msg_host.c):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/failover_bench.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c
+ *****************************************************************************
+ */
+
+#include "msg_protocol.h"
+
+#if MSG_ENABLE_RTOS
+#include "semphr.h"
+#endif /* MSG_ENABLE_RTOS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !MSG_ENABLE_FAILOVER || !MSG_ENABLE_STATISTICS
+#error "failover_bench requires MSG_ENABLE_FAILOVER and MSG_ENABLE_STATISTICS"
+#endif /* !MSG_ENABLE_FAILOVER || !MSG_ENABLE_STATISTICS */
+
+/* 每帧数据长度, 前 4 byte 是帧计数 */
+#define BENCH_LEN       32U
+/* 一帧编码后的最大长度 */
+#define BENCH_WIRE      MSG_FRAME_WIRE_SIZE(BENCH_LEN)
+/* 发送窗口大小 */
+#define BENCH_WINDOW    64U
+/* 模拟串口的收发缓冲区大小 */
+#define BENCH_BUF_SIZE  (1U << 16)
+/* 每个链路 ID 的接收缓冲区和队列大小 */
+#define BENCH_RECV_SIZE 1024U
+#define BENCH_FIFO_SIZE 4096U
+/* 每次试验的时长, 前一段断开主链路, 之后恢复 */
+#define BENCH_TRIAL     200U
+#define BENCH_CUT       40U
+/* 帧计数的最大值, 用于记录每一帧的交付次数 */
+#define BENCH_MAX_FRAMES (1U << 20)
+
+/**
+ * @brief 模拟的串口链路
+ */
+typedef struct {
+    msg_host_link_t uart; /*!< 串口句柄, 发送缓冲区按速率搬到接收缓冲区 */
+    double rate;          /*!< 每毫秒发出的字节数 */
+    double credit;        /*!< 本毫秒还能发出的字节数 */
+    bool cut;             /*!< 是否断开, 断开时发出的字节全部丢失 */
+} bench_link_t;
+
+static bench_link_t bench_links[2];
+static uint32_t bench_tick;
+
+static uint8_t *bench_delivered;  /* 每一帧的交付次数 */
+static uint32_t bench_last;       /* 最近交付新帧的时刻 */
+static uint32_t bench_gap;        /* 本次试验中交付中断的最长时间 */
+static uint32_t bench_corrupt;    /* 数据内容错误的帧数 */
+
+/**
+ * @brief 模拟的毫秒时基
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return bench_tick;
+}
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 模拟 DWT 周期计数器, 跟随模拟时基, 计数单位是 us
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static msg_host_dwt_t dwt;
+    dwt.CYCCNT = bench_tick * 1000U;
+    return &dwt;
+}
+
+/**
+ * @brief 单线程运行, 临界区不需要锁
+ */
+void msg_host_critical_enter(void) {
+}
+
+void msg_host_critical_exit(void) {
+}
+
+#if MSG_ENABLE_RTOS
+/**
+ * @brief 单线程运行, 互斥量不需要锁
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    static uint8_t dummy;
+    return (SemaphoreHandle_t)&dummy;
+}
+
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    (void)mutex;
+    (void)wait;
+    return pdTRUE;
+}
+
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    (void)mutex;
+    return pdTRUE;
+}
+#endif /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 写入发送缓冲区
+ *
+ * @param huart 串口句柄
+ * @param data 数据
+ * @param len 数据长度
+ * @return 写入的字节数, 缓冲区满时截断
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    uint32_t space = huart->tx_size - huart->tx_len;
+
+    if (len > space) {
+        len = space;
+    }
+
+    memcpy(huart->tx_buf + huart->tx_len, data, len);
+    huart->tx_len += (uint32_t)len;
+    return (uint32_t)len;
+}
+
+/**
+ * @brief 开始发送, 模拟的串口一直在按速率发送, 这里什么也不做
+ *
+ * @param huart 串口句柄
+ * @return 待发送的字节数
+ */
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    return huart->tx_len;
+}
+
+/**
+ * @brief 发送缓冲区大小
+ *
+ * @param huart 串口句柄
+ * @return 字节数
+ */
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    return huart->tx_size;
+}
+
+/**
+ * @brief 阻塞发送, 同样写入发送缓冲区
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)Timeout;
+    return (uart_dmatx_write(huart, pData, Size) == Size) ? HAL_OK : HAL_BUSY;
+}
+
+/**
+ * @brief 读出接收缓冲区
+ *
+ * @param huart 串口句柄
+ * @param buf 读出的位置
+ * @param len 最多读出的字节数
+ * @return 读出的字节数
+ */
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    uint32_t n = 0;
+
+    while ((n < len) && (huart->rx_head != huart->rx_tail)) {
+        ((uint8_t *)buf)[n++] = huart->rx_buf[huart->rx_head & huart->rx_mask];
+        ++huart->rx_head;
+    }
+
+    return n;
+}
+
+/**
+ * @brief 初始化一条模拟链路
+ *
+ * @param link 链路
+ * @param baud 波特率
+ * @return 是否成功
+ */
+static bool bench_link_init(bench_link_t *link, uint32_t baud) {
+    memset(link, 0, sizeof(bench_link_t));
+    link->uart.hdmatx = &link->uart;
+    link->uart.tx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.tx_size = BENCH_BUF_SIZE;
+    link->uart.rx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.rx_mask = BENCH_BUF_SIZE - 1U;
+    /* 1 位起始位, 8 位数据, 1 位停止位 */
+    link->rate = (double)baud / 10.0 / 1000.0;
+
+    return (link->uart.tx_buf != NULL) && (link->uart.rx_buf != NULL);
+}
+
+/**
+ * @brief 模拟 1 ms: 每条链路按速率把发送缓冲区中的字节搬到接收缓冲区,
+ *        断开的链路把字节丢掉
+ */
+static void bench_step(void) {
+    for (uint32_t i = 0; i < 2; ++i) {
+        msg_host_link_t *uart = &bench_links[i].uart;
+        uint32_t n;
+
+        bench_links[i].credit += bench_links[i].rate;
+        n = (uint32_t)bench_links[i].credit;
+        if (n > uart->tx_len) {
+            n = uart->tx_len;
+        }
+
+        for (uint32_t j = 0; (j < n) && !bench_links[i].cut; ++j) {
+            uart->rx_buf[uart->rx_tail & uart->rx_mask] = uart->tx_buf[j];
+            ++uart->rx_tail;
+        }
+
+        uart->tx_len -= n;
+        memmove(uart->tx_buf, uart->tx_buf + n, uart->tx_len);
+
+        /* 空闲时不积累发送能力 */
+        bench_links[i].credit =
+            (uart->tx_len != 0) ? bench_links[i].credit - n : 0;
+    }
+}
+
+/**
+ * @brief 冗余 ID 的接收回调, 记录每一帧的交付次数和交付中断的时间
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void bench_callback(uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data) {
+    uint32_t count;
+
+    (void)msg_id_type;
+
+    if (msg_length != BENCH_LEN) {
+        ++bench_corrupt;
+        return;
+    }
+
+    memcpy(&count, msg_data, sizeof(count));
+    for (uint32_t i = sizeof(count); i < BENCH_LEN; ++i) {
+        if (msg_data[i] != (uint8_t)(count + i)) {
+            ++bench_corrupt;
+            return;
+        }
+    }
+
+    if (count >= BENCH_MAX_FRAMES) {
+        ++bench_corrupt;
+        return;
+    }
+
+    if ((bench_delivered[count] == 0) && (bench_tick - bench_last > bench_gap)) {
+        bench_gap = bench_tick - bench_last;
+    }
+    if (bench_delivered[count] < 255U) {
+        ++bench_delivered[count];
+    }
+    bench_last = bench_tick;
+}
+
+/**
+ * @brief 当前使用的链路
+ *
+ * @return 链路序号
+ */
+static uint8_t bench_active(void) {
+    msg_failover_status_t status;
+
+    message_get_failover_status(MSG_ID_1, &status);
+    return status.active;
+}
+
+int main(int argc, char **argv) {
+    uint32_t trials = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 20U;
+    uint32_t baud = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 921600U;
+    uint32_t period = (argc > 3) ? (uint32_t)strtoul(argv[3], NULL, 0) : 1U;
+    msg_id_t links[2] = {MSG_ID_2, MSG_ID_3};
+    uint8_t data[BENCH_LEN];
+    uint32_t sent = 0, failed = 0;
+    uint32_t switch_max = 0, switch_sum = 0, gap_max = 0, gap_sum = 0;
+
+    if (period == 0) {
+        period = 1;
+    }
+
+    /* 链路本身过载时一直在积压, 测不出切换时间 */
+    if ((double)(BENCH_LEN + 8U) > (double)baud / 10.0 / 1000.0 * period) {
+        fprintf(stderr, "%u baud cannot carry a frame every %u ms\n", baud,
+                period);
+        return 1;
+    }
+
+    bench_delivered = calloc(BENCH_MAX_FRAMES, 1);
+    if (bench_delivered == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        if (!bench_link_init(&bench_links[i], baud)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        message_register_send_uart(links[i], &bench_links[i].uart, BENCH_WIRE);
+        message_register_polling_uart(links[i], &bench_links[i].uart,
+                                      BENCH_RECV_SIZE, BENCH_FIFO_SIZE);
+    }
+
+    if (message_register_failover(MSG_ID_1, links, 2, BENCH_WINDOW,
+                                  BENCH_LEN) != 0) {
+        fprintf(stderr, "message_register_failover failed\n");
+        return 1;
+    }
+    message_register_recv_callback(MSG_ID_1, bench_callback);
+
+    for (uint32_t trial = 0; trial <= trials; ++trial) {
+        /* 每次在不同的相位断开, 第 0 次只用来建立会话 */
+        uint32_t cut_at = bench_tick + BENCH_CUT + trial % 7U;
+        uint32_t end = bench_tick + BENCH_TRIAL;
+        uint32_t switched = 0;
+
+        bench_gap = 0;
+        while (bench_tick < end) {
+            if ((trial != 0) && (bench_tick == cut_at)) {
+                bench_links[0].cut = true;
+            }
+            if ((trial != 0) && (bench_tick == cut_at + BENCH_CUT)) {
+                bench_links[0].cut = false;
+            }
+
+            if ((bench_tick % period == 0) && (sent < BENCH_MAX_FRAMES)) {
+                memcpy(data, &sent, sizeof(sent));
+                for (uint32_t i = sizeof(sent); i < BENCH_LEN; ++i) {
+                    data[i] = (uint8_t)(sent + i);
+                }
+                if (message_send_data(MSG_ID_1, MSG_DATA_UINT8, data,
+                                      BENCH_LEN) == 0) {
+                    ++sent;
+                }
+            }
+
+            message_polling_data();
+            bench_step();
+            ++bench_tick;
+
+            if ((trial != 0) && (switched == 0) && (bench_active() == 1)) {
+                switched = bench_tick - cut_at;
+            }
+        }
+
+        if (trial == 0) {
+            continue;
+        }
+
+        if ((switched == 0) || (bench_active() != 0)) {
+            /* 没有切到备用链路或者没有切回 */
+            ++failed;
+        }
+        switch_sum += switched;
+        gap_sum += bench_gap;
+        if (switched > switch_max) {
+            switch_max = switched;
+        }
+        if (bench_gap > gap_max) {
+            gap_max = bench_gap;
+        }
+    }
+
+    /* 等最后的帧发完 */
+    for (uint32_t i = 0; i < BENCH_TRIAL; ++i) {
+        message_polling_data();
+        bench_step();
+        ++bench_tick;
+    }
+
+    uint32_t lost = 0, duplicate = 0;
+    for (uint32_t i = 0; i < sent; ++i) {
+        if (bench_delivered[i] == 0) {
+            ++lost;
+        } else if (bench_delivered[i] > 1) {
+            duplicate += bench_delivered[i] - 1U;
+        }
+    }
+
+    msg_stats_t stats;
+    message_get_stats(MSG_ID_1, &stats);
+
+    printf("%u trials, %u baud, one frame every %u ms\n", trials, baud, period);
+    printf("switchover: avg %.1f ms, max %u ms\n",
+           (double)switch_sum / (trials ? trials : 1), switch_max);
+    printf("delivery gap: avg %.1f ms, max %u ms\n",
+           (double)gap_sum / (trials ? trials : 1), gap_max);
+    printf("sent %u, lost %u, duplicate %u, corrupt %u\n", sent, lost,
+           duplicate, bench_corrupt);
+    printf("switches %u, resent %u, duplicates dropped %u\n",
+           stats.failover_switch, stats.failover_resent, stats.seq_duplicate);
+
+    if ((failed != 0) || (lost != 0) || (duplicate != 0) ||
+        (bench_corrupt != 0)) {
+        fprintf(stderr, "%u trials failed to switch, frames lost or "
+                        "duplicated\n",
+                failed);
+        return 1;
+    }
+
+    return 0;
+}
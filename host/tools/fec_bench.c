@@ -0,0 +1,396 @@
+/**
+ * @file    fec_bench.c
+ * @author  Deadline039
+ * @brief   前向纠错基准测试: 注入误码, 统计纠错的 CPU 开销和恢复的帧数
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   fec_bench [frames] [ber]...
+ *     frames 每个误码率下发送的帧数, 默认 20000
+ *     ber    每个字节出错 (随机翻转 1 位) 的概率, 可以给多个,
+ *            默认 0 0.0001 0.001 0.003 0.01
+ * MSG_ID_1 不带纠错校验, MSG_ID_2 带纠错校验, 各自在一条链路上自发自收.
+ * 每发一帧就把发送缓冲区中的字节注入误码后搬到接收缓冲区并轮询这个 ID,
+ * 两条链路使用相同的随机数序列. 统计两个 ID 完整收到的帧的比例,
+ * 每帧编码和解包 (包括纠错) 的平均 CPU 时间, 以及校验没有发现的错误帧
+ * 编译 (需要在 msg_protocol.h 中启用`MSG_ENABLE_FEC`和
+ * `MSG_ENABLE_STATISTICS`, 串口由本文件模拟, 不链接 msg_host.c):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/fec_bench.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c
+ *****************************************************************************
+ */
+
+#include "msg_protocol.h"
+
+#if MSG_ENABLE_RTOS
+#include "semphr.h"
+#endif /* MSG_ENABLE_RTOS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !MSG_ENABLE_FEC || !MSG_ENABLE_STATISTICS
+#error "fec_bench requires MSG_ENABLE_FEC and MSG_ENABLE_STATISTICS"
+#endif /* !MSG_ENABLE_FEC || !MSG_ENABLE_STATISTICS */
+
+/* 每帧数据长度, 前 4 byte 是帧计数 */
+#define BENCH_LEN       64U
+/* 一帧编码后的最大长度 */
+#define BENCH_WIRE      MSG_FRAME_WIRE_SIZE(BENCH_LEN)
+/* 模拟串口的收发缓冲区大小 */
+#define BENCH_BUF_SIZE  (1U << 16)
+/* 每个 ID 的接收缓冲区和队列大小 */
+#define BENCH_RECV_SIZE 1024U
+#define BENCH_FIFO_SIZE 4096U
+
+/**
+ * @brief 一个 ID 的测试结果
+ */
+typedef struct {
+    msg_host_link_t uart; /*!< 串口句柄, 发送缓冲区注入误码后搬到接收缓冲区 */
+    uint32_t received;    /*!< 完整收到的帧数 */
+    uint32_t corrupt;     /*!< 校验没有发现错误, 内容却不对的帧数 */
+    double encode_ns;     /*!< 编码用的 CPU 时间 */
+    double decode_ns;     /*!< 解包用的 CPU 时间 */
+} bench_link_t;
+
+static bench_link_t bench_links[2];
+static uint32_t bench_tick;
+
+/**
+ * @brief 模拟的毫秒时基
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return bench_tick;
+}
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 模拟 DWT 周期计数器, 跟随模拟时基, 计数单位是 us
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static msg_host_dwt_t dwt;
+    dwt.CYCCNT = bench_tick * 1000U;
+    return &dwt;
+}
+
+/**
+ * @brief 单线程运行, 临界区不需要锁
+ */
+void msg_host_critical_enter(void) {
+}
+
+void msg_host_critical_exit(void) {
+}
+
+#if MSG_ENABLE_RTOS
+/**
+ * @brief 单线程运行, 互斥量不需要锁
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    static uint8_t dummy;
+    return (SemaphoreHandle_t)&dummy;
+}
+
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    (void)mutex;
+    (void)wait;
+    return pdTRUE;
+}
+
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    (void)mutex;
+    return pdTRUE;
+}
+#endif /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 写入发送缓冲区
+ *
+ * @param huart 串口句柄
+ * @param data 数据
+ * @param len 数据长度
+ * @return 写入的字节数, 缓冲区满时截断
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    uint32_t space = huart->tx_size - huart->tx_len;
+
+    if (len > space) {
+        len = space;
+    }
+
+    memcpy(huart->tx_buf + huart->tx_len, data, len);
+    huart->tx_len += (uint32_t)len;
+    return (uint32_t)len;
+}
+
+/**
+ * @brief 开始发送, 模拟的串口一直在按速率发送, 这里什么也不做
+ *
+ * @param huart 串口句柄
+ * @return 待发送的字节数
+ */
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    return huart->tx_len;
+}
+
+/**
+ * @brief 发送缓冲区大小
+ *
+ * @param huart 串口句柄
+ * @return 字节数
+ */
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    return huart->tx_size;
+}
+
+/**
+ * @brief 阻塞发送, 同样写入发送缓冲区
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)Timeout;
+    return (uart_dmatx_write(huart, pData, Size) == Size) ? HAL_OK : HAL_BUSY;
+}
+
+/**
+ * @brief 读出接收缓冲区
+ *
+ * @param huart 串口句柄
+ * @param buf 读出的位置
+ * @param len 最多读出的字节数
+ * @return 读出的字节数
+ */
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    uint32_t n = 0;
+
+    while ((n < len) && (huart->rx_head != huart->rx_tail)) {
+        ((uint8_t *)buf)[n++] = huart->rx_buf[huart->rx_head & huart->rx_mask];
+        ++huart->rx_head;
+    }
+
+    return n;
+}
+
+/**
+ * @brief 初始化一条模拟链路
+ *
+ * @param link 链路
+ * @return 是否成功
+ */
+static bool bench_link_init(bench_link_t *link) {
+    memset(link, 0, sizeof(bench_link_t));
+    link->uart.hdmatx = &link->uart;
+    link->uart.tx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.tx_size = BENCH_BUF_SIZE;
+    link->uart.rx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.rx_mask = BENCH_BUF_SIZE - 1U;
+
+    return (link->uart.tx_buf != NULL) && (link->uart.rx_buf != NULL);
+}
+
+/**
+ * @brief 把发送缓冲区中的字节注入误码后全部搬到接收缓冲区
+ *
+ * @param link 链路
+ * @param ber 每个字节出错的概率
+ */
+static void bench_deliver(bench_link_t *link, double ber) {
+    msg_host_link_t *uart = &link->uart;
+
+    for (uint32_t j = 0; j < uart->tx_len; ++j) {
+        uint8_t byte = uart->tx_buf[j];
+        if ((ber > 0) && ((double)rand() / RAND_MAX < ber)) {
+            byte ^= (uint8_t)(1U << (rand() & 7));
+        }
+        uart->rx_buf[uart->rx_tail & uart->rx_mask] = byte;
+        ++uart->rx_tail;
+    }
+
+    uart->tx_len = 0;
+}
+
+/**
+ * @brief 检查收到的帧, 计入对应的链路
+ *
+ * @param link 链路
+ * @param msg_length 消息长度
+ * @param msg_data 消息数据
+ */
+static void bench_check(bench_link_t *link, uint32_t msg_length,
+                        const uint8_t *msg_data) {
+    uint32_t count;
+
+    if (msg_length != BENCH_LEN) {
+        ++link->corrupt;
+        return;
+    }
+
+    memcpy(&count, msg_data, sizeof(count));
+    for (uint32_t i = sizeof(count); i < BENCH_LEN; ++i) {
+        if (msg_data[i] != (uint8_t)(count + i)) {
+            ++link->corrupt;
+            return;
+        }
+    }
+
+    ++link->received;
+}
+
+/**
+ * @brief 不带纠错校验的 ID 的接收回调
+ */
+static void bench_plain_callback(uint32_t msg_length, uint8_t msg_id_type,
+                                 uint8_t *msg_data) {
+    (void)msg_id_type;
+    bench_check(&bench_links[0], msg_length, msg_data);
+}
+
+/**
+ * @brief 带纠错校验的 ID 的接收回调
+ */
+static void bench_fec_callback(uint32_t msg_length, uint8_t msg_id_type,
+                               uint8_t *msg_data) {
+    (void)msg_id_type;
+    bench_check(&bench_links[1], msg_length, msg_data);
+}
+
+/**
+ * @brief 当前时刻
+ *
+ * @return 单调时钟, 单位 ns
+ */
+static double bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * @brief 在一个 ID 上发送`frames`帧, 每帧注入误码后立即解包
+ *
+ * @param index 链路序号, 0 不带纠错校验, 1 带纠错校验
+ * @param frames 帧数
+ * @param ber 每个字节出错的概率
+ * @param seed 随机数种子, 两个 ID 使用相同的误码序列
+ */
+static void bench_run(uint32_t index, uint32_t frames, double ber,
+                      unsigned int seed) {
+    bench_link_t *link = &bench_links[index];
+    msg_id_t msg_id = (msg_id_t)(MSG_ID_1 + index);
+    uint8_t data[BENCH_LEN];
+
+    link->received = 0;
+    link->corrupt = 0;
+    link->encode_ns = 0;
+    link->decode_ns = 0;
+    message_reset_stats(msg_id);
+    srand(seed);
+
+    for (uint32_t count = 0; count < frames; ++count) {
+        memcpy(data, &count, sizeof(count));
+        for (uint32_t i = sizeof(count); i < BENCH_LEN; ++i) {
+            data[i] = (uint8_t)(count + i);
+        }
+
+        double t0 = bench_now_ns();
+        message_send_data(msg_id, MSG_DATA_UINT8, data, BENCH_LEN);
+        double t1 = bench_now_ns();
+        bench_deliver(link, ber);
+        double t2 = bench_now_ns();
+        message_polling_id(msg_id);
+        double t3 = bench_now_ns();
+
+        link->encode_ns += t1 - t0;
+        link->decode_ns += t3 - t2;
+        ++bench_tick;
+    }
+
+    /* 轮询先分发队列中已有的帧再读串口, 最后一帧要再轮询一次 */
+    message_polling_id(msg_id);
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 20000U;
+    double bers[16] = {0, 0.0001, 0.001, 0.003, 0.01};
+    uint32_t ber_num = 5;
+    bool failed = false;
+
+    if (frames == 0) {
+        frames = 1;
+    }
+
+    if (argc > 2) {
+        ber_num = 0;
+        for (int i = 2; (i < argc) && (ber_num < 16U); ++i) {
+            bers[ber_num++] = strtod(argv[i], NULL);
+        }
+    }
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        msg_id_t msg_id = (msg_id_t)(MSG_ID_1 + i);
+
+        if (!bench_link_init(&bench_links[i])) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        message_register_send_uart(msg_id, &bench_links[i].uart, BENCH_WIRE);
+        message_register_polling_uart(msg_id, &bench_links[i].uart,
+                                      BENCH_RECV_SIZE, BENCH_FIFO_SIZE);
+    }
+    message_register_recv_callback(MSG_ID_1, bench_plain_callback);
+    message_register_recv_callback(MSG_ID_2, bench_fec_callback);
+    message_register_fec(MSG_ID_2, 1);
+
+    printf("%u frames of %u bytes per error rate, FEC block %u\n", frames,
+           BENCH_LEN, MSG_FEC_BLOCK);
+    printf("  byte error   plain ok   fec ok   corrected  "
+           "encode ns (plain/fec)  decode ns (plain/fec)  undetected\n");
+
+    for (uint32_t n = 0; n < ber_num; ++n) {
+        msg_stats_t plain, fec;
+
+        bench_run(0, frames, bers[n], 1U + n);
+        bench_run(1, frames, bers[n], 1U + n);
+        message_get_stats(MSG_ID_1, &plain);
+        message_get_stats(MSG_ID_2, &fec);
+
+        printf("  %10.4f  %8.2f%%  %6.2f%%  %10u  %9.0f / %-9.0f  "
+               "%9.0f / %-9.0f  %u / %u\n",
+               bers[n], 100.0 * bench_links[0].received / frames,
+               100.0 * bench_links[1].received / frames, fec.fec_corrected,
+               bench_links[0].encode_ns / frames,
+               bench_links[1].encode_ns / frames,
+               bench_links[0].decode_ns / frames,
+               bench_links[1].decode_ns / frames, bench_links[0].corrupt,
+               bench_links[1].corrupt);
+
+        if ((bers[n] == 0) && ((bench_links[0].received != frames) ||
+                               (bench_links[1].received != frames) ||
+                               (plain.fec_corrected != 0) ||
+                               (fec.fec_corrected != 0))) {
+            failed = true;
+        }
+    }
+
+    if (failed) {
+        fprintf(stderr, "frames lost or corrected on a clean link\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file    gateway_bench.c
+ * @author  Deadline039
+ * @brief   网关回放基准测试: 把录制的字节流并行回放给多条流水线
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   gateway_bench gen <file> <frames>        用协议层编码生成测试字节流
+ *   gateway_bench run <repeat> <file>...     每个文件一条流水线, 回放
+ *                                            `repeat`次, 统计吞吐量
+ * 录制的字节流可以是`cat /dev/ttyUSB0 > link.bin`得到的原始数据
+ *****************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include "msg_gateway.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief 回放线程参数
+ */
+typedef struct {
+    int fd;              /*!< 管道写端 */
+    const uint8_t *data; /*!< 字节流 */
+    size_t len;          /*!< 字节流长度 */
+    uint32_t repeat;     /*!< 回放次数 */
+} bench_feed_t;
+
+/**
+ * @brief 当前时间
+ *
+ * @return 秒
+ */
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 回放线程, 把字节流写入管道, 写完关闭
+ *
+ * @param arg 回放线程参数
+ * @return `NULL`
+ */
+static void *bench_feed(void *arg) {
+    bench_feed_t *feed = arg;
+    size_t off;
+    ssize_t n;
+
+    for (uint32_t i = 0; i < feed->repeat; ++i) {
+        for (off = 0; off < feed->len; off += (size_t)n) {
+            n = write(feed->fd, feed->data + off, feed->len - off);
+            if (n <= 0) {
+                break;
+            }
+        }
+    }
+
+    close(feed->fd);
+    return NULL;
+}
+
+/**
+ * @brief 生成测试字节流
+ *
+ * @param path 文件路径
+ * @param frames 帧数
+ * @return 进程退出码
+ */
+static int bench_gen(const char *path, uint32_t frames) {
+    msg_host_link_t *link;
+    uint8_t data[200];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    link = (fd < 0) ? NULL : msg_host_link_attach(fd, 65536);
+    if (link == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    message_register_send_uart(MSG_ID_1, link, 256);
+    for (uint32_t i = 0; i < frames; ++i) {
+        /* 长度字节不转义, 0x7F 与结束符相同, 跳过 */
+        uint32_t len = 8 + i % 120;
+        if (len == MSG_EOF) {
+            --len;
+        }
+        for (uint32_t j = 0; j < len; ++j) {
+            data[j] = (uint8_t)(i * 7 + j);
+        }
+        message_send_data(MSG_ID_1, MSG_DATA_UINT8, data, len);
+    }
+
+    msg_host_link_close(link);
+    return 0;
+}
+
+/**
+ * @brief 回放并统计吞吐量
+ *
+ * @param repeat 回放次数
+ * @param paths 文件路径
+ * @param count 文件个数
+ * @return 进程退出码
+ */
+static int bench_run(uint32_t repeat, char **paths, uint32_t count) {
+    bench_feed_t feeds[MSG_ID_RESERVE_LEN];
+    pthread_t threads[MSG_ID_RESERVE_LEN];
+    msg_gateway_stats_t stats;
+    msg_gateway_frame_t *frame;
+    msg_gateway_t *gateway;
+    msg_host_link_t *links[MSG_ID_RESERVE_LEN];
+    uint64_t frames = 0, bytes = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double start, last;
+    uint32_t i, closed, idle = 0;
+    struct stat st;
+    int fds[2];
+
+    if (count > MSG_ID_RESERVE_LEN) {
+        fprintf(stderr, "at most %d links\n", MSG_ID_RESERVE_LEN);
+        return 1;
+    }
+
+    gateway = msg_gateway_create();
+    for (i = 0; i < count; ++i) {
+        int fd = open(paths[i], O_RDONLY);
+        msg_id_t id = (msg_id_t)i;
+
+        if ((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size == 0)) {
+            perror(paths[i]);
+            return 1;
+        }
+
+        feeds[i].data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                             fd, 0);
+        feeds[i].len = (size_t)st.st_size;
+        feeds[i].repeat = repeat;
+        close(fd);
+
+        if (pipe(fds) != 0) {
+            return 1;
+        }
+        fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+        feeds[i].fd = fds[1];
+
+        links[i] = msg_host_link_attach(fds[0], 1U << 16);
+        message_register_polling_uart(id, links[i], 4096, 1U << 14);
+        /* 流水线分散到各个 CPU, 消费者在主线程 */
+        msg_gateway_add_link(gateway, links[i], &id, 1, (int)(i % cpus), 4096);
+    }
+
+    start = bench_now();
+    last = start;
+    msg_gateway_start(gateway);
+    for (i = 0; i < count; ++i) {
+        pthread_create(&threads[i], NULL, bench_feed, &feeds[i]);
+    }
+
+    /* 所有链路断开并且一段时间没有新帧就结束 */
+    while (idle < 5) {
+        frame = msg_gateway_pop(gateway, 20);
+        if (frame != NULL) {
+            ++frames;
+            bytes += frame->len;
+            last = bench_now();
+            idle = 0;
+            msg_gateway_release(gateway, frame);
+            continue;
+        }
+
+        for (i = 0, closed = 0; i < count; ++i) {
+            msg_gateway_get_stats(gateway, i, &stats);
+            closed += stats.closed;
+        }
+        idle = (closed == count) ? idle + 1 : 0;
+    }
+
+    for (i = 0; i < count; ++i) {
+        pthread_join(threads[i], NULL);
+        msg_gateway_get_stats(gateway, i, &stats);
+        printf("link %u: %llu bytes, %llu frames, %llu stalls, max in flight "
+               "%u\n",
+               i, (unsigned long long)stats.rx_bytes,
+               (unsigned long long)stats.frames,
+               (unsigned long long)stats.stalls, stats.max_in_flight);
+    }
+
+    printf("%u links on %ld cpus: %llu frames in %.3f s, %.0f frames/s, "
+           "%.1f MB/s payload\n",
+           count, cpus, (unsigned long long)frames, last - start,
+           (double)frames / (last - start),
+           (double)bytes / (last - start) / 1e6);
+
+    msg_gateway_destroy(gateway);
+    for (i = 0; i < count; ++i) {
+        msg_host_link_close(links[i]);
+        munmap((void *)feeds[i].data, feeds[i].len);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if ((argc == 4) && (strcmp(argv[1], "gen") == 0)) {
+        return bench_gen(argv[2], (uint32_t)strtoul(argv[3], NULL, 0));
+    }
+
+    if ((argc >= 4) && (strcmp(argv[1], "run") == 0)) {
+        return bench_run((uint32_t)strtoul(argv[2], NULL, 0), &argv[3],
+                         (uint32_t)(argc - 3));
+    }
+
+    fprintf(stderr, "usage: %s gen <file> <frames>\n"
+                    "       %s run <repeat> <file>...\n",
+            argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,753 @@
+/**
+ * @file    msg_index.c
+ * @author  Deadline039
+ * @brief   原始字节流离线分析: 内存映射, 并行分块解包, 按 ID 建立帧偏移索引
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   msg_index build [-j threads] [-s] [-f] <dump>
+ *                                                建立索引`<dump>.idx`
+ *   msg_index stats [-j threads] [-s] [-f] <dump>
+ *                                                每个 ID 的帧数和错误率
+ *   msg_index query [-j threads] [-s] [-f] [-b baud] <dump> <id> [t0 t1]
+ *                                                打印某个 ID 在 [t0, t1)
+ *                                                之间的帧
+ * 原始字节流直接从链路保存, 例如`cat /dev/ttyUSB0 > link.bin`. 字节流没有
+ * 时间戳, 指定波特率`-b`时 t0 t1 单位为秒 (按连续传输换算), 否则为字节偏移.
+ * `-s`表示帧头带序号 (`MSG_ENABLE_SEQUENCE`), `-f`表示帧尾带纠错校验
+ * (`MSG_ENABLE_FEC`). 帧由 msg_protocol.c 解包, 每个线程用一个 ID 的接收
+ * 队列, 线程数不超过`MSG_ID_RESERVE_LEN`. 启用`MSG_ENABLE_EXT_ID`编译时
+ * 最多 256 个 ID. 索引过期 (字节流大小或修改时间变化) 时自动重建
+ * 编译 (需要启用`MSG_ENABLE_STATISTICS`, 不能启用`MSG_ENABLE_RESYNC`):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/msg_index.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c host/msg_host.c
+ *       -lpthread
+ *****************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include "msg_host.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !MSG_ENABLE_STATISTICS || MSG_ENABLE_RESYNC
+/* 靠错误计数区分被丢弃的帧和被转义的结束符, 重新同步会让帧结尾不确定 */
+#error "msg_index requires MSG_ENABLE_STATISTICS without MSG_ENABLE_RESYNC"
+#endif /* !MSG_ENABLE_STATISTICS || MSG_ENABLE_RESYNC */
+
+#if MSG_ENABLE_EXT_ID
+/* 扩展 ID 占 1 byte */
+#define INDEX_ID_NUM   256
+#else  /* MSG_ENABLE_EXT_ID */
+/* 帧中 ID 只有 4 bit */
+#define INDEX_ID_NUM   16
+#endif /* MSG_ENABLE_EXT_ID */
+#define INDEX_MAGIC    "MSGI"
+#define INDEX_VERSION  3
+/* 每个线程用一个 ID 解包 */
+#define INDEX_MAX_JOBS MSG_ID_RESERVE_LEN
+
+/* 解包时每个 ID 的接收缓冲区和队列大小 */
+#define INDEX_BUF_SIZE 4096U
+
+#define INDEX_FLAG_SEQUENCE 0x01U /*!< 帧头带序号 */
+#define INDEX_FLAG_FEC      0x02U /*!< 帧尾带纠错校验 */
+
+/**
+ * @brief 帧状态
+ */
+typedef enum {
+    INDEX_FRAME_OK = 0,    /*!< 正确 */
+    INDEX_FRAME_LENGTH,    /*!< 长度不一致或帧太长 */
+    INDEX_FRAME_CRC,       /*!< CRC8 校验错误 */
+    INDEX_FRAME_FEC,       /*!< 纠错失败 */
+} index_status_t;
+
+/**
+ * @brief 索引项, 按 ID 分组, 组内按偏移排序
+ */
+typedef struct {
+    uint64_t offset; /*!< 帧在字节流中的起始偏移 */
+    uint16_t size;   /*!< 帧在字节流中的长度 (转义后, 含结束符) */
+    uint8_t id_type; /*!< 消息 ID 和数据类型 */
+    uint8_t status;  /*!< 帧状态`index_status_t` */
+    uint8_t len;     /*!< 数据长度 */
+    uint8_t id;      /*!< 消息 ID, 包括扩展 ID */
+    uint8_t reserved[2];
+} index_entry_t;
+
+/**
+ * @brief 每个 ID 的汇总
+ */
+typedef struct {
+    uint64_t first;    /*!< 第一个索引项的序号 */
+    uint64_t count;    /*!< 索引项个数 */
+    uint64_t crc;      /*!< CRC8 校验错误数 */
+    uint64_t length;   /*!< 长度错误数 */
+    uint64_t fec;      /*!< 纠错失败数 */
+} index_id_t;
+
+/**
+ * @brief 索引文件头
+ */
+typedef struct {
+    char magic[4];                     /*!< "MSGI" */
+    uint32_t version;                  /*!< 版本 */
+    uint64_t dump_size;                /*!< 字节流大小 */
+    int64_t dump_mtime;                /*!< 字节流修改时间 */
+    uint32_t flags;                    /*!< 帧格式`INDEX_FLAG_*` */
+    uint32_t reserved;
+    index_id_t ids[INDEX_ID_NUM];      /*!< 每个 ID 的汇总 */
+} index_header_t;
+
+/**
+ * @brief 可增长的索引项数组
+ */
+typedef struct {
+    index_entry_t *items;
+    uint64_t count;
+    uint64_t capacity;
+} index_list_t;
+
+/**
+ * @brief 一个分块的解包任务
+ */
+typedef struct {
+    const uint8_t *dump;               /*!< 整个字节流 */
+    uint64_t size;                     /*!< 字节流大小 */
+    uint64_t begin;                    /*!< 分块起始 */
+    uint64_t stop;                     /*!< 结束符不在这之前的第一帧是最后一帧 */
+    msg_id_t id;                       /*!< 解包用的 ID */
+    msg_host_link_t *link;             /*!< 送入字节流的链路 */
+    uint8_t flags;                     /*!< 帧格式`INDEX_FLAG_*` */
+    uint8_t print;                     /*!< 回调时打印数据 */
+    uint8_t delivered;                 /*!< 当前帧已经回调 */
+    index_entry_t entry;               /*!< 当前帧 */
+    uint32_t crc;                      /*!< 上次读取的 CRC8 错误计数 */
+    uint32_t fec;                      /*!< 上次读取的纠错失败计数 */
+    uint32_t length;                   /*!< 上次读取的长度错误计数 */
+    pthread_t thread;
+    index_list_t lists[INDEX_ID_NUM];  /*!< 每个 ID 的索引项 */
+} index_job_t;
+
+/* 每个 ID 的链路, 同一个 ID 只注册一次 */
+static msg_host_link_t *index_links[MSG_ID_RESERVE_LEN];
+/* 当前线程的解包任务, 回调中使用 */
+static __thread index_job_t *index_current;
+
+/**
+ * @brief 添加索引项
+ *
+ * @param list 数组
+ * @param entry 索引项
+ */
+static void index_list_add(index_list_t *list, const index_entry_t *entry) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->items = realloc(list->items,
+                              list->capacity * sizeof(index_entry_t));
+        if (list->items == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    list->items[list->count++] = *entry;
+}
+
+/**
+ * @brief 接收回调, 记录帧头, 查询时打印数据
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void index_callback(uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data) {
+    index_job_t *job = index_current;
+
+    job->delivered = 1;
+    job->entry.id_type = msg_id_type;
+    job->entry.id = msg_id_type >> 4;
+    job->entry.len = (uint8_t)msg_length;
+
+#if MSG_ENABLE_EXT_ID
+    if ((msg_id_type >> 4) == MSG_ID_EXT) {
+        /* 扩展 ID 在长度之前, 启用序号时还隔着 1 byte 序号 */
+        job->entry.id =
+            msg_data[(job->flags & INDEX_FLAG_SEQUENCE) ? -3 : -2];
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+
+    if (job->print) {
+        for (uint32_t i = 0; i < msg_length; ++i) {
+            printf("%02x", msg_data[i]);
+        }
+    }
+}
+
+/**
+ * @brief 初始化解包任务, 第一次使用某个 ID 时注册链路
+ *
+ * @param job 解包任务
+ * @param id 解包用的 ID
+ * @param flags 帧格式`INDEX_FLAG_*`
+ */
+static void index_job_init(index_job_t *job, msg_id_t id, uint8_t flags) {
+    memset(job, 0, sizeof(index_job_t));
+    job->id = id;
+    job->flags = flags;
+
+    if (index_links[id] == NULL) {
+        /* 链路只用来存放送入的字节, 发送写到 /dev/null */
+        index_links[id] =
+            msg_host_link_attach(open("/dev/null", O_RDWR), INDEX_BUF_SIZE);
+        message_register_polling_uart(id, index_links[id], INDEX_BUF_SIZE,
+                                      INDEX_BUF_SIZE);
+        message_register_recv_callback(id, index_callback);
+#if MSG_ENABLE_SEQUENCE
+        message_register_sequence(id, flags & INDEX_FLAG_SEQUENCE);
+#endif /* MSG_ENABLE_SEQUENCE */
+#if MSG_ENABLE_FEC
+        message_register_fec(id, (flags & INDEX_FLAG_FEC) ? 1 : 0);
+#endif /* MSG_ENABLE_FEC */
+    }
+
+    job->link = index_links[id];
+}
+
+/**
+ * @brief 送入字节流直到下一个结束符, 解包并判断帧是否结束
+ *
+ * @param job 解包任务
+ * @param data 字节流, 只有最后一个字节可能是结束符
+ * @param n 长度
+ * @return 帧已经结束 (回调或者被丢弃) 返回 1, `job->entry.status`为帧状态;
+ *         结束符被转义或者没有结束符返回 0
+ * @note 队列中的帧出队时才校验, 被丢弃的帧没有回调, 只能从错误计数的变化
+ *       判断. 一帧的结尾一定是没有被转义的结束符, 所以不会漏掉
+ */
+static uint8_t index_feed(index_job_t *job, const uint8_t *data, uint64_t n) {
+    msg_host_link_t *link = job->link;
+    msg_stats_t stats;
+    uint32_t length;
+
+    job->delivered = 0;
+    for (uint64_t done = 0; done < n;) {
+        done += msg_host_link_inject(
+            link, data + done,
+            (n - done > INDEX_BUF_SIZE) ? INDEX_BUF_SIZE : (uint32_t)(n - done));
+        while (link->rx_tail != link->rx_head) {
+            message_polling_id(job->id);
+        }
+    }
+
+    /* 最后读出的帧在下一次轮询时才出队 */
+    message_polling_id(job->id);
+    if (job->delivered) {
+        job->entry.status = INDEX_FRAME_OK;
+        return 1;
+    }
+
+    message_get_stats(job->id, &stats);
+    length = stats.recv_error + stats.recv_oversize;
+    if (stats.crc_check_error != job->crc) {
+        job->entry.status = INDEX_FRAME_CRC;
+    } else if (stats.fec_uncorrectable != job->fec) {
+        job->entry.status = INDEX_FRAME_FEC;
+    } else if (length != job->length) {
+        job->entry.status = INDEX_FRAME_LENGTH;
+    } else {
+        return 0;
+    }
+
+    job->crc = stats.crc_check_error;
+    job->fec = stats.fec_uncorrectable;
+    job->length = length;
+    return 1;
+}
+
+/**
+ * @brief 读出被丢弃的帧的帧头, 只用来按 ID 归类错误
+ *
+ * @param dump 字节流
+ * @param pos 帧起始
+ * @param end 帧结尾 (结束符之后)
+ * @param[out] entry 索引项
+ */
+static void index_head(const uint8_t *dump, uint64_t pos, uint64_t end,
+                       index_entry_t *entry) {
+    uint8_t head[3] = {0};
+    uint32_t n = 0, ext_len = 0;
+    uint8_t escape = 0;
+
+    for (; (pos + 1 < end) && (n < sizeof(head)); ++pos) {
+#ifdef MSG_ESC
+        if ((dump[pos] == MSG_ESC) && !escape) {
+            escape = 1;
+            continue;
+        }
+#endif /* MSG_ESC */
+        escape = 0;
+        head[n++] = dump[pos];
+    }
+
+    entry->id_type = head[0];
+    entry->id = head[0] >> 4;
+#if MSG_ENABLE_EXT_ID
+    if ((head[0] >> 4) == MSG_ID_EXT) {
+        ext_len = 1;
+        entry->id = head[1];
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+    entry->len = head[1 + ext_len];
+    (void)escape;
+}
+
+/**
+ * @brief 解包一个分块, 记录从块内第一个帧结尾之后开始的帧
+ *
+ * @param arg 解包任务
+ * @return `NULL`
+ * @note 第一块从字节流开头解包. 其他块从任意位置开始, 解包状态与字节流
+ *       不一致, 丢弃第一帧, 之后的帧结尾与前一块相同, 两块在这里衔接.
+ *       最后一帧可以越过分块结尾
+ */
+static void *index_decode(void *arg) {
+    index_job_t *job = arg;
+    const uint8_t *dump = job->dump, *eof;
+    uint64_t start = job->begin, pos = job->begin, end;
+    uint8_t synced = (job->begin == 0);
+
+    index_current = job;
+    while (pos < job->size) {
+        eof = memchr(dump + pos, MSG_EOF, job->size - pos);
+        end = (eof == NULL) ? job->size : (uint64_t)(eof - dump) + 1;
+
+        if ((start == pos) && (end == pos + 1)) {
+            /* 连续的结束符, 不是帧, 解包也会丢弃, 不用送入 */
+        } else if (!index_feed(job, dump + pos, end - pos)) {
+            /* 结束符被转义, 帧还没有结束 */
+            pos = end;
+            continue;
+        } else if (synced) {
+            if (job->entry.status != INDEX_FRAME_OK) {
+                index_head(dump, start, end, &job->entry);
+            }
+            job->entry.offset = start;
+            job->entry.size =
+                (end - start > 0xFFFF) ? 0xFFFF : (uint16_t)(end - start);
+            index_list_add(&job->lists[job->entry.id], &job->entry);
+        }
+
+        synced = 1;
+        start = end;
+        pos = end;
+        if (end > job->stop) {
+            break;
+        }
+    }
+
+    if (start != pos) {
+        /* 字节流结尾的半帧留在解包状态中, 查询时还要复用这个 ID. 第一个结束符
+         * 可能被转义, 第二个一定能结束这一帧 */
+        static const uint8_t flush[2] = {MSG_EOF, MSG_EOF};
+        index_feed(job, flush, sizeof(flush));
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 索引文件路径
+ *
+ * @param dump_path 字节流路径
+ * @return 索引文件路径, 需要释放
+ */
+static char *index_path(const char *dump_path) {
+    char *path = malloc(strlen(dump_path) + 5);
+    sprintf(path, "%s.idx", dump_path);
+    return path;
+}
+
+/**
+ * @brief 映射整个文件
+ *
+ * @param path 文件路径
+ * @param[out] st 文件信息
+ * @return 映射地址, 失败返回`NULL`
+ */
+static const uint8_t *index_map(const char *path, struct stat *st) {
+    const uint8_t *map;
+    int fd = open(path, O_RDONLY);
+
+    if ((fd < 0) || (fstat(fd, st) != 0)) {
+        perror(path);
+        return NULL;
+    }
+
+    if (st->st_size == 0) {
+        close(fd);
+        return (const uint8_t *)"";
+    }
+
+    map = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    return map;
+}
+
+/**
+ * @brief 并行解包字节流并写出索引文件
+ *
+ * @param dump_path 字节流路径
+ * @param jobs 线程数
+ * @param flags 帧格式`INDEX_FLAG_*`
+ * @return 成功返回 0
+ */
+static int index_build(const char *dump_path, uint32_t jobs, uint8_t flags) {
+    static index_job_t job[INDEX_MAX_JOBS];
+    index_header_t header = {.magic = INDEX_MAGIC, .version = INDEX_VERSION};
+    const uint8_t *dump;
+    char *path = index_path(dump_path);
+    uint64_t chunk, total = 0;
+    struct stat st;
+    FILE *file;
+    uint32_t i, k;
+
+    dump = index_map(dump_path, &st);
+    if (dump == NULL) {
+        return 1;
+    }
+
+    if (st.st_size < (off_t)(jobs * 4096)) {
+        /* 太小了不值得分块 */
+        jobs = 1;
+    }
+
+    madvise((void *)dump, (size_t)st.st_size, MADV_SEQUENTIAL);
+    chunk = (uint64_t)st.st_size / jobs;
+    for (i = 0; i < jobs; ++i) {
+        /* 注册不是线程安全的, 在创建线程之前完成 */
+        index_job_init(&job[i], (msg_id_t)i, flags);
+        job[i].dump = dump;
+        job[i].size = (uint64_t)st.st_size;
+        job[i].begin = chunk * i;
+        job[i].stop = (uint64_t)st.st_size;
+#ifdef MSG_ESC
+        if (i != 0) {
+            /* 转义符之后的字节可能被转义, 从第一个不是转义符的字节之后开始,
+             * 解包的转义状态才与字节流一致 */
+            while ((job[i].begin < job[i].size) &&
+                   (dump[job[i].begin] == MSG_ESC)) {
+                ++job[i].begin;
+            }
+            if (job[i].begin < job[i].size) {
+                ++job[i].begin;
+            }
+        }
+#endif /* MSG_ESC */
+    }
+
+    for (i = 0; i < jobs; ++i) {
+        if (i + 1 < jobs) {
+            job[i].stop = job[i + 1].begin;
+        }
+        pthread_create(&job[i].thread, NULL, index_decode, &job[i]);
+    }
+
+    for (i = 0; i < jobs; ++i) {
+        pthread_join(job[i].thread, NULL);
+    }
+
+    header.dump_size = (uint64_t)st.st_size;
+    header.dump_mtime = (int64_t)st.st_mtime;
+    header.flags = flags;
+    for (k = 0; k < INDEX_ID_NUM; ++k) {
+        header.ids[k].first = total;
+        for (i = 0; i < jobs; ++i) {
+            for (uint64_t e = 0; e < job[i].lists[k].count; ++e) {
+                uint8_t status = job[i].lists[k].items[e].status;
+                header.ids[k].crc += (status == INDEX_FRAME_CRC);
+                header.ids[k].length += (status == INDEX_FRAME_LENGTH);
+                header.ids[k].fec += (status == INDEX_FRAME_FEC);
+            }
+            header.ids[k].count += job[i].lists[k].count;
+        }
+        total += header.ids[k].count;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    /* 分块按顺序拼接, 每个 ID 内仍然按偏移排序 */
+    for (k = 0; k < INDEX_ID_NUM; ++k) {
+        for (i = 0; i < jobs; ++i) {
+            fwrite(job[i].lists[k].items, sizeof(index_entry_t),
+                   job[i].lists[k].count, file);
+            free(job[i].lists[k].items);
+        }
+    }
+
+    fclose(file);
+    free(path);
+    if (st.st_size != 0) {
+        munmap((void *)dump, (size_t)st.st_size);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 打开索引, 不存在或过期时重建
+ *
+ * @param dump_path 字节流路径
+ * @param jobs 重建时的线程数
+ * @param flags 帧格式`INDEX_FLAG_*`
+ * @param[out] size 索引文件大小
+ * @return 索引文件映射, 失败返回`NULL`
+ */
+static const index_header_t *index_open(const char *dump_path, uint32_t jobs,
+                                        uint8_t flags, size_t *size) {
+    const index_header_t *header;
+    char *path = index_path(dump_path);
+    struct stat dump_st, st;
+
+    if (stat(dump_path, &dump_st) != 0) {
+        perror(dump_path);
+        return NULL;
+    }
+
+    for (uint32_t tries = 0; tries < 2; ++tries) {
+        header = NULL;
+        if (access(path, R_OK) == 0) {
+            header = (const index_header_t *)index_map(path, &st);
+        }
+        if ((header != NULL) && ((size_t)st.st_size >= sizeof(*header)) &&
+            (memcmp(header->magic, INDEX_MAGIC, 4) == 0) &&
+            (header->version == INDEX_VERSION) &&
+            (header->dump_size == (uint64_t)dump_st.st_size) &&
+            (header->dump_mtime == (int64_t)dump_st.st_mtime) &&
+            (header->flags == flags)) {
+            *size = (size_t)st.st_size;
+            free(path);
+            return header;
+        }
+
+        if ((header != NULL) && (st.st_size != 0)) {
+            munmap((void *)header, (size_t)st.st_size);
+        }
+
+        if ((tries == 0) && (index_build(dump_path, jobs, flags) != 0)) {
+            break;
+        }
+    }
+
+    free(path);
+    return NULL;
+}
+
+/**
+ * @brief 打印每个 ID 的帧数和错误率
+ *
+ * @param header 索引
+ */
+static void index_stats(const index_header_t *header) {
+    printf("id  frames      crc_err     len_err     fec_err     crc_rate\n");
+    for (uint32_t k = 0; k < INDEX_ID_NUM; ++k) {
+        const index_id_t *id = &header->ids[k];
+        if (id->count == 0) {
+            continue;
+        }
+
+        printf("%-3u %-11llu %-11llu %-11llu %-11llu %.6f\n", k,
+               (unsigned long long)id->count, (unsigned long long)id->crc,
+               (unsigned long long)id->length, (unsigned long long)id->fec,
+               (double)id->crc / (double)id->count);
+    }
+}
+
+/**
+ * @brief 二分查找第一个偏移不小于`offset`的索引项
+ *
+ * @param entries 索引项
+ * @param count 个数
+ * @param offset 偏移
+ * @return 序号
+ */
+static uint64_t index_lower_bound(const index_entry_t *entries, uint64_t count,
+                                  uint64_t offset) {
+    uint64_t low = 0, high = count, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (entries[mid].offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * @brief 打印某个 ID 在偏移范围内的帧, 正确的帧重新解包打印数据
+ *
+ * @param dump_path 字节流路径
+ * @param header 索引
+ * @param id 消息 ID
+ * @param begin 起始偏移
+ * @param end 结束偏移
+ * @param baud 波特率, 0 表示不换算时间
+ * @return 成功返回 0
+ */
+static int index_query(const char *dump_path, const index_header_t *header,
+                       uint32_t id, uint64_t begin, uint64_t end,
+                       uint32_t baud) {
+    static const char *status_name[] = {"ok", "len", "crc", "fec"};
+    static index_job_t job;
+    const index_entry_t *entries = (const index_entry_t *)(header + 1);
+    const index_id_t *summary = &header->ids[id];
+    const uint8_t *dump;
+    struct stat st;
+    uint64_t i;
+
+    dump = index_map(dump_path, &st);
+    if (dump == NULL) {
+        return 1;
+    }
+
+    /* 建立索引时解包停在帧结尾, 可以接着用 */
+    index_job_init(&job, (msg_id_t)0, (uint8_t)header->flags);
+    job.print = 1;
+    index_current = &job;
+
+    entries += summary->first;
+    for (i = index_lower_bound(entries, summary->count, begin);
+         (i < summary->count) && (entries[i].offset < end); ++i) {
+        const index_entry_t *entry = &entries[i];
+
+        if (baud != 0) {
+            printf("%.6f ", (double)entry->offset * 10.0 / baud);
+        }
+        printf("%llu %u %u %s ", (unsigned long long)entry->offset,
+               entry->id_type & 0x0F, entry->len, status_name[entry->status]);
+
+        if (entry->status == INDEX_FRAME_OK) {
+            /* 帧以没有被转义的结束符结尾, 解包后回到帧起始 */
+            index_feed(&job, dump + entry->offset, entry->size);
+        }
+        putchar('\n');
+    }
+
+    if (st.st_size != 0) {
+        munmap((void *)dump, (size_t)st.st_size);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 打印用法
+ *
+ * @param name 程序名
+ * @return 1
+ */
+static int index_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s build [-j threads] [-s] [-f] <dump>\n"
+            "       %s stats [-j threads] [-s] [-f] <dump>\n"
+            "       %s query [-j threads] [-s] [-f] [-b baud] <dump> <id> "
+            "[t0 t1]\n",
+            name, name, name);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const index_header_t *header;
+    uint32_t jobs = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t baud = 0, id;
+    uint8_t flags = 0;
+    uint64_t begin = 0, end = UINT64_MAX;
+    const char *cmd;
+    size_t size;
+    int opt, ret;
+
+    if (argc < 3) {
+        return index_usage(argv[0]);
+    }
+
+    cmd = argv[1];
+    optind = 2;
+    while ((opt = getopt(argc, argv, "j:sfb:")) != -1) {
+        if (opt == 'j') {
+            jobs = (uint32_t)strtoul(optarg, NULL, 0);
+#if MSG_ENABLE_SEQUENCE
+        } else if (opt == 's') {
+            flags |= INDEX_FLAG_SEQUENCE;
+#endif /* MSG_ENABLE_SEQUENCE */
+#if MSG_ENABLE_FEC
+        } else if (opt == 'f') {
+            flags |= INDEX_FLAG_FEC;
+#endif /* MSG_ENABLE_FEC */
+        } else if (opt == 'b') {
+            baud = (uint32_t)strtoul(optarg, NULL, 0);
+        } else {
+            return index_usage(argv[0]);
+        }
+    }
+
+    if ((optind >= argc) || (jobs == 0)) {
+        return index_usage(argv[0]);
+    }
+    if (jobs > INDEX_MAX_JOBS) {
+        jobs = INDEX_MAX_JOBS;
+    }
+
+    if (strcmp(cmd, "build") == 0) {
+        return index_build(argv[optind], jobs, flags);
+    }
+
+    header = index_open(argv[optind], jobs, flags, &size);
+    if (header == NULL) {
+        return 1;
+    }
+
+    if (strcmp(cmd, "stats") == 0) {
+        index_stats(header);
+        ret = 0;
+    } else if ((strcmp(cmd, "query") == 0) && (optind + 1 < argc)) {
+        id = (uint32_t)strtoul(argv[optind + 1], NULL, 0) % INDEX_ID_NUM;
+        if (optind + 3 < argc) {
+            /* 有波特率时按秒换算成字节偏移, 每字节 10 bit */
+            double scale = baud ? (double)baud / 10.0 : 1.0;
+            begin = (uint64_t)(strtod(argv[optind + 2], NULL) * scale);
+            end = (uint64_t)(strtod(argv[optind + 3], NULL) * scale);
+        }
+        ret = index_query(argv[optind], header, id, begin, end, baud);
+    } else {
+        ret = index_usage(argv[0]);
+    }
+
+    munmap((void *)header, size);
+    return ret;
+}
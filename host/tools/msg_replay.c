@@ -0,0 +1,214 @@
+/**
+ * @file    msg_replay.c
+ * @author  Deadline039
+ * @brief   录制日志回放: 把录制的原始字节重新送入解包
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   msg_replay [-r] [-p] <log>
+ *     -r 按录制时的时间间隔回放, 默认以最快速度回放, 用于解包基准测试
+ *     -p 打印每一帧 (ID, 类型, 长度, 数据), 输出可以作为回归测试的基准
+ * 日志由`message_record_dump`或`msg_host_record_open`生成
+ *****************************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include "msg_host.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* 回放时每个 ID 的接收缓冲区和队列大小 */
+#define REPLAY_BUF_SIZE  4096U
+#define REPLAY_FIFO_SIZE 16384U
+
+static uint8_t replay_print;
+static uint64_t replay_frames[MSG_ID_RESERVE_LEN];
+/* 正在轮询的 ID, 扩展 ID 不在帧头的高四位中 */
+static msg_id_t replay_id;
+
+/**
+ * @brief 当前时间
+ *
+ * @return 单位 us
+ */
+static uint64_t replay_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+/**
+ * @brief 接收回调, 计数并按需打印
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void replay_callback(uint32_t msg_length, uint8_t msg_id_type,
+                            uint8_t *msg_data) {
+    ++replay_frames[replay_id];
+
+    if (replay_print == 0) {
+        return;
+    }
+
+    printf("%u %2u %3u ", replay_id, msg_id_type & 0x0F, msg_length);
+    for (uint32_t i = 0; i < msg_length; ++i) {
+        printf("%02x", msg_data[i]);
+    }
+    putchar('\n');
+}
+
+/**
+ * @brief 解包某个 ID 接收缓冲区中的所有数据
+ *
+ * @param link 链路
+ * @param msg_id 数据含义
+ */
+static void replay_drain(msg_host_link_t *link, msg_id_t msg_id) {
+    replay_id = msg_id;
+    while (link->rx_tail != link->rx_head) {
+        message_polling_id(msg_id);
+    }
+}
+
+int main(int argc, char **argv) {
+    msg_host_link_t *links[MSG_ID_RESERVE_LEN] = {NULL};
+    const uint8_t *log, *pos, *end;
+    uint64_t start, bytes = 0, records = 0, frames = 0;
+    uint32_t stamp, first = 0, len, done;
+    uint8_t realtime = 0;
+    struct stat st;
+    msg_id_t id;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "rp")) != -1) {
+        if (opt == 'r') {
+            realtime = 1;
+        } else if (opt == 'p') {
+            replay_print = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-r] [-p] <log>\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-r] [-p] <log>\n", argv[0]);
+        return 1;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    log = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ((log == MAP_FAILED) || (st.st_size < 5) ||
+        (memcmp(log, MSG_RECORD_MAGIC, 4) != 0) ||
+        (log[4] != MSG_RECORD_VERSION)) {
+        fprintf(stderr, "%s: not a record log\n", argv[optind]);
+        return 1;
+    }
+    madvise((void *)log, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    pos = log + 5;
+    end = log + st.st_size;
+    start = replay_now_us();
+
+    while (end - pos >= MSG_RECORD_HEAD_SIZE) {
+        stamp = pos[0] | (pos[1] << 8) | (pos[2] << 16) | ((uint32_t)pos[3] << 24);
+        len = pos[4] | (pos[5] << 8);
+        id = (msg_id_t)pos[6];
+        pos += MSG_RECORD_HEAD_SIZE;
+
+        if ((uint32_t)(end - pos) < len) {
+            fprintf(stderr, "truncated record at offset %ld\n",
+                    (long)(pos - log - MSG_RECORD_HEAD_SIZE));
+            break;
+        }
+
+        if (id >= MSG_ID_RESERVE_LEN) {
+            /* 录制端的 ID 比本机多, 跳过 */
+            pos += len;
+            continue;
+        }
+
+        if (links[id] == NULL) {
+            /* 链路只用来存放回放的数据, 发送写到 /dev/null */
+            links[id] = msg_host_link_attach(open("/dev/null", O_RDWR),
+                                             REPLAY_FIFO_SIZE);
+            message_register_polling_uart(id, links[id], REPLAY_BUF_SIZE,
+                                          REPLAY_FIFO_SIZE);
+            message_register_recv_callback(id, replay_callback);
+        }
+
+        if (records == 0) {
+            first = stamp;
+        }
+
+        if (realtime) {
+            /* 按录制时的间隔等待, 时间戳溢出也能正确计算差值 */
+            uint64_t due = start + (uint32_t)(stamp - first);
+            uint64_t now = replay_now_us();
+            if (due > now) {
+                usleep((useconds_t)(due - now));
+            }
+        }
+
+        for (done = 0; done < len;) {
+            done += msg_host_link_inject(links[id], pos + done, len - done);
+            replay_drain(links[id], id);
+        }
+
+        pos += len;
+        bytes += len;
+        ++records;
+    }
+
+    /* 最后读出的帧在下一次轮询时才出队 */
+    for (id = 0; id < MSG_ID_RESERVE_LEN; ++id) {
+        replay_id = id;
+        message_polling_id(id);
+    }
+
+    double seconds = (double)(replay_now_us() - start) / 1e6;
+    for (id = 0; id < MSG_ID_RESERVE_LEN; ++id) {
+        if (links[id] == NULL) {
+            continue;
+        }
+
+        frames += replay_frames[id];
+#if MSG_ENABLE_STATISTICS
+        msg_stats_t stats;
+        message_get_stats(id, &stats);
+        fprintf(stderr,
+                "id %u: %llu frames, %u length errors, %u crc errors, "
+                "%u fifo overflows\n",
+                id, (unsigned long long)replay_frames[id], stats.recv_error,
+                stats.crc_check_error, stats.fifo_overflow);
+#else  /* MSG_ENABLE_STATISTICS */
+        fprintf(stderr, "id %u: %llu frames\n", id,
+                (unsigned long long)replay_frames[id]);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+
+    fprintf(stderr,
+            "%llu records, %llu bytes, %llu frames in %.3f s (%.1f MB/s)\n",
+            (unsigned long long)records, (unsigned long long)bytes,
+            (unsigned long long)frames, seconds,
+            (double)bytes / seconds / 1e6);
+
+    return 0;
+}
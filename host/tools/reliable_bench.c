@@ -0,0 +1,400 @@
+/**
+ * @file    reliable_bench.c
+ * @author  Deadline039
+ * @brief   可靠传输基准测试: 在模拟的丢帧串口上统计不同丢帧率下的有效吞吐量
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 用法:
+ *   reliable_bench [frames] [baud] [loss]...
+ *     frames 每个丢帧率下交付的帧数, 默认 5000
+ *     baud   链路的波特率, 默认 921600
+ *     loss   每帧丢失的概率, 可以给多个, 默认 0 0.01 0.02 0.05 0.1 0.2
+ * MSG_ID_1 使用可靠传输, 链路自发自收, 数据帧和应答帧在同一条链路上.
+ * 按波特率每毫秒把发送缓冲区中的字节搬到接收缓冲区, 时间是模拟的, 与主机
+ * 速度无关, 每毫秒轮询一次. 每一帧 (包括应答帧) 按给定的概率整帧丢弃,
+ * 相当于被干扰后校验失败. 发送端在链路积压不到 2 ms 的数据且窗口没满时
+ * 继续发送. 每个丢帧率下统计交付的有效吞吐量占链路速率的比例和每帧的
+ * 重传次数, 并检查是否按顺序交付了每一帧
+ * 编译 (需要在 msg_protocol.h 中启用`MSG_ENABLE_RELIABLE`,
+ * `MSG_ENABLE_SEQUENCE`和`MSG_ENABLE_STATISTICS`, 串口由本文件模拟,
+ * 不链接 msg_host.c):
+ *   gcc -O2 -Ihost -I. -If429-demo/User/Utils host/tools/reliable_bench.c
+ *       msg_protocol.c f429-demo/User/Utils/crc/crc.c
+ *****************************************************************************
+ */
+
+#include "msg_protocol.h"
+
+#if MSG_ENABLE_RTOS
+#include "semphr.h"
+#endif /* MSG_ENABLE_RTOS */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !MSG_ENABLE_RELIABLE || !MSG_ENABLE_STATISTICS
+#error "reliable_bench requires MSG_ENABLE_RELIABLE and MSG_ENABLE_STATISTICS"
+#endif /* !MSG_ENABLE_RELIABLE || !MSG_ENABLE_STATISTICS */
+
+/* 每帧数据长度, 前 4 byte 是帧计数 */
+#define BENCH_LEN       64U
+/* 一帧编码后的最大长度 */
+#define BENCH_WIRE      MSG_FRAME_WIRE_SIZE(BENCH_LEN)
+/* 发送和接收窗口大小 */
+#define BENCH_WINDOW    64U
+/* 链路积压不到这么多毫秒的数据时继续发送 */
+#define BENCH_AHEAD     2U
+/* 模拟串口的收发缓冲区大小 */
+#define BENCH_BUF_SIZE  (1U << 16)
+/* 接收缓冲区和队列大小 */
+#define BENCH_RECV_SIZE 1024U
+#define BENCH_FIFO_SIZE 8192U
+/* 每个丢帧率下最长运行的时间, 超过认为传输停滞 */
+#define BENCH_STALL     600000U
+
+/**
+ * @brief 模拟的丢帧串口链路
+ */
+typedef struct {
+    msg_host_link_t uart; /*!< 串口句柄, 发送缓冲区按速率搬到接收缓冲区 */
+    double rate;          /*!< 每毫秒发出的字节数 */
+    double credit;        /*!< 本毫秒还能发出的字节数 */
+    double loss;          /*!< 每帧丢失的概率 */
+    bool in_frame;        /*!< 是否在一帧中间 */
+    bool escaped;         /*!< 上一个字节是否是转义字符 */
+    bool dropping;        /*!< 当前帧是否丢弃 */
+} bench_link_t;
+
+static bench_link_t bench_link;
+static uint32_t bench_tick;
+
+static uint32_t bench_next;     /* 期望收到的下一个帧计数 */
+static uint32_t bench_received; /* 收到的帧数 */
+static uint32_t bench_disorder; /* 帧计数不连续的次数 */
+static uint32_t bench_corrupt;  /* 数据内容错误的帧数 */
+static uint32_t bench_dropped;  /* 链路丢弃的帧数, 包括应答帧 */
+static uint32_t bench_frames;   /* 链路上出现的帧数, 包括应答帧 */
+
+/**
+ * @brief 模拟的毫秒时基
+ *
+ * @return 当前时间, 单位 ms
+ */
+uint32_t HAL_GetTick(void) {
+    return bench_tick;
+}
+
+msg_host_core_debug_t msg_host_core_debug;
+
+/**
+ * @brief 模拟 DWT 周期计数器, 跟随模拟时基, 计数单位是 us
+ *
+ * @return DWT 寄存器
+ */
+msg_host_dwt_t *msg_host_dwt(void) {
+    static msg_host_dwt_t dwt;
+    dwt.CYCCNT = bench_tick * 1000U;
+    return &dwt;
+}
+
+/**
+ * @brief 单线程运行, 临界区不需要锁
+ */
+void msg_host_critical_enter(void) {
+}
+
+void msg_host_critical_exit(void) {
+}
+
+#if MSG_ENABLE_RTOS
+/**
+ * @brief 单线程运行, 互斥量不需要锁
+ */
+SemaphoreHandle_t msg_host_mutex_create(void) {
+    static uint8_t dummy;
+    return (SemaphoreHandle_t)&dummy;
+}
+
+BaseType_t msg_host_mutex_take(SemaphoreHandle_t mutex, TickType_t wait) {
+    (void)mutex;
+    (void)wait;
+    return pdTRUE;
+}
+
+BaseType_t msg_host_mutex_give(SemaphoreHandle_t mutex) {
+    (void)mutex;
+    return pdTRUE;
+}
+#endif /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 写入发送缓冲区
+ *
+ * @param huart 串口句柄
+ * @param data 数据
+ * @param len 数据长度
+ * @return 写入的字节数, 缓冲区满时截断
+ */
+uint32_t uart_dmatx_write(UART_HandleTypeDef *huart, const void *data,
+                          size_t len) {
+    uint32_t space = huart->tx_size - huart->tx_len;
+
+    if (len > space) {
+        len = space;
+    }
+
+    memcpy(huart->tx_buf + huart->tx_len, data, len);
+    huart->tx_len += (uint32_t)len;
+    return (uint32_t)len;
+}
+
+/**
+ * @brief 开始发送, 模拟的串口一直在按速率发送, 这里什么也不做
+ *
+ * @param huart 串口句柄
+ * @return 待发送的字节数
+ */
+uint32_t uart_dmatx_send(UART_HandleTypeDef *huart) {
+    return huart->tx_len;
+}
+
+/**
+ * @brief 发送缓冲区大小
+ *
+ * @param huart 串口句柄
+ * @return 字节数
+ */
+uint32_t uart_damtx_get_buf_szie(UART_HandleTypeDef *huart) {
+    return huart->tx_size;
+}
+
+/**
+ * @brief 阻塞发送, 同样写入发送缓冲区
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+    (void)Timeout;
+    return (uart_dmatx_write(huart, pData, Size) == Size) ? HAL_OK : HAL_BUSY;
+}
+
+/**
+ * @brief 读出接收缓冲区
+ *
+ * @param huart 串口句柄
+ * @param buf 读出的位置
+ * @param len 最多读出的字节数
+ * @return 读出的字节数
+ */
+uint32_t uart_dmarx_read(UART_HandleTypeDef *huart, void *buf, size_t len) {
+    uint32_t n = 0;
+
+    while ((n < len) && (huart->rx_head != huart->rx_tail)) {
+        ((uint8_t *)buf)[n++] = huart->rx_buf[huart->rx_head & huart->rx_mask];
+        ++huart->rx_head;
+    }
+
+    return n;
+}
+
+/**
+ * @brief 初始化模拟链路
+ *
+ * @param link 链路
+ * @param baud 波特率
+ * @return 是否成功
+ */
+static bool bench_link_init(bench_link_t *link, uint32_t baud) {
+    memset(link, 0, sizeof(bench_link_t));
+    link->uart.hdmatx = &link->uart;
+    link->uart.tx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.tx_size = BENCH_BUF_SIZE;
+    link->uart.rx_buf = malloc(BENCH_BUF_SIZE);
+    link->uart.rx_mask = BENCH_BUF_SIZE - 1U;
+    /* 1 位起始位, 8 位数据, 1 位停止位 */
+    link->rate = (double)baud / 10.0 / 1000.0;
+
+    return (link->uart.tx_buf != NULL) && (link->uart.rx_buf != NULL);
+}
+
+/**
+ * @brief 模拟 1 ms: 按速率把发送缓冲区中的字节搬到接收缓冲区,
+ *        每一帧开始时决定是否整帧丢弃
+ */
+static void bench_step(void) {
+    bench_link_t *link = &bench_link;
+    msg_host_link_t *uart = &link->uart;
+    uint32_t n;
+
+    link->credit += link->rate;
+    n = (uint32_t)link->credit;
+    if (n > uart->tx_len) {
+        n = uart->tx_len;
+    }
+
+    for (uint32_t j = 0; j < n; ++j) {
+        uint8_t byte = uart->tx_buf[j];
+
+        if (!link->in_frame) {
+            link->in_frame = true;
+            link->dropping = (link->loss > 0) &&
+                             ((double)rand() / RAND_MAX < link->loss);
+            ++bench_frames;
+            if (link->dropping) {
+                ++bench_dropped;
+            }
+        }
+
+        if (!link->dropping) {
+            uart->rx_buf[uart->rx_tail & uart->rx_mask] = byte;
+            ++uart->rx_tail;
+        }
+
+        /* 转义后的结束符是数据, 不是帧尾 */
+        if (link->escaped) {
+            link->escaped = false;
+        } else if (byte == MSG_ESC) {
+            link->escaped = true;
+        } else if (byte == MSG_EOF) {
+            link->in_frame = false;
+        }
+    }
+
+    uart->tx_len -= n;
+    memmove(uart->tx_buf, uart->tx_buf + n, uart->tx_len);
+
+    /* 空闲时不积累发送能力 */
+    link->credit = (uart->tx_len != 0) ? link->credit - n : 0;
+}
+
+/**
+ * @brief 可靠传输 ID 的接收回调, 检查帧计数是否连续和数据内容
+ *
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param[in] msg_data 消息数据
+ */
+static void bench_callback(uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data) {
+    uint32_t count;
+
+    (void)msg_id_type;
+
+    if (msg_length != BENCH_LEN) {
+        ++bench_corrupt;
+        return;
+    }
+
+    memcpy(&count, msg_data, sizeof(count));
+    for (uint32_t i = sizeof(count); i < BENCH_LEN; ++i) {
+        if (msg_data[i] != (uint8_t)(count + i)) {
+            ++bench_corrupt;
+            return;
+        }
+    }
+
+    if (count != bench_next) {
+        ++bench_disorder;
+    }
+    bench_next = count + 1;
+    ++bench_received;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 5000U;
+    uint32_t baud = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 921600U;
+    double losses[16] = {0, 0.01, 0.02, 0.05, 0.1, 0.2};
+    uint32_t loss_num = 6;
+    uint8_t data[BENCH_LEN];
+    uint32_t sent = 0;
+    bool stalled = false;
+
+    if (argc > 3) {
+        loss_num = 0;
+        for (int i = 3; (i < argc) && (loss_num < 16U); ++i) {
+            losses[loss_num++] = strtod(argv[i], NULL);
+        }
+    }
+
+    if (!bench_link_init(&bench_link, baud)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    message_register_send_uart(MSG_ID_1, &bench_link.uart, BENCH_WIRE);
+    message_register_polling_uart(MSG_ID_1, &bench_link.uart, BENCH_RECV_SIZE,
+                                  BENCH_FIFO_SIZE);
+    if (message_register_reliable(MSG_ID_1, BENCH_WINDOW, BENCH_LEN) != 0) {
+        fprintf(stderr, "message_register_reliable failed\n");
+        return 1;
+    }
+    message_register_recv_callback(MSG_ID_1, bench_callback);
+
+    printf("%u baud (%.1f KB/s), %u byte frames, window %u\n", baud,
+           bench_link.rate, BENCH_LEN, BENCH_WINDOW);
+    printf("  loss  dropped  goodput KB/s  of link  retransmit/frame\n");
+
+    for (uint32_t phase = 0; phase < loss_num; ++phase) {
+        uint32_t start = bench_tick;
+        uint32_t target = bench_received + frames;
+
+        bench_link.loss = losses[phase];
+        bench_frames = 0;
+        bench_dropped = 0;
+        message_reset_stats(MSG_ID_1);
+
+        while (bench_received < target) {
+            while ((double)bench_link.uart.tx_len <
+                   bench_link.rate * BENCH_AHEAD) {
+                memcpy(data, &sent, sizeof(sent));
+                for (uint32_t i = sizeof(sent); i < BENCH_LEN; ++i) {
+                    data[i] = (uint8_t)(sent + i);
+                }
+                if (message_send_data(MSG_ID_1, MSG_DATA_UINT8, data,
+                                      BENCH_LEN) != 0) {
+                    /* 窗口满或者还在和对端同步序号 */
+                    break;
+                }
+                ++sent;
+            }
+
+            message_polling_data();
+            bench_step();
+            ++bench_tick;
+
+            if (bench_tick - start > BENCH_STALL) {
+                stalled = true;
+                break;
+            }
+        }
+
+        if (stalled) {
+            fprintf(stderr, "no progress at loss %.3f\n", losses[phase]);
+            break;
+        }
+
+        msg_stats_t stats;
+        message_get_stats(MSG_ID_1, &stats);
+
+        double seconds = (bench_tick - start) / 1000.0;
+        double goodput = frames * (double)BENCH_LEN / 1000.0 / seconds;
+        printf("  %.3f  %6.2f%%  %12.1f  %6.1f%%  %16.3f\n", losses[phase],
+               100.0 * bench_dropped / (bench_frames ? bench_frames : 1),
+               goodput, 100.0 * goodput / bench_link.rate,
+               (double)stats.retransmit / frames);
+    }
+
+    printf("received %u in order, out of order %u, corrupt %u\n",
+           bench_received, bench_disorder, bench_corrupt);
+
+    if (stalled || (bench_disorder != 0) || (bench_corrupt != 0)) {
+        fprintf(stderr, "frames lost or out of order\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -18,11 +18,73 @@
 #if MSG_ENABLE_RTOS
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+
+#define MSG_ENTER_CRITICAL() taskENTER_CRITICAL()
+#define MSG_EXIT_CRITICAL()  taskEXIT_CRITICAL()
+/* 中断中使用的临界区 */
+#define MSG_ENTER_CRITICAL_ISR()                                               \
+    UBaseType_t msg_isr_mask = taskENTER_CRITICAL_FROM_ISR()
+#define MSG_EXIT_CRITICAL_ISR() taskEXIT_CRITICAL_FROM_ISR(msg_isr_mask)
+#else /* MSG_ENABLE_RTOS */
+#define MSG_ENTER_CRITICAL()                                                   \
+    uint32_t msg_primask = __get_PRIMASK();                                    \
+    __disable_irq()
+#define MSG_EXIT_CRITICAL()      __set_PRIMASK(msg_primask)
+#define MSG_ENTER_CRITICAL_ISR() MSG_ENTER_CRITICAL()
+#define MSG_EXIT_CRITICAL_ISR()  MSG_EXIT_CRITICAL()
 #endif /* MSG_ENABLE_RTOS */
 
-#ifdef __GNUC__
+#if MSG_ENABLE_STATISTICS
+/* 统计计数的读-改-写放在临界区中, 否则与`message_reset_stats`交错时清零会被
+ * 写回的旧值覆盖 */
+#define MSG_STATS_ADD(counter, n)                                              \
+    do {                                                                       \
+        MSG_ENTER_CRITICAL();                                                  \
+        (counter) += (n);                                                      \
+        MSG_EXIT_CRITICAL();                                                   \
+    } while (0)
+#define MSG_STATS_INC(counter) MSG_STATS_ADD(counter, 1U)
+/* 可能在中断中执行的统计计数 */
+#define MSG_STATS_INC_ISR(counter)                                             \
+    do {                                                                       \
+        MSG_ENTER_CRITICAL_ISR();                                              \
+        ++(counter);                                                           \
+        MSG_EXIT_CRITICAL_ISR();                                               \
+    } while (0)
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_DEFERRED && !MSG_ENABLE_RTOS
+#error "MSG_ENABLE_DEFERRED requires MSG_ENABLE_RTOS"
+#endif /* MSG_ENABLE_DEFERRED && !MSG_ENABLE_RTOS */
+
+#if MSG_ENABLE_RELIABLE && !MSG_ENABLE_SEQUENCE
+#error "MSG_ENABLE_RELIABLE requires MSG_ENABLE_SEQUENCE"
+#endif /* MSG_ENABLE_RELIABLE && !MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_BOND && !MSG_ENABLE_SEQUENCE
+#error "MSG_ENABLE_BOND requires MSG_ENABLE_SEQUENCE"
+#endif /* MSG_ENABLE_BOND && !MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_FAILOVER && !MSG_ENABLE_SEQUENCE
+#error "MSG_ENABLE_FAILOVER requires MSG_ENABLE_SEQUENCE"
+#endif /* MSG_ENABLE_FAILOVER && !MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_CAN && !(CAN1_ENABLE || CAN2_ENABLE || CAN3_ENABLE)
+#error "MSG_ENABLE_CAN requires at least one CAN enabled in CSP_Config.h"
+#endif /* MSG_ENABLE_CAN && !(CAN1_ENABLE || CAN2_ENABLE || CAN3_ENABLE) */
+
+#if MSG_ENABLE_SPI && !defined(HAL_SPI_MODULE_ENABLED)
+#error "MSG_ENABLE_SPI requires HAL_SPI_MODULE_ENABLED"
+#endif /* MSG_ENABLE_SPI && !defined(HAL_SPI_MODULE_ENABLED) */
+
+#if MSG_ENABLE_ETH && !(ETH_ENABLE && defined(HAL_ETH_MODULE_ENABLED))
+#error "MSG_ENABLE_ETH requires ETH_ENABLE and HAL_ETH_MODULE_ENABLED"
+#endif /* MSG_ENABLE_ETH && !(ETH_ENABLE && defined(HAL_ETH_MODULE_ENABLED)) */
+
+#ifdef __clang__
 #pragma GCC diagnostic ignored "-Wzero-length-array"
-#endif /* __GNUC__ */
+#endif /* __clang__ */
 
 /**
  * @brief 判断是否是 2 的幂次方
@@ -49,6 +111,312 @@ typedef struct {
     uint8_t buf[0];         /*!< 缓冲区 */
 } msg_fifo_t;
 
+/* FIFO 元素大小只有 1 byte, 一帧连同结束符最多存 254 byte */
+#define MSG_FIFO_FRAME_MAX 0xFEU
+
+#if MSG_ENABLE_STATISTICS
+/**
+ * @brief 滑动窗口速率统计
+ * 
+ * @note 保存当前窗口与上一个窗口的字节数, 按当前窗口已经过去的时间对上一个
+ *       窗口加权, 近似得到最近一个窗口长度内的速率
+ */
+typedef struct {
+    uint32_t start; /*!< 当前窗口起始时刻 */
+    uint32_t cur;   /*!< 当前窗口字节数 */
+    uint32_t prev;  /*!< 上一个窗口字节数 */
+} msg_rate_t;
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_LATENCY
+/**
+ * @brief 帧时间戳
+ */
+typedef struct {
+    uint32_t index;   /*!< 帧序号, 用于判断时间戳是否已被覆盖 */
+    uint32_t arrive;  /*!< 帧第一个字节从串口读出的时刻 */
+    uint32_t decoded; /*!< 收到帧结束符的时刻 */
+} msg_stamp_t;
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_DEFERRED
+/**
+ * @brief 延迟分发帧池
+ */
+typedef struct {
+    QueueHandle_t free_queue; /*!< 空闲帧队列 */
+    uint32_t frame_size;      /*!< 每帧数据区大小 */
+    uint8_t *mem;             /*!< 帧内存 */
+} msg_frame_pool_t;
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_CONFLATE
+/**
+ * @brief 最新值邮箱, 轮询任务写, 其他任务读
+ * @note 两块数据轮流写, 写的总是读者不读的那一块, 写完才增加`seq`. 写完
+ *       一帧后下一帧就会写读者正在读的那一块, 所以读者复制期间`seq`有任何
+ *       变化都要重新读. 写者正在写的是另一块, 抢占了写者的读者不用等待
+ */
+typedef struct {
+    volatile uint32_t seq; /*!< 已经写完的帧数, 最低位是最新数据所在的块 */
+    uint32_t size;         /*!< 每块数据的大小 */
+    uint8_t id_type[2];    /*!< 每块的消息 ID 和数据类型 */
+    uint8_t len[2];        /*!< 每块的数据长度 */
+    uint8_t data[0];       /*!< 两块数据, 每块`size`字节 */
+} msg_mailbox_t;
+#endif /* MSG_ENABLE_CONFLATE */
+
+#if MSG_ENABLE_RELIABLE
+/* 应答帧类型, 应答帧数据区为 [类型, 序号] */
+#define MSG_RELIABLE_ACK       0x00U /*!< 累计确认, 序号之前的帧都已收到 */
+#define MSG_RELIABLE_NACK      0x01U /*!< 缺帧, 请求立即重传该序号 */
+#define MSG_RELIABLE_RESET     0x02U /*!< 重新同步, 接收端从该序号重新开始 */
+#define MSG_RELIABLE_RESET_ACK 0x03U /*!< 确认重新同步 */
+
+/**
+ * @brief 可靠传输窗口中的一帧
+ */
+typedef struct {
+    uint32_t len;    /*!< 帧长度, 接收窗口中为 0 表示空 */
+    uint32_t tick;   /*!< 最近一次发送的时刻, 仅发送窗口使用 */
+    uint8_t id_type; /*!< 消息标识, 仅接收窗口使用 */
+} msg_reliable_slot_t;
+
+/**
+ * @brief 可靠传输状态
+ */
+typedef struct {
+    uint32_t mask;           /*!< 窗口大小掩码 */
+    uint32_t frame_size;     /*!< 每帧最大数据长度 */
+    uint32_t tx_stride;      /*!< 发送窗口每帧缓冲区大小 (编码后最坏长度) */
+    uint8_t tx_base;         /*!< 最早一帧未确认的发送序号 */
+    uint8_t rx_expect;       /*!< 期望收到的下一帧序号 */
+    bool rx_nacked;          /*!< 是否已经为`rx_expect`发送过 NACK */
+    bool tx_reset;           /*!< 是否在等待对端确认重新同步 */
+    uint32_t reset_tick;     /*!< 最近一次发送重新同步的时刻 */
+    msg_reliable_slot_t *tx; /*!< 发送窗口 */
+    msg_reliable_slot_t *rx; /*!< 接收窗口 */
+    uint8_t *tx_mem;         /*!< 发送窗口帧缓冲区, 保存编码后的帧 */
+    uint8_t *rx_mem;         /*!< 接收窗口帧缓冲区, 保存乱序到达的数据 */
+} msg_reliable_t;
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_CAN
+/**
+ * @brief CAN 链路
+ *
+ * @note 接收中断把分段拼接到环形缓冲区, 收完一整帧才移动`tail`,
+ *       轮询任务从`head`读出后按串口字节流同样解包
+ */
+typedef struct {
+    can_selected_t can;     /*!< 使用的 CAN */
+    uint32_t can_id;        /*!< 标准帧 ID */
+    uint32_t size;          /*!< 接收缓冲区大小 */
+    uint32_t mask;          /*!< 大小掩码 */
+    volatile uint32_t head; /*!< 读指针, 轮询任务修改 */
+    volatile uint32_t tail; /*!< 写指针, 接收中断修改 */
+    uint32_t pending;       /*!< 正在拼接的帧写到的位置 */
+    uint32_t remain;        /*!< 正在拼接的帧剩余字节数, 0 为空闲 */
+    uint8_t next_sn;        /*!< 期望的下一个连续帧序号 */
+    uint8_t buf[0];         /*!< 接收缓冲区 */
+} msg_can_link_t;
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+/**
+ * @brief SPI 链路
+ *
+ * @note 发送时编码后的帧先写入发送环形缓冲区, 每次传输开始前装入发送块;
+ *       传输完成中断把接收块中的数据写入接收环形缓冲区, 轮询任务读出后
+ *       按串口字节流同样解包
+ */
+typedef struct {
+    SPI_HandleTypeDef *hspi;   /*!< SPI 句柄 */
+    msg_spi_role_t role;       /*!< 主机或从机 */
+    msg_spi_pin_t ready;       /*!< 从机已准备好, 每次准备好翻转一次 */
+    msg_spi_pin_t attention;   /*!< 从机有数据要发 */
+    volatile bool busy;        /*!< 主机正在传输 */
+    GPIO_PinState ready_level; /*!< 主机开始上次传输时 ready 的电平 */
+    uint32_t ready_tick;       /*!< 主机开始上次传输的时刻 */
+    uint32_t mask;             /*!< 环形缓冲区大小掩码 */
+    volatile uint32_t tx_head; /*!< 发送读指针, 装入发送块时修改 */
+    volatile uint32_t tx_tail; /*!< 发送写指针, 发送任务修改 */
+    volatile uint32_t rx_head; /*!< 接收读指针, 轮询任务修改 */
+    volatile uint32_t rx_tail; /*!< 接收写指针, 传输完成中断修改 */
+    uint8_t *tx_ring;          /*!< 发送环形缓冲区 */
+    uint8_t *rx_ring;          /*!< 接收环形缓冲区 */
+
+    uint8_t tx_slot[MSG_SPI_SLOT_SIZE]; /*!< DMA 发送块 */
+    uint8_t rx_slot[MSG_SPI_SLOT_SIZE]; /*!< DMA 接收块 */
+} msg_spi_link_t;
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+/* 以太网 14 byte, IPv4 20 byte, UDP 8 byte */
+#define MSG_ETH_HEADER_LEN  42
+/* 以太网 MTU 1500 byte 能放下的最大 UDP 数据长度 */
+#define MSG_ETH_PAYLOAD_MAX 1472
+
+/**
+ * @brief 以太网链路
+ *
+ * @note 发送的帧攒在`tx_buf`的头部后面, 发出时再填写头部. 接收的数据报
+ *       在轮询任务中读出并写入接收环形缓冲区, 按串口字节流同样解包
+ */
+typedef struct {
+    uint16_t port;        /*!< 本机 UDP 端口 */
+    uint16_t remote_port; /*!< 对端 UDP 端口 */
+    uint32_t tx_len;      /*!< 数据报中已攒的字节数 */
+    uint32_t tx_stamp;    /*!< 攒入第一帧的时刻 */
+    uint32_t mask;        /*!< 接收环形缓冲区大小掩码 */
+    uint32_t head;        /*!< 接收读指针 */
+    uint32_t tail;        /*!< 接收写指针 */
+    uint8_t *rx_ring;     /*!< 接收环形缓冲区 */
+
+    uint8_t tx_buf[MSG_ETH_HEADER_LEN + MSG_ETH_PAYLOAD_MAX]; /*!< 数据报 */
+} msg_eth_link_t;
+#endif /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+/**
+ * @brief 聚合接收窗口中的一帧
+ */
+typedef struct {
+    uint32_t len;    /*!< 数据长度, 为 0 表示空 */
+    uint8_t id_type; /*!< 消息标识 */
+} msg_bond_slot_t;
+
+/**
+ * @brief 多链路聚合状态
+ *
+ * @note 8 位序号展开成 32 位, 记录每条链路最近收到的序号. 每条链路内部
+ *       不会乱序, 所有链路都收到了比期望序号新的帧时, 期望的帧一定已经丢失;
+ *       某条链路上的序号倒退时, 对端一定重新启动过
+ */
+typedef struct {
+    struct msg_instance *owner;                    /*!< 聚合的逻辑实例 */
+    msg_id_t msg_id;                               /*!< 聚合的逻辑 ID */
+    uint32_t count;                                /*!< 链路数 */
+    struct msg_instance *link[MSG_BOND_MAX_LINKS]; /*!< 链路实例 */
+    uint32_t weight[MSG_BOND_MAX_LINKS];           /*!< 链路权重 */
+    uint32_t link_last[MSG_BOND_MAX_LINKS]; /*!< 每条链路最近收到的序号 */
+    bool link_seen[MSG_BOND_MAX_LINKS];     /*!< 链路是否收到过帧 */
+    uint32_t mask;                          /*!< 接收窗口大小掩码 */
+    uint32_t frame_size;                    /*!< 每帧最大数据长度 */
+    bool rx_synced;                         /*!< 是否已经收到过第一帧 */
+    uint32_t rx_expect;                     /*!< 期望交付的下一帧序号 */
+    uint32_t rx_buffered;                   /*!< 窗口中缓存的帧数 */
+    uint32_t gap_tick;                      /*!< 开始等待缺帧的时刻 */
+    msg_bond_slot_t *rx;                    /*!< 接收窗口 */
+    uint8_t *rx_mem;                        /*!< 接收窗口帧缓冲区 */
+} msg_bond_t;
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+/* 心跳帧数据区为 [类型, 已交付的最新序号, 标志, 健康度, 本端会话号,
+ * 看到的对端会话号] */
+#define MSG_FAILOVER_PROBE     0x02U /*!< 心跳, 与可靠传输的应答类型区分 */
+#define MSG_FAILOVER_ACK_VALID 0x01U /*!< 已经交付过数据帧, 序号有效 */
+#define MSG_FAILOVER_PROBE_LEN 6U
+
+/* 健康度满分, 每收到一帧恢复的分数, CRC 错误和队列溢出扣的分数 */
+#define MSG_FAILOVER_HEALTH_MAX       100U
+#define MSG_FAILOVER_HEALTH_GOOD      5U
+#define MSG_FAILOVER_CRC_PENALTY      20U
+#define MSG_FAILOVER_OVERFLOW_PENALTY 50U
+
+/**
+ * @brief 链路冗余发送窗口中的一帧
+ */
+typedef struct {
+    uint32_t len; /*!< 帧长度, 为 0 表示空 */
+    uint8_t seq;  /*!< 帧序号 */
+} msg_failover_slot_t;
+
+/**
+ * @brief 链路冗余状态
+ *
+ * @note 发送窗口保留最近发出的帧, 切换链路时补发对端还没有交付的部分.
+ *       接收端用 64 帧的位图去掉补发造成的重复帧.
+ *       会话号启动时为 0, 对端在心跳中回显 0 后改为 1. 对端的会话号变为 0
+ *       或者在两个非 0 值之间变化时说明对端重新启动过, 序号从头开始,
+ *       清掉去重位图和对端的交付进度
+ */
+typedef struct {
+    struct msg_instance *owner;                       /*!< 逻辑实例 */
+    msg_id_t msg_id;                                  /*!< 逻辑 ID */
+    uint32_t count;                                   /*!< 链路数 */
+    struct msg_instance *link[MSG_FAILOVER_MAX_LINKS]; /*!< 链路实例 */
+    uint8_t health[MSG_FAILOVER_MAX_LINKS];      /*!< 本端算出的健康度 */
+    uint8_t peer_health[MSG_FAILOVER_MAX_LINKS]; /*!< 对端心跳报告的健康度 */
+    uint32_t rx_tick[MSG_FAILOVER_MAX_LINKS];    /*!< 最近收到帧的时刻 */
+    uint32_t tx_tick[MSG_FAILOVER_MAX_LINKS];    /*!< 最近发送的时刻 */
+    volatile uint8_t active;                     /*!< 正在使用的链路 */
+    bool peer_ack_valid;          /*!< 是否收到过对端的交付序号 */
+    uint8_t peer_ack;             /*!< 对端已交付的最新序号 */
+    bool rx_synced;               /*!< 是否已经交付过数据帧 */
+    uint8_t rx_last;              /*!< 已交付的最新序号 */
+    uint64_t rx_seen;             /*!< 最新序号之前 64 帧是否已交付 */
+    volatile uint8_t epoch;       /*!< 本端的会话号, 0 表示刚启动 */
+    bool peer_epoch_valid;        /*!< 是否收到过对端的会话号 */
+    uint8_t peer_epoch;           /*!< 对端的会话号 */
+    uint32_t mask;                /*!< 发送窗口大小掩码 */
+    uint32_t tx_stride;           /*!< 发送窗口每帧缓冲区大小 */
+    msg_failover_slot_t *tx;      /*!< 发送窗口 */
+    uint8_t *tx_mem;              /*!< 发送窗口帧缓冲区 */
+} msg_failover_t;
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+/**
+ * @brief 组播发送缓冲区, 所有串口都发完才能重新使用
+ */
+typedef struct {
+    volatile uint8_t ref; /*!< 还没有发完的串口数, 为 0 时空闲 */
+    uint32_t len;         /*!< 帧长度 */
+    uint8_t *data;        /*!< 编码后的帧 */
+} msg_mcast_buf_t;
+
+/**
+ * @brief 组播中的一个串口, 缓冲区按发送顺序排队
+ */
+typedef struct {
+    UART_HandleTypeDef *huart; /*!< 串口句柄 */
+    msg_mcast_buf_t **queue;   /*!< 排队的缓冲区, 长度与缓冲区个数相同 */
+    volatile uint32_t head;    /*!< 正在发送的位置 */
+    volatile uint32_t tail;    /*!< 写入位置 */
+    volatile bool busy;        /*!< DMA 是否正在发送 */
+} msg_mcast_port_t;
+
+/**
+ * @brief 组播
+ */
+typedef struct {
+    uint32_t count;      /*!< 串口个数 */
+    uint32_t mask;       /*!< 缓冲区个数掩码 */
+    uint32_t frame_size; /*!< 每帧最大数据长度 */
+    uint32_t next;       /*!< 下一次从这里开始查找空闲缓冲区 */
+    msg_mcast_port_t port[MSG_MULTICAST_MAX_UARTS]; /*!< 成员串口 */
+    msg_mcast_buf_t *buf;                           /*!< 发送缓冲区 */
+} msg_mcast_t;
+#endif /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_ROUTE
+/**
+ * @brief 一条路由, 挂在接收链路的实例上
+ */
+typedef struct msg_route {
+    struct msg_route *next;          /*!< 同一条接收链路的下一条路由 */
+    msg_id_t frame_id;               /*!< 帧头中的 ID */
+    bool cut_through;                /*!< 是否不校验 CRC8 直接转发 */
+    uint32_t count;                  /*!< 目的链路个数 */
+    msg_id_t dst[MSG_ROUTE_MAX_DST]; /*!< 目的链路的 ID */
+} msg_route_t;
+
+/* 重新转义一帧需要的缓冲区大小, 队列元素不超过 255 byte, 每个字节最多转义一次 */
+#define MSG_ROUTE_BUF_SIZE (2U * UINT8_MAX)
+#endif /* MSG_ENABLE_ROUTE */
+
 struct msg_instance {
     msg_recv_callback_t recv_callback; /*!< 接收回调函数 */
     UART_HandleTypeDef *send_uart;     /*!< 发送串口句柄 */
@@ -67,26 +435,343 @@ struct msg_instance {
 #ifdef MSG_ESC
     bool escape; /*!< 是否要将下一个字符转义 */
 #endif           /* MSG_ESC */
+    bool hunting; /*!< 正在丢弃帧的剩余部分, 查找下一个结束符 */
+
+#if MSG_ENABLE_RESYNC
+    bool scanning;         /*!< 正在逐字节查找帧头 */
+    uint16_t frame_expect; /*!< 根据长度字节算出的帧长度 */
+#endif                     /* MSG_ENABLE_RESYNC */
+
+    bool len_limited; /*!< 是否注册了数据长度范围 */
+    uint8_t len_min;  /*!< 最小数据长度 */
+    uint8_t len_max;  /*!< 最大数据长度 */
+
+#if MSG_ENABLE_STATIC_TABLE
+    uint16_t type_mask; /*!< 消息表中声明的数据类型, 第 n 位对应类型 n */
+#endif                  /* MSG_ENABLE_STATIC_TABLE */
 
     msg_fifo_t *fifo;          /*!< 接收缓冲区 */
     uint32_t fifo_element_len; /*!< 当前队列元素个数 */
+    uint32_t dispatch_limit;   /*!< 每次轮询最多分发的帧数, 0 为不限制 */
+
+#if MSG_ENABLE_SEQUENCE
+    bool sequence;      /*!< 是否在帧头携带序号 */
+    bool seq_synced;    /*!< 是否已经收到过第一帧 */
+    uint8_t seq_next;   /*!< 下一帧发送序号 */
+    uint8_t seq_expect; /*!< 期望收到的下一帧序号 */
+#endif                  /* MSG_ENABLE_SEQUENCE */
 
 #if MSG_ENABLE_STATISTICS
-    uint32_t send_count; /*!< 发送计数 */
+    msg_stats_t stats;    /*!< 统计计数 */
+    msg_rate_t send_rate; /*!< 发送速率窗口 */
+    msg_rate_t recv_rate; /*!< 接收速率窗口 */
+#if MSG_ENABLE_ROUTE
+    msg_rate_t route_rate; /*!< 转发速率窗口 */
+#endif                     /* MSG_ENABLE_ROUTE */
+#endif                     /* MSG_ENABLE_STATISTICS */
 
-    uint32_t recv_success; /*!< 接收成功计数 */
-    uint32_t recv_error;   /*!< 接收错误计数 */
-#if MSG_ENABLE_CRC8
-    uint32_t crc_check_error; /*!< CRC 校验错误计数 */
-#endif                        /* MSG_ENABLE_CRC8 */
+#if MSG_ENABLE_LATENCY
+    uint32_t rx_stamp;     /*!< 本次从串口读出数据的时刻 */
+    uint32_t frame_arrive; /*!< 当前正在接收的帧的到达时刻 */
+    uint32_t frame_in;     /*!< 已解出的帧计数 */
+    uint32_t frame_out;    /*!< 已出队的帧计数 */
+    msg_stamp_t stamps[MSG_LATENCY_DEPTH]; /*!< 已解出未出队的帧时间戳 */
+    msg_latency_t latency;                 /*!< 延迟统计 */
+#endif                                     /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_CALLBACK_BUDGET
+    msg_overrun_hook_t overrun_hook; /*!< 回调超时钩子 */
+    msg_callback_stats_t callback;   /*!< 回调耗时统计 */
+#endif                               /* MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_DEFERRED
+    QueueHandle_t frame_queue;    /*!< 延迟分发队列, 为`NULL`时直接回调 */
+    msg_frame_pool_t *frame_pool; /*!< 延迟分发帧池 */
+#endif                            /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_CONFLATE
+    msg_mailbox_t *mailbox; /*!< 最新值邮箱, 为`NULL`时逐帧处理 */
+    bool conflate_send;     /*!< 发送时是否覆盖还没发出的帧 */
+    uint32_t tx_pending;    /*!< 留在发送缓冲区等待链路空闲的帧长度 */
+#endif                      /* MSG_ENABLE_CONFLATE */
+
+#if MSG_ENABLE_RELIABLE
+    msg_reliable_t *reliable; /*!< 可靠传输状态, 为`NULL`时尽力而为发送 */
+#endif                        /* MSG_ENABLE_RELIABLE */
 
-    uint32_t max_fifo_element_len; /*!< 最大队列元素个数 */
-    uint32_t fifo_overflow;        /*!< 队列溢出清空计数 */
-#endif                             /* MSG_ENABLE_STATISTICS */
+#if MSG_ENABLE_FEC
+    bool fec; /*!< 是否附加前向纠错校验 */
+#endif        /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_CAN
+    msg_can_link_t *can; /*!< CAN 链路, 为`NULL`时使用串口 */
+#endif                   /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+    msg_spi_link_t *spi; /*!< SPI 链路, 为`NULL`时使用串口 */
+#endif                   /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+    msg_eth_link_t *eth; /*!< 以太网链路, 为`NULL`时使用串口 */
+#endif                   /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+    msg_bond_t *bond;    /*!< 聚合发送的链路, 为`NULL`时不聚合 */
+    msg_bond_t *bond_of; /*!< 作为链路所属的聚合, 收到的帧交给聚合重排 */
+    uint8_t bond_index;  /*!< 在所属聚合中的链路序号 */
+#endif                   /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+    msg_failover_t *failover;    /*!< 冗余发送的链路组, 为`NULL`时不冗余 */
+    msg_failover_t *failover_of; /*!< 作为链路所属的冗余组 */
+    uint8_t failover_index;      /*!< 在所属冗余组中的链路序号 */
+#endif                           /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+    msg_mcast_t *mcast; /*!< 组播的串口, 为`NULL`时不组播 */
+#endif                  /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_ROUTE
+    msg_route_t *route; /*!< 收到的帧的路由, 为`NULL`时不转发 */
+    uint8_t *route_buf; /*!< 转发时重新转义的缓冲区 */
+#endif                  /* MSG_ENABLE_ROUTE */
 };
 
+#if MSG_ENABLE_STATIC_TABLE
+
+/* 不小于 x 的 2 的幂次方, x 不超过 65536 */
+#define MSG_POW2_1(x)    ((x) | ((x) >> 1))
+#define MSG_POW2_2(x)    (MSG_POW2_1(x) | (MSG_POW2_1(x) >> 2))
+#define MSG_POW2_4(x)    (MSG_POW2_2(x) | (MSG_POW2_2(x) >> 4))
+#define MSG_POW2_8(x)    (MSG_POW2_4(x) | (MSG_POW2_4(x) >> 8))
+#define MSG_POW2_CEIL(x) (MSG_POW2_8((x) - 1U) + 1U)
+
+/* 消息表中每个 ID 的接收缓冲区和队列大小 */
+#define MSG_TABLE_RECV_SIZE(max_len)                                           \
+    (MSG_FRAME_WIRE_SIZE(max_len) * MSG_SIZE_FRAMES)
+#define MSG_TABLE_FIFO_SIZE(max_len)                                           \
+    MSG_POW2_CEIL(MSG_FRAME_FIFO_SIZE(max_len) * MSG_SIZE_FRAMES)
+
+/* 每个 ID 的实例, 缓冲区和队列都静态分配, 队列的缓冲区紧跟在队列后面 */
+#define MSG_TABLE_STORAGE(id, send, recv, max_len, type, cb)                   \
+    static uint8_t msg_send_buf_##id[MSG_FRAME_WIRE_SIZE(max_len)];            \
+    static uint8_t msg_recv_buf_##id[MSG_TABLE_RECV_SIZE(max_len)];            \
+    static struct {                                                            \
+        msg_fifo_t fifo;                                                       \
+        uint8_t buf[MSG_TABLE_FIFO_SIZE(max_len)];                             \
+    } msg_fifo_##id = {.fifo = {.size = MSG_TABLE_FIFO_SIZE(max_len),          \
+                                .mask = MSG_TABLE_FIFO_SIZE(max_len) - 1U,     \
+                                .new_frame = true}};                           \
+    static struct msg_instance msg_instance_##id = {                           \
+        .recv_callback = (cb),                                                 \
+        .send_uart = (send),                                                   \
+        .recv_uart = (recv),                                                   \
+        .send_buf = msg_send_buf_##id,                                         \
+        .send_buf_len = sizeof(msg_send_buf_##id),                             \
+        .recv_buf = msg_recv_buf_##id,                                         \
+        .recv_buf_size = sizeof(msg_recv_buf_##id),                            \
+        .fifo = &msg_fifo_##id.fifo,                                           \
+        .len_limited = true,                                                   \
+        .len_max = (max_len),                                                  \
+        .type_mask = (uint16_t)(1U << (type)),                                 \
+    };
+MSG_TABLE(MSG_TABLE_STORAGE)
+
+#define MSG_TABLE_ENTRY(id, ...) [id] = &msg_instance_##id,
+struct msg_instance *const msg_list[MSG_ID_RESERVE_LEN] = {
+    MSG_TABLE(MSG_TABLE_ENTRY)};
+
+#else /* MSG_ENABLE_STATIC_TABLE */
 struct msg_instance *msg_list[MSG_ID_RESERVE_LEN];
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+#if MSG_ENABLE_EXT_ID
+_Static_assert(MSG_ID_RESERVE_LEN <= 256, "extended msg id is one byte");
+#else  /* MSG_ENABLE_EXT_ID */
+_Static_assert(MSG_ID_RESERVE_LEN <= 16,
+               "msg id only has 4 bits, enable MSG_ENABLE_EXT_ID");
+#endif /* MSG_ENABLE_EXT_ID */
+
 static msg_fifo_t *msg_fifo_init(uint32_t fifo_size);
+static uint32_t message_frame_encode(struct msg_instance *msg, msg_id_t msg_id,
+                                     msg_type_t data_type, uint8_t *data,
+                                     uint32_t data_len);
+static uint32_t msg_frame_write(struct msg_instance *msg, msg_id_t msg_id,
+                                msg_type_t data_type, uint8_t *data,
+                                uint32_t data_len, uint8_t *send_buf);
+static bool message_link_ready(struct msg_instance *msg);
+static uint32_t message_receive(struct msg_instance *msg);
+static uint8_t message_transmit(struct msg_instance *msg, uint8_t *buf,
+                                uint32_t len);
+static inline void msg_uart_tx_wait(UART_HandleTypeDef *huart);
+static void message_deliver(struct msg_instance *msg, msg_id_t msg_id,
+                            uint32_t msg_length, uint8_t msg_id_type,
+                            uint8_t *msg_data);
+
+#if MSG_ENABLE_STATISTICS
+static void msg_rate_update(msg_rate_t *rate, uint32_t bytes);
+static uint32_t msg_rate_get(msg_rate_t *rate);
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_LATENCY
+static msg_stamp_t *msg_latency_pop(struct msg_instance *msg);
+static void msg_latency_record(struct msg_instance *msg, msg_stamp_t *stamp,
+                               uint32_t entry, uint32_t exit);
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+static inline void msg_latency_hist_add(msg_latency_hist_t *hist,
+                                        uint32_t value);
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_CALLBACK_BUDGET
+static void msg_callback_record(struct msg_instance *msg, msg_id_t msg_id,
+                                uint32_t duration);
+#endif /* MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_SEQUENCE
+static void msg_sequence_check(struct msg_instance *msg, uint8_t seq);
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_RELIABLE
+static bool msg_reliable_writable(struct msg_instance *msg, uint32_t data_len);
+static void msg_reliable_store(struct msg_instance *msg, uint8_t seq,
+                               uint32_t frame_len);
+static bool msg_reliable_recv(struct msg_instance *msg, msg_id_t msg_id,
+                              uint8_t msg_id_type, uint8_t *msg_data,
+                              uint32_t msg_length);
+static void msg_reliable_advance(struct msg_instance *msg, msg_id_t msg_id);
+static void msg_reliable_poll(struct msg_instance *msg, msg_id_t msg_id);
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_FEC
+/* 码字最长为 1 byte 标识, 扩展 ID, 1 byte 长度, 1 byte 序号, 255 byte 数据,
+ * 2 byte CRC8 */
+#define MSG_FEC_PARITY_MAX                                                     \
+    (2 * ((260 + MSG_ID_EXT_LEN + MSG_FEC_BLOCK - 1) / MSG_FEC_BLOCK))
+
+static uint32_t msg_fec_append(uint8_t *buf, uint32_t len, uint32_t *escape);
+static uint32_t msg_fec_decode(struct msg_instance *msg, msg_fifo_t *fifo,
+                               uint32_t frame_len);
+#endif /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_CAN
+static uint8_t msg_can_transmit(struct msg_instance *msg, const uint8_t *buf,
+                                uint32_t len);
+static uint32_t msg_can_read(msg_can_link_t *link, uint8_t *buf,
+                             uint32_t size);
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+static void msg_spi_write(struct msg_instance *msg, const uint8_t *buf,
+                          uint32_t len);
+static void msg_spi_kick(struct msg_instance *msg);
+static uint8_t msg_spi_start(struct msg_instance *msg);
+static uint32_t msg_spi_read(msg_spi_link_t *link, uint8_t *buf,
+                             uint32_t size);
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+static void msg_eth_write(struct msg_instance *msg, const uint8_t *buf,
+                          uint32_t len);
+static void msg_eth_poll(struct msg_instance *msg);
+static uint32_t msg_eth_read(msg_eth_link_t *link, uint8_t *buf,
+                             uint32_t size);
+#endif /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+static void msg_bond_transmit(struct msg_instance *msg, uint8_t *buf,
+                              uint32_t len);
+static void msg_bond_recv(msg_bond_t *bond, uint32_t index,
+                          uint8_t msg_id_type, uint8_t *msg_data,
+                          uint32_t msg_length);
+static void msg_bond_poll(msg_bond_t *bond);
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+static void msg_failover_transmit(struct msg_instance *msg, uint8_t *buf,
+                                  uint32_t len);
+static void msg_failover_recv(msg_failover_t *fo, uint32_t index,
+                              uint8_t msg_id_type, uint8_t *msg_data,
+                              uint32_t msg_length);
+static void msg_failover_penalty(struct msg_instance *msg, uint8_t penalty);
+static void msg_failover_poll(msg_failover_t *fo, uint32_t index);
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+static bool msg_mcast_writable(struct msg_instance *msg, uint32_t data_len);
+static void msg_mcast_transmit(struct msg_instance *msg, uint8_t *buf,
+                               uint32_t len);
+#endif /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_ROUTE
+static const msg_route_t *msg_route_find(struct msg_instance *msg,
+                                         const uint8_t *frame,
+                                         uint32_t ext_len);
+static void msg_route_forward(struct msg_instance *msg,
+                              const msg_route_t *route, const uint8_t *frame,
+                              uint32_t len, uint32_t ext_len);
+#endif /* MSG_ENABLE_ROUTE */
+
+#if MSG_ENABLE_DEFERRED
+static void msg_frame_post(struct msg_instance *msg, msg_id_t msg_id,
+                           uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data);
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_CONFLATE
+static void msg_conflate_replace(struct msg_instance *msg);
+static bool msg_conflate_hold(struct msg_instance *msg, uint32_t frame_len);
+static void msg_mailbox_write(msg_mailbox_t *box, uint8_t id_type,
+                              const uint8_t *data, uint32_t len);
+#endif /* MSG_ENABLE_CONFLATE */
+
+#if MSG_ENABLE_RESYNC
+static void msg_resync_drop(struct msg_instance *msg);
+static bool msg_resync_rescan(struct msg_instance *msg, uint32_t count,
+                              uint32_t overhead, bool eof);
+static bool msg_resync_check(struct msg_instance *msg, uint8_t byte);
+#endif /* MSG_ENABLE_RESYNC */
+
+static inline uint32_t msg_ext_len(uint8_t id_type);
+#if MSG_ENABLE_CRC8
+static inline bool msg_frame_crc_valid(uint8_t *data, uint32_t len,
+                                       uint32_t head_len);
+#endif /* MSG_ENABLE_CRC8 */
+static inline bool msg_frame_valid(uint32_t msg_id, uint8_t data_type,
+                                   uint32_t len);
+static inline bool msg_frame_head_valid(msg_fifo_t *fifo, uint8_t byte);
+static uint32_t msg_frame_hunt(struct msg_instance *msg, uint32_t pos,
+                               uint32_t recv_len);
+
+#if MSG_ENABLE_RECORD
+static void msg_record_chunk(msg_id_t msg_id, const uint8_t *data,
+                             uint32_t len);
+#endif /* MSG_ENABLE_RECORD */
+
+#if MSG_ENABLE_STATIC_TABLE
+/**
+ * @brief 实例都在消息表中静态分配, 不需要创建
+ *
+ * @param msg_id 数据含义
+ */
+static inline void msg_instance_create(msg_id_t msg_id) {
+    (void)msg_id;
+}
+#else  /* MSG_ENABLE_STATIC_TABLE */
+/**
+ * @brief 某个 ID 还没有实例时创建一个
+ *
+ * @param msg_id 数据含义
+ */
+static void msg_instance_create(msg_id_t msg_id) {
+    if (msg_list[msg_id] == NULL) {
+        msg_list[msg_id] =
+            (struct msg_instance *)MSG_MALLOC(sizeof(struct msg_instance));
+        memset(msg_list[msg_id], 0, sizeof(struct msg_instance));
+    }
+}
+#endif /* MSG_ENABLE_STATIC_TABLE */
 
 /**
  * @brief 注册数据发送句柄
@@ -101,15 +786,17 @@ void message_register_send_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
         return;
     }
 
-    if (msg_list[msg_id] == NULL) {
-        msg_list[msg_id] =
-            (struct msg_instance *)MSG_MALLOC(sizeof(struct msg_instance));
-        memset(msg_list[msg_id], 0, sizeof(struct msg_instance));
-    }
+    msg_instance_create(msg_id);
 
     struct msg_instance *msg = msg_list[msg_id];
 
     msg->send_uart = huart;
+#if MSG_ENABLE_STATIC_TABLE
+    /* 缓冲区在消息表中静态分配, 只更换串口 */
+    (void)buf_size;
+    return;
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
     if (msg->send_buf != NULL) {
         MSG_FREE(msg->send_buf);
     }
@@ -140,11 +827,7 @@ void message_register_recv_callback(msg_id_t msg_id,
         return;
     }
 
-    if (msg_list[msg_id] == NULL) {
-        msg_list[msg_id] =
-            (struct msg_instance *)MSG_MALLOC(sizeof(struct msg_instance));
-        memset(msg_list[msg_id], 0, sizeof(struct msg_instance));
-    }
+    msg_instance_create(msg_id);
 
     msg_list[msg_id]->recv_callback = msg_callback;
 }
@@ -154,8 +837,9 @@ void message_register_recv_callback(msg_id_t msg_id,
  *
  * @param msg_id 数据含义
  * @param huart 接收串口句柄
- * @param buf_size 串口缓冲区大小
- * @param fifo_size 队列大小 (必须是 2 的幂次方! )
+ * @param buf_size 串口缓冲区大小, 为 0 时按注册的最大数据长度计算
+ * @param fifo_size 队列大小 (必须是 2 的幂次方! ), 为 0 时按注册的最大数据
+ *                  长度计算
  */
 void message_register_polling_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
                                    uint32_t buf_size, uint32_t fifo_size) {
@@ -163,18 +847,35 @@ void message_register_polling_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
         return;
     }
 
-    if (is_pow_of_2(fifo_size) == 0) {
-        /* 不是 2 的幂次方 */
-        return;
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+
+#if MSG_ENABLE_STATIC_TABLE
+    /* 缓冲区和队列在消息表中静态分配, 只更换串口 */
+    msg->recv_uart = huart;
+    (void)buf_size;
+    (void)fifo_size;
+    return;
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+    /* 按注册的最大数据长度计算, 没有注册时按长度字节能表示的最大值 */
+    uint32_t len_max = msg->len_limited ? msg->len_max : 0xFF;
+    if (buf_size == 0) {
+        buf_size = MSG_FRAME_WIRE_SIZE(len_max) * MSG_SIZE_FRAMES;
     }
 
-    if (msg_list[msg_id] == NULL) {
-        msg_list[msg_id] =
-            (struct msg_instance *)MSG_MALLOC(sizeof(struct msg_instance));
-        memset(msg_list[msg_id], 0, sizeof(struct msg_instance));
+    if (fifo_size == 0) {
+        for (fifo_size = 1;
+             fifo_size < MSG_FRAME_FIFO_SIZE(len_max) * MSG_SIZE_FRAMES;
+             fifo_size <<= 1) {
+        }
     }
 
-    struct msg_instance *msg = msg_list[msg_id];
+    if (is_pow_of_2(fifo_size) == 0) {
+        /* 不是 2 的幂次方 */
+        return;
+    }
     msg->recv_uart = huart;
     msg->recv_buf = (uint8_t *)MSG_MALLOC(buf_size);
     if (msg->recv_buf == NULL) {
@@ -186,8 +887,67 @@ void message_register_polling_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
     if (msg->fifo == NULL) {
         return;
     }
+
+#if MSG_ENABLE_LATENCY
+    MSG_TIMESTAMP_INIT();
+#endif /* MSG_ENABLE_LATENCY */
+}
+
+/**
+ * @brief 注册某个 ID 的数据长度范围
+ *
+ * @param msg_id 数据含义
+ * @param max_len 最大数据长度
+ * @param exact 为 1 时数据长度必须等于`max_len`
+ * @return 注册结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误
+ * @note 接收时读到长度字节就检查, 超出范围的帧不等存完就丢弃, 跳到下一个
+ *       结束符. 发送超出范围的数据返回 1. 应答帧不受限制.
+ *       在`message_register_polling_uart`之前调用, 缓冲区和队列大小传 0 时
+ *       按最大长度计算, 能容纳`MSG_SIZE_FRAMES`个最长的帧
+ */
+uint8_t message_register_length(msg_id_t msg_id, uint32_t max_len,
+                                uint8_t exact) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (max_len == 0) ||
+        (max_len > 0xFF)) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    msg->len_max = (uint8_t)max_len;
+    msg->len_min = exact ? (uint8_t)max_len : 0;
+    msg->len_limited = true;
+
+    return 0;
+}
+
+#if MSG_ENABLE_STATIC_TABLE
+
+/**
+ * @brief 初始化消息表
+ *
+ * @note 实例, 缓冲区和队列都已经静态分配, 这里只创建发送缓冲区互斥量和
+ *       初始化时间戳. 在启动调度器和收发之前调用一次
+ */
+void message_table_init(void) {
+#if MSG_ENABLE_RTOS
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        if (msg_list[i]->send_buf_semp == NULL) {
+            msg_list[i]->send_buf_semp = xSemaphoreCreateMutex();
+        }
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+#if MSG_ENABLE_LATENCY
+    MSG_TIMESTAMP_INIT();
+#endif /* MSG_ENABLE_LATENCY */
 }
 
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
 /**
  * @brief 填充并发送数据, 支持多种类型
  *
@@ -195,78 +955,560 @@ void message_register_polling_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
  * @param data_type 数据类型
  * @param data 数据内容
  * @param data_len 发送长度
+ * @return 发送结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误, 缓冲区分配失败, 可靠传输发送窗口已满或 CAN
+ *               发送失败
  */
-void message_send_data(msg_id_t msg_id, msg_type_t data_type, uint8_t *data,
-                       uint32_t data_len) {
+uint8_t message_send_data(msg_id_t msg_id, msg_type_t data_type,
+                          uint8_t *data, uint32_t data_len) {
     if (data == NULL || data_len == 0) {
-        return;
+        return 1;
     }
 
     if (msg_id >= MSG_ID_RESERVE_LEN) {
-        return;
+        return 1;
     }
 
+#if !MSG_ENABLE_STATIC_TABLE
     if (msg_list[msg_id] == NULL) {
-        return;
+        return 1;
     }
+#endif /* !MSG_ENABLE_STATIC_TABLE */
 
     struct msg_instance *msg = msg_list[msg_id];
 
-    if (msg->send_uart == NULL || msg->send_buf == NULL) {
-        return;
+    if (!message_link_ready(msg) ||
+        !msg_frame_valid(msg_id, data_type, data_len)) {
+        return 1;
     }
 
 #if MSG_ENABLE_RTOS
     xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
 #endif /* MSG_ENABLE_RTOS */
 
-    if (msg->send_buf_len <= data_len + 5) {
-        /* 不够, 扩容当前数据长度的 2 倍 */
-        uint8_t *new_buf = (uint8_t *)MSG_REALLOC(msg->send_buf, data_len * 2);
-        if (new_buf == NULL) {
-            return;
-        }
-
-        msg->send_buf = new_buf;
-        msg->send_buf_len = data_len * 2;
-    } else if ((data_len + 3) * 3 <= msg->send_buf_len) {
-        /* 长度小于 1/3, 缩容到原来的 1/2 */
-        uint8_t *new_buf =
-            (uint8_t *)MSG_REALLOC(msg->send_buf, msg->send_buf_len / 2);
-        if (new_buf == NULL) {
-            return;
-        }
-
-        msg->send_buf = new_buf;
-        msg->send_buf_len = msg->send_buf_len / 2;
+#if MSG_ENABLE_RELIABLE
+    /* 编码前的序号, 即这一帧的序号 */
+    uint8_t seq = msg->seq_next;
+    if (!msg_reliable_writable(msg, data_len)) {
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+        return 1;
     }
+#endif /* MSG_ENABLE_RELIABLE */
 
-    uint8_t *send_buf = (uint8_t *)msg->send_buf;
-    uint32_t buf_idx = 0;
+#if MSG_ENABLE_MULTICAST
+    if (!msg_mcast_writable(msg, data_len)) {
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+        return 1;
+    }
+#endif /* MSG_ENABLE_MULTICAST */
 
-#if MSG_ENABLE_CRC8
-    /* CRC8 校验结果 */
-    uint8_t crc8_value = calc_crc8(data, data_len);
-#endif /* MSG_ENABLE_CRC8 */
+#if MSG_ENABLE_CONFLATE
+    /* 还没发出的帧直接被这一帧覆盖 */
+    msg_conflate_replace(msg);
+#endif /* MSG_ENABLE_CONFLATE */
 
-    /* 第一个字节, 高四位标记 ID, 低四位标记数据类型 */
-    send_buf[buf_idx] = (uint8_t)(msg_id << 4) | data_type;
-    ++buf_idx;
-    /* 第二个字节, 标记数据长度 */
-    send_buf[buf_idx] = (uint8_t)data_len;
-    ++buf_idx;
+    uint8_t ret = 1;
+    uint32_t frame_len =
+        message_frame_encode(msg, msg_id, data_type, data, data_len);
 
-    /* 复制数据到字节流 */
-    for (uint32_t data_idx = 0; data_idx < data_len; ++data_idx) {
-#ifdef MSG_ESC
-        if ((data[data_idx] == MSG_EOF) || (data[data_idx] == MSG_ESC)) {
-            /* 转义 */
-            send_buf[buf_idx] = MSG_ESC;
-            ++buf_idx;
+    if (frame_len != 0) {
+        ret = 0;
+#if MSG_ENABLE_RELIABLE
+        msg_reliable_store(msg, seq, frame_len);
+#endif /* MSG_ENABLE_RELIABLE */
+#if MSG_ENABLE_CONFLATE
+        if (!msg_conflate_hold(msg, frame_len)) {
+            ret = message_transmit(msg, msg->send_buf, frame_len);
         }
-#endif /* MSG_ESC */
+#else  /* MSG_ENABLE_CONFLATE */
+        ret = message_transmit(msg, msg->send_buf, frame_len);
+#endif /* MSG_ENABLE_CONFLATE */
+#if MSG_ENABLE_RELIABLE
+        if (msg->reliable != NULL) {
+            /* 已经放入发送窗口, 发送失败由重传补上 */
+            ret = 0;
+        }
+#endif /* MSG_ENABLE_RELIABLE */
+    }
 
-        send_buf[buf_idx] = data[data_idx];
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+
+    return ret;
+}
+
+/**
+ * @brief 是否已经注册了发送链路 (串口或 CAN) 和发送缓冲区
+ *
+ * @param msg 消息实例
+ * @return 是否可以发送
+ */
+static bool message_link_ready(struct msg_instance *msg) {
+#if MSG_ENABLE_CAN
+    if (msg->can != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_CAN */
+#if MSG_ENABLE_SPI
+    if (msg->spi != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_SPI */
+#if MSG_ENABLE_ETH
+    if (msg->eth != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_ETH */
+#if MSG_ENABLE_BOND
+    if (msg->bond != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_BOND */
+#if MSG_ENABLE_FAILOVER
+    if (msg->failover != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_FAILOVER */
+#if MSG_ENABLE_MULTICAST
+    if (msg->mcast != NULL) {
+        return msg->send_buf != NULL;
+    }
+#endif /* MSG_ENABLE_MULTICAST */
+    return (msg->send_uart != NULL) && (msg->send_buf != NULL);
+}
+
+/**
+ * @brief 将一帧发送出去, 没有开启 DMA 发送的串口阻塞发送
+ *
+ * @param msg 消息实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @return 发送结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 链路发送失败 (只有 CAN 会失败)
+ */
+static uint8_t message_transmit(struct msg_instance *msg, uint8_t *buf,
+                                uint32_t len) {
+#if MSG_ENABLE_CAN
+    if (msg->can != NULL) {
+        return msg_can_transmit(msg, buf, len);
+    }
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+    if (msg->spi != NULL) {
+        msg_spi_write(msg, buf, len);
+        return 0;
+    }
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+    if (msg->eth != NULL) {
+        msg_eth_write(msg, buf, len);
+        return 0;
+    }
+#endif /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+    if (msg->bond != NULL) {
+        msg_bond_transmit(msg, buf, len);
+        return 0;
+    }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+    if (msg->failover != NULL) {
+        msg_failover_transmit(msg, buf, len);
+        return 0;
+    }
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+    if (msg->mcast != NULL) {
+        msg_mcast_transmit(msg, buf, len);
+        return 0;
+    }
+#endif /* MSG_ENABLE_MULTICAST */
+
+    if (msg->send_uart->hdmatx != NULL) {
+        msg_uart_tx_wait(msg->send_uart);
+        uart_dmatx_write(msg->send_uart, buf, len);
+        uart_dmatx_send(msg->send_uart);
+    } else {
+        HAL_UART_Transmit(msg->send_uart, buf, len, 0xFFFF);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 等待串口上一次 DMA 发送完成
+ *
+ * @param huart 串口句柄
+ * @note `uart_dmatx_send`启动 DMA 后就把写指针清零, 发完之前写入会覆盖
+ *       DMA 正在发送的数据, 所以写入 DMA 发送缓冲区之前要先等待
+ */
+static inline void msg_uart_tx_wait(UART_HandleTypeDef *huart) {
+    while (__HAL_UART_GET_FLAG(huart, UART_FLAG_TC) == RESET) {
+    }
+}
+
+/**
+ * @brief 批量发送多帧数据, 每个串口只启动一次 DMA 发送
+ *
+ * @param items 要发送的帧
+ * @param count 帧个数
+ * @return 成功写入发送缓冲区的帧数
+ * @note 所有帧依次编码后写入各自串口的 DMA 发送缓冲区, 最后每个串口只等待
+ *       一次发送完成并启动一次 DMA. DMA 发送缓冲区放不下时会先把已经写入
+ *       的帧发出去, 等发完再继续写入. 比整个 DMA 发送缓冲区还大的帧不发送.
+ *       没有开启 DMA 发送的串口逐帧阻塞发送
+ */
+uint32_t message_send_batch(const msg_batch_item_t *items, uint32_t count) {
+    if (items == NULL) {
+        return 0;
+    }
+
+    /* 本批次涉及的串口以及已经写入的字节数, 串口数不会超过 ID 数 */
+    UART_HandleTypeDef *uarts[MSG_ID_RESERVE_LEN];
+    uint32_t pending[MSG_ID_RESERVE_LEN];
+    uint32_t uart_num = 0;
+    uint32_t sent = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const msg_batch_item_t *item = &items[i];
+
+        if ((item->data == NULL) || (item->data_len == 0) ||
+            (item->msg_id >= MSG_ID_RESERVE_LEN) ||
+            (msg_list[item->msg_id] == NULL)) {
+            continue;
+        }
+
+        struct msg_instance *msg = msg_list[item->msg_id];
+        if (!message_link_ready(msg) ||
+            !msg_frame_valid(item->msg_id, item->data_type, item->data_len)) {
+            continue;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+#if MSG_ENABLE_MULTICAST
+        if (!msg_mcast_writable(msg, item->data_len)) {
+#if MSG_ENABLE_RTOS
+            xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+            continue;
+        }
+#endif /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_CONFLATE
+        msg_conflate_replace(msg);
+#endif /* MSG_ENABLE_CONFLATE */
+
+        uint32_t frame_len = 0;
+#if MSG_ENABLE_RELIABLE
+        uint8_t seq = msg->seq_next;
+        if (msg_reliable_writable(msg, item->data_len)) {
+            frame_len = message_frame_encode(msg, item->msg_id,
+                                             item->data_type, item->data,
+                                             item->data_len);
+            if (frame_len != 0) {
+                msg_reliable_store(msg, seq, frame_len);
+            }
+        }
+#else  /* MSG_ENABLE_RELIABLE */
+        frame_len = message_frame_encode(msg, item->msg_id, item->data_type,
+                                         item->data, item->data_len);
+#endif /* MSG_ENABLE_RELIABLE */
+
+        if (frame_len == 0) {
+            /* 编码失败或可靠传输发送窗口已满 */
+#if MSG_ENABLE_CONFLATE
+        } else if (msg_conflate_hold(msg, frame_len)) {
+            /* 串口正忙, 留在发送缓冲区等空闲时发出 */
+            ++sent;
+#endif /* MSG_ENABLE_CONFLATE */
+#if MSG_ENABLE_CAN
+        } else if (msg->can != NULL) {
+            /* CAN 没有 DMA 发送缓冲区, 逐帧发送 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_CAN */
+#if MSG_ENABLE_SPI
+        } else if (msg->spi != NULL) {
+            /* 写入发送环形缓冲区, 下一次传输时一起装入发送块 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_SPI */
+#if MSG_ENABLE_ETH
+        } else if (msg->eth != NULL) {
+            /* 攒入数据报, 由大小阈值或定时发出 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_ETH */
+#if MSG_ENABLE_BOND
+        } else if (msg->bond != NULL) {
+            /* 每帧单独选择链路 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_BOND */
+#if MSG_ENABLE_FAILOVER
+        } else if (msg->failover != NULL) {
+            /* 先保存到发送窗口, 再从当前链路发出 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_FAILOVER */
+#if MSG_ENABLE_MULTICAST
+        } else if (msg->mcast != NULL) {
+            /* 每个串口各自排队 DMA 发送 */
+            message_transmit(msg, msg->send_buf, frame_len);
+            ++sent;
+#endif /* MSG_ENABLE_MULTICAST */
+        } else if (msg->send_uart->hdmatx == NULL) {
+            HAL_UART_Transmit(msg->send_uart, msg->send_buf, frame_len,
+                              0xFFFF);
+            ++sent;
+        } else if (frame_len > uart_damtx_get_buf_szie(msg->send_uart)) {
+            /* 比整个 DMA 发送缓冲区还大, 写入会被截断, 不发送 */
+        } else {
+            uint32_t idx;
+            for (idx = 0; idx < uart_num; ++idx) {
+                if (uarts[idx] == msg->send_uart) {
+                    break;
+                }
+            }
+
+            if (idx == uart_num) {
+                uarts[idx] = msg->send_uart;
+                pending[idx] = 0;
+                ++uart_num;
+                /* 批次之前的发送可能还没有完成 */
+                msg_uart_tx_wait(msg->send_uart);
+            }
+
+            if (pending[idx] + frame_len >
+                uart_damtx_get_buf_szie(msg->send_uart)) {
+                /* 放不下了, 先把之前的帧发出去, 发完才能继续写入 */
+                uart_dmatx_send(msg->send_uart);
+                pending[idx] = 0;
+                msg_uart_tx_wait(msg->send_uart);
+            }
+
+            pending[idx] +=
+                uart_dmatx_write(msg->send_uart, msg->send_buf, frame_len);
+            ++sent;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+    }
+
+    for (uint32_t idx = 0; idx < uart_num; ++idx) {
+        uart_dmatx_send(uarts[idx]);
+    }
+
+    return sent;
+}
+
+/**
+ * @brief 将数据编码成一帧, 写入消息实例的发送缓冲区
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ * @param data_type 数据类型
+ * @param data 数据内容
+ * @param data_len 数据长度
+ * @return 编码后的帧长度, 0 表示发送缓冲区分配失败
+ * @note 调用前需要持有发送缓冲区互斥量
+ */
+static uint32_t message_frame_encode(struct msg_instance *msg, msg_id_t msg_id,
+                                     msg_type_t data_type, uint8_t *data,
+                                     uint32_t data_len) {
+    /* 最坏情况下的帧长度: 1 byte 标识, 1 byte 长度, 数据全部转义, 2 byte CRC8,
+     * 1 byte 结束符 */
+    uint32_t frame_max = 2 + data_len * 2 + 2 + 1;
+
+#if MSG_ENABLE_EXT_ID
+    if (msg_id >= MSG_ID_EXT) {
+        /* 扩展 ID 也可能被转义 */
+        frame_max += 2;
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+
+#if MSG_ENABLE_SEQUENCE
+    if (msg->sequence) {
+        /* 序号也可能被转义 */
+        frame_max += 2;
+    }
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_FEC
+    if (msg->fec) {
+        /* 纠错校验也可能被转义, 块数与`MSG_FRAME_FIFO_SIZE`的算法一致,
+         * 静态缓冲区才放得下 */
+        frame_max += 4 * ((data_len + 5 + MSG_ID_EXT_LEN + MSG_FEC_BLOCK - 1) /
+                          MSG_FEC_BLOCK);
+    }
+#endif /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_STATIC_TABLE
+    if (msg->send_buf_len < frame_max) {
+        /* 静态缓冲区按消息表中的最大长度分配, 发送时已经检查过长度 */
+        return 0;
+    }
+#else  /* MSG_ENABLE_STATIC_TABLE */
+    if (msg->send_buf_len < frame_max) {
+        /* 不够, 扩容到最坏情况的帧长度 */
+        uint8_t *new_buf = (uint8_t *)MSG_REALLOC(msg->send_buf, frame_max);
+        if (new_buf == NULL) {
+            return 0;
+        }
+
+        msg->send_buf = new_buf;
+        msg->send_buf_len = frame_max;
+    } else if (frame_max * 3 <= msg->send_buf_len) {
+        /* 长度小于 1/3, 缩容到原来的 1/2 */
+        uint8_t *new_buf =
+            (uint8_t *)MSG_REALLOC(msg->send_buf, msg->send_buf_len / 2);
+        if (new_buf == NULL) {
+            return 0;
+        }
+
+        msg->send_buf = new_buf;
+        msg->send_buf_len = msg->send_buf_len / 2;
+    }
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+    return msg_frame_write(msg, msg_id, data_type, data, data_len,
+                           (uint8_t *)msg->send_buf);
+}
+
+/**
+ * @brief 将数据编码成一帧, 写入指定的缓冲区
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ * @param data_type 数据类型
+ * @param data 数据内容
+ * @param data_len 数据长度
+ * @param[out] send_buf 帧缓冲区, 不小于`MSG_FRAME_WIRE_SIZE(data_len)`
+ * @return 编码后的帧长度
+ * @note 调用前需要持有发送缓冲区互斥量, 数据帧会占用一个序号
+ */
+static uint32_t msg_frame_write(struct msg_instance *msg, msg_id_t msg_id,
+                                msg_type_t data_type, uint8_t *data,
+                                uint32_t data_len, uint8_t *send_buf) {
+    /* 第一个字节, 高四位标记 ID, 低四位标记数据类型 */
+    uint8_t id_type = (uint8_t)(msg_id << 4) | data_type;
+
+#if MSG_ENABLE_EXT_ID
+    bool ext = (msg_id >= MSG_ID_EXT);
+    if (ext) {
+        /* 高四位写扩展标识 */
+        id_type = (uint8_t)(MSG_ID_EXT << 4) | data_type;
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+
+#if MSG_ENABLE_SEQUENCE
+    uint8_t seq = msg->seq_next;
+    if (msg->sequence && data_type != MSG_DATA_CONTROL) {
+        /* 缓冲区准备好才占用序号, 编码失败不能让接收方误计丢帧.
+         * 应答帧不占用序号, 以免打乱本方向的数据帧序号 */
+        ++msg->seq_next;
+    }
+#endif /* MSG_ENABLE_SEQUENCE */
+
+    uint32_t buf_idx = 0;
+#if MSG_ENABLE_STATISTICS
+    uint32_t escape_count = 0;
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_CRC8
+    /* CRC8 校验结果 */
+    uint8_t crc8_value = 0;
+#if MSG_ENABLE_SEQUENCE
+    if (msg->sequence) {
+        /* 标识, 长度和序号一起参与校验, 避免帧头出错 (如应答帧和数据帧
+         * 混淆) 无法发现. 按接收队列中的顺序排列 */
+        uint8_t frame_head[4];
+        uint32_t head_len = 0;
+        frame_head[head_len++] = id_type;
+#if MSG_ENABLE_EXT_ID
+        if (ext) {
+            frame_head[head_len++] = (uint8_t)msg_id;
+        }
+#endif /* MSG_ENABLE_EXT_ID */
+        frame_head[head_len++] = (uint8_t)data_len;
+        frame_head[head_len++] = seq;
+        crc8_value = calc_crc8_update(crc8_value, frame_head, head_len);
+    }
+#endif /* MSG_ENABLE_SEQUENCE */
+    crc8_value = calc_crc8_update(crc8_value, data, data_len);
+#endif /* MSG_ENABLE_CRC8 */
+
+    send_buf[buf_idx] = id_type;
+    ++buf_idx;
+
+#if MSG_ENABLE_EXT_ID
+    if (ext) {
+        /* 扩展 ID 紧跟在第一个字节后面, 和数据一样需要转义 */
+#ifdef MSG_ESC
+        if (((uint8_t)msg_id == MSG_EOF) || ((uint8_t)msg_id == MSG_ESC)) {
+            send_buf[buf_idx] = MSG_ESC;
+            ++buf_idx;
+#if MSG_ENABLE_STATISTICS
+            ++escape_count;
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+#endif /* MSG_ESC */
+        send_buf[buf_idx] = (uint8_t)msg_id;
+        ++buf_idx;
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+    /* 第二个字节, 标记数据长度 */
+    send_buf[buf_idx] = (uint8_t)data_len;
+    ++buf_idx;
+
+#if MSG_ENABLE_SEQUENCE
+    if (msg->sequence) {
+        /* 启用序号时, 第三个字节是序号, 和数据一样需要转义 */
+#ifdef MSG_ESC
+        if ((seq == MSG_EOF) || (seq == MSG_ESC)) {
+            send_buf[buf_idx] = MSG_ESC;
+            ++buf_idx;
+#if MSG_ENABLE_STATISTICS
+            ++escape_count;
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+#endif /* MSG_ESC */
+        send_buf[buf_idx] = seq;
+        ++buf_idx;
+    }
+#endif /* MSG_ENABLE_SEQUENCE */
+
+    /* 复制数据到字节流 */
+    for (uint32_t data_idx = 0; data_idx < data_len; ++data_idx) {
+#ifdef MSG_ESC
+        if ((data[data_idx] == MSG_EOF) || (data[data_idx] == MSG_ESC)) {
+            /* 转义 */
+            send_buf[buf_idx] = MSG_ESC;
+            ++buf_idx;
+#if MSG_ENABLE_STATISTICS
+            ++escape_count;
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+#endif /* MSG_ESC */
+
+        send_buf[buf_idx] = data[data_idx];
         ++buf_idx;
     }
 
@@ -278,278 +1520,5280 @@ void message_send_data(msg_id_t msg_id, msg_type_t data_type, uint8_t *data,
     ++buf_idx;
 #endif /* MSG_ENABLE_CRC8 */
 
-    /* 最后一个字节, 标记数据末尾 */
-    send_buf[buf_idx] = MSG_EOF;
-    ++buf_idx;
+#if MSG_ENABLE_FEC
+    if (msg->fec) {
+        /* 对前面所有字节计算纠错校验, 附加在结束符之前 */
+#if MSG_ENABLE_STATISTICS
+        buf_idx = msg_fec_append(send_buf, buf_idx, &escape_count);
+#else  /* MSG_ENABLE_STATISTICS */
+        buf_idx = msg_fec_append(send_buf, buf_idx, NULL);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+#endif /* MSG_ENABLE_FEC */
+
+    /* 最后一个字节, 标记数据末尾 */
+    send_buf[buf_idx] = MSG_EOF;
+    ++buf_idx;
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++msg->stats.send_count;
+    msg->stats.send_bytes += buf_idx;
+    msg->stats.send_escape += escape_count;
+    msg_rate_update(&msg->send_rate, buf_idx);
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+
+    return buf_idx;
+}
+
+static void message_data_enqueue(struct msg_instance *msg, uint32_t recv_len);
+static void message_data_dequeue(struct msg_instance *msg, msg_id_t msg_id);
+static inline void message_polling_instance(struct msg_instance *msg,
+                                            msg_id_t msg_id);
+
+/**
+ * @brief 设置每次轮询某个 ID 最多分发的帧数
+ *
+ * @param msg_id 数据含义
+ * @param limit 最多分发的帧数, 0 为不限制
+ * @note 达到上限后剩余的帧留在队列中等下一次轮询, 避免高频 ID 的回调
+ *       拖慢其他 ID. 上限过小会使队列积压, 需要相应增大队列大小
+ */
+void message_set_dispatch_limit(msg_id_t msg_id, uint32_t limit) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    if (msg_list[msg_id] == NULL) {
+        return;
+    }
+
+    msg_list[msg_id]->dispatch_limit = limit;
+}
+
+/**
+ * @brief 轮询数据, 并调用相应的函数
+ *
+ */
+void message_polling_data(void) {
+#if MSG_ENABLE_STATIC_TABLE
+    /* 按消息表展开, 实例地址是常量, 不用查表和判空 */
+#define MSG_TABLE_POLL(id, ...) message_polling_instance(&msg_instance_##id, id);
+    MSG_TABLE(MSG_TABLE_POLL)
+#undef MSG_TABLE_POLL
+#else  /* MSG_ENABLE_STATIC_TABLE */
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        message_polling_id(i);
+    }
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+#if MSG_ENABLE_CONFLATE
+    /* 发送队列空闲后发出留在发送缓冲区的帧 */
+    message_conflate_flush();
+#endif /* MSG_ENABLE_CONFLATE */
+}
+
+/**
+ * @brief 轮询一个 ID 的数据, 并调用相应的函数
+ *
+ * @param msg_id 数据含义
+ * @note 每个 ID 的接收缓冲区, 队列和解包状态相互独立, 不同的 ID 可以在
+ *       不同的线程中同时轮询. 同一个 ID 只能在一个线程中轮询
+ */
+void message_polling_id(msg_id_t msg_id) {
+    struct msg_instance *msg;
+
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    msg = msg_list[msg_id];
+    if ((msg == NULL) || (msg->fifo == NULL)) {
+        return;
+    }
+
+    message_polling_instance(msg, msg_id);
+}
+
+/**
+ * @brief 轮询一个实例: 分发已解出的帧, 读链路, 解包
+ *
+ * @param msg 消息实例, 必须已经注册接收
+ * @param msg_id 数据含义
+ */
+static inline void message_polling_instance(struct msg_instance *msg,
+                                            msg_id_t msg_id) {
+    uint32_t recv_len;
+
+    message_data_dequeue(msg, msg_id);
+
+#if MSG_ENABLE_BOND
+    if (msg->bond_of != NULL) {
+        /* 空闲的链路不能证明缺帧已经丢失, 等待超时后跳过 */
+        msg_bond_poll(msg->bond_of);
+    }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+    if (msg->failover_of != NULL) {
+        /* 发送心跳, 检查健康度, 需要时切换链路 */
+        msg_failover_poll(msg->failover_of, msg->failover_index);
+    }
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_RELIABLE
+    /* 超时未确认的帧重传 */
+    msg_reliable_poll(msg, msg_id);
+#endif /* MSG_ENABLE_RELIABLE */
+
+    recv_len = message_receive(msg);
+    if (recv_len == 0) {
+        return;
+    }
+
+#if MSG_ENABLE_LATENCY
+    msg->rx_stamp = MSG_TIMESTAMP();
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    msg->stats.recv_bytes += recv_len;
+    msg_rate_update(&msg->recv_rate, recv_len);
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_RECORD
+    /* 解包之前记录原始字节, 回放时能复现同样的解包过程 */
+    msg_record_chunk(msg_id, msg->recv_buf, recv_len);
+#endif /* MSG_ENABLE_RECORD */
+
+    message_data_enqueue(msg, recv_len);
+}
+
+/**
+ * @brief 从接收链路 (串口, CAN 或 SPI) 读出数据到接收缓冲区
+ *
+ * @param msg 消息实例
+ * @return 读出的字节数, 没有注册接收链路时返回 0
+ */
+static uint32_t message_receive(struct msg_instance *msg) {
+#if MSG_ENABLE_CAN
+    if (msg->can != NULL) {
+        return msg_can_read(msg->can, msg->recv_buf, msg->recv_buf_size);
+    }
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+    if (msg->spi != NULL) {
+        /* 主机在这里检查是否需要开始传输 */
+        msg_spi_kick(msg);
+        return msg_spi_read(msg->spi, msg->recv_buf, msg->recv_buf_size);
+    }
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+    if (msg->eth != NULL) {
+        /* 读出网卡收到的数据报, 检查发送定时 */
+        msg_eth_poll(msg);
+        return msg_eth_read(msg->eth, msg->recv_buf, msg->recv_buf_size);
+    }
+#endif /* MSG_ENABLE_ETH */
+
+    if (msg->recv_uart == NULL) {
+        return 0;
+    }
+
+    return uart_dmarx_read(msg->recv_uart, msg->recv_buf, msg->recv_buf_size);
+}
+
+/**
+ * @brief 消息数据入队
+ * 
+ * @param msg 消息实例
+ * @param recv_len 接收到的数据长度
+ */
+static void message_data_enqueue(struct msg_instance *msg, uint32_t recv_len) {
+    msg_fifo_t *fifo = msg->fifo;
+
+#if MSG_ENABLE_STATISTICS
+    /* 逐字节的计数先累加在这里, 最后一次写入统计 */
+    uint32_t escape_count = 0;
+    uint32_t max_element_len = 0;
+#endif /* MSG_ENABLE_STATISTICS */
+
+    for (uint32_t i = 0; i < recv_len; ++i) {
+        if (msg->hunting) {
+            /* 跳过丢弃的帧, 从下一个结束符之后继续 */
+            i = msg_frame_hunt(msg, i, recv_len) - 1;
+            continue;
+        }
+
+#ifdef MSG_ESC
+        if ((msg->recv_buf[i] == MSG_ESC) && (msg->escape == false)) {
+            /* 遇到转义, 跳过这一字节到下一字节 */
+            msg->escape = true;
+#if MSG_ENABLE_STATISTICS
+            ++escape_count;
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+#endif /* MSG_ESC */
+
+#if MSG_ENABLE_RESYNC
+        if (!msg_resync_check(msg, msg->recv_buf[i])) {
+            /* 噪声或者错误帧, 已经丢弃 */
+            continue;
+        }
+#else  /* MSG_ENABLE_RESYNC */
+        if (!msg_frame_head_valid(fifo, msg->recv_buf[i])) {
+            /* 长度超出注册的范围, 退回帧头, 不等整帧存完就丢弃 */
+            fifo->tail -= fifo->frame_len + 1U;
+            fifo->frame_len = 0;
+            fifo->new_frame = true;
+#ifdef MSG_ESC
+            msg->hunting = msg->escape || (msg->recv_buf[i] != MSG_EOF);
+            msg->escape = false;
+#else  /* MSG_ESC */
+            msg->hunting = (msg->recv_buf[i] != MSG_EOF);
+#endif /* MSG_ESC */
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.recv_oversize);
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+#endif /* MSG_ENABLE_RESYNC */
+
+        if (fifo->frame_len >= MSG_FIFO_FRAME_MAX) {
+            /* 超出 FIFO 元素大小的帧不再存入, 等到结束符整帧丢弃, 后面的帧
+             * 不受影响 */
+#ifdef MSG_ESC
+            if (msg->escape || (msg->recv_buf[i] != MSG_EOF)) {
+                msg->escape = false;
+                continue;
+            }
+#else  /* MSG_ESC */
+            if (msg->recv_buf[i] != MSG_EOF) {
+                continue;
+            }
+#endif /* MSG_ESC */
+            fifo->tail -= fifo->frame_len + 1U;
+            fifo->frame_len = 0;
+            fifo->new_frame = true;
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.recv_oversize);
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+
+        if (fifo->new_frame) {
+            /* 空一个字节写长度, 长度写 0 */
+            fifo->buf[fifo->tail & fifo->mask] = 0;
+            ++fifo->tail;
+            fifo->new_frame = false;
+#if MSG_ENABLE_LATENCY
+            msg->frame_arrive = msg->rx_stamp;
+#endif /* MSG_ENABLE_LATENCY */
+        }
+
+        /* 将数据写入队列 */
+        fifo->buf[fifo->tail & fifo->mask] = msg->recv_buf[i];
+        ++fifo->tail;
+        ++fifo->frame_len;
+
+        if (fifo->size == (fifo->tail - fifo->head)) {
+            /* FIFO 已满, 先覆盖旧数据, 有新的帧直接清空 FIFO, 从头开始存 */
+            fifo->head = 0;
+            fifo->tail = 0;
+            msg->fifo_element_len = 0;
+            fifo->frame_len = 0;
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.fifo_overflow);
+#endif /* MSG_ENABLE_STATISTICS */
+#if MSG_ENABLE_FAILOVER
+            msg_failover_penalty(msg, MSG_FAILOVER_OVERFLOW_PENALTY);
+#endif /* MSG_ENABLE_FAILOVER */
+#if MSG_ENABLE_LATENCY
+            /* 队列里的帧都被丢弃了, 对应的时间戳也作废 */
+            msg->frame_out = msg->frame_in;
+#endif /* MSG_ENABLE_LATENCY */
+#if MSG_ENABLE_RESYNC
+            /* 正在接收的帧已经不完整, 丢弃剩下的部分 */
+            fifo->new_frame = true;
+#ifdef MSG_ESC
+            msg->hunting = msg->escape || (msg->recv_buf[i] != MSG_EOF);
+            msg->escape = false;
+#else  /* MSG_ESC */
+            msg->hunting = (msg->recv_buf[i] != MSG_EOF);
+#endif /* MSG_ESC */
+            msg->scanning = msg->hunting;
+            continue;
+#endif /* MSG_ENABLE_RESYNC */
+        }
+
+#ifdef MSG_ESC
+        if (msg->escape) {
+            msg->escape = false;
+            /* 这是被转义的字符, 避免执行到下面的结束标识被当成结束符处理 */
+            continue;
+        }
+#endif /* MSG_ESC */
+
+        if (msg->recv_buf[i] == MSG_EOF) {
+            /* 写入上帧长度, 算上 FIFO 元素大小 */
+            fifo->buf[(fifo->tail - fifo->frame_len - 1) & fifo->mask] =
+                fifo->frame_len + 1;
+
+            /* 帧长度清零 */
+            fifo->frame_len = 0;
+
+            /* 下次空出一个字节写 */
+            fifo->new_frame = true;
+
+            ++msg->fifo_element_len;
+
+#if MSG_ENABLE_LATENCY
+            msg_stamp_t *stamp =
+                &msg->stamps[msg->frame_in & (MSG_LATENCY_DEPTH - 1)];
+            stamp->index = msg->frame_in;
+            stamp->arrive = msg->frame_arrive;
+            stamp->decoded = MSG_TIMESTAMP();
+            ++msg->frame_in;
+#endif /* MSG_ENABLE_LATENCY */
+        }
+
+#if MSG_ENABLE_STATISTICS
+        if (msg->fifo_element_len > max_element_len) {
+            max_element_len = msg->fifo_element_len;
+        }
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    msg->stats.recv_escape += escape_count;
+    if (max_element_len > msg->stats.max_fifo_element_len) {
+        msg->stats.max_fifo_element_len = max_element_len;
+    }
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 帧头中扩展 ID 的字节数
+ *
+ * @param id_type 帧的第一个字节
+ * @return 高四位是扩展标识时返回 1, 否则返回 0
+ */
+static inline uint32_t msg_ext_len(uint8_t id_type) {
+#if MSG_ENABLE_EXT_ID
+    return ((id_type >> 4) == MSG_ID_EXT) ? 1U : 0U;
+#else  /* MSG_ENABLE_EXT_ID */
+    (void)id_type;
+    return 0U;
+#endif /* MSG_ENABLE_EXT_ID */
+}
+
+#if MSG_ENABLE_CRC8
+/**
+ * @brief 校验队列中一帧的 CRC8
+ *
+ * @param data 帧数据, 帧头在前面连续存放, CRC8 紧跟在数据后面
+ * @param len 数据长度
+ * @param head_len 参与校验的帧头长度, 启用序号时帧头一起校验
+ * @return 校验是否通过
+ */
+static inline bool msg_frame_crc_valid(uint8_t *data, uint32_t len,
+                                       uint32_t head_len) {
+    uint8_t crc_value = calc_crc8(data - head_len, len + head_len);
+    /* CRC8 分成高低两个半字节存放, 避免与结束符冲突 */
+    uint8_t crc_recv = (data[len + 1] & 0x0F) | (data[len] << 4);
+
+    return crc_value == crc_recv;
+}
+#endif /* MSG_ENABLE_CRC8 */
+
+/**
+ * @brief 检查数据类型和长度是否符合该 ID 注册的范围
+ *
+ * @param msg_id 数据含义
+ * @param data_type 数据类型
+ * @param len 数据长度
+ * @return 符合, ID 没有注册长度或者是应答帧时返回`true`
+ */
+static inline bool msg_frame_valid(uint32_t msg_id, uint8_t data_type,
+                                   uint32_t len) {
+    struct msg_instance *msg;
+
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (data_type == MSG_DATA_CONTROL)) {
+        return true;
+    }
+
+    msg = msg_list[msg_id];
+#if MSG_ENABLE_STATIC_TABLE
+    if ((msg->type_mask & (1U << data_type)) == 0) {
+        /* 与消息表中声明的类型不一致 */
+        return false;
+    }
+#else  /* MSG_ENABLE_STATIC_TABLE */
+    if (msg == NULL) {
+        return true;
+    }
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+    if (!msg->len_limited) {
+        return true;
+    }
+
+    return (len >= msg->len_min) && (len <= msg->len_max);
+}
+
+/**
+ * @brief 帧头 (标识和扩展 ID) 存完后, 用收到的长度字节检查帧是否有效
+ *
+ * @param fifo 接收队列
+ * @param byte 收到的字节
+ * @return 不是长度字节或者帧有效时返回`true`
+ */
+static inline bool msg_frame_head_valid(msg_fifo_t *fifo, uint8_t byte) {
+    uint8_t id_type;
+    uint32_t ext_len;
+
+    if (fifo->new_frame || (fifo->frame_len == 0)) {
+        return true;
+    }
+
+    id_type = fifo->buf[(fifo->tail - fifo->frame_len) & fifo->mask];
+    ext_len = msg_ext_len(id_type);
+    if ((fifo->frame_len != 1 + ext_len) ||
+        (fifo->tail - fifo->head < fifo->frame_len + 1U)) {
+        return true;
+    }
+
+    return msg_frame_valid(ext_len ? fifo->buf[(fifo->tail - 1) & fifo->mask]
+                                   : (uint32_t)(id_type >> 4),
+                           id_type & 0x0F, byte);
+}
+
+/**
+ * @brief 跳过噪声, 查找下一个没有被转义的结束符
+ *
+ * @param msg 消息实例
+ * @param pos 开始查找的位置, `msg->escape`是这个位置的转义状态
+ * @param recv_len 接收到的数据长度
+ * @return 结束符之后的位置, 没有找到返回`recv_len`
+ * @note 用`memchr`成块查找结束符, 丢弃的字节不逐个处理. 非转义符后面一定
+ *       不在转义状态, 所以结束符是否被转义只取决于它前面连续转义符个数的奇偶
+ */
+static uint32_t msg_frame_hunt(struct msg_instance *msg, uint32_t pos,
+                                uint32_t recv_len) {
+    const uint8_t *buf = msg->recv_buf;
+    const uint8_t *eof;
+    uint32_t p = pos;
+    bool escape = false;
+
+    for (;;) {
+        eof = (const uint8_t *)memchr(&buf[p], MSG_EOF, recv_len - p);
+        p = (eof == NULL) ? recv_len : (uint32_t)(eof - buf);
+
+#ifdef MSG_ESC
+        uint32_t run = 0;
+        while ((p - run > pos) && (buf[p - run - 1] == MSG_ESC)) {
+            ++run;
+        }
+        escape = (((p - run == pos) && msg->escape) != ((run & 1) != 0));
+#endif /* MSG_ESC */
+
+        if ((eof == NULL) || !escape) {
+            break;
+        }
+
+        /* 被转义的结束符是数据, 继续查找 */
+        ++p;
+    }
+
+    if (eof != NULL) {
+        /* 找到帧边界, 下一个字节是新的一帧 */
+        msg->hunting = false;
+        ++p;
+    }
+
+#ifdef MSG_ESC
+    /* 没有找到时保留末尾的转义状态, 下次接着查找 */
+    msg->escape = (eof == NULL) && escape;
+#endif /* MSG_ESC */
+
+#if MSG_ENABLE_STATISTICS && MSG_ENABLE_RESYNC
+    MSG_STATS_ADD(msg->stats.resync_discard, p - pos);
+#endif /* MSG_ENABLE_STATISTICS && MSG_ENABLE_RESYNC */
+
+    return p;
+}
+
+/**
+ * @brief 消息数据出队并调用回调函数
+ *
+ * @param msg 消息实例
+ * @param msg_id 消息 ID
+ */
+static void message_data_dequeue(struct msg_instance *msg, msg_id_t msg_id) {
+    if (msg->fifo_element_len == 0) {
+        /* 队列中没有元素 */
+        return;
+    }
+
+    msg_fifo_t *fifo = msg->fifo;
+    uint8_t frame_len;
+    /* 回调消息 ID & type */
+    uint8_t call_id_type;
+    /* 回调消息数据 */
+    uint8_t *call_data;
+    /* 回调消息长度 */
+    uint32_t call_len;
+    /* 实际在缓冲区的位置指针 */
+    uint32_t head, tail;
+
+#if MSG_ENABLE_ROUTE
+    /* 当前帧的路由 */
+    const msg_route_t *route;
+#endif /* MSG_ENABLE_ROUTE */
+
+    /* 本次轮询已分发的帧数 */
+    uint32_t dispatched = 0;
+    /* 序号长度 */
+    uint32_t seq_len = 0;
+    /* 纠错校验长度 */
+    uint32_t fec_len = 0;
+    /* 扩展 ID 长度 */
+    uint32_t ext_len;
+
+#if MSG_ENABLE_SEQUENCE
+    seq_len = msg->sequence ? 1 : 0;
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_LATENCY
+    /* 当前帧的时间戳 */
+    msg_stamp_t *stamp;
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+    /* 回调进入与退出时刻 */
+    uint32_t call_entry, call_exit;
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+
+    /* 队空条件: head == tail */
+    while (fifo->head != fifo->tail) {
+        /* 头存储的是帧长度 */
+        frame_len = fifo->buf[fifo->head & fifo->mask];
+        if (frame_len == 0) {
+            /* 最后一帧还没存完, 存完才会写长度, 已经结束了, 跳出循环 */
+            break;
+        }
+
+        if (fifo->head > fifo->tail) {
+            /* 正常不可能头比尾还大 */
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.recv_error);
+#endif /* MSG_ENABLE_STATISTICS */
+            break;
+        }
+
+        if ((msg->dispatch_limit != 0) && (dispatched >= msg->dispatch_limit)) {
+            /* 达到本次分发上限, 剩下的留到下一次轮询 */
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.dispatch_limited);
+#endif /* MSG_ENABLE_STATISTICS */
+            break;
+        }
+
+#if MSG_ENABLE_LATENCY
+        /* 每出队一帧都要取走一个时间戳, 与入队一一对应 */
+        stamp = msg_latency_pop(msg);
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_CONFLATE
+        if ((msg->mailbox != NULL) && (msg->fifo_element_len > 1)) {
+            /* 后面已经有完整的新帧, 这一帧不校验也不回调, 序号照常检查 */
+#if MSG_ENABLE_SEQUENCE
+            if (msg->sequence) {
+                ext_len = msg_ext_len(fifo->buf[(fifo->head + 1) & fifo->mask]);
+                msg_sequence_check(
+                    msg, fifo->buf[(fifo->head + 3 + ext_len) & fifo->mask]);
+            }
+#endif /* MSG_ENABLE_SEQUENCE */
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.conflate_skip);
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+#endif /* MSG_ENABLE_CONFLATE */
+
+        head = fifo->head & fifo->mask;
+        tail = (fifo->head + frame_len) & fifo->mask;
+
+#if MSG_ENABLE_FEC
+        if (msg->fec) {
+            /* 先在 FIFO 中纠错, 之后的长度和 CRC8 检查都基于纠正后的数据 */
+            fec_len = msg_fec_decode(msg, fifo, frame_len);
+            if (fec_len == 0) {
+                /* 无法纠正, 出队到下一个 */
+                fifo->head += frame_len;
+                --msg->fifo_element_len;
+                continue;
+            }
+        }
+#endif /* MSG_ENABLE_FEC */
+
+        ext_len = msg_ext_len(fifo->buf[(fifo->head + 1) & fifo->mask]);
+
+        /* 验证数据包长度与实际接收长度是否一致, 长度在标识 (和扩展 ID) 之后 */
+#if MSG_ENABLE_CRC8
+        /* 1 byte 标识, 1 byte 长度, 1 byte 结束符, 1 byte FIFO 元素大小
+         * 2 byte CRC8 校验值
+         * 总共 6 byte, 启用序号还有 1 byte 序号, 启用纠错还有纠错校验,
+         * 扩展 ID 还有 1 byte. */
+        if ((frame_len - 6 - seq_len - fec_len - ext_len) !=
+            fifo->buf[(fifo->head + 2 + ext_len) & fifo->mask]) {
+#else  /* MSG_ENABLE_CRC8 */
+        /* 1 byte 标识, 1 byte 长度, 1 byte 结束符, 1 byte FIFO 元素大小
+         * 总共 4 byte, 启用序号还有 1 byte 序号, 启用纠错还有纠错校验,
+         * 扩展 ID 还有 1 byte. */
+        if ((frame_len - 4 - seq_len - fec_len - ext_len) !=
+            fifo->buf[(fifo->head + 2 + ext_len) & fifo->mask]) {
+#endif /* MSG_ENABLE_CRC8 */
+
+            /* 不一致, 出队到下一个 */
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.recv_error);
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+
+        if (tail < head) {
+            /* 数据在头尾, 分成两段, 直接复制到`recv_buf` (下一次读取就覆盖了) */
+            if (frame_len <= msg->recv_buf_size) {
+                /* 复制前半段 */
+                memcpy(msg->recv_buf, &fifo->buf[head], fifo->size - head);
+                /* 复制后半段 */
+                memcpy(&msg->recv_buf[fifo->size - head], &fifo->buf[0], tail);
+                call_id_type = msg->recv_buf[1];
+                call_len = msg->recv_buf[2 + ext_len];
+                call_data = &msg->recv_buf[3 + ext_len + seq_len];
+            } else {
+                /* 空间不够, 不复制, 出队到下一个 */
+                fifo->head += frame_len;
+                --msg->fifo_element_len;
+#if MSG_ENABLE_STATISTICS
+                MSG_STATS_INC(msg->stats.recv_error);
+#endif /* MSG_ENABLE_STATISTICS */
+                continue;
+            }
+        } else {
+            /* 完整的一帧没有被截断 */
+            call_id_type = fifo->buf[(fifo->head + 1) & fifo->mask];
+            call_len = fifo->buf[(fifo->head + 2 + ext_len) & fifo->mask];
+            call_data =
+                &fifo->buf[(fifo->head + 3 + ext_len + seq_len) & fifo->mask];
+        }
+
+#if MSG_ENABLE_ROUTE
+        /* 帧从标识开始, 到纠错校验结束, 不含 FIFO 元素大小和结束符 */
+        route = msg_route_find(msg, call_data - (2 + ext_len + seq_len),
+                               ext_len);
+        if (route != NULL) {
+            /* 转发到其他链路, 不回调也不检查序号 */
+#if MSG_ENABLE_CRC8
+            if (!route->cut_through &&
+                !msg_frame_crc_valid(call_data, call_len,
+                                     seq_len * (3 + ext_len))) {
+                /* 存储转发, 校验错误的帧不转发 */
+                fifo->head += frame_len;
+                --msg->fifo_element_len;
+#if MSG_ENABLE_STATISTICS
+                MSG_STATS_INC(msg->stats.crc_check_error);
+#endif /* MSG_ENABLE_STATISTICS */
+                continue;
+            }
+#endif /* MSG_ENABLE_CRC8 */
+
+            msg_route_forward(msg, route, call_data - (2 + ext_len + seq_len),
+                              frame_len - 2, ext_len);
+            ++dispatched;
+#if MSG_ENABLE_LATENCY
+            if (stamp != NULL) {
+                MSG_ENTER_CRITICAL();
+                msg_latency_hist_add(&msg->latency.forward,
+                                     MSG_TIMESTAMP() - stamp->arrive);
+                MSG_EXIT_CRITICAL();
+            }
+#endif /* MSG_ENABLE_LATENCY */
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+            continue;
+        }
+#endif /* MSG_ENABLE_ROUTE */
+
+#if MSG_ENABLE_CRC8
+        /* 校验 CRC8, 启用序号时帧头与数据连续存放, 一起校验 */
+        if (!msg_frame_crc_valid(call_data, call_len,
+                                 seq_len * (3 + ext_len))) {
+            /* 校验结果不一致, 出队到下一个 */
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.crc_check_error);
+#endif /* MSG_ENABLE_STATISTICS */
+#if MSG_ENABLE_FAILOVER
+            msg_failover_penalty(msg, MSG_FAILOVER_CRC_PENALTY);
+#endif /* MSG_ENABLE_FAILOVER */
+            continue;
+        }
+#endif /* MSG_ENABLE_CRC8 */
+
+#if MSG_ENABLE_BOND
+        if (msg->bond_of != NULL) {
+            /* 聚合的链路, 交给聚合按序号重排后回调逻辑 ID */
+            msg_bond_recv(msg->bond_of, msg->bond_index, call_id_type,
+                          call_data, call_len);
+            ++dispatched;
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+            continue;
+        }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+        if (msg->failover_of != NULL) {
+            /* 冗余组的链路, 心跳在这里处理, 数据帧去重后回调逻辑 ID */
+            msg_failover_recv(msg->failover_of, msg->failover_index,
+                              call_id_type, call_data, call_len);
+            ++dispatched;
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+            continue;
+        }
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_RELIABLE
+        if ((msg->reliable != NULL) &&
+            !msg_reliable_recv(msg, msg_id, call_id_type, call_data,
+                               call_len)) {
+            /* 应答帧, 乱序缓存或重复的帧, 不在这里回调 */
+            fifo->head += frame_len;
+            --msg->fifo_element_len;
+            continue;
+        }
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_SEQUENCE
+        if (msg->sequence) {
+            msg_sequence_check(msg, call_data[-1]);
+        }
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+        call_entry = MSG_TIMESTAMP();
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+
+        message_deliver(msg, msg_id, call_len, call_id_type, call_data);
+        ++dispatched;
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+        call_exit = MSG_TIMESTAMP();
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+#if MSG_ENABLE_LATENCY
+        msg_latency_record(msg, stamp, call_entry, call_exit);
+#endif /* MSG_ENABLE_LATENCY */
+#if MSG_ENABLE_CALLBACK_BUDGET
+        msg_callback_record(msg, msg_id, call_exit - call_entry);
+#endif /* MSG_ENABLE_CALLBACK_BUDGET */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.recv_success);
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_RELIABLE
+        if (msg->reliable != NULL) {
+            /* 交付之前缓存的后续帧, 回复确认 */
+            msg_reliable_advance(msg, msg_id);
+        }
+#endif /* MSG_ENABLE_RELIABLE */
+
+        /* 出队到下一个 */
+        fifo->head += frame_len;
+        --msg->fifo_element_len;
+    }
+}
+
+/**
+ * @brief 交付一帧数据, 调用回调或放入延迟分发队列
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据
+ */
+static void message_deliver(struct msg_instance *msg, msg_id_t msg_id,
+                            uint32_t msg_length, uint8_t msg_id_type,
+                            uint8_t *msg_data) {
+#if MSG_ENABLE_CONFLATE
+    if (msg->mailbox != NULL) {
+        /* 先更新邮箱, 回调中读取的也是这一帧 */
+        msg_mailbox_write(msg->mailbox, msg_id_type, msg_data, msg_length);
+    }
+#endif /* MSG_ENABLE_CONFLATE */
+
+#if MSG_ENABLE_DEFERRED
+    if (msg->frame_queue != NULL) {
+        /* 交给处理任务, 这里只复制数据 */
+        msg_frame_post(msg, msg_id, msg_length, msg_id_type, msg_data);
+        return;
+    }
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_STATIC_TABLE
+    /* 消息表中的回调直接调用, 可以被内联. 为 NULL 时使用运行时注册的回调 */
+#define MSG_TABLE_DELIVER(id, send, recv, max_len, type, cb)                   \
+    case id:                                                                   \
+        if ((uintptr_t)(cb) != 0) {                                            \
+            ((msg_recv_callback_t)(cb))(msg_length, msg_id_type, msg_data);    \
+            return;                                                            \
+        }                                                                      \
+        break;
+    switch (msg_id) {
+        MSG_TABLE(MSG_TABLE_DELIVER)
+        default:
+            break;
+    }
+#undef MSG_TABLE_DELIVER
+#else  /* MSG_ENABLE_STATIC_TABLE */
+    (void)msg_id;
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+    if (msg->recv_callback) {
+        msg->recv_callback(msg_length, msg_id_type, msg_data);
+    }
+}
+
+/**
+ * @brief 初始化消息队列
+ * 
+ * @param fifo_size 队列长度
+ * @return 消息队列
+ */
+static msg_fifo_t *msg_fifo_init(uint32_t fifo_size) {
+    msg_fifo_t *fifo = (msg_fifo_t *)MSG_MALLOC(sizeof(msg_fifo_t) + fifo_size);
+    if (fifo == NULL) {
+        return NULL;
+    }
+
+    fifo->size = fifo_size;
+    fifo->mask = fifo_size - 1;
+    fifo->head = 0;
+    fifo->tail = 0;
+    fifo->frame_len = 0;
+    fifo->new_frame = true;
+
+    return fifo;
+}
+
+#if MSG_ENABLE_STATISTICS
+
+/**
+ * @brief 获取消息统计快照
+ *
+ * @param msg_id 数据含义
+ * @param[out] stats 统计快照
+ * @return 获取结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或该 ID 未注册
+ * @note 在临界区内复制, 保证与收发路径并发更新时快照不会被撕裂
+ */
+uint8_t message_get_stats(msg_id_t msg_id, msg_stats_t *stats) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (stats == NULL)) {
+        return 1;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    MSG_ENTER_CRITICAL();
+    *stats = msg->stats;
+    stats->fifo_element_len = msg->fifo_element_len;
+    stats->send_rate = msg_rate_get(&msg->send_rate);
+    stats->recv_rate = msg_rate_get(&msg->recv_rate);
+#if MSG_ENABLE_ROUTE
+    stats->route_rate = msg_rate_get(&msg->route_rate);
+#endif /* MSG_ENABLE_ROUTE */
+    MSG_EXIT_CRITICAL();
+
+    return 0;
+}
+
+/**
+ * @brief 清零消息统计
+ *
+ * @param msg_id 数据含义
+ */
+void message_reset_stats(msg_id_t msg_id) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return;
+    }
+
+    uint32_t now = MSG_GET_TICK();
+
+    MSG_ENTER_CRITICAL();
+    memset(&msg->stats, 0, sizeof(msg_stats_t));
+    memset(&msg->send_rate, 0, sizeof(msg_rate_t));
+    memset(&msg->recv_rate, 0, sizeof(msg_rate_t));
+    msg->send_rate.start = now;
+    msg->recv_rate.start = now;
+#if MSG_ENABLE_ROUTE
+    memset(&msg->route_rate, 0, sizeof(msg_rate_t));
+    msg->route_rate.start = now;
+#endif /* MSG_ENABLE_ROUTE */
+    MSG_EXIT_CRITICAL();
+}
+
+/**
+ * @brief 滑动窗口向前滚动到当前时刻
+ *
+ * @param rate 速率窗口
+ * @param now 当前时刻
+ */
+static inline void msg_rate_roll(msg_rate_t *rate, uint32_t now) {
+    uint32_t elapsed = now - rate->start;
+
+    if (elapsed >= 2 * MSG_STATISTICS_WINDOW) {
+        /* 已经超过两个窗口没有数据 */
+        rate->prev = 0;
+        rate->cur = 0;
+        rate->start = now;
+    } else if (elapsed >= MSG_STATISTICS_WINDOW) {
+        rate->prev = rate->cur;
+        rate->cur = 0;
+        rate->start += MSG_STATISTICS_WINDOW;
+    }
+}
+
+/**
+ * @brief 累加速率窗口字节数
+ *
+ * @param rate 速率窗口
+ * @param bytes 字节数
+ */
+static void msg_rate_update(msg_rate_t *rate, uint32_t bytes) {
+    msg_rate_roll(rate, MSG_GET_TICK());
+    rate->cur += bytes;
+}
+
+/**
+ * @brief 计算最近一个窗口内的速率
+ *
+ * @param rate 速率窗口
+ * @return 速率 (byte/s)
+ */
+static uint32_t msg_rate_get(msg_rate_t *rate) {
+    uint32_t now = MSG_GET_TICK();
+    msg_rate_roll(rate, now);
+
+    /* 滚动后当前窗口已经过去的时间一定小于窗口长度 */
+    uint32_t elapsed = now - rate->start;
+
+    /* 上一个窗口按剩余时间加权, 再加上当前窗口 */
+    uint64_t bytes =
+        (uint64_t)rate->prev * (MSG_STATISTICS_WINDOW - elapsed) /
+            MSG_STATISTICS_WINDOW +
+        rate->cur;
+
+    return (uint32_t)(bytes * 1000 / MSG_STATISTICS_WINDOW);
+}
+
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_LATENCY
+
+/**
+ * @brief 获取消息延迟统计快照
+ *
+ * @param msg_id 数据含义
+ * @param[out] latency 延迟快照
+ * @return 获取结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或该 ID 未注册
+ */
+uint8_t message_get_latency(msg_id_t msg_id, msg_latency_t *latency) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (latency == NULL)) {
+        return 1;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    MSG_ENTER_CRITICAL();
+    *latency = msg->latency;
+    MSG_EXIT_CRITICAL();
+
+    return 0;
+}
+
+/**
+ * @brief 清零消息延迟统计
+ *
+ * @param msg_id 数据含义
+ */
+void message_reset_latency(msg_id_t msg_id) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return;
+    }
+
+    MSG_ENTER_CRITICAL();
+    memset(&msg->latency, 0, sizeof(msg_latency_t));
+    MSG_EXIT_CRITICAL();
+}
+
+/**
+ * @brief 取出最早一帧的时间戳
+ *
+ * @param msg 消息实例
+ * @return 时间戳, 已被覆盖返回`NULL`
+ */
+static msg_stamp_t *msg_latency_pop(struct msg_instance *msg) {
+    if (msg->frame_out == msg->frame_in) {
+        /* 队列溢出后时间戳已作废 */
+        return NULL;
+    }
+
+    msg_stamp_t *stamp =
+        &msg->stamps[msg->frame_out & (MSG_LATENCY_DEPTH - 1)];
+    uint32_t index = msg->frame_out;
+    ++msg->frame_out;
+
+    if (stamp->index != index) {
+        /* 在途帧超过`MSG_LATENCY_DEPTH`, 已经被后面的帧覆盖 */
+        ++msg->latency.lost_stamp;
+        return NULL;
+    }
+
+    return stamp;
+}
+
+/**
+ * @brief 记录一帧的延迟
+ *
+ * @param msg 消息实例
+ * @param stamp 帧时间戳, 为`NULL`时只统计回调耗时
+ * @param entry 回调进入时刻
+ * @param exit 回调退出时刻
+ */
+static void msg_latency_record(struct msg_instance *msg, msg_stamp_t *stamp,
+                               uint32_t entry, uint32_t exit) {
+    MSG_ENTER_CRITICAL();
+    if (stamp != NULL) {
+        msg_latency_hist_add(&msg->latency.decode,
+                             stamp->decoded - stamp->arrive);
+        msg_latency_hist_add(&msg->latency.queue, entry - stamp->decoded);
+    }
+    msg_latency_hist_add(&msg->latency.process, exit - entry);
+    MSG_EXIT_CRITICAL();
+}
+
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+
+/**
+ * @brief 将一个样本加入直方图
+ *
+ * @param hist 直方图
+ * @param value 样本值
+ */
+static inline void msg_latency_hist_add(msg_latency_hist_t *hist,
+                                        uint32_t value) {
+    /* 按最高有效位分桶, 0 放在第 0 个桶 */
+    uint32_t bucket = (value == 0) ? 0 : (32 - __builtin_clz(value));
+    if (bucket >= MSG_LATENCY_BUCKETS) {
+        bucket = MSG_LATENCY_BUCKETS - 1;
+    }
+
+    ++hist->count;
+    hist->total += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    ++hist->hist[bucket];
+}
+
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_CALLBACK_BUDGET
+
+/**
+ * @brief 设置回调耗时预算
+ *
+ * @param msg_id 数据含义
+ * @param budget 耗时预算 (时间戳单位, 见`MSG_TIMESTAMP`), 0 为不检查
+ * @param hook 回调超出预算时调用的钩子, 可以为`NULL`
+ */
+void message_register_callback_budget(msg_id_t msg_id, uint32_t budget,
+                                      msg_overrun_hook_t hook) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    msg->callback.budget = budget;
+    msg->overrun_hook = hook;
+
+    MSG_TIMESTAMP_INIT();
+}
+
+/**
+ * @brief 获取回调耗时统计快照
+ *
+ * @param msg_id 数据含义
+ * @param[out] stats 统计快照
+ * @return 获取结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或该 ID 未注册
+ */
+uint8_t message_get_callback_stats(msg_id_t msg_id,
+                                   msg_callback_stats_t *stats) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (stats == NULL)) {
+        return 1;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    MSG_ENTER_CRITICAL();
+    *stats = msg->callback;
+    MSG_EXIT_CRITICAL();
+
+    return 0;
+}
+
+/**
+ * @brief 清零回调耗时统计, 保留预算设置
+ *
+ * @param msg_id 数据含义
+ */
+void message_reset_callback_stats(msg_id_t msg_id) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return;
+    }
+
+    MSG_ENTER_CRITICAL();
+    memset(&msg->callback.duration, 0, sizeof(msg_latency_hist_t));
+    msg->callback.overrun = 0;
+    MSG_EXIT_CRITICAL();
+}
+
+/**
+ * @brief 记录一次回调耗时, 超出预算时调用钩子
+ *
+ * @param msg 消息实例
+ * @param msg_id 消息 ID
+ * @param duration 回调耗时
+ */
+static void msg_callback_record(struct msg_instance *msg, msg_id_t msg_id,
+                                uint32_t duration) {
+    bool overrun;
+
+    MSG_ENTER_CRITICAL();
+    msg_latency_hist_add(&msg->callback.duration, duration);
+    overrun = (msg->callback.budget != 0) && (duration > msg->callback.budget);
+    if (overrun) {
+        ++msg->callback.overrun;
+    }
+    MSG_EXIT_CRITICAL();
+
+    if (overrun && (msg->overrun_hook != NULL)) {
+        msg->overrun_hook(msg_id, duration);
+    }
+}
+
+#endif /* MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_DEFERRED
+
+/**
+ * @brief 设置某个 ID 使用延迟分发
+ *
+ * @param msg_id 数据含义
+ * @param queue 分发队列, 元素为`msg_frame_t *`. 多个 ID 可以共用一个队列;
+ *              传入`NULL`则新建一个深度为`frame_num`的队列
+ * @param frame_num 帧池中的帧个数
+ * @param frame_size 每帧数据区大小, 超过该长度的帧会被丢弃
+ * @return 分发队列, 失败返回`NULL`
+ * @note 启用后该 ID 不再调用接收回调. 处理任务取出帧后必须调用
+ *       `message_frame_release`归还
+ */
+QueueHandle_t message_register_deferred(msg_id_t msg_id, QueueHandle_t queue,
+                                        uint32_t frame_num,
+                                        uint32_t frame_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (frame_num == 0) ||
+        (frame_size == 0)) {
+        return NULL;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg->frame_pool != NULL) {
+        /* 已经注册过 */
+        return msg->frame_queue;
+    }
+
+    /* 每帧按 4 字节对齐 */
+    uint32_t block_size = (sizeof(msg_frame_t) + frame_size + 3) & ~3U;
+
+    msg_frame_pool_t *pool =
+        (msg_frame_pool_t *)MSG_MALLOC(sizeof(msg_frame_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->frame_size = frame_size;
+    pool->mem = (uint8_t *)MSG_MALLOC(block_size * frame_num);
+    pool->free_queue = xQueueCreate(frame_num, sizeof(msg_frame_t *));
+    if ((pool->mem == NULL) || (pool->free_queue == NULL)) {
+        MSG_FREE(pool->mem);
+        if (pool->free_queue != NULL) {
+            vQueueDelete(pool->free_queue);
+        }
+        MSG_FREE(pool);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < frame_num; ++i) {
+        msg_frame_t *frame = (msg_frame_t *)&pool->mem[i * block_size];
+        frame->pool = pool;
+        xQueueSend(pool->free_queue, &frame, 0);
+    }
+
+    if (queue == NULL) {
+        queue = xQueueCreate(frame_num, sizeof(msg_frame_t *));
+        if (queue == NULL) {
+            vQueueDelete(pool->free_queue);
+            MSG_FREE(pool->mem);
+            MSG_FREE(pool);
+            return NULL;
+        }
+    }
+
+    msg->frame_pool = pool;
+    msg->frame_queue = queue;
+
+    return queue;
+}
+
+/**
+ * @brief 归还延迟分发的帧
+ *
+ * @param frame 从分发队列取出的帧
+ */
+void message_frame_release(msg_frame_t *frame) {
+    if (frame == NULL) {
+        return;
+    }
+
+    msg_frame_pool_t *pool = (msg_frame_pool_t *)frame->pool;
+    xQueueSend(pool->free_queue, &frame, 0);
+}
+
+/**
+ * @brief 将一帧复制到帧池并放入分发队列
+ *
+ * @param msg 消息实例
+ * @param msg_id 消息 ID
+ * @param msg_length 消息长度
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据
+ * @note 帧池耗尽或队列已满时直接丢弃, 不阻塞轮询任务
+ */
+static void msg_frame_post(struct msg_instance *msg, msg_id_t msg_id,
+                           uint32_t msg_length, uint8_t msg_id_type,
+                           uint8_t *msg_data) {
+    msg_frame_pool_t *pool = msg->frame_pool;
+    msg_frame_t *frame;
+
+    if ((msg_length > pool->frame_size) ||
+        (xQueueReceive(pool->free_queue, &frame, 0) != pdTRUE)) {
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.deferred_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return;
+    }
+
+    frame->msg_id = msg_id;
+    frame->msg_id_type = msg_id_type;
+    frame->msg_length = msg_length;
+    memcpy(frame->msg_data, msg_data, msg_length);
+
+    if (xQueueSend(msg->frame_queue, &frame, 0) != pdTRUE) {
+        xQueueSend(pool->free_queue, &frame, 0);
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.deferred_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+}
+
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_CONFLATE
+
+/**
+ * @brief 设置某个 ID 使用最新值模式
+ *
+ * @param msg_id 数据含义
+ * @param mode 模式, `msg_conflate_mode_t`按位或, 0 为关闭发送端覆盖
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误, 内存分配失败或该 ID 的链路不支持
+ * @note 接收端轮询落后时只校验和回调队列中最新的一帧, 最新一帧校验失败时
+ *       邮箱保持上一次的值. 可靠传输, 聚合和冗余的链路 ID 要逐帧交付, 不能
+ *       启用. 邮箱按注册的最大长度分配, 需要先调用`message_register_length`,
+ *       注册后一直保留
+ * @note 发送端只支持 DMA 发送的串口, 需要先注册发送串口. 留在发送缓冲区的帧
+ *       由`message_polling_data`或`message_conflate_flush`发出
+ */
+uint8_t message_register_conflate(msg_id_t msg_id, uint8_t mode) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) ||
+        ((mode & ~(MSG_CONFLATE_RECV | MSG_CONFLATE_SEND)) != 0)) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+
+#if MSG_ENABLE_RELIABLE
+    if (msg->reliable != NULL) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_BOND
+    if ((msg->bond_of != NULL) ||
+        ((msg->bond != NULL) && (mode & MSG_CONFLATE_SEND))) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+    if ((msg->failover_of != NULL) ||
+        ((msg->failover != NULL) && (mode & MSG_CONFLATE_SEND))) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_FAILOVER */
+
+    if (mode & MSG_CONFLATE_SEND) {
+        /* 只有串口能读出 DMA 是否正在发送 */
+#if MSG_ENABLE_MULTICAST
+        if (msg->mcast != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_MULTICAST */
+#if MSG_ENABLE_CAN
+        if (msg->can != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_CAN */
+#if MSG_ENABLE_SPI
+        if (msg->spi != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_SPI */
+#if MSG_ENABLE_ETH
+        if (msg->eth != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_ETH */
+        if (msg->send_uart == NULL) {
+            return 1;
+        }
+    }
+
+    if ((mode & MSG_CONFLATE_RECV) && (msg->mailbox == NULL)) {
+        uint32_t size = msg->len_limited ? msg->len_max : UINT8_MAX;
+        msg_mailbox_t *box =
+            (msg_mailbox_t *)MSG_MALLOC(sizeof(msg_mailbox_t) + 2 * size);
+        if (box == NULL) {
+            return 1;
+        }
+
+        memset(box, 0, sizeof(msg_mailbox_t));
+        box->size = size;
+        msg->mailbox = box;
+    }
+
+    /* 关闭后已经留在发送缓冲区的帧仍然会发出 */
+    msg->conflate_send = ((mode & MSG_CONFLATE_SEND) != 0);
+
+    return 0;
+}
+
+/**
+ * @brief 读取某个 ID 最新收到的一帧, 可以在任意任务中调用
+ *
+ * @param msg_id 数据含义
+ * @param[out] data 数据, 放不下时只复制前`size`字节
+ * @param size `data`的大小
+ * @param[out] msg_id_type 消息 ID 和数据类型, 可以为`NULL`
+ * @param[out] version 到目前为止写入邮箱的帧数, 用于判断是否有新数据,
+ *                     可以为`NULL`
+ * @return 数据长度, 0 表示还没有收到或该 ID 没有启用接收端最新值模式
+ */
+uint32_t message_read_latest(msg_id_t msg_id, uint8_t *data, uint32_t size,
+                             uint8_t *msg_id_type, uint32_t *version) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (data == NULL)) {
+        return 0;
+    }
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if ((msg == NULL) || (msg->mailbox == NULL)) {
+        return 0;
+    }
+
+    msg_mailbox_t *box = msg->mailbox;
+    uint32_t seq, len, slot;
+    uint8_t id_type;
+
+    do {
+        seq = box->seq;
+        if (seq == 0) {
+            return 0;
+        }
+
+        __DMB();
+        slot = seq & 1U;
+        id_type = box->id_type[slot];
+        len = box->len[slot];
+        memcpy(data, &box->data[slot * box->size], (len < size) ? len : size);
+        __DMB();
+        /* 复制期间写者写完一帧, 可能已经开始改写这一块, 重新读 */
+    } while (box->seq != seq);
+
+    if (msg_id_type != NULL) {
+        *msg_id_type = id_type;
+    }
+
+    if (version != NULL) {
+        *version = seq;
+    }
+
+    return len;
+}
+
+/**
+ * @brief 在链路空闲时发出所有 ID 留在发送缓冲区的帧
+ *
+ * @note `message_polling_data`中会调用, 只轮询部分 ID 时需要定期调用
+ */
+void message_conflate_flush(void) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        struct msg_instance *msg = msg_list[i];
+        if ((msg == NULL) || (msg->tx_pending == 0)) {
+            continue;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+        /* 拿到互斥量之前可能已经被发送覆盖并发出 */
+        if ((msg->tx_pending != 0) &&
+            (MSG_UART_TX_PENDING(msg->send_uart) == 0)) {
+            message_transmit(msg, msg->send_buf, msg->tx_pending);
+            msg->tx_pending = 0;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+    }
+}
+
+/**
+ * @brief 丢弃还没发出的帧, 要发送的新帧沿用它的序号
+ *
+ * @param msg 消息实例
+ * @note 调用前需要持有发送缓冲区互斥量
+ */
+static void msg_conflate_replace(struct msg_instance *msg) {
+    if (msg->tx_pending == 0) {
+        return;
+    }
+
+    msg->tx_pending = 0;
+
+#if MSG_ENABLE_SEQUENCE
+    if (msg->sequence) {
+        /* 被覆盖的帧没有发出, 接收端不会把它算作丢帧 */
+        --msg->seq_next;
+    }
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++msg->stats.conflate_replace;
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 串口正在发送时把刚编码的帧留在发送缓冲区
+ *
+ * @param msg 消息实例
+ * @param frame_len 帧长度
+ * @return 是否留下, 否则需要立即发送
+ * @note 调用前需要持有发送缓冲区互斥量
+ */
+static bool msg_conflate_hold(struct msg_instance *msg, uint32_t frame_len) {
+    if (!msg->conflate_send || (MSG_UART_TX_PENDING(msg->send_uart) == 0)) {
+        return false;
+    }
+
+    msg->tx_pending = frame_len;
+    return true;
+}
+
+/**
+ * @brief 把一帧写入邮箱
+ *
+ * @param box 邮箱
+ * @param id_type 消息 ID 和数据类型
+ * @param data 数据
+ * @param len 数据长度
+ */
+static void msg_mailbox_write(msg_mailbox_t *box, uint8_t id_type,
+                              const uint8_t *data, uint32_t len) {
+    if (len > box->size) {
+        /* 邮箱分配之后又放宽了长度 */
+        return;
+    }
+
+    /* 写读者不读的那一块 */
+    uint32_t slot = (box->seq + 1U) & 1U;
+
+    box->id_type[slot] = id_type;
+    box->len[slot] = (uint8_t)len;
+    memcpy(&box->data[slot * box->size], data, len);
+    /* 数据写完再发布 */
+    __DMB();
+    ++box->seq;
+}
+
+#endif /* MSG_ENABLE_CONFLATE */
+
+#if MSG_ENABLE_SEQUENCE
+
+/**
+ * @brief 设置某个 ID 是否在帧头携带序号
+ *
+ * @param msg_id 数据含义
+ * @param enable 0: 不携带; 其他: 携带
+ * @note 收发双方必须设置一致. 启用后帧格式变为
+ *       标识 : 长度 : 序号 : 数据 : CRC8 : 结束符, 标识, 长度和序号都参与
+ *       CRC8 校验
+ */
+void message_register_sequence(msg_id_t msg_id, uint8_t enable) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    msg->sequence = (enable != 0);
+    msg->seq_synced = false;
+    msg->seq_next = 0;
+}
+
+/**
+ * @brief 检查接收序号, 统计丢帧与重复帧
+ *
+ * @param msg 消息实例
+ * @param seq 收到的序号
+ */
+static void msg_sequence_check(struct msg_instance *msg, uint8_t seq) {
+    if (!msg->seq_synced) {
+        /* 第一帧, 以它为起点 */
+        msg->seq_synced = true;
+        msg->seq_expect = seq + 1;
+        return;
+    }
+
+    uint8_t gap = seq - msg->seq_expect;
+
+    /* 串口不会乱序, 序号落后说明是重复帧或者对端重新开始计数,
+     * 都以收到的序号重新同步 */
+    msg->seq_expect = seq + 1;
+
+#if MSG_ENABLE_STATISTICS
+    if (gap == 0) {
+        return;
+    }
+
+    if (gap >= 128) {
+        MSG_STATS_INC(msg->stats.seq_duplicate);
+        return;
+    }
+
+    /* 连续丢了 gap 帧, 按 log2 分桶 */
+    uint32_t bucket = 31 - __builtin_clz(gap);
+    if (bucket >= MSG_SEQ_BURST_BUCKETS) {
+        bucket = MSG_SEQ_BURST_BUCKETS - 1;
+    }
+
+    MSG_ENTER_CRITICAL();
+    msg->stats.seq_lost += gap;
+    ++msg->stats.seq_burst[bucket];
+    MSG_EXIT_CRITICAL();
+#else  /* MSG_ENABLE_STATISTICS */
+    (void)gap;
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_RELIABLE
+
+/**
+ * @brief 设置某个 ID 使用可靠传输 (选择重传)
+ *
+ * @param msg_id 数据含义
+ * @param window 窗口大小, 必须是 2 的幂次方, 不超过 128
+ * @param frame_size 每帧最大数据长度, 不超过 255
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 收发双方必须设置一致, 同时会启用该 ID 的帧序号. 发送和接收窗口
+ *       各保留`window`帧, 在注册时一次分配好, 收发过程中不再分配内存.
+ *       注册后先和对端同步序号, 同步完成之前发送会失败
+ */
+uint8_t message_register_reliable(msg_id_t msg_id, uint32_t window,
+                                  uint32_t frame_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || !is_pow_of_2(window) ||
+        (window > 128) || (frame_size == 0) || (frame_size > 255)) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg->reliable != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    /* 1 byte 标识, 1 byte 长度, 2 byte 序号, 数据全部转义, 2 byte CRC8,
+     * 1 byte 结束符 */
+    uint32_t tx_stride = 7 + frame_size * 2;
+
+    msg_reliable_t *rel = (msg_reliable_t *)MSG_MALLOC(
+        sizeof(msg_reliable_t) + window * 2 * sizeof(msg_reliable_slot_t) +
+        window * (tx_stride + frame_size));
+    if (rel == NULL) {
+        return 1;
+    }
+
+    memset(rel, 0, sizeof(msg_reliable_t) +
+                       window * 2 * sizeof(msg_reliable_slot_t));
+    rel->mask = window - 1;
+    rel->frame_size = frame_size;
+    rel->tx_stride = tx_stride;
+    rel->tx = (msg_reliable_slot_t *)(rel + 1);
+    rel->rx = rel->tx + window;
+    rel->tx_mem = (uint8_t *)(rel->rx + window);
+    rel->rx_mem = rel->tx_mem + window * tx_stride;
+    /* 对端可能保留着上次运行的接收序号, 先让它从本端的序号重新开始 */
+    rel->tx_reset = true;
+    rel->reset_tick = MSG_GET_TICK() - MSG_RELIABLE_TIMEOUT;
+
+    msg->sequence = true;
+    msg->seq_synced = false;
+    msg->seq_next = 0;
+    msg->reliable = rel;
+
+    return 0;
+}
+
+/**
+ * @brief 检查可靠传输的 ID 能否再发送一帧
+ *
+ * @param msg 消息实例
+ * @param data_len 数据长度
+ * @return 是否可以发送, 非可靠传输的 ID 总是可以发送
+ * @note 调用前需要持有发送缓冲区互斥量
+ */
+static bool msg_reliable_writable(struct msg_instance *msg, uint32_t data_len) {
+    msg_reliable_t *rel = msg->reliable;
+    if (rel == NULL) {
+        return true;
+    }
+
+    if ((data_len > rel->frame_size) || rel->tx_reset) {
+        /* 和对端同步序号之前发出的帧可能被当作重复帧丢弃 */
+        return false;
+    }
+
+    if ((uint8_t)(msg->seq_next - rel->tx_base) > rel->mask) {
+        /* 未确认的帧已经占满窗口 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.window_full);
+#endif /* MSG_ENABLE_STATISTICS */
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 将刚编码的帧保存到发送窗口, 等待确认
+ *
+ * @param msg 消息实例
+ * @param seq 帧序号
+ * @param frame_len 帧长度
+ * @note 调用前需要持有发送缓冲区互斥量
+ */
+static void msg_reliable_store(struct msg_instance *msg, uint8_t seq,
+                               uint32_t frame_len) {
+    msg_reliable_t *rel = msg->reliable;
+    if (rel == NULL) {
+        return;
+    }
+
+    uint32_t idx = seq & rel->mask;
+    memcpy(&rel->tx_mem[idx * rel->tx_stride], msg->send_buf, frame_len);
+    rel->tx[idx].len = frame_len;
+    rel->tx[idx].tick = MSG_GET_TICK();
+}
+
+/**
+ * @brief 发送应答帧
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ * @param kind 应答类型, ACK 或 NACK
+ * @param seq 应答的序号
+ * @note 应答帧很短, 编码到栈上的缓冲区, 不会按应答的长度缩小发送缓冲区,
+ *       下一个数据帧也就不用再扩容
+ */
+static void msg_reliable_reply(struct msg_instance *msg, msg_id_t msg_id,
+                               uint8_t kind, uint8_t seq) {
+    if (!message_link_ready(msg)) {
+        return;
+    }
+
+    uint8_t reply[2] = {kind, seq};
+    uint8_t frame[MSG_FRAME_WIRE_SIZE(2)];
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+    uint32_t frame_len =
+        msg_frame_write(msg, msg_id, MSG_DATA_CONTROL, reply, 2, frame);
+    message_transmit(msg, frame, frame_len);
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+}
+
+/**
+ * @brief 处理收到的应答帧, 释放已确认的帧, NACK 立即重传
+ *
+ * @param msg 消息实例
+ * @param kind 应答类型
+ * @param seq 应答的序号
+ * @note 串口不会乱序, 累计确认不会后退. 窗口外的确认说明对端重新启动过,
+ *       和`msg_sequence_check`一样以本端为准重新同步
+ */
+static void msg_reliable_ack(struct msg_instance *msg, uint8_t kind,
+                             uint8_t seq) {
+    msg_reliable_t *rel = msg->reliable;
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+    if (kind == MSG_RELIABLE_RESET_ACK) {
+        if (rel->tx_reset && (seq == rel->tx_base)) {
+            /* 对端已经从`tx_base`重新开始, 未确认的帧在下次轮询时全部重传 */
+            rel->tx_reset = false;
+            for (uint8_t idx = rel->tx_base; idx != msg->seq_next; ++idx) {
+                rel->tx[idx & rel->mask].tick =
+                    MSG_GET_TICK() - MSG_RELIABLE_TIMEOUT;
+            }
+        }
+    } else if (rel->tx_reset) {
+        /* 同步完成之前的应答是按对端原来的序号回复的, 忽略 */
+    } else if ((uint8_t)(seq - rel->tx_base) >
+               (uint8_t)(msg->seq_next - rel->tx_base)) {
+        /* 对端重新启动过, 否则窗口满后再也等不到确认 */
+        rel->tx_reset = true;
+        rel->reset_tick = MSG_GET_TICK() - MSG_RELIABLE_TIMEOUT;
+    } else {
+        /* 累计确认, 序号之前的帧都已收到 */
+        rel->tx_base = seq;
+
+        if ((kind == MSG_RELIABLE_NACK) && (seq != msg->seq_next)) {
+            /* 对端缺这一帧, 不等超时直接重传 */
+            msg_reliable_slot_t *slot = &rel->tx[seq & rel->mask];
+            message_transmit(msg,
+                             &rel->tx_mem[(seq & rel->mask) * rel->tx_stride],
+                             slot->len);
+            slot->tick = MSG_GET_TICK();
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.retransmit);
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+    }
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+}
+
+/**
+ * @brief 可靠传输接收处理
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据, 前一个字节是序号
+ * @param msg_length 消息长度
+ * @return 是否是期望的下一帧, 是则由调用者回调, 之后调用
+ *         `msg_reliable_advance`
+ */
+static bool msg_reliable_recv(struct msg_instance *msg, msg_id_t msg_id,
+                              uint8_t msg_id_type, uint8_t *msg_data,
+                              uint32_t msg_length) {
+    msg_reliable_t *rel = msg->reliable;
+
+    if ((msg_id_type & 0x0F) == MSG_DATA_CONTROL) {
+        if ((msg_length != 2) || !message_link_ready(msg)) {
+            return false;
+        }
+
+        if (msg_data[0] == MSG_RELIABLE_RESET) {
+            /* 对端的发送序号重新开始, 丢弃缓存的乱序帧, 它们会被重传 */
+            for (uint32_t idx = 0; idx <= rel->mask; ++idx) {
+                rel->rx[idx].len = 0;
+            }
+            rel->rx_expect = msg_data[1];
+            rel->rx_nacked = false;
+            msg->seq_synced = false;
+            msg_reliable_reply(msg, msg_id, MSG_RELIABLE_RESET_ACK,
+                               rel->rx_expect);
+        } else {
+            /* 应答帧, 处理对端对本方向数据帧的确认 */
+            msg_reliable_ack(msg, msg_data[0], msg_data[1]);
+        }
+        return false;
+    }
+
+    uint8_t seq = msg_data[-1];
+    uint8_t offset = seq - rel->rx_expect;
+
+    if (offset == 0) {
+        return true;
+    }
+
+    if (msg_length > rel->frame_size) {
+        /* 超过注册的长度, 收发双方设置不一致 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.recv_error);
+#endif /* MSG_ENABLE_STATISTICS */
+        return false;
+    }
+
+    if (offset > rel->mask) {
+        /* 已经交付过的重复帧 (对端没收到确认), 重新确认 */
+        msg_reliable_reply(msg, msg_id, MSG_RELIABLE_ACK, rel->rx_expect);
+        return false;
+    }
+
+    /* 窗口内的乱序帧, 先缓存 */
+    uint32_t idx = seq & rel->mask;
+    if (rel->rx[idx].len == 0) {
+        memcpy(&rel->rx_mem[idx * rel->frame_size], msg_data, msg_length);
+        rel->rx[idx].len = msg_length;
+        rel->rx[idx].id_type = msg_id_type;
+    }
+
+    if (!rel->rx_nacked) {
+        /* 期望的帧缺失, 请求重传, 每个缺口只请求一次, 之后依靠超时重传 */
+        rel->rx_nacked = true;
+        msg_reliable_reply(msg, msg_id, MSG_RELIABLE_NACK, rel->rx_expect);
+    }
+
+    return false;
+}
+
+/**
+ * @brief 期望的帧已交付, 继续交付缓存的后续帧并回复确认
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ */
+static void msg_reliable_advance(struct msg_instance *msg, msg_id_t msg_id) {
+    msg_reliable_t *rel = msg->reliable;
+    msg_reliable_slot_t *slot;
+
+    ++rel->rx_expect;
+    slot = &rel->rx[rel->rx_expect & rel->mask];
+    while (slot->len != 0) {
+        message_deliver(msg, msg_id, slot->len, slot->id_type,
+                        &rel->rx_mem[(rel->rx_expect & rel->mask) *
+                                     rel->frame_size]);
+        slot->len = 0;
+        ++rel->rx_expect;
+        slot = &rel->rx[rel->rx_expect & rel->mask];
+    }
+
+    rel->rx_nacked = false;
+    /* 缓存的帧不经过序号检查, 同步期望序号以免统计成丢帧 */
+    msg->seq_expect = rel->rx_expect;
+
+    msg_reliable_reply(msg, msg_id, MSG_RELIABLE_ACK, rel->rx_expect);
+}
+
+/**
+ * @brief 重传超时未确认的帧, 等待重新同步时重发同步请求
+ *
+ * @param msg 消息实例
+ * @param msg_id 数据含义
+ */
+static void msg_reliable_poll(struct msg_instance *msg, msg_id_t msg_id) {
+    msg_reliable_t *rel = msg->reliable;
+    if ((rel == NULL) || !message_link_ready(msg)) {
+        return;
+    }
+
+    if (rel->tx_reset) {
+        /* 对端还在按原来的序号接收, 重传的帧会被当作重复帧 */
+        uint32_t now = MSG_GET_TICK();
+        if (now - rel->reset_tick >= MSG_RELIABLE_TIMEOUT) {
+            rel->reset_tick = now;
+            msg_reliable_reply(msg, msg_id, MSG_RELIABLE_RESET, rel->tx_base);
+        }
+        return;
+    }
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+    uint32_t now = MSG_GET_TICK();
+    for (uint8_t seq = rel->tx_base; seq != msg->seq_next; ++seq) {
+        msg_reliable_slot_t *slot = &rel->tx[seq & rel->mask];
+        if (now - slot->tick < MSG_RELIABLE_TIMEOUT) {
+            continue;
+        }
+
+        message_transmit(msg, &rel->tx_mem[(seq & rel->mask) * rel->tx_stride],
+                         slot->len);
+        slot->tick = now;
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.retransmit);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+}
+
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_FEC
+
+/* GF(2^8) 指数表和对数表, 本原多项式 x^8 + x^4 + x^3 + x^2 + 1, 生成元 2.
+ * 指数表存两个周期, 乘法时不用取模 */
+static uint8_t msg_gf_exp[512];
+static uint8_t msg_gf_log[256];
+
+/**
+ * @brief 生成 GF(2^8) 指数表和对数表
+ */
+static void msg_gf_init(void) {
+    uint32_t x = 1;
+    for (uint32_t i = 0; i < 255; ++i) {
+        msg_gf_exp[i] = (uint8_t)x;
+        msg_gf_exp[i + 255] = (uint8_t)x;
+        msg_gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= 0x11D;
+        }
+    }
+}
+
+/**
+ * @brief 乘以生成元, 用于按 Horner 法则计算 c(2)
+ *
+ * @param x 乘数
+ * @return 乘积
+ */
+static inline uint8_t msg_gf_mul2(uint8_t x) {
+    return (x == 0) ? 0 : msg_gf_exp[msg_gf_log[x] + 1];
+}
+
+/**
+ * @brief 设置某个 ID 是否附加前向纠错校验
+ *
+ * @param msg_id 数据含义
+ * @param enable 0: 不附加; 其他: 附加
+ * @note 收发双方必须设置一致. 结束符之前的字节按`MSG_FEC_BLOCK`分块,
+ *       每块是一个 RS(n, n - 2) 码字, 校验按块顺序附加在结束符之前.
+ *       FIFO 元素长度只有 1 byte, 启用后单帧数据长度上限会相应减小
+ */
+void message_register_fec(msg_id_t msg_id, uint8_t enable) {
+    if (msg_id >= MSG_ID_RESERVE_LEN) {
+        return;
+    }
+
+    if (msg_gf_exp[0] == 0) {
+        msg_gf_init();
+    }
+
+    msg_instance_create(msg_id);
+
+    msg_list[msg_id]->fec = (enable != 0);
+}
+
+/**
+ * @brief 计算一块的 2 byte 校验, 使码字在 1 和 2 处的取值都为 0
+ *
+ * @param s0 数据字节异或和
+ * @param s1 数据字节按 Horner 法则在 2 处的取值
+ * @param[out] parity 校验, 依次对应 x^1, x^0 的系数
+ */
+static void msg_fec_parity(uint8_t s0, uint8_t s1, uint8_t *parity) {
+    /* c(1) = s0 + p1 + p0 = 0, c(2) = 4 * s1 + 2 * p1 + p0 = 0
+     * => p1 = (4 * s1 + s0) / 3, p0 = s0 + p1 */
+    uint8_t t = msg_gf_mul2(msg_gf_mul2(s1)) ^ s0;
+    uint8_t p1 =
+        (t == 0) ? 0 : msg_gf_exp[msg_gf_log[t] + 255 - msg_gf_log[3]];
+    parity[0] = p1;
+    parity[1] = s0 ^ p1;
+}
+
+/**
+ * @brief 计算纠错校验并附加到帧尾
+ *
+ * @param buf 已经编码的帧 (不含结束符)
+ * @param len 帧长度
+ * @param[out] escape 累加校验中转义的字节数, 可以为`NULL`
+ * @return 附加校验后的帧长度
+ */
+static uint32_t msg_fec_append(uint8_t *buf, uint32_t len, uint32_t *escape) {
+    uint8_t parity[MSG_FEC_PARITY_MAX];
+    uint32_t parity_len = 0;
+    uint32_t count = 0;
+    uint8_t s0 = 0, s1 = 0;
+    bool escaped = false;
+
+    for (uint32_t i = 0; i < len; ++i) {
+#ifdef MSG_ESC
+        if ((buf[i] == MSG_ESC) && !escaped) {
+            /* 校验按转义前的数据计算, 与接收端 FIFO 中的内容一致 */
+            escaped = true;
+            continue;
+        }
+        escaped = false;
+#endif /* MSG_ESC */
+
+        s0 ^= buf[i];
+        s1 = msg_gf_mul2(s1) ^ buf[i];
+        if (++count == MSG_FEC_BLOCK) {
+            msg_fec_parity(s0, s1, &parity[parity_len]);
+            parity_len += 2;
+            count = 0;
+            s0 = 0;
+            s1 = 0;
+        }
+    }
+
+    if (count != 0) {
+        /* 最后不满一块 */
+        msg_fec_parity(s0, s1, &parity[parity_len]);
+        parity_len += 2;
+    }
+
+    for (uint32_t i = 0; i < parity_len; ++i) {
+#ifdef MSG_ESC
+        if ((parity[i] == MSG_EOF) || (parity[i] == MSG_ESC)) {
+            buf[len] = MSG_ESC;
+            ++len;
+            if (escape != NULL) {
+                ++*escape;
+            }
+        }
+#endif /* MSG_ESC */
+        buf[len] = parity[i];
+        ++len;
+    }
+
+    (void)escaped;
+    return len;
+}
+
+/**
+ * @brief 在 FIFO 中对一帧纠错
+ *
+ * @param msg 消息实例
+ * @param fifo 接收队列, 帧从`fifo->head`开始
+ * @param frame_len FIFO 元素长度
+ * @return 纠错校验长度, 0 表示无法纠正
+ */
+static uint32_t msg_fec_decode(struct msg_instance *msg, msg_fifo_t *fifo,
+                               uint32_t frame_len) {
+    /* 除去 FIFO 元素大小和结束符, 前 k byte 是数据, 后面每块 2 byte 校验 */
+    uint32_t total = frame_len - 2;
+    uint32_t blocks = (total + MSG_FEC_BLOCK + 1) / (MSG_FEC_BLOCK + 2);
+    uint32_t data_len = total - blocks * 2;
+    if ((frame_len < 5) ||
+        ((data_len + MSG_FEC_BLOCK - 1) / MSG_FEC_BLOCK != blocks)) {
+        /* 长度对不上, 丢了字节 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.fec_uncorrectable);
+#endif /* MSG_ENABLE_STATISTICS */
+        return 0;
+    }
+
+    uint32_t base = fifo->head + 1;
+    uint32_t corrected = 0;
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+        uint32_t start = b * MSG_FEC_BLOCK;
+        uint32_t n = data_len - start;
+        if (n > MSG_FEC_BLOCK) {
+            n = MSG_FEC_BLOCK;
+        }
+
+        /* 码字依次是 n byte 数据和 2 byte 校验, 计算伴随式 c(1), c(2) */
+        uint8_t s0 = 0, s1 = 0, c;
+        for (uint32_t i = 0; i < n + 2; ++i) {
+            if (i < n) {
+                c = fifo->buf[(base + start + i) & fifo->mask];
+            } else {
+                c = fifo->buf[(base + data_len + b * 2 + i - n) & fifo->mask];
+            }
+            s0 ^= c;
+            s1 = msg_gf_mul2(s1) ^ c;
+        }
+
+        if ((s0 == 0) && (s1 == 0)) {
+            continue;
+        }
+
+        /* 单个错误 e 在 x^p 处: s0 = e, s1 = e * 2^p */
+        uint32_t p = (s0 == 0 || s1 == 0)
+                         ? 255
+                         : (msg_gf_log[s1] + 255 - msg_gf_log[s0]) % 255;
+        if (p >= n + 2) {
+            /* 不止一个错误 */
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.fec_uncorrectable);
+#endif /* MSG_ENABLE_STATISTICS */
+            return 0;
+        }
+
+        uint32_t i = n + 1 - p;
+        if (i < n) {
+            fifo->buf[(base + start + i) & fifo->mask] ^= s0;
+        } else {
+            fifo->buf[(base + data_len + b * 2 + i - n) & fifo->mask] ^= s0;
+        }
+        ++corrected;
+    }
+
+#if MSG_ENABLE_STATISTICS
+    MSG_STATS_ADD(msg->stats.fec_corrected, corrected);
+#else  /* MSG_ENABLE_STATISTICS */
+    (void)corrected;
+#endif /* MSG_ENABLE_STATISTICS */
+
+    return blocks * 2;
+}
+
+#endif /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_CAN
+
+/* ISO-TP 协议控制信息, 第一个字节的高四位 */
+#define MSG_CAN_SINGLE_FRAME      0x00U /*!< 单帧, 低四位是长度 */
+#define MSG_CAN_FIRST_FRAME       0x10U /*!< 首帧, 低四位和第二个字节是长度 */
+#define MSG_CAN_CONSECUTIVE_FRAME 0x20U /*!< 连续帧, 低四位是序号 */
+
+/**
+ * @brief 获取 CAN 句柄
+ *
+ * @param can 使用的 CAN
+ * @return CAN 句柄, 没有启用时返回`NULL`
+ */
+static CAN_HandleTypeDef *msg_can_get_handle(can_selected_t can) {
+    switch (can) {
+#if CAN1_ENABLE
+        case can1_selected:
+            return &can1_handle;
+#endif /* CAN1_ENABLE */
+#if CAN2_ENABLE
+        case can2_selected:
+            return &can2_handle;
+#endif /* CAN2_ENABLE */
+#if CAN3_ENABLE
+        case can3_selected:
+            return &can3_handle;
+#endif /* CAN3_ENABLE */
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * @brief 在 CAN 自己的过滤器组范围内配置消息协议的过滤器
+ *
+ * @param hcan CAN 句柄
+ * @return 配置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 没有可用的过滤器组或配置失败
+ * @note CAN1 和 CAN2 共用 CAN1 的 28 个过滤器组, CAN2 从 CAN2SB 开始,
+ *       CAN3 独占 14 个. CAN2SB 保持 CSP 的设置, 否则另一个 CAN 的过滤器组
+ *       会被重新分配. 只改写自己的那一组, 其他代码配置的过滤器组保持不变
+ */
+static uint8_t msg_can_filter_config(CAN_HandleTypeDef *hcan) {
+    uint32_t first = 0;
+    uint32_t last = 14;
+
+    /* 32 位掩码模式, 只比较标准帧 ID 的高 7 位 */
+    CAN_FilterTypeDef filter = {0};
+    filter.FilterMode = CAN_FILTERMODE_IDMASK;
+    filter.FilterScale = CAN_FILTERSCALE_32BIT;
+    filter.FilterIdHigh = (MSG_CAN_ID_BASE & 0x7F0) << 5;
+    filter.FilterMaskIdHigh = 0x7F0 << 5;
+    filter.FilterFIFOAssignment = CAN_FILTER_FIFO0;
+
+#if defined(CAN2)
+    uint32_t slave_start =
+        READ_BIT(CAN1->FMR, CAN_FMR_CAN2SB) >> CAN_FMR_CAN2SB_Pos;
+    filter.SlaveStartFilterBank = slave_start;
+    if (hcan->Instance == CAN2) {
+        first = slave_start;
+        last = 28;
+    } else {
+        last = slave_start;
+    }
+#endif /* CAN2 */
+
+#if defined(CAN3)
+    if (hcan->Instance == CAN3) {
+        first = 0;
+        last = 14;
+    }
+#endif /* CAN3 */
+
+    if (first + MSG_CAN_FILTER_BANK >= last) {
+        return 1;
+    }
+
+    filter.FilterBank = first + MSG_CAN_FILTER_BANK;
+    filter.FilterActivation = CAN_FILTER_ENABLE;
+    if (HAL_CAN_ConfigFilter(hcan, &filter) != HAL_OK) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 设置某个 ID 使用 CAN 收发
+ *
+ * @param msg_id 数据含义
+ * @param can 使用的 CAN, 需要先初始化
+ * @param buf_size 接收缓冲区大小 (必须是 2 的幂次方! )
+ * @param fifo_size 队列大小 (必须是 2 的幂次方! )
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 每个 CAN 第一次注册时, 在它的过滤器组范围内第`MSG_CAN_FILTER_BANK`
+ *       组配置过滤器, 只接收`MSG_CAN_ID_BASE`开始的 16 个 ID, 放入 FIFO0.
+ *       默认改写 CSP 初始化时配置的接收所有报文的第 0 组, 该 CAN 上的其他
+ *       报文需要另外配置过滤器组. 范围内还有接收所有报文的过滤器组时,
+ *       硬件不会过滤
+ */
+uint8_t message_register_can(msg_id_t msg_id, can_selected_t can,
+                             uint32_t buf_size, uint32_t fifo_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || !is_pow_of_2(buf_size) ||
+        !is_pow_of_2(fifo_size)) {
+        return 1;
+    }
+
+#if MSG_ENABLE_EXT_ID
+    if (msg_id >= 16) {
+        /* 过滤器只接收 16 个 ID */
+        return 1;
+    }
+#endif /* MSG_ENABLE_EXT_ID */
+
+    CAN_HandleTypeDef *hcan = msg_can_get_handle(can);
+    if (hcan == NULL) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg->can != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    msg_can_link_t *link =
+        (msg_can_link_t *)MSG_MALLOC(sizeof(msg_can_link_t) + buf_size);
+    if (link == NULL) {
+        return 1;
+    }
+
+    memset(link, 0, sizeof(msg_can_link_t));
+    link->can = can;
+    link->can_id = MSG_CAN_ID_BASE + msg_id;
+    link->size = buf_size;
+    link->mask = buf_size - 1;
+
+    if (msg->recv_buf == NULL) {
+        msg->recv_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->recv_buf_size = buf_size;
+    }
+
+    if (msg->fifo == NULL) {
+        msg->fifo = msg_fifo_init(fifo_size);
+    }
+
+    if (msg->send_buf == NULL) {
+        /* 发送时会按帧长度扩容 */
+        msg->send_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->send_buf_len = buf_size;
+    }
+
+    if ((msg->recv_buf == NULL) || (msg->fifo == NULL) ||
+        (msg->send_buf == NULL)) {
+        MSG_FREE(link);
+        return 1;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    static bool filtered[3];
+    if (!filtered[can]) {
+        if (msg_can_filter_config(hcan) != 0) {
+            MSG_FREE(link);
+            return 1;
+        }
+        filtered[can] = true;
+    }
+
+    /* 同一 ID 的分段会同时占用多个发送邮箱, 按请求顺序发送才不会乱序 */
+    SET_BIT(hcan->Instance->MCR, CAN_MCR_TXFP);
+
+    msg->can = link;
+
+#if MSG_ENABLE_LATENCY
+    MSG_TIMESTAMP_INIT();
+#endif /* MSG_ENABLE_LATENCY */
+
+    return 0;
+}
+
+/**
+ * @brief 发送一个 CAN 报文, 邮箱满时重试
+ *
+ * @param link CAN 链路
+ * @param data 报文数据
+ * @param len 报文长度
+ * @return 发送结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 失败
+ */
+static uint8_t msg_can_send(msg_can_link_t *link, const uint8_t *data,
+                            uint32_t len) {
+    for (uint32_t retry = 0; retry < MSG_CAN_SEND_RETRY; ++retry) {
+        uint8_t ret = can_send_message(link->can, CAN_ID_STD, link->can_id,
+                                       (uint8_t)len, data);
+        if (ret != 2) {
+            /* 2 是等待邮箱超时, 其他错误不再重试 */
+            return (ret == 0) ? 0 : 1;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief 将编码后的一帧按 ISO-TP 方式分段发送
+ *
+ * @param msg 消息实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @return 发送结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 帧超过 4095 字节或 CAN 发送失败, 计入`can_tx_drop`
+ */
+static uint8_t msg_can_transmit(struct msg_instance *msg, const uint8_t *buf,
+                                uint32_t len) {
+    msg_can_link_t *link = msg->can;
+    uint8_t frame[8];
+    uint8_t ret = 1;
+
+    if (len <= 7) {
+        frame[0] = MSG_CAN_SINGLE_FRAME | (uint8_t)len;
+        memcpy(&frame[1], buf, len);
+        ret = msg_can_send(link, frame, len + 1);
+    } else if (len <= 0xFFF) {
+        frame[0] = MSG_CAN_FIRST_FRAME | (uint8_t)(len >> 8);
+        frame[1] = (uint8_t)len;
+        memcpy(&frame[2], buf, 6);
+        ret = msg_can_send(link, frame, 8);
+
+        uint8_t sn = 1;
+        for (uint32_t idx = 6; (ret == 0) && (idx < len);) {
+            uint32_t n = len - idx;
+            if (n > 7) {
+                n = 7;
+            }
+
+            frame[0] = MSG_CAN_CONSECUTIVE_FRAME | sn;
+            memcpy(&frame[1], &buf[idx], n);
+            /* 失败后不再发送后面的分段, 接收端会因为长度不够丢弃这一帧 */
+            ret = msg_can_send(link, frame, n + 1);
+
+            idx += n;
+            sn = (sn + 1) & 0x0F;
+        }
+    }
+
+#if MSG_ENABLE_STATISTICS
+    if (ret != 0) {
+        MSG_STATS_INC(msg->stats.can_tx_drop);
+    }
+#endif /* MSG_ENABLE_STATISTICS */
+
+    return ret;
+}
+
+/**
+ * @brief 开始拼接一帧
+ *
+ * @param msg 消息实例
+ * @param len 帧长度
+ * @return 是否有足够空间
+ */
+static bool msg_can_begin(struct msg_instance *msg, uint32_t len) {
+    msg_can_link_t *link = msg->can;
+
+    if (len > link->size - (link->tail - link->head)) {
+        link->remain = 0;
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC_ISR(msg->stats.can_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return false;
+    }
+
+    link->pending = link->tail;
+    link->remain = len;
+    return true;
+}
+
+/**
+ * @brief 写入拼接中的帧, 收完后提交给轮询任务
+ *
+ * @param link CAN 链路
+ * @param data 分段数据
+ * @param len 分段长度
+ */
+static void msg_can_append(msg_can_link_t *link, const uint8_t *data,
+                           uint32_t len) {
+    if (len > link->remain) {
+        /* 最后一段可能有填充 */
+        len = link->remain;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        link->buf[(link->pending + i) & link->mask] = data[i];
+    }
+    link->pending += len;
+    link->remain -= len;
+
+    if (link->remain == 0) {
+        /* 数据写完再移动写指针 */
+        __DMB();
+        link->tail = link->pending;
+    }
+}
+
+/**
+ * @brief CAN 接收处理, 在 CAN 接收中断回调中调用
+ *
+ * @param can 收到报文的 CAN
+ * @param can_id 标准帧 ID
+ * @param data 报文数据
+ * @param len 报文长度
+ * @return 处理结果:
+ *  @retval - 0: 报文属于消息协议, 已处理
+ *  @retval - 1: 不是消息协议的报文
+ */
+uint8_t message_can_receive(can_selected_t can, uint32_t can_id,
+                            const uint8_t *data, uint32_t len) {
+    if ((can_id < MSG_CAN_ID_BASE) ||
+        (can_id >= MSG_CAN_ID_BASE + MSG_ID_RESERVE_LEN)) {
+        return 1;
+    }
+
+    struct msg_instance *msg = msg_list[can_id - MSG_CAN_ID_BASE];
+    if ((msg == NULL) || (msg->can == NULL) || (msg->can->can != can)) {
+        return 1;
+    }
+
+    msg_can_link_t *link = msg->can;
+    if ((len == 0) || (len > 8)) {
+        return 0;
+    }
+
+    uint32_t frame_len;
+    switch (data[0] & 0xF0) {
+        case MSG_CAN_SINGLE_FRAME:
+            frame_len = data[0] & 0x0F;
+            if ((frame_len == 0) || (frame_len > len - 1)) {
+                break;
+            }
+            if (link->remain != 0) {
+                /* 上一帧没有收完, 丢弃 */
+#if MSG_ENABLE_STATISTICS
+                MSG_STATS_INC_ISR(msg->stats.can_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+            }
+            if (msg_can_begin(msg, frame_len)) {
+                msg_can_append(link, &data[1], frame_len);
+            }
+            break;
+
+        case MSG_CAN_FIRST_FRAME:
+            frame_len = ((data[0] & 0x0F) << 8) | data[1];
+            if ((len != 8) || (frame_len <= 7)) {
+                break;
+            }
+            if (link->remain != 0) {
+#if MSG_ENABLE_STATISTICS
+                MSG_STATS_INC_ISR(msg->stats.can_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+            }
+            if (msg_can_begin(msg, frame_len)) {
+                link->next_sn = 1;
+                msg_can_append(link, &data[2], 6);
+            }
+            break;
+
+        case MSG_CAN_CONSECUTIVE_FRAME:
+            if (link->remain == 0) {
+                /* 没有收到首帧 */
+                break;
+            }
+            if ((data[0] & 0x0F) != link->next_sn) {
+                /* 分段丢失, 丢弃整帧 */
+                link->remain = 0;
+#if MSG_ENABLE_STATISTICS
+                MSG_STATS_INC_ISR(msg->stats.can_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+                break;
+            }
+            link->next_sn = (link->next_sn + 1) & 0x0F;
+            msg_can_append(link, &data[1], len - 1);
+            break;
+
+        default:
+            /* 不使用流控帧 */
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 读出 CAN 链路中已经收完的数据
+ *
+ * @param link CAN 链路
+ * @param buf 读出缓冲区
+ * @param size 缓冲区大小
+ * @return 读出的字节数
+ */
+static uint32_t msg_can_read(msg_can_link_t *link, uint8_t *buf,
+                             uint32_t size) {
+    uint32_t len = link->tail - link->head;
+    if (len > size) {
+        len = size;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        buf[i] = link->buf[(link->head + i) & link->mask];
+    }
+    link->head += len;
+
+    return len;
+}
+
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+
+/* 传输块头部长度, 大端存放有效数据长度 */
+#define MSG_SPI_HEADER_LEN 2
+
+/**
+ * @brief 设置某个 ID 使用 SPI 收发
+ *
+ * @param msg_id 数据含义
+ * @param hspi SPI 句柄, 需要先初始化并配置收发 DMA
+ * @param role 主机或从机
+ * @param ready ready 引脚, 主机为输入, 从机为输出
+ * @param attention attention 引脚, 主机为输入, 从机为输出
+ * @param buf_size 收发环形缓冲区大小 (必须是 2 的幂次方! )
+ * @param fifo_size 队列大小 (必须是 2 的幂次方! )
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误, 内存分配失败或 DMA 启动失败
+ * @note 从机注册后立即装好第一次传输, 然后翻转 ready
+ */
+uint8_t message_register_spi(msg_id_t msg_id, SPI_HandleTypeDef *hspi,
+                             msg_spi_role_t role, msg_spi_pin_t ready,
+                             msg_spi_pin_t attention, uint32_t buf_size,
+                             uint32_t fifo_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (hspi == NULL) ||
+        (hspi->hdmatx == NULL) || (hspi->hdmarx == NULL) ||
+        !is_pow_of_2(buf_size) || !is_pow_of_2(fifo_size)) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg->spi != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    msg_spi_link_t *link = (msg_spi_link_t *)MSG_MALLOC(sizeof(msg_spi_link_t));
+    if (link == NULL) {
+        return 1;
+    }
+
+    memset(link, 0, sizeof(msg_spi_link_t));
+    link->hspi = hspi;
+    link->role = role;
+    link->ready = ready;
+    link->attention = attention;
+    link->mask = buf_size - 1;
+    link->tx_ring = (uint8_t *)MSG_MALLOC(buf_size);
+    link->rx_ring = (uint8_t *)MSG_MALLOC(buf_size);
+
+    if (msg->recv_buf == NULL) {
+        msg->recv_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->recv_buf_size = buf_size;
+    }
+
+    if (msg->fifo == NULL) {
+        msg->fifo = msg_fifo_init(fifo_size);
+    }
+
+    if (msg->send_buf == NULL) {
+        /* 发送时会按帧长度扩容 */
+        msg->send_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->send_buf_len = buf_size;
+    }
+
+    if ((link->tx_ring == NULL) || (link->rx_ring == NULL) ||
+        (msg->recv_buf == NULL) || (msg->fifo == NULL) ||
+        (msg->send_buf == NULL)) {
+        MSG_FREE(link->tx_ring);
+        MSG_FREE(link->rx_ring);
+        MSG_FREE(link);
+        return 1;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+#if MSG_ENABLE_LATENCY
+    MSG_TIMESTAMP_INIT();
+#endif /* MSG_ENABLE_LATENCY */
+
+    if (role == MSG_SPI_MASTER) {
+        /* 从机注册后 ready 会翻转, 以当前电平为基准 */
+        link->ready_level = HAL_GPIO_ReadPin(ready.port, ready.pin);
+        link->ready_tick = MSG_GET_TICK();
+        msg->spi = link;
+        return 0;
+    }
+
+    HAL_GPIO_WritePin(attention.port, attention.pin, GPIO_PIN_RESET);
+    msg->spi = link;
+    if (msg_spi_start(msg) != 0) {
+        msg->spi = NULL;
+        MSG_FREE(link->tx_ring);
+        MSG_FREE(link->rx_ring);
+        MSG_FREE(link);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 把发送环形缓冲区中的数据装入发送块
+ *
+ * @param link SPI 链路
+ * @return 装入的字节数
+ */
+static uint32_t msg_spi_pack(msg_spi_link_t *link) {
+    uint32_t len = link->tx_tail - link->tx_head;
+    if (len > MSG_SPI_SLOT_SIZE - MSG_SPI_HEADER_LEN) {
+        len = MSG_SPI_SLOT_SIZE - MSG_SPI_HEADER_LEN;
+    }
+
+    link->tx_slot[0] = (uint8_t)(len >> 8);
+    link->tx_slot[1] = (uint8_t)len;
+    for (uint32_t i = 0; i < len; ++i) {
+        link->tx_slot[MSG_SPI_HEADER_LEN + i] =
+            link->tx_ring[(link->tx_head + i) & link->mask];
+    }
+    link->tx_head += len;
+
+    return len;
+}
+
+/**
+ * @brief 装好发送块并启动一次 DMA 全双工传输
+ *
+ * @param msg 消息实例
+ * @return 启动结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 失败, 已装入的数据丢弃
+ * @note 主机需要先占用`busy`, 保证同一时刻只有一处装入发送块
+ */
+static uint8_t msg_spi_start(struct msg_instance *msg) {
+    msg_spi_link_t *link = msg->spi;
+    uint32_t len = msg_spi_pack(link);
+
+    if (link->role == MSG_SPI_MASTER) {
+        link->ready_level =
+            HAL_GPIO_ReadPin(link->ready.port, link->ready.pin);
+        link->ready_tick = MSG_GET_TICK();
+    }
+
+    if (HAL_SPI_TransmitReceive_DMA(link->hspi, link->tx_slot, link->rx_slot,
+                                    MSG_SPI_SLOT_SIZE) != HAL_OK) {
+        link->busy = false;
+#if MSG_ENABLE_STATISTICS
+        if (len != 0) {
+            MSG_STATS_INC_ISR(msg->stats.spi_drop);
+        }
+#endif /* MSG_ENABLE_STATISTICS */
+        return 1;
+    }
+
+    if (link->role == MSG_SPI_SLAVE) {
+        /* 先更新 attention 再翻转 ready, 主机看到 ready 翻转时 attention
+         * 已经是最新的 */
+        HAL_GPIO_WritePin(link->attention.port, link->attention.pin,
+                          (len != 0) ? GPIO_PIN_SET : GPIO_PIN_RESET);
+        HAL_GPIO_TogglePin(link->ready.port, link->ready.pin);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 主机检查是否可以开始下一次传输
+ *
+ * @param msg 消息实例
+ * @note 需要自己有数据要发或从机拉高 attention, 并且从机已经翻转 ready.
+ *       ready 超过`MSG_SPI_READY_TIMEOUT`没有翻转时认为握手失步, 直接开始
+ */
+static void msg_spi_kick(struct msg_instance *msg) {
+    msg_spi_link_t *link = msg->spi;
+
+    if ((link->role != MSG_SPI_MASTER) || link->busy) {
+        return;
+    }
+
+    if ((link->tx_tail == link->tx_head) &&
+        (HAL_GPIO_ReadPin(link->attention.port, link->attention.pin) ==
+         GPIO_PIN_RESET)) {
+        return;
+    }
+
+    if ((HAL_GPIO_ReadPin(link->ready.port, link->ready.pin) ==
+         link->ready_level) &&
+        (MSG_GET_TICK() - link->ready_tick < MSG_SPI_READY_TIMEOUT)) {
+        /* 从机还没有装好 */
+        return;
+    }
+
+    /* 任务, 传输完成中断和 ready 中断都会调用, 只关中断占用`busy`,
+     * 装入发送块和启动 DMA 不需要关中断 */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool idle = !link->busy;
+    link->busy = true;
+    __set_PRIMASK(primask);
+
+    if (idle) {
+        msg_spi_start(msg);
+    }
+}
+
+/**
+ * @brief 将编码后的一帧写入发送环形缓冲区
+ *
+ * @param msg 消息实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @note 缓冲区放不下时丢弃这一帧. 主机随后尝试开始传输, 从机拉高 attention
+ */
+static void msg_spi_write(struct msg_instance *msg, const uint8_t *buf,
+                          uint32_t len) {
+    msg_spi_link_t *link = msg->spi;
+
+    if (len > link->mask + 1 - (link->tx_tail - link->tx_head)) {
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.spi_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        link->tx_ring[(link->tx_tail + i) & link->mask] = buf[i];
+    }
+    /* 数据写完再移动写指针 */
+    __DMB();
+    link->tx_tail += len;
+
+    if (link->role == MSG_SPI_MASTER) {
+        msg_spi_kick(msg);
+    } else {
+        HAL_GPIO_WritePin(link->attention.port, link->attention.pin,
+                          GPIO_PIN_SET);
+    }
+}
+
+/**
+ * @brief 把接收块中的数据写入接收环形缓冲区
+ *
+ * @param msg 消息实例
+ */
+static void msg_spi_unpack(struct msg_instance *msg) {
+    msg_spi_link_t *link = msg->spi;
+    uint32_t len = ((uint32_t)link->rx_slot[0] << 8) | link->rx_slot[1];
+
+    if (len == 0) {
+        return;
+    }
+
+    if ((len > MSG_SPI_SLOT_SIZE - MSG_SPI_HEADER_LEN) ||
+        (len > link->mask + 1 - (link->rx_tail - link->rx_head))) {
+        /* 长度错误或接收缓冲区满, 丢弃整块 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC_ISR(msg->stats.spi_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        link->rx_ring[(link->rx_tail + i) & link->mask] =
+            link->rx_slot[MSG_SPI_HEADER_LEN + i];
+    }
+    /* 数据写完再移动写指针 */
+    __DMB();
+    link->rx_tail += len;
+}
+
+/**
+ * @brief SPI 传输完成或出错处理, 在`HAL_SPI_TxRxCpltCallback`和
+ *        `HAL_SPI_ErrorCallback`中调用
+ *
+ * @param hspi SPI 句柄
+ */
+void message_spi_transfer_callback(SPI_HandleTypeDef *hspi) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        struct msg_instance *msg = msg_list[i];
+        if ((msg == NULL) || (msg->spi == NULL) || (msg->spi->hspi != hspi)) {
+            continue;
+        }
+
+        if (hspi->ErrorCode == HAL_SPI_ERROR_NONE) {
+            msg_spi_unpack(msg);
+        } else {
+            /* 收发的数据都不可信, 对方会因为 CRC 或分帧错误丢弃 */
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC_ISR(msg->stats.spi_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+
+        if (msg->spi->role == MSG_SPI_SLAVE) {
+            /* 从机马上装好下一次传输 */
+            msg_spi_start(msg);
+        } else {
+            msg->spi->busy = false;
+            msg_spi_kick(msg);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief ready 引脚外部中断处理, 主机在`HAL_GPIO_EXTI_Callback`中调用
+ *
+ * @param pin 触发中断的引脚
+ * @note ready 引脚需要配置为双边沿触发. 不调用时由`message_polling_data`
+ *       检查, 传输间隔取决于轮询周期
+ */
+void message_spi_ready_callback(uint16_t pin) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        struct msg_instance *msg = msg_list[i];
+        if ((msg == NULL) || (msg->spi == NULL) ||
+            (msg->spi->ready.pin != pin)) {
+            continue;
+        }
+
+        msg_spi_kick(msg);
+    }
+}
+
+/**
+ * @brief 读出 SPI 链路中已经收到的数据
+ *
+ * @param link SPI 链路
+ * @param buf 读出缓冲区
+ * @param size 缓冲区大小
+ * @return 读出的字节数
+ */
+static uint32_t msg_spi_read(msg_spi_link_t *link, uint8_t *buf,
+                             uint32_t size) {
+    uint32_t len = link->rx_tail - link->rx_head;
+    if (len > size) {
+        len = size;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        buf[i] = link->rx_ring[(link->rx_head + i) & link->mask];
+    }
+    link->rx_head += len;
+
+    return len;
+}
+
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+
+/* 以太网类型 */
+#define MSG_ETH_TYPE_IPV4 0x0800U
+#define MSG_ETH_TYPE_ARP  0x0806U
+/* IPv4 协议号 */
+#define MSG_IP_PROTO_UDP  17U
+/* ARP 报文长度, 包括以太网头 */
+#define MSG_ARP_LEN       42
+/* 以太网发送超时, 单位 ms */
+#define MSG_ETH_TX_TIMEOUT 10
+
+/**
+ * @brief 收到的以太网报文
+ */
+typedef struct {
+    uint8_t *data; /*!< 报文数据 */
+    uint32_t len;  /*!< 报文长度 */
+} msg_eth_packet_t;
+
+static msg_eth_addr_t msg_eth_local;  /*!< 本机地址 */
+static msg_eth_addr_t msg_eth_remote; /*!< 对端地址, MAC 全 0 时广播 */
+static uint16_t msg_eth_ip_id;        /*!< IPv4 报文标识 */
+
+/* 接收缓冲区比接收描述符多一个, 正在处理的报文不会被网卡覆盖 */
+static uint8_t msg_eth_rx_pool[ETH_RX_DESC_CNT + 1][ETH_RX_BUF_SIZE]
+    __attribute__((aligned(4)));
+static uint32_t msg_eth_rx_next;
+static msg_eth_packet_t msg_eth_rx_packet;
+
+#if MSG_ENABLE_RTOS
+static SemaphoreHandle_t msg_eth_semp; /*!< 网卡发送互斥锁 */
+#endif                                 /* MSG_ENABLE_RTOS */
+
+/**
+ * @brief 写入大端 16 位数
+ *
+ * @param p 写入位置
+ * @param value 数值
+ */
+static inline void msg_put_be16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+/**
+ * @brief 读出大端 16 位数
+ *
+ * @param p 读出位置
+ * @return 数值
+ */
+static inline uint16_t msg_get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief 网卡申请接收缓冲区回调
+ *
+ * @param buff 返回的缓冲区
+ */
+static void msg_eth_rx_allocate(uint8_t **buff) {
+    *buff = msg_eth_rx_pool[msg_eth_rx_next];
+    msg_eth_rx_next = (msg_eth_rx_next + 1) % (ETH_RX_DESC_CNT + 1);
+}
+
+/**
+ * @brief 网卡收到报文回调, 报文不超过一个接收缓冲区
+ *
+ * @param start 报文起始
+ * @param end 报文结束
+ * @param buff 接收缓冲区
+ * @param len 数据长度
+ */
+static void msg_eth_rx_link(void **start, void **end, uint8_t *buff,
+                            uint16_t len) {
+    msg_eth_rx_packet.data = buff;
+    msg_eth_rx_packet.len = len;
+    *start = &msg_eth_rx_packet;
+    *end = &msg_eth_rx_packet;
+}
+
+/**
+ * @brief 设置以太网地址并启动网卡
+ *
+ * @param local 本机地址
+ * @param remote 对端地址, MAC 全 0 时先广播, 收到对端数据报后更新
+ * @return 启动结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 失败
+ * @note 需要先调用`eth_init`初始化 MAC/PHY
+ */
+uint8_t message_eth_init(const msg_eth_addr_t *local,
+                         const msg_eth_addr_t *remote) {
+    if ((local == NULL) || (remote == NULL)) {
+        return 1;
+    }
+
+    msg_eth_local = *local;
+    msg_eth_remote = *remote;
+
+#if MSG_ENABLE_RTOS
+    if (msg_eth_semp == NULL) {
+        msg_eth_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    if (eth_handle.gState == HAL_ETH_STATE_STARTED) {
+        return 0;
+    }
+
+    HAL_ETH_RegisterRxAllocateCallback(&eth_handle, msg_eth_rx_allocate);
+    HAL_ETH_RegisterRxLinkCallback(&eth_handle, msg_eth_rx_link);
+
+    return (HAL_ETH_Start(&eth_handle) == HAL_OK) ? 0 : 1;
+}
+
+/**
+ * @brief 设置某个 ID 使用以太网收发
+ *
+ * @param msg_id 数据含义
+ * @param buf_size 接收环形缓冲区大小 (必须是 2 的幂次方! )
+ * @param fifo_size 队列大小 (必须是 2 的幂次方! )
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ */
+uint8_t message_register_eth(msg_id_t msg_id, uint32_t buf_size,
+                             uint32_t fifo_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || !is_pow_of_2(buf_size) ||
+        !is_pow_of_2(fifo_size)) {
+        return 1;
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg->eth != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    msg_eth_link_t *link = (msg_eth_link_t *)MSG_MALLOC(sizeof(msg_eth_link_t));
+    if (link == NULL) {
+        return 1;
+    }
+
+    memset(link, 0, sizeof(msg_eth_link_t));
+    link->port = msg_eth_local.port + msg_id;
+    link->remote_port = msg_eth_remote.port + msg_id;
+    link->mask = buf_size - 1;
+    link->rx_ring = (uint8_t *)MSG_MALLOC(buf_size);
+
+    if (msg->recv_buf == NULL) {
+        msg->recv_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->recv_buf_size = buf_size;
+    }
+
+    if (msg->fifo == NULL) {
+        msg->fifo = msg_fifo_init(fifo_size);
+    }
+
+    if (msg->send_buf == NULL) {
+        /* 发送时会按帧长度扩容 */
+        msg->send_buf = (uint8_t *)MSG_MALLOC(buf_size);
+        msg->send_buf_len = buf_size;
+    }
+
+    if ((link->rx_ring == NULL) || (msg->recv_buf == NULL) ||
+        (msg->fifo == NULL) || (msg->send_buf == NULL)) {
+        MSG_FREE(link->rx_ring);
+        MSG_FREE(link);
+        return 1;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    /* 发送定时也要用时间戳 */
+    MSG_TIMESTAMP_INIT();
+
+    msg->eth = link;
+    return 0;
+}
+
+/**
+ * @brief 计算 IPv4 头部校验和
+ *
+ * @param data 头部数据
+ * @param len 头部长度
+ * @return 校验和
+ */
+static uint16_t msg_ip_checksum(const uint8_t *data, uint32_t len) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        sum += msg_get_be16(&data[i]);
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief 发送一个以太网报文
+ *
+ * @param data 报文数据, 包括以太网头
+ * @param len 报文长度
+ * @return 发送结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 失败
+ */
+static uint8_t msg_eth_output(uint8_t *data, uint32_t len) {
+    ETH_BufferTypeDef buffer = {.buffer = data, .len = len, .next = NULL};
+    ETH_TxPacketConfigTypeDef config = {0};
+    config.Attributes = ETH_TX_PACKETS_FEATURES_CRCPAD;
+    config.CRCPadCtrl = ETH_CRC_PAD_INSERT;
+    config.ChecksumCtrl = ETH_CHECKSUM_DISABLE;
+    config.Length = len;
+    config.TxBuffer = &buffer;
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreTake(msg_eth_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+    HAL_StatusTypeDef res =
+        HAL_ETH_Transmit(&eth_handle, &config, MSG_ETH_TX_TIMEOUT);
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg_eth_semp);
+#endif /* MSG_ENABLE_RTOS */
+
+    return (res == HAL_OK) ? 0 : 1;
+}
+
+/**
+ * @brief 填写头部并发出攒好的数据报
+ *
+ * @param msg 消息实例
+ * @note 调用前需要持有该 ID 的发送缓冲区锁
+ */
+static void msg_eth_flush_link(struct msg_instance *msg) {
+    msg_eth_link_t *link = msg->eth;
+    if (link->tx_len == 0) {
+        return;
+    }
+
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t zero_mac[6] = {0};
+    bool known = (memcmp(msg_eth_remote.mac, zero_mac, 6) != 0);
+
+    /* 以太网头 */
+    uint8_t *p = link->tx_buf;
+    memcpy(&p[0], known ? msg_eth_remote.mac : broadcast, 6);
+    memcpy(&p[6], msg_eth_local.mac, 6);
+    msg_put_be16(&p[12], MSG_ETH_TYPE_IPV4);
+
+    /* IPv4 头, 不分片 */
+    uint8_t *ip = &p[14];
+    ip[0] = 0x45;
+    ip[1] = 0;
+    msg_put_be16(&ip[2], (uint16_t)(20 + 8 + link->tx_len));
+    msg_put_be16(&ip[4], msg_eth_ip_id++);
+    msg_put_be16(&ip[6], 0x4000);
+    ip[8] = 64;
+    ip[9] = MSG_IP_PROTO_UDP;
+    msg_put_be16(&ip[10], 0);
+    memcpy(&ip[12], msg_eth_local.ip, 4);
+    memcpy(&ip[16], known ? msg_eth_remote.ip : broadcast, 4);
+    msg_put_be16(&ip[10], msg_ip_checksum(ip, 20));
+
+    /* UDP 头, IPv4 下校验和可以为 0, 链路上有以太网 CRC */
+    uint8_t *udp = &ip[20];
+    msg_put_be16(&udp[0], link->port);
+    msg_put_be16(&udp[2], link->remote_port);
+    msg_put_be16(&udp[4], (uint16_t)(8 + link->tx_len));
+    msg_put_be16(&udp[6], 0);
+
+    if (msg_eth_output(link->tx_buf, MSG_ETH_HEADER_LEN + link->tx_len) ==
+        0) {
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.eth_datagram);
+    } else {
+        MSG_STATS_INC(msg->stats.eth_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+
+    link->tx_len = 0;
+}
+
+/**
+ * @brief 将编码后的一帧攒入数据报
+ *
+ * @param msg 消息实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @note 放不下时先发出之前攒的, 攒够`MSG_ETH_FLUSH_SIZE`后立即发出
+ */
+static void msg_eth_write(struct msg_instance *msg, const uint8_t *buf,
+                          uint32_t len) {
+    msg_eth_link_t *link = msg->eth;
+
+    if (len > MSG_ETH_PAYLOAD_MAX) {
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.eth_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return;
+    }
+
+    if (link->tx_len + len > MSG_ETH_PAYLOAD_MAX) {
+        msg_eth_flush_link(msg);
+    }
+
+    if (link->tx_len == 0) {
+        link->tx_stamp = MSG_TIMESTAMP();
+    }
+
+    memcpy(&link->tx_buf[MSG_ETH_HEADER_LEN + link->tx_len], buf, len);
+    link->tx_len += len;
+
+    if (link->tx_len >= MSG_ETH_FLUSH_SIZE) {
+        msg_eth_flush_link(msg);
+    }
+}
+
+/**
+ * @brief 回复本机 IP 的 ARP 请求
+ *
+ * @param data 收到的报文
+ * @param len 报文长度
+ */
+static void msg_eth_arp_input(const uint8_t *data, uint32_t len) {
+    const uint8_t *arp = &data[14];
+
+    /* 以太网, IPv4, 请求, 目标是本机 */
+    if ((len < MSG_ARP_LEN) || (msg_get_be16(&arp[0]) != 1) ||
+        (msg_get_be16(&arp[2]) != MSG_ETH_TYPE_IPV4) ||
+        (msg_get_be16(&arp[6]) != 1) ||
+        (memcmp(&arp[24], msg_eth_local.ip, 4) != 0)) {
+        return;
+    }
+
+    uint8_t reply[MSG_ARP_LEN];
+    memcpy(&reply[0], &data[6], 6);
+    memcpy(&reply[6], msg_eth_local.mac, 6);
+    msg_put_be16(&reply[12], MSG_ETH_TYPE_ARP);
+
+    uint8_t *p = &reply[14];
+    msg_put_be16(&p[0], 1);
+    msg_put_be16(&p[2], MSG_ETH_TYPE_IPV4);
+    p[4] = 6;
+    p[5] = 4;
+    msg_put_be16(&p[6], 2);
+    memcpy(&p[8], msg_eth_local.mac, 6);
+    memcpy(&p[14], msg_eth_local.ip, 4);
+    memcpy(&p[18], &arp[8], 6);
+    memcpy(&p[24], &arp[14], 4);
+
+    msg_eth_output(reply, MSG_ARP_LEN);
+}
+
+/**
+ * @brief 处理收到的以太网报文, UDP 数据写入对应 ID 的接收环形缓冲区
+ *
+ * @param data 报文数据
+ * @param len 报文长度
+ */
+static void msg_eth_input(const uint8_t *data, uint32_t len) {
+    if (len < 14) {
+        return;
+    }
+
+    uint16_t type = msg_get_be16(&data[12]);
+    if (type == MSG_ETH_TYPE_ARP) {
+        msg_eth_arp_input(data, len);
+        return;
+    }
+
+    if ((type != MSG_ETH_TYPE_IPV4) || (len < MSG_ETH_HEADER_LEN)) {
+        return;
+    }
+
+    const uint8_t *ip = &data[14];
+    uint32_t ip_header = (ip[0] & 0x0F) * 4;
+    uint32_t ip_len = msg_get_be16(&ip[2]);
+    if (((ip[0] >> 4) != 4) || (ip_header < 20) ||
+        (ip_len < ip_header + 8) || (14 + ip_len > len) ||
+        (ip[9] != MSG_IP_PROTO_UDP) ||
+        ((msg_get_be16(&ip[6]) & 0x3FFF) != 0)) {
+        /* 不是 UDP 或者是分片 */
+        return;
+    }
+
+    if (memcmp(&ip[16], msg_eth_local.ip, 4) != 0) {
+        return;
+    }
+
+    const uint8_t *udp = &ip[ip_header];
+    uint16_t port = msg_get_be16(&udp[2]);
+    uint32_t udp_len = msg_get_be16(&udp[4]);
+    if ((port < msg_eth_local.port) ||
+        (port >= msg_eth_local.port + MSG_ID_RESERVE_LEN) || (udp_len < 8) ||
+        (udp_len > ip_len - ip_header)) {
+        return;
+    }
+
+    struct msg_instance *msg = msg_list[port - msg_eth_local.port];
+    if ((msg == NULL) || (msg->eth == NULL)) {
+        return;
+    }
+
+    /* 记住对端, 之后的数据报直接发给它 */
+    msg_eth_link_t *link = msg->eth;
+    memcpy(msg_eth_remote.mac, &data[6], 6);
+    memcpy(msg_eth_remote.ip, &ip[12], 4);
+    link->remote_port = msg_get_be16(&udp[0]);
+
+    uint32_t payload = udp_len - 8;
+    if (payload > link->mask + 1 - (link->tail - link->head)) {
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.eth_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+        return;
+    }
+
+    for (uint32_t i = 0; i < payload; ++i) {
+        link->rx_ring[(link->tail + i) & link->mask] = udp[8 + i];
+    }
+    link->tail += payload;
+}
+
+/**
+ * @brief 读出网卡收到的报文, 发出等待超时的数据报
+ *
+ * @param msg 消息实例
+ */
+static void msg_eth_poll(struct msg_instance *msg) {
+    void *app_buf;
+    while (HAL_ETH_ReadData(&eth_handle, &app_buf) == HAL_OK) {
+        msg_eth_packet_t *packet = (msg_eth_packet_t *)app_buf;
+        msg_eth_input(packet->data, packet->len);
+    }
+
+    msg_eth_link_t *link = msg->eth;
+    if ((link->tx_len == 0) || (MSG_TIMESTAMP() - link->tx_stamp <
+                                MSG_ETH_FLUSH_US * MSG_TIMESTAMP_PER_US)) {
+        return;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (xSemaphoreTake(msg->send_buf_semp, 0) != pdTRUE) {
+        /* 正在发送, 下一次轮询再检查 */
+        return;
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    msg_eth_flush_link(msg);
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+}
+
+/**
+ * @brief 立即发出所有 ID 攒好的数据报
+ *
+ */
+void message_eth_flush(void) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        struct msg_instance *msg = msg_list[i];
+        if ((msg == NULL) || (msg->eth == NULL)) {
+            continue;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreTake(msg->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+        msg_eth_flush_link(msg);
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(msg->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+    }
+}
+
+/**
+ * @brief 读出以太网链路中已经收到的数据
+ *
+ * @param link 以太网链路
+ * @param buf 读出缓冲区
+ * @param size 缓冲区大小
+ * @return 读出的字节数
+ */
+static uint32_t msg_eth_read(msg_eth_link_t *link, uint8_t *buf,
+                             uint32_t size) {
+    uint32_t len = link->tail - link->head;
+    if (len > size) {
+        len = size;
+    }
+
+    for (uint32_t i = 0; i < len; ++i) {
+        buf[i] = link->rx_ring[(link->head + i) & link->mask];
+    }
+    link->head += len;
+
+    return len;
+}
+
+#endif /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+
+/**
+ * @brief 设置某个 ID 通过多条链路聚合收发
+ *
+ * @param msg_id 聚合的逻辑 ID, 发送和回调都使用它
+ * @param links 链路, 每条链路是一个专用的 ID, 需要另外注册它的收发链路
+ * @param count 链路个数, 不超过`MSG_BOND_MAX_LINKS`
+ * @param window 接收重排窗口大小, 必须是 2 的幂次方, 不超过 128
+ * @param frame_size 每帧最大数据长度, 不超过 255
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 收发双方都要注册, 同时会启用逻辑 ID 和链路 ID 的帧序号. 链路 ID
+ *       收到的帧全部交给聚合, 不再回调链路 ID 自己的回调. 不能与可靠传输
+ *       同时使用
+ */
+uint8_t message_register_bond(msg_id_t msg_id, const msg_bond_link_t *links,
+                              uint32_t count, uint32_t window,
+                              uint32_t frame_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (links == NULL) || (count == 0) ||
+        (count > MSG_BOND_MAX_LINKS) || !is_pow_of_2(window) ||
+        (window > 128) || (frame_size == 0) || (frame_size > 255)) {
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if ((links[i].msg_id >= MSG_ID_RESERVE_LEN) ||
+            (links[i].msg_id == msg_id)) {
+            return 1;
+        }
+
+        msg_instance_create(links[i].msg_id);
+        if ((msg_list[links[i].msg_id] == NULL) ||
+            (msg_list[links[i].msg_id]->bond != NULL)) {
+            /* 链路本身不能再聚合 */
+            return 1;
+        }
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    if (msg->bond != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    msg_bond_t *bond = (msg_bond_t *)MSG_MALLOC(
+        sizeof(msg_bond_t) + window * sizeof(msg_bond_slot_t) +
+        window * frame_size);
+    if (bond == NULL) {
+        return 1;
+    }
+
+    if (msg->send_buf == NULL) {
+        msg->send_buf = (uint8_t *)MSG_MALLOC(MSG_FRAME_WIRE_SIZE(frame_size));
+        if (msg->send_buf == NULL) {
+            MSG_FREE(bond);
+            return 1;
+        }
+        msg->send_buf_len = MSG_FRAME_WIRE_SIZE(frame_size);
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    memset(bond, 0, sizeof(msg_bond_t) + window * sizeof(msg_bond_slot_t));
+    bond->owner = msg;
+    bond->msg_id = msg_id;
+    bond->count = count;
+    bond->mask = window - 1;
+    bond->frame_size = frame_size;
+    bond->rx = (msg_bond_slot_t *)(bond + 1);
+    bond->rx_mem = (uint8_t *)(bond->rx + window);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        struct msg_instance *link = msg_list[links[i].msg_id];
+
+        bond->link[i] = link;
+        bond->weight[i] = (links[i].weight != 0) ? links[i].weight : 1;
+
+        /* 链路上的帧带的是逻辑 ID 的序号 */
+        link->sequence = true;
+        link->seq_synced = false;
+        link->bond_of = bond;
+        link->bond_index = (uint8_t)i;
+    }
+
+    msg->sequence = true;
+    msg->seq_synced = false;
+    msg->seq_next = 0;
+    msg->bond = bond;
+
+    return 0;
+}
+
+/**
+ * @brief 选择一条链路发送一帧
+ *
+ * @param msg 聚合的逻辑实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @note 按`(积压字节数 + 帧长度) / 权重`选择最早能发完这一帧的链路.
+ *       CAN, SPI 和以太网链路自己缓冲, 积压按 0 计算
+ */
+static void msg_bond_transmit(struct msg_instance *msg, uint8_t *buf,
+                              uint32_t len) {
+    msg_bond_t *bond = msg->bond;
+    struct msg_instance *best = NULL;
+    uint32_t best_idx = 0;
+    uint64_t best_cost = 0, best_weight = 1;
+
+    for (uint32_t i = 0; i < bond->count; ++i) {
+        struct msg_instance *link = bond->link[i];
+        if (!message_link_ready(link)) {
+            continue;
+        }
+
+        uint64_t cost = len;
+        if (link->send_uart != NULL) {
+            cost += MSG_UART_TX_PENDING(link->send_uart);
+        }
+
+        /* 比较 cost / weight, 交叉相乘避免除法 */
+        if ((best == NULL) ||
+            (cost * best_weight < best_cost * bond->weight[i])) {
+            best = link;
+            best_idx = i;
+            best_cost = cost;
+            best_weight = bond->weight[i];
+        }
+    }
+
+    if (best == NULL) {
+        return;
+    }
+
+    message_transmit(best, buf, len);
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++msg->stats.bond_frames[best_idx];
+    MSG_EXIT_CRITICAL();
+#else  /* MSG_ENABLE_STATISTICS */
+    (void)best_idx;
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 按顺序交付一帧
+ *
+ * @param bond 聚合
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据
+ * @param msg_length 消息长度
+ */
+static void msg_bond_deliver(msg_bond_t *bond, uint8_t msg_id_type,
+                             uint8_t *msg_data, uint32_t msg_length) {
+    message_deliver(bond->owner, bond->msg_id, msg_length, msg_id_type,
+                    msg_data);
+    ++bond->rx_expect;
+    bond->gap_tick = MSG_GET_TICK();
+
+#if MSG_ENABLE_STATISTICS
+    MSG_STATS_INC(bond->owner->stats.recv_success);
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 放弃期望的帧, 记为丢失
+ *
+ * @param bond 聚合
+ */
+static void msg_bond_lose(msg_bond_t *bond) {
+    ++bond->rx_expect;
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++bond->owner->stats.seq_lost;
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 所有链路是否都收到了比期望序号新的帧
+ *
+ * @param bond 聚合
+ * @return 是则期望的帧已经丢失
+ */
+static bool msg_bond_passed(msg_bond_t *bond) {
+    for (uint32_t i = 0; i < bond->count; ++i) {
+        if (!bond->link_seen[i] ||
+            ((int32_t)(bond->link_last[i] - bond->rx_expect) <= 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief 交付窗口中连续的帧, 确定丢失的帧直接跳过
+ *
+ * @param bond 聚合
+ */
+static void msg_bond_advance(msg_bond_t *bond) {
+    msg_bond_slot_t *slot;
+
+    while (bond->rx_buffered != 0) {
+        uint32_t idx = bond->rx_expect & bond->mask;
+
+        slot = &bond->rx[idx];
+        if (slot->len != 0) {
+            uint32_t len = slot->len;
+            slot->len = 0;
+            --bond->rx_buffered;
+            msg_bond_deliver(bond, slot->id_type,
+                             &bond->rx_mem[idx * bond->frame_size], len);
+        } else if (msg_bond_passed(bond)) {
+            msg_bond_lose(bond);
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 对端重新启动后序号从头开始, 交付窗口中缓存的旧帧后重新同步
+ *
+ * @param bond 聚合
+ */
+static void msg_bond_resync(msg_bond_t *bond) {
+    while (bond->rx_buffered != 0) {
+        uint32_t idx = bond->rx_expect & bond->mask;
+        if (bond->rx[idx].len != 0) {
+            uint32_t len = bond->rx[idx].len;
+            bond->rx[idx].len = 0;
+            --bond->rx_buffered;
+            msg_bond_deliver(bond, bond->rx[idx].id_type,
+                             &bond->rx_mem[idx * bond->frame_size], len);
+        } else {
+            msg_bond_lose(bond);
+        }
+    }
+
+    bond->rx_synced = false;
+    memset(bond->link_seen, 0, sizeof(bond->link_seen));
+}
+
+/**
+ * @brief 聚合的链路收到一帧, 按序号重排后交付
+ *
+ * @param bond 聚合
+ * @param index 收到这一帧的链路序号
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据, 前一个字节是序号
+ * @param msg_length 消息长度
+ */
+static void msg_bond_recv(msg_bond_t *bond, uint32_t index,
+                          uint8_t msg_id_type, uint8_t *msg_data,
+                          uint32_t msg_length) {
+    uint8_t seq = msg_data[-1];
+    int8_t delta = 0;
+    uint32_t pos = 0;
+
+    if (bond->rx_synced) {
+        /* 8 位序号在期望序号前后 128 帧内展开 */
+        delta = (int8_t)(uint8_t)(seq - (uint8_t)bond->rx_expect);
+        pos = bond->rx_expect + (uint32_t)(int32_t)delta;
+
+        if (bond->link_seen[index] &&
+            ((int32_t)(pos - bond->link_last[index]) <= 0)) {
+            /* 每条链路内部不会乱序, 同一条链路上的序号倒退说明对端重新
+             * 启动, 从头开始计数 */
+            msg_bond_resync(bond);
+        }
+    }
+
+    if (!bond->rx_synced) {
+        /* 第一帧, 以它为起点 */
+        bond->rx_synced = true;
+        bond->rx_expect = seq;
+        delta = 0;
+        pos = seq;
+    }
+
+    if (!bond->link_seen[index] ||
+        ((int32_t)(pos - bond->link_last[index]) > 0)) {
+        bond->link_seen[index] = true;
+        bond->link_last[index] = pos;
+    }
+
+    if (delta < 0) {
+        /* 已经交付或超时跳过的帧 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(bond->owner->stats.seq_duplicate);
+#endif /* MSG_ENABLE_STATISTICS */
+        msg_bond_advance(bond);
+        return;
+    }
+
+    if (msg_length > bond->frame_size) {
+        /* 超过注册的长度, 收发双方设置不一致 */
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(bond->owner->stats.recv_error);
+#endif /* MSG_ENABLE_STATISTICS */
+        msg_bond_advance(bond);
+        return;
+    }
+
+    if (delta == 0) {
+        /* 按序到达, 不用复制 */
+        msg_bond_deliver(bond, msg_id_type, msg_data, msg_length);
+        msg_bond_advance(bond);
+        return;
+    }
+
+    while ((uint32_t)(pos - bond->rx_expect) > bond->mask) {
+        /* 超出窗口, 不再等待窗口之前的帧 */
+        uint32_t idx = bond->rx_expect & bond->mask;
+        if (bond->rx[idx].len != 0) {
+            uint32_t len = bond->rx[idx].len;
+            bond->rx[idx].len = 0;
+            --bond->rx_buffered;
+            msg_bond_deliver(bond, bond->rx[idx].id_type,
+                             &bond->rx_mem[idx * bond->frame_size], len);
+        } else {
+            msg_bond_lose(bond);
+        }
+    }
+
+    if (pos == bond->rx_expect) {
+        msg_bond_deliver(bond, msg_id_type, msg_data, msg_length);
+    } else {
+        /* 窗口内的乱序帧, 先缓存 */
+        uint32_t idx = pos & bond->mask;
+        if (bond->rx[idx].len == 0) {
+            memcpy(&bond->rx_mem[idx * bond->frame_size], msg_data,
+                   msg_length);
+            bond->rx[idx].len = msg_length;
+            bond->rx[idx].id_type = msg_id_type;
+            if (bond->rx_buffered++ == 0) {
+                bond->gap_tick = MSG_GET_TICK();
+            }
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(bond->owner->stats.bond_reorder);
+#endif /* MSG_ENABLE_STATISTICS */
+        }
+    }
+
+    msg_bond_advance(bond);
+}
+
+/**
+ * @brief 缺帧等待超时后跳过
+ *
+ * @param bond 聚合
+ */
+static void msg_bond_poll(msg_bond_t *bond) {
+    if ((bond->rx_buffered == 0) ||
+        (MSG_GET_TICK() - bond->gap_tick < MSG_BOND_TIMEOUT)) {
+        return;
+    }
+
+    while (bond->rx[bond->rx_expect & bond->mask].len == 0) {
+        msg_bond_lose(bond);
+    }
+
+    msg_bond_advance(bond);
+}
+
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+
+/**
+ * @brief 设置某个 ID 使用主备链路冗余收发
+ *
+ * @param msg_id 逻辑 ID, 发送和回调都使用它
+ * @param links 链路 ID, 第一个是主链路, 之后按优先级排列. 每个链路 ID 需要
+ *              另外注册它的收发链路
+ * @param count 链路个数, 不超过`MSG_FAILOVER_MAX_LINKS`
+ * @param window 发送窗口大小, 切换时最多补发这么多帧, 必须是 2 的幂次方,
+ *               不超过 64
+ * @param frame_size 每帧最大数据长度, 不超过 255
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 收发双方都要注册, 链路顺序要一致, 同时会启用逻辑 ID 和链路 ID 的
+ *       帧序号. 链路 ID 收到的帧全部交给冗余组, 不能与可靠传输同时使用
+ */
+uint8_t message_register_failover(msg_id_t msg_id, const msg_id_t *links,
+                                  uint32_t count, uint32_t window,
+                                  uint32_t frame_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (links == NULL) || (count == 0) ||
+        (count > MSG_FAILOVER_MAX_LINKS) || !is_pow_of_2(window) ||
+        (window > 64) || (frame_size == 0) || (frame_size > 255)) {
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if ((links[i] >= MSG_ID_RESERVE_LEN) || (links[i] == msg_id)) {
+            return 1;
+        }
+
+        msg_instance_create(links[i]);
+        if ((msg_list[links[i]] == NULL) ||
+            (msg_list[links[i]]->failover != NULL)) {
+            /* 链路本身不能再冗余 */
+            return 1;
+        }
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    if (msg->failover != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+    uint32_t tx_stride = MSG_FRAME_WIRE_SIZE(frame_size);
+    msg_failover_t *fo = (msg_failover_t *)MSG_MALLOC(
+        sizeof(msg_failover_t) + window * sizeof(msg_failover_slot_t) +
+        window * tx_stride);
+    if (fo == NULL) {
+        return 1;
+    }
+
+    if (msg->send_buf == NULL) {
+        msg->send_buf = (uint8_t *)MSG_MALLOC(tx_stride);
+        if (msg->send_buf == NULL) {
+            MSG_FREE(fo);
+            return 1;
+        }
+        msg->send_buf_len = tx_stride;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    memset(fo, 0, sizeof(msg_failover_t) + window * sizeof(msg_failover_slot_t));
+    fo->owner = msg;
+    fo->msg_id = msg_id;
+    fo->count = count;
+    fo->mask = window - 1;
+    fo->tx_stride = tx_stride;
+    fo->tx = (msg_failover_slot_t *)(fo + 1);
+    fo->tx_mem = (uint8_t *)(fo->tx + window);
+
+    uint32_t now = MSG_GET_TICK();
+    for (uint32_t i = 0; i < count; ++i) {
+        struct msg_instance *link = msg_list[links[i]];
+
+        fo->link[i] = link;
+        /* 开始时认为链路健康, 对端不在线时超时后归零 */
+        fo->health[i] = MSG_FAILOVER_HEALTH_MAX;
+        fo->peer_health[i] = MSG_FAILOVER_HEALTH_MAX;
+        fo->rx_tick[i] = now;
+        fo->tx_tick[i] = now;
+
+        link->sequence = true;
+        link->seq_synced = false;
+        link->failover_of = fo;
+        link->failover_index = (uint8_t)i;
+    }
+
+    msg->sequence = true;
+    msg->seq_synced = false;
+    msg->seq_next = 0;
+    msg->failover = fo;
+
+    return 0;
+}
+
+/**
+ * @brief 获取链路冗余状态
+ *
+ * @param msg_id 逻辑 ID
+ * @param[out] status 状态
+ * @return 获取结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或该 ID 没有注册链路冗余
+ */
+uint8_t message_get_failover_status(msg_id_t msg_id,
+                                    msg_failover_status_t *status) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (status == NULL)) {
+        return 1;
+    }
+
+    if ((msg_list[msg_id] == NULL) || (msg_list[msg_id]->failover == NULL)) {
+        return 1;
+    }
+
+    msg_failover_t *fo = msg_list[msg_id]->failover;
+
+    memset(status, 0, sizeof(msg_failover_status_t));
+    status->active = fo->active;
+    for (uint32_t i = 0; i < fo->count; ++i) {
+        status->health[i] = (fo->health[i] < fo->peer_health[i])
+                                ? fo->health[i]
+                                : fo->peer_health[i];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 链路是否健康
+ *
+ * @param fo 冗余组
+ * @param index 链路序号
+ * @return 本端和对端的健康度都不低于`MSG_FAILOVER_HEALTH_MIN`
+ */
+static inline bool msg_failover_healthy(msg_failover_t *fo, uint32_t index) {
+    return message_link_ready(fo->link[index]) &&
+           (fo->health[index] >= MSG_FAILOVER_HEALTH_MIN) &&
+           (fo->peer_health[index] >= MSG_FAILOVER_HEALTH_MIN);
+}
+
+/**
+ * @brief 在一条链路上发送心跳
+ *
+ * @param fo 冗余组
+ * @param index 链路序号
+ * @param now 当前时刻
+ * @note 调用前需要持有逻辑实例的发送缓冲区互斥量
+ */
+static void msg_failover_heartbeat(msg_failover_t *fo, uint32_t index,
+                                   uint32_t now) {
+    struct msg_instance *link = fo->link[index];
+    uint8_t probe[MSG_FAILOVER_PROBE_LEN] = {
+        MSG_FAILOVER_PROBE,
+        fo->rx_last,
+        fo->rx_synced ? MSG_FAILOVER_ACK_VALID : 0U,
+        fo->health[index],
+        fo->epoch,
+        fo->peer_epoch_valid ? fo->peer_epoch : 0U};
+
+    fo->tx_tick[index] = now;
+    if (!message_link_ready(link)) {
+        return;
+    }
+
+    uint32_t frame_len = message_frame_encode(link, fo->msg_id,
+                                              MSG_DATA_CONTROL, probe,
+                                              MSG_FAILOVER_PROBE_LEN);
+    if (frame_len != 0) {
+        message_transmit(link, link->send_buf, frame_len);
+    }
+}
+
+/**
+ * @brief 保存到发送窗口, 从当前链路发出
+ *
+ * @param msg 逻辑实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @note 调用前需要持有逻辑实例的发送缓冲区互斥量
+ */
+static void msg_failover_transmit(struct msg_instance *msg, uint8_t *buf,
+                                  uint32_t len) {
+    msg_failover_t *fo = msg->failover;
+    /* 编码时已经递增了序号 */
+    uint8_t seq = msg->seq_next - 1;
+    msg_failover_slot_t *slot = &fo->tx[seq & fo->mask];
+
+    if (len <= fo->tx_stride) {
+        memcpy(&fo->tx_mem[(seq & fo->mask) * fo->tx_stride], buf, len);
+        slot->len = len;
+        slot->seq = seq;
+    } else {
+        slot->len = 0;
+    }
+
+    uint8_t active = fo->active;
+    if (!message_link_ready(fo->link[active])) {
+        return;
+    }
+
+    if (fo->epoch == 0) {
+        /* 对端还没有确认本端的会话号, 可能还保留着上次启动的序号,
+         * 先发心跳让它清掉, 同一条链路上心跳一定先到 */
+        msg_failover_heartbeat(fo, active, MSG_GET_TICK());
+    }
+
+    message_transmit(fo->link[active], buf, len);
+    fo->tx_tick[active] = MSG_GET_TICK();
+}
+
+/**
+ * @brief 链路收到错误的数据, 降低健康度
+ *
+ * @param msg 链路实例, 不属于冗余组时什么也不做
+ * @param penalty 扣的分数
+ */
+static void msg_failover_penalty(struct msg_instance *msg, uint8_t penalty) {
+    msg_failover_t *fo = msg->failover_of;
+    if (fo == NULL) {
+        return;
+    }
+
+    uint8_t *health = &fo->health[msg->failover_index];
+    *health = (*health > penalty) ? *health - penalty : 0;
+}
+
+/**
+ * @brief 处理心跳中的会话号
+ *
+ * @param fo 冗余组
+ * @param index 收到心跳的链路序号
+ * @param epoch 对端的会话号
+ * @param echo 对端看到的本端会话号
+ */
+static void msg_failover_epoch(msg_failover_t *fo, uint32_t index,
+                               uint8_t epoch, uint8_t echo) {
+    if (fo->peer_epoch_valid && (epoch != fo->peer_epoch) &&
+        ((epoch == 0) || (fo->peer_epoch != 0))) {
+        /* 对端重新启动过, 它的序号从头开始, 以它之后的第一帧为起点 */
+        fo->rx_synced = false;
+        fo->rx_last = 0;
+        fo->rx_seen = 0;
+        fo->peer_ack_valid = false;
+    }
+    fo->peer_epoch_valid = true;
+    fo->peer_epoch = epoch;
+
+    if (epoch == 0) {
+        /* 对端刚启动, 在下一次轮询时回复心跳, 让它尽快确认会话号 */
+        fo->tx_tick[index] = MSG_GET_TICK() - MSG_FAILOVER_HEARTBEAT;
+    }
+
+    if ((fo->epoch == 0) && (echo == 0)) {
+        /* 对端已经看到本端的会话号 0, 即已经清掉了上次启动的接收状态 */
+        fo->epoch = 1;
+    }
+}
+
+/**
+ * @brief 冗余组的链路收到一帧
+ *
+ * @param fo 冗余组
+ * @param index 收到这一帧的链路序号
+ * @param msg_id_type 消息 ID 和数据类型
+ * @param msg_data 消息数据, 前一个字节是序号
+ * @param msg_length 消息长度
+ */
+static void msg_failover_recv(msg_failover_t *fo, uint32_t index,
+                              uint8_t msg_id_type, uint8_t *msg_data,
+                              uint32_t msg_length) {
+    struct msg_instance *msg = fo->owner;
+
+    fo->rx_tick[index] = MSG_GET_TICK();
+    fo->health[index] =
+        (fo->health[index] + MSG_FAILOVER_HEALTH_GOOD < MSG_FAILOVER_HEALTH_MAX)
+            ? fo->health[index] + MSG_FAILOVER_HEALTH_GOOD
+            : MSG_FAILOVER_HEALTH_MAX;
+
+    if ((msg_id_type & 0x0F) == MSG_DATA_CONTROL) {
+        if ((msg_length == MSG_FAILOVER_PROBE_LEN) &&
+            (msg_data[0] == MSG_FAILOVER_PROBE)) {
+            /* 心跳, 先检查对端是否重新启动过, 再记下对端的交付进度和它
+             * 看到的链路健康度 */
+            msg_failover_epoch(fo, index, msg_data[4], msg_data[5]);
+            if (msg_data[2] & MSG_FAILOVER_ACK_VALID) {
+                fo->peer_ack_valid = true;
+                fo->peer_ack = msg_data[1];
+            }
+            fo->peer_health[index] = msg_data[3];
+        }
+        return;
+    }
+
+    uint8_t seq = msg_data[-1];
+
+    if (!fo->rx_synced) {
+        /* 第一帧, 以它为起点 */
+        fo->rx_synced = true;
+        fo->rx_last = seq - 1;
+        fo->rx_seen = 0;
+    }
+
+    uint8_t ahead = seq - fo->rx_last;
+    if ((ahead != 0) && (ahead < 128)) {
+        /* 新的帧, 移动位图 */
+        fo->rx_seen = (ahead < 64) ? ((fo->rx_seen << ahead) | 1U) : 1U;
+        fo->rx_last = seq;
+    } else {
+        /* 之前的帧, 补发的帧已经交付过就丢弃 */
+        uint8_t behind = fo->rx_last - seq;
+        if ((behind >= 64) || ((fo->rx_seen >> behind) & 1U)) {
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.seq_duplicate);
+#endif /* MSG_ENABLE_STATISTICS */
+            return;
+        }
+        fo->rx_seen |= (uint64_t)1U << behind;
+    }
+
+    message_deliver(msg, fo->msg_id, msg_length, msg_id_type, msg_data);
+
+#if MSG_ENABLE_STATISTICS
+    MSG_STATS_INC(msg->stats.recv_success);
+#endif /* MSG_ENABLE_STATISTICS */
+}
+
+/**
+ * @brief 切换发送链路
+ *
+ * @param fo 冗余组
+ * @param to 新的链路序号
+ * @param resend 是否在新链路上补发对端还没有交付的帧
+ * @note 调用前需要持有逻辑实例的发送缓冲区互斥量
+ */
+static void msg_failover_switch(msg_failover_t *fo, uint32_t to, bool resend) {
+    struct msg_instance *msg = fo->owner;
+
+    fo->active = (uint8_t)to;
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++msg->stats.failover_switch;
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+
+    if (!resend) {
+        return;
+    }
+
+    /* 对端没有报告过交付进度时补发整个窗口 */
+    uint8_t seq = fo->peer_ack_valid ? (uint8_t)(fo->peer_ack + 1)
+                                     : (uint8_t)(msg->seq_next - fo->mask - 1);
+    if ((uint8_t)(msg->seq_next - seq) > fo->mask + 1) {
+        seq = (uint8_t)(msg->seq_next - fo->mask - 1);
+    }
+
+    for (; seq != msg->seq_next; ++seq) {
+        msg_failover_slot_t *slot = &fo->tx[seq & fo->mask];
+        if ((slot->len == 0) || (slot->seq != seq)) {
+            continue;
+        }
+
+        message_transmit(fo->link[to],
+                         &fo->tx_mem[(seq & fo->mask) * fo->tx_stride],
+                         slot->len);
+#if MSG_ENABLE_STATISTICS
+        MSG_STATS_INC(msg->stats.failover_resent);
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+
+    fo->tx_tick[to] = MSG_GET_TICK();
+}
+
+/**
+ * @brief 检查一条链路: 超时归零, 空闲时发送心跳, 需要时切换链路
+ *
+ * @param fo 冗余组
+ * @param index 正在轮询的链路序号
+ */
+static void msg_failover_poll(msg_failover_t *fo, uint32_t index) {
+    uint32_t now = MSG_GET_TICK();
+
+    if (now - fo->rx_tick[index] > MSG_FAILOVER_TIMEOUT) {
+        /* 对端的心跳也收不到了 */
+        fo->health[index] = 0;
+    }
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreTake(fo->owner->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+
+    if (now - fo->tx_tick[index] >= MSG_FAILOVER_HEARTBEAT) {
+        msg_failover_heartbeat(fo, index, now);
+    }
+
+    uint32_t active = fo->active;
+    if (!msg_failover_healthy(fo, active)) {
+        /* 当前链路故障, 换到优先级最高的健康链路, 补发可能丢在旧链路上的帧 */
+        for (uint32_t i = 0; i < fo->count; ++i) {
+            if ((i != active) && msg_failover_healthy(fo, i)) {
+                msg_failover_switch(fo, i, true);
+                break;
+            }
+        }
+    } else {
+        /* 优先级更高的链路完全恢复后切回 */
+        for (uint32_t i = 0; i < active; ++i) {
+            if ((fo->health[i] == MSG_FAILOVER_HEALTH_MAX) &&
+                (fo->peer_health[i] == MSG_FAILOVER_HEALTH_MAX) &&
+                message_link_ready(fo->link[i])) {
+                msg_failover_switch(fo, i, false);
+                break;
+            }
+        }
+    }
+
+#if MSG_ENABLE_RTOS
+    xSemaphoreGive(fo->owner->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+}
+
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+
+/**
+ * @brief 设置某个 ID 的帧组播到多个串口
+ *
+ * @param msg_id 数据含义, 帧头使用这个 ID
+ * @param uarts 成员串口, 需要开启 DMA 发送
+ * @param count 串口个数, 不超过`MSG_MULTICAST_MAX_UARTS`
+ * @param buf_num 发送缓冲区个数, 必须是 2 的幂次方, 不超过 128
+ * @param frame_size 每帧最大数据长度, 不超过 255
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 缓冲区在注册时一次分配好. 一个串口只能属于一个组播, 它的 DMA 发送
+ *       由组播独占. 不能与可靠传输, 聚合和冗余同时使用
+ */
+uint8_t message_register_multicast(msg_id_t msg_id,
+                                   UART_HandleTypeDef *const *uarts,
+                                   uint32_t count, uint32_t buf_num,
+                                   uint32_t frame_size) {
+    if ((msg_id >= MSG_ID_RESERVE_LEN) || (uarts == NULL) || (count == 0) ||
+        (count > MSG_MULTICAST_MAX_UARTS) || !is_pow_of_2(buf_num) ||
+        (buf_num > 128) || (frame_size == 0) || (frame_size > 255)) {
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if ((uarts[i] == NULL) || (uarts[i]->hdmatx == NULL)) {
+            return 1;
+        }
+    }
+
+    msg_instance_create(msg_id);
+
+    struct msg_instance *msg = msg_list[msg_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    if (msg->mcast != NULL) {
+        /* 已经注册过 */
+        return 0;
+    }
+
+#if MSG_ENABLE_RELIABLE
+    if (msg->reliable != NULL) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_BOND
+    if ((msg->bond != NULL) || (msg->bond_of != NULL)) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+    if ((msg->failover != NULL) || (msg->failover_of != NULL)) {
+        return 1;
+    }
+#endif /* MSG_ENABLE_FAILOVER */
+
+    uint32_t stride = MSG_FRAME_WIRE_SIZE(frame_size);
+    msg_mcast_t *mc = (msg_mcast_t *)MSG_MALLOC(
+        sizeof(msg_mcast_t) + buf_num * sizeof(msg_mcast_buf_t) +
+        count * buf_num * sizeof(msg_mcast_buf_t *) + buf_num * stride);
+    if (mc == NULL) {
+        return 1;
+    }
+
+    if (msg->send_buf == NULL) {
+        msg->send_buf = (uint8_t *)MSG_MALLOC(stride);
+        if (msg->send_buf == NULL) {
+            MSG_FREE(mc);
+            return 1;
+        }
+        msg->send_buf_len = stride;
+    }
+
+#if MSG_ENABLE_RTOS
+    if (msg->send_buf_semp == NULL) {
+        msg->send_buf_semp = xSemaphoreCreateMutex();
+    }
+#endif /* MSG_ENABLE_RTOS */
+
+    memset(mc, 0, sizeof(msg_mcast_t));
+    mc->count = count;
+    mc->mask = buf_num - 1;
+    mc->frame_size = frame_size;
+    mc->buf = (msg_mcast_buf_t *)(mc + 1);
+
+    msg_mcast_buf_t **queue = (msg_mcast_buf_t **)(mc->buf + buf_num);
+    uint8_t *mem = (uint8_t *)(queue + count * buf_num);
+
+    for (uint32_t i = 0; i < buf_num; ++i) {
+        mc->buf[i].ref = 0;
+        mc->buf[i].len = 0;
+        mc->buf[i].data = mem + i * stride;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        mc->port[i].huart = uarts[i];
+        mc->port[i].queue = queue + i * buf_num;
+    }
+
+    msg->mcast = mc;
+
+    return 0;
+}
+
+/**
+ * @brief 检查组播的 ID 能否再发送一帧
+ *
+ * @param msg 消息实例
+ * @param data_len 数据长度
+ * @return 是否可以发送, 非组播的 ID 总是可以发送
+ * @note 调用前需要持有发送缓冲区互斥量. 只有发送时会占用缓冲区, 检查通过后
+ *       发送时一定能找到空闲的缓冲区
+ */
+static bool msg_mcast_writable(struct msg_instance *msg, uint32_t data_len) {
+    msg_mcast_t *mc = msg->mcast;
+    if (mc == NULL) {
+        return true;
+    }
+
+    if (data_len > mc->frame_size) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= mc->mask; ++i) {
+        if (mc->buf[(mc->next + i) & mc->mask].ref == 0) {
+            mc->next = (mc->next + i) & mc->mask;
+            return true;
+        }
+    }
+
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    ++msg->stats.mcast_pool_full;
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+
+    return false;
+}
+
+/**
+ * @brief 启动串口上排队的下一个缓冲区的 DMA 发送
+ *
+ * @param msg 消息实例
+ * @param port 成员串口
+ * @note 在临界区或发送完成中断中调用. 启动失败的缓冲区直接从这个串口的
+ *       队列中去掉
+ */
+static void msg_mcast_kick(struct msg_instance *msg, msg_mcast_port_t *port) {
+    while (!port->busy && (port->head != port->tail)) {
+        msg_mcast_buf_t *buf = port->queue[port->head & msg->mcast->mask];
+
+        if (HAL_UART_Transmit_DMA(port->huart, buf->data,
+                                  (uint16_t)buf->len) == HAL_OK) {
+            port->busy = true;
+            break;
+        }
+
+        ++port->head;
+        --buf->ref;
+#if MSG_ENABLE_STATISTICS
+        ++msg->stats.mcast_drop;
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+}
+
+/**
+ * @brief 把一帧复制到空闲的发送缓冲区, 在每个串口上排队发送
+ *
+ * @param msg 消息实例
+ * @param buf 帧数据
+ * @param len 帧长度
+ * @note 调用前需要持有发送缓冲区互斥量, 并且`msg_mcast_writable`检查通过
+ */
+static void msg_mcast_transmit(struct msg_instance *msg, uint8_t *buf,
+                               uint32_t len) {
+    msg_mcast_t *mc = msg->mcast;
+    msg_mcast_buf_t *slot = &mc->buf[mc->next];
+
+    memcpy(slot->data, buf, len);
+    slot->len = len;
+    /* 先设置好引用计数, 第一个串口可能在排队第二个之前就发完了 */
+    slot->ref = (uint8_t)mc->count;
+    mc->next = (mc->next + 1) & mc->mask;
+
+    for (uint32_t i = 0; i < mc->count; ++i) {
+        msg_mcast_port_t *port = &mc->port[i];
+
+        MSG_ENTER_CRITICAL();
+        port->queue[port->tail & mc->mask] = slot;
+        ++port->tail;
+        msg_mcast_kick(msg, port);
+        MSG_EXIT_CRITICAL();
+    }
+}
+
+/**
+ * @brief 串口发送完成处理, 在`HAL_UART_TxCpltCallback`中调用
+ *
+ * @param huart 串口句柄
+ * @note 释放这个串口发完的缓冲区, 所有串口都发完后缓冲区可以重新使用,
+ *       然后启动这个串口上排队的下一个缓冲区
+ */
+void message_uart_tx_callback(UART_HandleTypeDef *huart) {
+    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
+        struct msg_instance *msg = msg_list[i];
+        if ((msg == NULL) || (msg->mcast == NULL)) {
+            continue;
+        }
+
+        msg_mcast_t *mc = msg->mcast;
+        for (uint32_t j = 0; j < mc->count; ++j) {
+            msg_mcast_port_t *port = &mc->port[j];
+            if ((port->huart != huart) || !port->busy) {
+                continue;
+            }
+
+            /* 其他成员串口的中断可能嵌套进来释放同一个缓冲区 */
+            MSG_ENTER_CRITICAL_ISR();
+            --port->queue[port->head & mc->mask]->ref;
+            ++port->head;
+            port->busy = false;
+            msg_mcast_kick(msg, port);
+            MSG_EXIT_CRITICAL_ISR();
+            return;
+        }
+    }
+}
+
+#endif /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_ROUTE
+
+/**
+ * @brief 设置某条链路收到的某个 ID 的帧转发到其他链路
+ *
+ * @param src_id 接收链路的 ID, 需要注册接收
+ * @param frame_id 帧头中的 ID
+ * @param dst_ids 目的链路的 ID, 需要注册发送链路
+ * @param count 目的链路个数, 不超过`MSG_ROUTE_MAX_DST`
+ * @param cut_through 非 0 时直通转发, 不校验 CRC8, 由最终的接收端校验;
+ *                    0 为存储转发, 校验 CRC8 通过后才转发
+ * @return 设置结果:
+ *  @retval - 0: 成功
+ *  @retval - 1: 参数错误或内存分配失败
+ * @note 转发的帧不回调, 不检查序号, 帧头中的 ID, 序号和 CRC8 保持原样.
+ *       同一条接收链路的同一个 ID 再次设置时替换目的链路, 要在开始轮询之前
+ *       完成. 目的链路不能是可靠传输, 聚合, 冗余或组播的 ID
+ */
+uint8_t message_register_route(msg_id_t src_id, msg_id_t frame_id,
+                               const msg_id_t *dst_ids, uint32_t count,
+                               uint8_t cut_through) {
+    if ((src_id >= MSG_ID_RESERVE_LEN) || (frame_id >= MSG_ID_RESERVE_LEN) ||
+        (dst_ids == NULL) || (count == 0) || (count > MSG_ROUTE_MAX_DST)) {
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (dst_ids[i] >= MSG_ID_RESERVE_LEN) {
+            return 1;
+        }
+
+        struct msg_instance *dst = msg_list[dst_ids[i]];
+        if (dst == NULL) {
+            /* 发送链路可以之后再注册 */
+            continue;
+        }
+
+        /* 这些 ID 的序号和发送窗口由本端维护, 不能直接写入别人的帧 */
+#if MSG_ENABLE_RELIABLE
+        if (dst->reliable != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_BOND
+        if (dst->bond != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+        if (dst->failover != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+        if (dst->mcast != NULL) {
+            return 1;
+        }
+#endif /* MSG_ENABLE_MULTICAST */
+    }
+
+    msg_instance_create(src_id);
+
+    struct msg_instance *msg = msg_list[src_id];
+    if (msg == NULL) {
+        return 1;
+    }
+
+    if (msg->route_buf == NULL) {
+        /* 同一条接收链路的路由共用, 只在轮询这条链路时使用 */
+        msg->route_buf = (uint8_t *)MSG_MALLOC(MSG_ROUTE_BUF_SIZE);
+        if (msg->route_buf == NULL) {
+            return 1;
+        }
+    }
+
+    msg_route_t *route = msg->route;
+    while ((route != NULL) && (route->frame_id != frame_id)) {
+        route = route->next;
+    }
+
+    bool created = (route == NULL);
+    if (created) {
+        route = (msg_route_t *)MSG_MALLOC(sizeof(msg_route_t));
+        if (route == NULL) {
+            return 1;
+        }
+        route->frame_id = frame_id;
+    }
+
+    route->cut_through = (cut_through != 0);
+    route->count = count;
+    memcpy(route->dst, dst_ids, count * sizeof(msg_id_t));
+
+    if (created) {
+        /* 填好后再挂到链表上 */
+        route->next = msg->route;
+        msg->route = route;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 查找队列中一帧的路由
+ *
+ * @param msg 接收链路的消息实例
+ * @param frame 帧, 从标识开始
+ * @param ext_len 扩展 ID 长度
+ * @return 路由, 不需要转发时返回`NULL`
+ */
+static const msg_route_t *msg_route_find(struct msg_instance *msg,
+                                         const uint8_t *frame,
+                                         uint32_t ext_len) {
+    if (msg->route == NULL) {
+        return NULL;
+    }
+
+    msg_id_t frame_id =
+        (msg_id_t)((ext_len != 0) ? frame[1] : (frame[0] >> 4));
+
+    for (const msg_route_t *route = msg->route; route != NULL;
+         route = route->next) {
+        if (route->frame_id == frame_id) {
+            return route;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 把队列中的一帧原样转发到路由的目的链路
+ *
+ * @param msg 接收链路的消息实例
+ * @param route 路由
+ * @param frame 帧, 从标识开始, 到纠错校验结束
+ * @param len 帧长度, 不含 FIFO 元素大小和结束符
+ * @param ext_len 扩展 ID 长度
+ * @note 队列中存放的是去掉转义的帧, 这里按编码规则重新转义一次, 所有目的
+ *       链路共用. CRC8 和纠错校验不重新计算
+ */
+static void msg_route_forward(struct msg_instance *msg,
+                              const msg_route_t *route, const uint8_t *frame,
+                              uint32_t len, uint32_t ext_len) {
+    uint8_t *buf = msg->route_buf;
+    uint32_t buf_idx = 0;
+
+    for (uint32_t i = 0; i < len; ++i) {
+#ifdef MSG_ESC
+        /* 标识和长度不转义; CRC8 拆成了两个半字节, 不会与结束符冲突 */
+        if ((i != 0) && (i != 1 + ext_len) &&
+            ((frame[i] == MSG_EOF) || (frame[i] == MSG_ESC))) {
+            buf[buf_idx] = MSG_ESC;
+            ++buf_idx;
+        }
+#endif /* MSG_ESC */
+        buf[buf_idx] = frame[i];
+        ++buf_idx;
+    }
+    buf[buf_idx] = MSG_EOF;
+    ++buf_idx;
+    (void)ext_len;
+
+    for (uint32_t i = 0; i < route->count; ++i) {
+        struct msg_instance *dst = msg_list[route->dst[i]];
+        if ((dst == NULL) || !message_link_ready(dst)) {
+#if MSG_ENABLE_STATISTICS
+            MSG_STATS_INC(msg->stats.route_drop);
+#endif /* MSG_ENABLE_STATISTICS */
+            continue;
+        }
+
+#if MSG_ENABLE_RTOS
+        xSemaphoreTake(dst->send_buf_semp, portMAX_DELAY);
+#endif /* MSG_ENABLE_RTOS */
+        message_transmit(dst, buf, buf_idx);
+#if MSG_ENABLE_RTOS
+        xSemaphoreGive(dst->send_buf_semp);
+#endif /* MSG_ENABLE_RTOS */
+
+#if MSG_ENABLE_STATISTICS
+        MSG_ENTER_CRITICAL();
+        ++msg->stats.route_frames;
+        msg->stats.route_bytes += buf_idx;
+        msg_rate_update(&msg->route_rate, buf_idx);
+        MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+    }
+}
+
+#endif /* MSG_ENABLE_ROUTE */
+
+#if MSG_ENABLE_RECORD
+
+/* 两次记录间隔超过这么久 (ms) 时改用系统时基计时, 避免周期计数器溢出 */
+#define MSG_RECORD_RESYNC_MS 5000U
+
+/**
+ * @brief 录制状态
+ */
+typedef struct {
+    uint8_t *buf;           /*!< 环形缓冲区, 存放连续的记录 */
+    uint32_t mask;          /*!< 大小掩码 */
+    uint32_t head;          /*!< 最旧记录的位置 */
+    uint32_t tail;          /*!< 写入位置 */
+    bool paused;            /*!< 正在导出, 暂停写入 */
+    uint32_t last_stamp;    /*!< 上次换算到的时间戳 */
+    uint32_t last_tick;     /*!< 上次记录的系统时基 */
+    uint32_t now_us;        /*!< 录制时钟, 单位 us */
+    msg_record_hook_t hook; /*!< 录制钩子 */
+} msg_record_t;
+
+static msg_record_t msg_record;
+
+/**
+ * @brief 注册录制钩子
+ *
+ * @param hook 钩子函数, 在轮询中每次从链路读出数据后调用, `NULL`取消
+ * @note 钩子在临界区外调用, 可以做文件读写等耗时操作
+ */
+void message_register_record_hook(msg_record_hook_t hook) {
+    MSG_TIMESTAMP_INIT();
+    msg_record.hook = hook;
+}
+
+/**
+ * @brief 开始录制到内存环形缓冲区
+ *
+ * @param size 缓冲区大小 (必须是 2 的幂次方! )
+ * @return 启动状态
+ * @retval - 0: 成功
+ * @retval - 1: 大小不是 2 的幂次方或内存分配失败
+ * @note 已经在录制时重新分配缓冲区, 之前的记录丢弃
+ */
+uint8_t message_record_start(uint32_t size) {
+    uint8_t *buf, *old;
+
+    if (is_pow_of_2(size) == 0) {
+        return 1;
+    }
+
+    buf = (uint8_t *)MSG_MALLOC(size);
+    if (buf == NULL) {
+        return 1;
+    }
+
+    MSG_TIMESTAMP_INIT();
+
+    MSG_ENTER_CRITICAL();
+    old = msg_record.buf;
+    msg_record.buf = buf;
+    msg_record.mask = size - 1;
+    msg_record.head = 0;
+    msg_record.tail = 0;
+    msg_record.paused = false;
+    MSG_EXIT_CRITICAL();
+
+    MSG_FREE(old);
+    return 0;
+}
+
+/**
+ * @brief 停止录制并释放缓冲区
+ *
+ */
+void message_record_stop(void) {
+    uint8_t *old;
 
-    if (msg->send_uart->hdmatx != NULL) {
-        uart_dmatx_write(msg->send_uart, send_buf, buf_idx);
-        uart_dmatx_send(msg->send_uart);
+    MSG_ENTER_CRITICAL();
+    old = msg_record.buf;
+    msg_record.buf = NULL;
+    MSG_EXIT_CRITICAL();
+
+    MSG_FREE(old);
+}
+
+/**
+ * @brief 录制时钟, 把时间戳换算成微秒累加, 调用前已进入临界区
+ *
+ * @return 当前时刻, 单位 us
+ */
+static uint32_t msg_record_clock(void) {
+    uint32_t stamp = MSG_TIMESTAMP();
+    uint32_t tick = MSG_GET_TICK();
+    uint32_t us;
+
+    if (tick - msg_record.last_tick > MSG_RECORD_RESYNC_MS) {
+        /* 间隔太久, 周期计数器可能已经溢出, 按毫秒计 */
+        msg_record.now_us += (tick - msg_record.last_tick) * 1000U;
+        msg_record.last_stamp = stamp;
     } else {
-        HAL_UART_Transmit(msg->send_uart, send_buf, buf_idx, 0xFFFF);
+        /* 余数留到下一次, 不累积误差 */
+        us = (stamp - msg_record.last_stamp) / MSG_TIMESTAMP_PER_US;
+        msg_record.last_stamp += us * MSG_TIMESTAMP_PER_US;
+        msg_record.now_us += us;
     }
+    msg_record.last_tick = tick;
 
-#if MSG_ENABLE_STATISTICS
-    ++msg->send_count;
-#endif /* MSG_ENABLE_STATISTICS */
+    return msg_record.now_us;
+}
 
-#if MSG_ENABLE_RTOS
-    xSemaphoreGive(msg->send_buf_semp);
-#endif /* MSG_ENABLE_RTOS */
+/**
+ * @brief 写入录制缓冲区, 调用前已进入临界区
+ *
+ * @param data 数据
+ * @param len 数据长度
+ */
+static void msg_record_copy(const uint8_t *data, uint32_t len) {
+    uint32_t offset = msg_record.tail & msg_record.mask;
+    uint32_t first = msg_record.mask + 1 - offset;
+
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(&msg_record.buf[offset], data, first);
+    memcpy(msg_record.buf, data + first, len - first);
+    msg_record.tail += len;
 }
 
-static void message_data_enqueue(struct msg_instance *msg, uint32_t recv_len);
-static void message_data_dequeue(struct msg_instance *msg);
+/**
+ * @brief 写入一条记录, 空间不够时丢弃最旧的记录. 调用前已进入临界区
+ *
+ * @param head 记录头
+ * @param data 原始字节
+ * @param len 字节数
+ */
+static void msg_record_write(const uint8_t *head, const uint8_t *data,
+                             uint32_t len) {
+    uint32_t size = msg_record.mask + 1;
+    uint32_t need = MSG_RECORD_HEAD_SIZE + len;
+    uint32_t old;
+
+    if (need > size) {
+        /* 比整个缓冲区还大, 不记录 */
+        return;
+    }
+
+    while (size - (msg_record.tail - msg_record.head) < need) {
+        old = msg_record.buf[(msg_record.head + 4) & msg_record.mask] |
+              (msg_record.buf[(msg_record.head + 5) & msg_record.mask] << 8);
+        msg_record.head += MSG_RECORD_HEAD_SIZE + old;
+    }
+
+    msg_record_copy(head, MSG_RECORD_HEAD_SIZE);
+    msg_record_copy(data, len);
+}
 
 /**
- * @brief 轮询数据, 并调用相应的函数
+ * @brief 记录一次从链路读出的原始字节
  *
+ * @param msg_id 数据含义
+ * @param data 原始字节
+ * @param len 字节数
  */
-void message_polling_data(void) {
-    struct msg_instance *msg;
-    uint32_t recv_len;
-    for (msg_id_t i = 0; i < MSG_ID_RESERVE_LEN; ++i) {
-        msg = msg_list[i];
-        if (msg == NULL) {
-            continue;
-        }
+static void msg_record_chunk(msg_id_t msg_id, const uint8_t *data,
+                             uint32_t len) {
+    uint8_t head[MSG_RECORD_HEAD_SIZE];
+    msg_record_hook_t hook;
+    uint32_t stamp, part;
 
-        if (msg->recv_uart == NULL) {
-            continue;
-        }
+    while (len != 0) {
+        /* 长度只有 2 byte, 超长的分成多条 */
+        part = (len > 0xFFFFU) ? 0xFFFFU : len;
 
-        if (msg->fifo == NULL) {
-            continue;
+        {
+            MSG_ENTER_CRITICAL();
+            stamp = msg_record_clock();
+            hook = msg_record.hook;
+            if ((msg_record.buf != NULL) && !msg_record.paused) {
+                head[0] = (uint8_t)stamp;
+                head[1] = (uint8_t)(stamp >> 8);
+                head[2] = (uint8_t)(stamp >> 16);
+                head[3] = (uint8_t)(stamp >> 24);
+                head[4] = (uint8_t)part;
+                head[5] = (uint8_t)(part >> 8);
+                head[6] = (uint8_t)msg_id;
+                msg_record_write(head, data, part);
+            }
+            MSG_EXIT_CRITICAL();
         }
 
-        message_data_dequeue(msg);
-
-        recv_len =
-            uart_dmarx_read(msg->recv_uart, msg->recv_buf, msg->recv_buf_size);
-        if (recv_len == 0) {
-            continue;
+        if (hook != NULL) {
+            hook(msg_id, stamp, data, part);
         }
 
-        message_data_enqueue(msg, recv_len);
+        data += part;
+        len -= part;
     }
 }
 
 /**
- * @brief 消息数据入队
- * 
- * @param msg 消息实例
- * @param recv_len 接收到的数据长度
+ * @brief 通过串口导出录制内容并清空缓冲区
+ *
+ * @param huart 导出用的串口句柄, 阻塞发送
+ * @return 导出的字节数 (包括文件头), 没有在录制时返回 0
+ * @note 导出期间暂停录制. 导出的字节流直接保存就是日志文件
  */
-static void message_data_enqueue(struct msg_instance *msg, uint32_t recv_len) {
-    msg_fifo_t *fifo = msg->fifo;
-    for (uint32_t i = 0; i < recv_len; ++i) {
-#ifdef MSG_ESC
-        if ((msg->recv_buf[i] == MSG_ESC) && (msg->escape == false)) {
-            /* 遇到转义, 跳过这一字节到下一字节 */
-            msg->escape = true;
-            continue;
-        }
-#endif /* MSG_ESC */
-        if (fifo->new_frame) {
-            /* 空一个字节写长度, 长度写 0 */
-            fifo->buf[fifo->tail & fifo->mask] = 0;
-            ++fifo->tail;
-            fifo->new_frame = false;
-        }
+uint32_t message_record_dump(UART_HandleTypeDef *huart) {
+    static const uint8_t header[] = {'M', 'S', 'G', 'R', MSG_RECORD_VERSION};
+    uint32_t head, tail, pos, offset, len;
+    uint8_t *buf;
 
-        /* 将数据写入队列 */
-        fifo->buf[fifo->tail & fifo->mask] = msg->recv_buf[i];
-        ++fifo->tail;
-        ++fifo->frame_len;
+    {
+        MSG_ENTER_CRITICAL();
+        buf = msg_record.buf;
+        msg_record.paused = (buf != NULL);
+        head = msg_record.head;
+        tail = msg_record.tail;
+        MSG_EXIT_CRITICAL();
+    }
 
-        if (fifo->size == (fifo->tail - fifo->head)) {
-            /* FIFO 已满, 先覆盖旧数据, 有新的帧直接清空 FIFO, 从头开始存 */
-            fifo->head = 0;
-            fifo->tail = 0;
-            msg->fifo_element_len = 0;
-            fifo->frame_len = 0;
-#if MSG_ENABLE_STATISTICS
-            ++msg->fifo_overflow;
-#endif /* MSG_ENABLE_STATISTICS */
-        }
+    if (buf == NULL) {
+        return 0;
+    }
 
-#ifdef MSG_ESC
-        if (msg->escape) {
-            msg->escape = false;
-            /* 这是被转义的字符, 避免执行到下面的结束标识被当成结束符处理 */
-            continue;
+    HAL_UART_Transmit(huart, header, sizeof(header), 0xFFFF);
+    for (pos = head; pos != tail; pos += len) {
+        offset = pos & msg_record.mask;
+        len = tail - pos;
+        if (len > msg_record.mask + 1 - offset) {
+            len = msg_record.mask + 1 - offset;
+        }
+        if (len > 0x8000U) {
+            /* 一次发送长度只有 16 bit */
+            len = 0x8000U;
         }
-#endif /* MSG_ESC */
 
-        if (msg->recv_buf[i] == MSG_EOF) {
-            /* 写入上帧长度, 算上 FIFO 元素大小 */
-            fifo->buf[(fifo->tail - fifo->frame_len - 1) & fifo->mask] =
-                fifo->frame_len + 1;
+        HAL_UART_Transmit(huart, &buf[offset], (uint16_t)len, 0xFFFF);
+    }
 
-            /* 帧长度清零 */
-            fifo->frame_len = 0;
+    {
+        MSG_ENTER_CRITICAL();
+        msg_record.head = tail;
+        msg_record.paused = false;
+        MSG_EXIT_CRITICAL();
+    }
 
-            /* 下次空出一个字节写 */
-            fifo->new_frame = true;
+    return sizeof(header) + tail - head;
+}
 
-            ++msg->fifo_element_len;
-        }
+#endif /* MSG_ENABLE_RECORD */
 
-#if MSG_ENABLE_STATISTICS
-        if (msg->fifo_element_len > msg->max_fifo_element_len) {
-            msg->max_fifo_element_len = msg->fifo_element_len;
-        }
-#endif /* MSG_ENABLE_STATISTICS */
+#if MSG_ENABLE_RESYNC
+
+/**
+ * @brief 判断一个字节能否作为帧头
+ *
+ * @param byte 字节
+ * @return ID 已经注册并且类型在`MSG_RESYNC_TYPE_MASK`中返回`true`
+ */
+static inline bool msg_resync_header(uint8_t byte) {
+    if ((MSG_RESYNC_TYPE_MASK & (1U << (byte & 0x0F))) == 0) {
+        return false;
+    }
+
+#if MSG_ENABLE_EXT_ID
+    if ((byte >> 4) == MSG_ID_EXT) {
+        /* 扩展 ID 在下一个字节检查 */
+        return true;
     }
+#endif /* MSG_ENABLE_EXT_ID */
+
+    return ((byte >> 4) < MSG_ID_RESERVE_LEN) && (msg_list[byte >> 4] != NULL);
 }
 
 /**
- * @brief 消息数据出队并调用回调函数
+ * @brief 判断扩展帧头的第二个字节是否是已注册的扩展 ID
+ *
+ * @param byte 字节
+ * @return 是返回`true`, 未启用扩展 ID 时总是返回`false`
+ */
+static inline bool msg_resync_ext(uint8_t byte) {
+#if MSG_ENABLE_EXT_ID
+    return (byte >= MSG_ID_EXT) && (byte < MSG_ID_RESERVE_LEN) &&
+           (msg_list[byte] != NULL);
+#else  /* MSG_ENABLE_EXT_ID */
+    (void)byte;
+    return false;
+#endif /* MSG_ENABLE_EXT_ID */
+}
+
+/**
+ * @brief 丢弃已经写入队列的半帧
  *
  * @param msg 消息实例
  */
-static void message_data_dequeue(struct msg_instance *msg) {
-    if (msg->fifo_element_len == 0) {
-        /* 队列中没有元素 */
+static void msg_resync_drop(struct msg_instance *msg) {
+    msg_fifo_t *fifo = msg->fifo;
+
+    if (fifo->new_frame) {
         return;
     }
 
+#if MSG_ENABLE_STATISTICS
+    MSG_STATS_ADD(msg->stats.resync_discard, fifo->frame_len);
+#endif /* MSG_ENABLE_STATISTICS */
+
+    /* 连同长度字节一起退回 */
+    fifo->tail -= fifo->frame_len + 1U;
+    fifo->frame_len = 0;
+    fifo->new_frame = true;
+}
+
+/**
+ * @brief 接收时检查帧头, 长度和结束符的位置
+ *
+ * @param msg 消息实例
+ * @param byte 去掉转义后的字节, `msg->escape`表示它是否被转义
+ * @return 是否写入队列, 返回`false`时这个字节已经丢弃
+ * @note 帧头的 ID 必须已经注册, 类型在`MSG_RESYNC_TYPE_MASK`中, 长度不超过
+ *       队列元素能存放的长度. 帧头或长度不合理时逐字节向后查找帧头;
+ *       结束符没有按时出现说明在帧中间, 跳过剩下的部分直到结束符
+ */
+static bool msg_resync_check(struct msg_instance *msg, uint8_t byte) {
     msg_fifo_t *fifo = msg->fifo;
-    uint8_t frame_len;
-    /* 回调消息 ID & type */
-    uint8_t call_id_type;
-    /* 回调消息数据 */
-    uint8_t *call_data;
-    /* 回调消息长度 */
-    uint32_t call_len;
-    /* 实际在缓冲区的位置指针 */
-    uint32_t head, tail;
+    uint32_t seq_len = 0, crc_len = 0;
+    uint32_t overhead;
+    uint32_t count = fifo->new_frame ? 1 : fifo->frame_len + 1U;
+    uint32_t ext_len = 0;
+    uint8_t id_type = 0;
+    bool eof = (byte == MSG_EOF);
+
+#ifdef MSG_ESC
+    eof = eof && !msg->escape;
+#endif /* MSG_ESC */
+
+#if MSG_ENABLE_FEC
+    if (msg->fec) {
+        /* 帧头和长度要在纠错之后才可信 */
+        return true;
+    }
+#endif /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_SEQUENCE
+    seq_len = msg->sequence ? 1 : 0;
+#endif /* MSG_ENABLE_SEQUENCE */
 
 #if MSG_ENABLE_CRC8
-    /* 接收到的 CRC8 校验值 */
-    uint8_t crc_recv;
-    /* 计算得到的 CRC8 校验值 */
-    uint8_t crc_value;
+    crc_len = 2;
 #endif /* MSG_ENABLE_CRC8 */
 
-    /* 队空条件: head == tail */
-    while (fifo->head != fifo->tail) {
-        /* 头存储的是帧长度 */
-        frame_len = fifo->buf[fifo->head & fifo->mask];
-        if (frame_len == 0) {
-            /* 最后一帧还没存完, 存完才会写长度, 已经结束了, 跳出循环 */
-            break;
+    /* 标识, 长度, 序号, CRC8 和结束符, 扩展 ID 按帧另外计算 */
+    overhead = 3 + seq_len + crc_len;
+
+    if (!fifo->new_frame) {
+        id_type = fifo->buf[(fifo->tail - fifo->frame_len) & fifo->mask];
+        ext_len = msg_ext_len(id_type);
+    }
+
+    if (count > 2 + ext_len) {
+        if (eof == (count == msg->frame_expect)) {
+            return true;
         }
 
-        if (fifo->head > fifo->tail) {
-            /* 正常不可能头比尾还大 */
+        if (msg_resync_rescan(msg, count, overhead, eof)) {
+            /* 真正的帧在噪声后面, 已经移到帧开头 */
+            return true;
+        }
+
+        msg_resync_drop(msg);
 #if MSG_ENABLE_STATISTICS
-            ++msg->recv_error;
+        MSG_STATS_INC(msg->stats.resync_discard);
+        if (eof) {
+            /* 结束符提前出现, 丢了字节的帧 */
+            MSG_STATS_INC(msg->stats.recv_error);
+        } else if (!msg->scanning) {
+            MSG_STATS_INC(msg->stats.resync_count);
+        }
 #endif /* MSG_ENABLE_STATISTICS */
-            break;
+
+        /* 结束符没有按时出现, 跳过剩下的部分直到结束符 */
+        msg->hunting = !eof;
+        msg->scanning = !eof;
+#ifdef MSG_ESC
+        msg->escape = false;
+#endif /* MSG_ESC */
+        return false;
+    }
+
+    if ((count == 2) && (ext_len != 0)) {
+        if (!eof && msg_resync_ext(byte)) {
+            return true;
         }
 
-        head = fifo->head & fifo->mask;
-        tail = (fifo->head + frame_len) & fifo->mask;
+        /* 扩展 ID 没有注册, 帧头是噪声, 这个字节重新当作帧头检查 */
+        msg_resync_drop(msg);
+    } else if (count == 2 + ext_len) {
+        /* 长度加上帧头和帧尾就是帧长度 */
+        msg->frame_expect = (uint16_t)(overhead + ext_len + byte);
+        if (!eof && (msg->frame_expect <= 254) &&
+            msg_frame_valid(ext_len ? fifo->buf[(fifo->tail - 1) & fifo->mask]
+                                    : (uint32_t)(id_type >> 4),
+                            id_type & 0x0F, byte)) {
+            return true;
+        }
 
-        /* 验证数据包长度与实际接收长度是否一致, 数据包第二个字节是长度 */
-#if MSG_ENABLE_CRC8
-        /* 1 byte 标识, 1 byte 长度, 1 byte 结束符, 1 byte FIFO 元素大小
-         * 2 byte CRC8 校验值
-         * 总共 6 byte. */
-        if ((frame_len - 6) != fifo->buf[(fifo->head + 2) & fifo->mask]) {
-#else  /* MSG_ENABLE_CRC8 */
-        /* 1 byte 标识, 1 byte 长度, 1 byte 结束符, 1 byte FIFO 元素大小
-         * 总共 4 byte. */
-        if ((frame_len - 4) != fifo->buf[(fifo->head + 2) & fifo->mask]) {
-#endif /* MSG_ENABLE_CRC8 */
+        /* 长度不合理, 帧头是噪声, 这个字节重新当作帧头检查 */
+        msg_resync_drop(msg);
+    }
+
+    if (!eof && msg_resync_header(byte)) {
+        msg->scanning = false;
+        return true;
+    }
 
-            /* 不一致, 出队到下一个 */
-            fifo->head += frame_len;
-            --msg->fifo_element_len;
 #if MSG_ENABLE_STATISTICS
-            ++msg->recv_error;
+    MSG_STATS_INC(msg->stats.resync_discard);
+    if (!eof && !msg->scanning) {
+        MSG_STATS_INC(msg->stats.resync_count);
+    }
 #endif /* MSG_ENABLE_STATISTICS */
+
+    /* 不是帧头, 下一个字节再检查. 单独的结束符只是空帧 */
+    msg->scanning = !eof;
+#ifdef MSG_ESC
+    msg->escape = false;
+#endif /* MSG_ESC */
+    return false;
+}
+
+/**
+ * @brief 结束符位置不对时, 在已写入的部分中查找真正的帧头
+ *
+ * @param msg 消息实例
+ * @param count 算上当前字节的帧长度
+ * @param overhead 帧头和帧尾的长度
+ * @param eof 当前字节是否是结束符
+ * @return 找到返回`true`, 帧已经移到开头, 当前字节由调用者写入
+ * @note 噪声中像帧头的字节会把后面真正的帧当成数据吞掉. 结束符提前出现时,
+ *       真正的帧头满足长度正好到这个结束符; 结束符没有按时出现时, 真正的
+ *       帧还没有结束. 只在出错时扫描一次, 不影响正常接收
+ */
+static bool msg_resync_rescan(struct msg_instance *msg, uint32_t count,
+                              uint32_t overhead, bool eof) {
+    msg_fifo_t *fifo = msg->fifo;
+    uint32_t base = fifo->tail - fifo->frame_len;
+    uint32_t s, k, expect = 0;
+    uint32_t ext_len, msg_id, len;
+    uint8_t id_type;
+
+    /* 帧头和长度都要已经写入队列 */
+    for (s = 1; s + 3 <= count; ++s) {
+        id_type = fifo->buf[(base + s) & fifo->mask];
+        if (!msg_resync_header(id_type)) {
             continue;
         }
 
-        if (tail < head) {
-            /* 数据在头尾, 分成两段, 直接复制到`recv_buf` (下一次读取就覆盖了) */
-            if (frame_len <= msg->recv_buf_size) {
-                /* 复制前半段 */
-                memcpy(msg->recv_buf, &fifo->buf[head], fifo->size - head);
-                /* 复制后半段 */
-                memcpy(&msg->recv_buf[fifo->size - head], &fifo->buf[0], tail);
-                call_id_type = msg->recv_buf[1];
-#if MSG_ENABLE_CRC8
-                call_len = frame_len - 6;
-#else  /* MSG_ENABLE_CRC8 */
-                call_len = frame_len - 4;
-#endif /* MSG_ENABLE_CRC8 */
-                call_data = &msg->recv_buf[3];
-            } else {
-                /* 空间不够, 不复制, 出队到下一个 */
-                fifo->head += frame_len;
-                --msg->fifo_element_len;
-#if MSG_ENABLE_STATISTICS
-                ++msg->recv_error;
-#endif /* MSG_ENABLE_STATISTICS */
+        ext_len = msg_ext_len(id_type);
+        msg_id = id_type >> 4;
+        if (ext_len != 0) {
+            msg_id = fifo->buf[(base + s + 1) & fifo->mask];
+            if ((s + 3 + ext_len > count) || !msg_resync_ext((uint8_t)msg_id)) {
                 continue;
             }
-        } else {
-            /* 完整的一帧没有被截断 */
-            call_id_type = fifo->buf[(fifo->head + 1) & fifo->mask];
-            call_len = fifo->buf[(fifo->head + 2) & fifo->mask];
-            call_data = &fifo->buf[(fifo->head + 3) & fifo->mask];
         }
 
-#if MSG_ENABLE_CRC8
-        /* 校验 CRC8 */
-        crc_value = calc_crc8(call_data, call_len);
-        /* 接收到的 CRC8 校验值 */
-        crc_recv =
-            (call_data[frame_len - 5] & 0x0F) | (call_data[frame_len - 6] << 4);
-        if (crc_value != crc_recv) {
-            /* 校验结果不一致, 出队到下一个 */
-            fifo->head += frame_len;
-            --msg->fifo_element_len;
-#if MSG_ENABLE_STATISTICS
-            ++msg->crc_check_error;
-#endif /* MSG_ENABLE_STATISTICS */
+        len = fifo->buf[(base + s + 1 + ext_len) & fifo->mask];
+        expect = len + overhead + ext_len;
+        if (!msg_frame_valid(msg_id, id_type & 0x0F, len)) {
             continue;
         }
-#endif /* MSG_ENABLE_CRC8 */
 
-        if (msg->recv_callback) {
-            msg->recv_callback(call_len, call_id_type, call_data);
+        if (eof ? (expect == count - s)
+                : ((expect > count - s) && (expect <= 254))) {
+            break;
         }
-#if MSG_ENABLE_STATISTICS
-        ++msg->recv_success;
-#endif /* MSG_ENABLE_STATISTICS */
+    }
 
-        /* 出队到下一个 */
-        fifo->head += frame_len;
-        --msg->fifo_element_len;
+    if (s + 3 > count) {
+        return false;
     }
-}
 
-/**
- * @brief 初始化消息队列
- * 
- * @param fifo_size 队列长度
- * @return 消息队列
- */
-static msg_fifo_t *msg_fifo_init(uint32_t fifo_size) {
-    msg_fifo_t *fifo = (msg_fifo_t *)MSG_MALLOC(sizeof(msg_fifo_t) + fifo_size);
-    if (fifo == NULL) {
-        return NULL;
+    for (k = 0; k < count - s - 1; ++k) {
+        fifo->buf[(base + k) & fifo->mask] =
+            fifo->buf[(base + s + k) & fifo->mask];
     }
 
-    fifo->size = fifo_size;
-    fifo->mask = fifo_size - 1;
-    fifo->head = 0;
-    fifo->tail = 0;
-    fifo->new_frame = true;
+    fifo->frame_len = (uint8_t)(count - s - 1);
+    fifo->tail = base + fifo->frame_len;
+    msg->frame_expect = (uint16_t)expect;
 
-    return fifo;
+#if MSG_ENABLE_STATISTICS
+    MSG_ENTER_CRITICAL();
+    msg->stats.resync_discard += s;
+    ++msg->stats.resync_count;
+    MSG_EXIT_CRITICAL();
+#endif /* MSG_ENABLE_STATISTICS */
+
+    return true;
 }
+
+#endif /* MSG_ENABLE_RESYNC */
@@ -17,6 +17,8 @@
  *      (##) `message_send_data`函数需要指定消息 ID (`msg_id_t`), 消息数据
  *           类型 (`msg_type_t), `data`(数据指针, 也就是要发送的数据), 
  *           以及`data_len`, 数据长度
+ *      (##) 同一时刻要发多帧时, 调用`message_send_batch`批量发送. 所有帧先
+ *           写入 DMA 发送缓冲区, 每个串口只等待一次发送完成, 启动一次 DMA
  * (#) 接收
  *      (##) 调用`message_register_polling_uart`添加消息 ID 对应的轮询串口
  *      (##) 调用`message_register_recv_callback`注册接收回调函数, 当收到消息
@@ -27,6 +29,164 @@
  *           第一个参数是消息长度, 第二个参数是消息标识 (高四位是 ID, 低四位是数据类型)
  *           第三个参数是数据区内容, 无返回值
  *      (##) `message_polling_data`仅支持 DMA 接收
+ *      (##) 调用`message_register_length`注册某个 ID 的最大或固定数据长度,
+ *           接收时读到长度字节就丢弃超出范围的帧. 之后注册轮询串口时缓冲区
+ *           和队列大小传 0, 按最大长度自动计算
+ * (#) 静态消息表
+ *      (##) 启用`MSG_ENABLE_STATIC_TABLE`后, 在 msg_table.h 的`MSG_TABLE`中
+ *           每个 ID 写一行`X(ID, 发送串口, 接收串口, 最大长度, 类型, 回调)`,
+ *           `msg_id_t`由它生成. 实例, 收发缓冲区和队列按最大长度静态分配,
+ *           启动时只需调用`message_table_init`, 不需要其他注册函数
+ *      (##) 轮询和回调按消息表展开, 不再查表判空, 回调可以被内联. 回调写
+ *           `NULL`时使用`message_register_recv_callback`注册的回调.
+ *           注册串口的函数只更换串口, 不重新分配缓冲区
+ * (#) 扩展 ID
+ *      (##) 帧头第一个字节高四位是 ID, 最多 16 个. 启用`MSG_ENABLE_EXT_ID`后,
+ *           ID 不小于`MSG_ID_EXT`(15) 的帧高四位写`MSG_ID_EXT`, 后面 1 byte
+ *           是完整的 ID, 像数据一样转义, 最多 256 个 ID. 小于 15 的 ID 仍然
+ *           是 1 byte 帧头, 小帧开销不变
+ *      (##) 每个 ID 仍然有独立的实例, 接收时按实例分发, 不查找 ID. 扩展 ID 的
+ *           回调中`msg_id_type`高四位是`MSG_ID_EXT`, 低四位仍是数据类型
+ *      (##) CAN 过滤器只接收前 16 个 ID, 扩展 ID 不能使用 CAN 传输
+ * (#) 序号
+ *      (##) 启用`MSG_ENABLE_SEQUENCE`后, 收发双方都调用`message_register_sequence`
+ *           让某个 ID 在长度字节后携带 1 byte 序号, 接收端据此统计丢帧数,
+ *           重复帧数和连续丢帧长度, 结果在统计快照中
+ * (#) 可靠传输
+ *      (##) 启用`MSG_ENABLE_RELIABLE`后, 收发双方都调用`message_register_reliable`
+ *           让某个 ID 改为选择重传模式. 双方都要注册该 ID 的发送和接收串口,
+ *           应答帧沿反方向发送
+ *      (##) 接收端按序号重排后按顺序回调, 收到按序的帧回复累计 ACK,
+ *           发现缺帧时回复 NACK 让发送端立即重传
+ *      (##) 发送端保留未确认的帧, 超过`MSG_RELIABLE_TIMEOUT`没有确认的帧在
+ *           `message_polling_data`中重传. 窗口满时`message_send_data`返回 1,
+ *           需要稍后重发
+ *      (##) 注册后以及发现对端重新启动 (收到窗口外的确认) 时, 发送端先让
+ *           对端从本端的序号重新开始接收, 同步完成之前`message_send_data`
+ *           也返回 1
+ * (#) 前向纠错
+ *      (##) 启用`MSG_ENABLE_FEC`后, 收发双方都调用`message_register_fec`让某个
+ *           ID 在帧尾附加纠错校验, 每`MSG_FEC_BLOCK`字节纠正 1 byte 错误
+ *      (##) 校验覆盖结束符以外的所有字节. 错误把字节变成结束符或转义字符时
+ *           会破坏分帧, 无法纠正
+ * (#) CAN 传输
+ *      (##) 启用`MSG_ENABLE_CAN`后, 调用`message_register_can`让某个 ID 改用
+ *           CAN 收发. 消息 ID 为 n 的帧使用标准帧 ID `MSG_CAN_ID_BASE + n`,
+ *           注册时在该 CAN 的过滤器组范围内配置掩码过滤器只接收这些 ID,
+ *           并关闭 CSP 配置的接收所有报文的过滤器组
+ *      (##) 编码后的帧按 ISO-TP 方式分段: 不超过 7 byte 用单帧, 否则首帧
+ *           加连续帧. 连续帧序号不连续时丢弃整帧
+ *      (##) 在`HAL_CAN_RxFifo0MsgPendingCallback`中取出报文后调用
+ *           `message_can_receive`, 返回 0 表示报文属于消息协议. 解包和回调
+ *           仍然在`message_polling_data`中进行
+ *      (##) 一个消息 ID 在总线上只能有一个节点发送
+ * (#) SPI 传输
+ *      (##) 启用`MSG_ENABLE_SPI`后, 调用`message_register_spi`让某个 ID 改用
+ *           SPI DMA 全双工收发. 每次传输固定`MSG_SPI_SLOT_SIZE`字节, 前 2 byte
+ *           是有效数据长度, 后面装入尽可能多的已编码帧, 双方同时收发
+ *      (##) 需要两根 GPIO: ready 由从机翻转电平, 表示已经装好下一次传输;
+ *           attention 由从机拉高, 表示有数据要发. 主机在自己有数据或
+ *           attention 为高, 并且 ready 翻转过时才开始传输
+ *      (##) 在`HAL_SPI_TxRxCpltCallback`和`HAL_SPI_ErrorCallback`中调用
+ *           `message_spi_transfer_callback`. 主机可以在 ready 引脚的外部中断
+ *           中调用`message_spi_ready_callback`连续传输, 不调用时由
+ *           `message_polling_data`检查
+ *      (##) SPI 需要提前初始化并配置收发 DMA, 主机和从机的时钟模式要一致
+ * (#) 以太网传输
+ *      (##) 启用`MSG_ENABLE_ETH`后, 先调用`eth_init`初始化 MAC/PHY, 再调用
+ *           `message_eth_init`设置本机和对端的 MAC, IP 和起始端口, 然后调用
+ *           `message_register_eth`让某个 ID 改用以太网收发
+ *      (##) 不使用协议栈, 直接收发 IPv4/UDP 报文, PC 端用普通 UDP 套接字即可.
+ *           消息 ID 为 n 的帧使用本机端口`local.port + n`和对端端口
+ *           `remote.port + n`. 会回复本机 IP 的 ARP 请求
+ *      (##) 发送的帧先攒在数据报中, 超过`MSG_ETH_FLUSH_SIZE`字节或第一帧
+ *           等待超过`MSG_ETH_FLUSH_US`微秒后发出, 也可以调用
+ *           `message_eth_flush`立即发出. 超时检查在`message_polling_data`中
+ *      (##) 对端 MAC 全 0 时先广播, 收到对端的数据报后记住对端的 MAC, IP 和端口
+ * (#) 多链路聚合
+ *      (##) 启用`MSG_ENABLE_BOND`后, 先为每条链路注册一个专用的 ID 和它的
+ *           收发串口 (或其他链路), 再调用`message_register_bond`把这些 ID
+ *           聚合成一个逻辑 ID. 收发双方都要注册, 链路要一一对接
+ *      (##) 发送逻辑 ID 的帧时, 按`(积压字节数 + 帧长度) / 权重`选择最早能发完
+ *           的链路, 积压字节数读 DMA 发送计数器, 权重按链路速率设置.
+ *           帧携带逻辑 ID 和它的序号, 每条链路的帧头仍是逻辑 ID
+ *      (##) 接收端从各条链路收到的帧按序号重排后按顺序回调逻辑 ID 的回调,
+ *           统计也记在逻辑 ID 上. 每条链路都收到了更新的帧时, 缺的帧一定已经
+ *           丢失, 立即跳过; 否则超过`MSG_BOND_TIMEOUT`后跳过. 每条链路内部
+ *           不会乱序, 某条链路上的序号倒退说明对端重新启动了, 交付缓存的帧
+ *           后以新收到的帧为起点重新同步
+ *      (##) 同一个聚合的链路 ID 要在同一个线程中轮询. 重排窗口要能容纳链路
+ *           之间的延迟差, 最慢和最快的链路相差不能超过 128 帧
+ * (#) 链路冗余
+ *      (##) 启用`MSG_ENABLE_FAILOVER`后, 先为主备链路各注册一个专用的 ID 和它的
+ *           收发串口, 再调用`message_register_failover`把它们组成一个逻辑 ID,
+ *           第一条是主链路. 收发双方都要注册, 链路顺序要一致
+ *      (##) 发送只走当前链路. 链路空闲超过`MSG_FAILOVER_HEARTBEAT`时发送心跳,
+ *           心跳中带本端已交付的最新序号, 本端看到的这条链路的健康度和
+ *           会话号. 会话号启动时为 0, 对端回显后变为非 0. 对端的会话号变化
+ *           说明它重新启动过, 清掉去重状态后从它之后的第一帧重新开始
+ *      (##) 健康度满分 100, 每收到一帧恢复一些, CRC 错误和队列溢出扣分,
+ *           超过`MSG_FAILOVER_TIMEOUT`什么也没收到直接归零. 本端和对端报告的
+ *           健康度取较小值, 低于`MSG_FAILOVER_HEALTH_MIN`时切换到下一条健康的
+ *           链路, 并在新链路上补发对端还没有交付的帧. 主链路恢复满分后切回
+ *      (##) 接收端按序号去掉补发产生的重复帧, 切换时可能短暂乱序. 轮询频率
+ *           要高于心跳频率, 默认配置下 1 kHz 轮询时 10 ms 内完成切换
+ * (#) 组播
+ *      (##) 启用`MSG_ENABLE_MULTICAST`后, 调用`message_register_multicast`把一个
+ *           ID 的帧同时发给多个串口, 各个对端都按这个 ID 接收. 不需要为这个 ID
+ *           注册发送串口
+ *      (##) 发送时只编码 (转义和 CRC8) 一次, 复制到一个空闲的发送缓冲区后在
+ *           每个串口上排队 DMA 发送, 最后一个串口发完时释放. 缓冲区都在使用时
+ *           发送返回失败
+ *      (##) 需要在`HAL_UART_TxCpltCallback`中调用`message_uart_tx_callback`.
+ *           成员串口的 DMA 发送由组播独占, 不能再用于其他 ID 的发送
+ * (#) 路由
+ *      (##) 启用`MSG_ENABLE_ROUTE`后, 调用`message_register_route`设置某条链路
+ *           收到的某个 ID 的帧转发到哪些链路, 用于在多条链路之间桥接的板子
+ *      (##) 转发在轮询接收链路时完成, 不回调也不重新编码: 队列中的帧只按编码
+ *           规则重新转义一次, 帧头, 序号, 数据和 CRC8 原样写入目的链路的发送
+ *           缓冲区. 存储转发先校验 CRC8, 直通转发不校验, 由最终的接收端校验
+ *      (##) 目的链路没有注册发送时丢弃. 转发的统计和延迟记在接收链路的 ID 上
+ * (#) 录制
+ *      (##) 启用`MSG_ENABLE_RECORD`后, 每次从链路读出数据, 解包之前先把原始
+ *           字节连同时间戳 (us) 和消息 ID 记录下来, 格式见`MSG_RECORD_MAGIC`
+ *      (##) 调用`message_record_start`开始录制到内存环形缓冲区, 满了丢弃最旧
+ *           的记录. 调用`message_record_dump`通过空闲串口阻塞导出并清空,
+ *           导出的字节流直接保存就是日志文件
+ *      (##) 也可以调用`message_register_record_hook`注册钩子自己保存, 主机端
+ *           用它写文件. 主机端回放工具把日志重新送入解包, 可以按原速或最快速度
+ * (#) 重新同步
+ *      (##) 启用`MSG_ENABLE_RESYNC`后, 接收时逐帧检查帧头: ID 必须已经注册,
+ *           类型在`MSG_RESYNC_TYPE_MASK`中, 长度不超过队列元素能存放的长度.
+ *           结束符必须正好出现在长度字节算出的位置
+ *      (##) 帧头或长度不合理时逐字节向后查找帧头, 帧间的噪声不会吞掉下一帧.
+ *           结束符没有按时出现时丢弃已写入队列的部分, 用`memchr`成块查找
+ *           下一个没有被转义的结束符. 噪声不写入队列, 也不会在出队时产生
+ *           错误帧. 队列溢出时同样丢弃正在接收的帧剩下的部分
+ *      (##) 启用前向纠错的 ID 不检查帧头和长度, 它们在纠错之后才可信
+ * (#) 统计
+ *      (##) 启用`MSG_ENABLE_STATISTICS`后, 调用`message_get_stats`获取某个 ID
+ *           的统计快照, 调用`message_reset_stats`清零统计
+ *      (##) 启用`MSG_ENABLE_LATENCY`后, 调用`message_get_latency`获取某个 ID
+ *           的解包, 排队, 回调耗时直方图, 时间单位由`MSG_TIMESTAMP`决定
+ *      (##) 启用`MSG_ENABLE_CALLBACK_BUDGET`后, 调用
+ *           `message_register_callback_budget`设置回调耗时预算和超时钩子,
+ *           调用`message_get_callback_stats`获取回调耗时统计
+ * (#) 调度
+ *      (##) 调用`message_set_dispatch_limit`限制每次轮询某个 ID 最多分发的帧数,
+ *           避免高频 ID 的回调占满轮询任务, 未分发的帧留到下一次轮询
+ *      (##) 启用`MSG_ENABLE_DEFERRED`后, 调用`message_register_deferred`让某个
+ *           ID 不再调用回调, 而是把帧复制到帧池中, 将帧指针 (`msg_frame_t *`)
+ *           放入队列. 处理任务使用`xQueueReceive`阻塞等待, 处理完调用
+ *           `message_frame_release`归还帧. 多个 ID 可以共用一个队列,
+ *           按优先级划分处理任务
+ *      (##) 启用`MSG_ENABLE_CONFLATE`后, 调用`message_register_conflate`让位姿,
+ *           电机反馈这类状态量只保留最新值. 接收端轮询落后时, 队列中被更新的
+ *           帧取代的旧帧不校验也不回调, 只处理最新一帧, 并写入邮箱, 其他任务
+ *           随时调用`message_read_latest`读取. 邮箱有两块数据, 读写不用加锁
+ *      (##) 发送端串口 DMA 正在发送时, 新的帧留在发送缓冲区, 不等待上一次
+ *           发完, 再次发送同一个 ID 时直接覆盖并沿用它的序号.
+ *           `message_polling_data`或`message_conflate_flush`在链路空闲时发出
  ******************************************************************************
  *    Date    | Version |   Author    | Version Info
  * -----------+---------+-------------+----------------------------------------
@@ -45,24 +205,171 @@
 
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
 /* 帧结束标志 (End Of Frame), 注意需要避开数据头标识和长度 */
-#define MSG_EOF               0x7F
+#define MSG_EOF                    0x7F
 /* 转义标识 (Escape), 注意需要避开头标识和长度 */
-#define MSG_ESC               0x8F
+#define MSG_ESC                    0x8F
 /* 启用 CRC8 */
-#define MSG_ENABLE_CRC8       1
+#define MSG_ENABLE_CRC8            1
 
 /* 线程安全处理, 启用后会使用互斥信号量来保护发送缓冲区, 仅支持 FreeRTOS. */
-#define MSG_ENABLE_RTOS       1
+#define MSG_ENABLE_RTOS            1
 
 /* 始能统计, 启用后统计接收成功错误计数, 队列最大深度等信息 */
-#define MSG_ENABLE_STATISTICS 1
+#define MSG_ENABLE_STATISTICS      1
+/* 统计收发速率的滑动窗口长度, 单位 ms */
+#define MSG_STATISTICS_WINDOW      1000
+
+/* 启用延迟测量, 记录每帧的解包, 排队和回调处理耗时, 会增加接收路径开销 */
+#define MSG_ENABLE_LATENCY         0
+/* 每个 ID 最多记录多少个已解包未回调的帧时间戳, 必须是 2 的幂次方 */
+#define MSG_LATENCY_DEPTH          32
+/* 延迟直方图桶个数, 第 n 个桶统计 [2^(n-1), 2^n) 个时间戳单位 */
+#define MSG_LATENCY_BUCKETS        24
+
+/* 启用回调执行时间监控, 统计回调耗时并检测超出预算的回调 */
+#define MSG_ENABLE_CALLBACK_BUDGET 0
+
+/* 启用延迟分发, 解包后的帧放入 FreeRTOS 队列交给其他任务处理, 需要启用 RTOS */
+#define MSG_ENABLE_DEFERRED        0
+
+/* 启用最新值模式, 可以为每个 ID 单独设置只处理和发送最新一帧, 用于状态量 */
+#define MSG_ENABLE_CONFLATE        0
+
+/* 启用帧序号, 可以为每个 ID 单独设置是否在帧头携带序号, 用于检测丢帧 */
+#define MSG_ENABLE_SEQUENCE        0
+/* 连续丢帧长度直方图桶个数, 第 n 个桶统计连续丢了 [2^n, 2^(n+1)) 帧 */
+#define MSG_SEQ_BURST_BUCKETS      7
+
+/* 启用可靠传输 (选择重传), 需要启用帧序号 */
+#define MSG_ENABLE_RELIABLE        0
+/* 可靠传输重传超时, 单位与`MSG_GET_TICK`相同 */
+#define MSG_RELIABLE_TIMEOUT       20
+
+/* 启用前向纠错, 可以为每个 ID 单独设置, 用于干扰大的长线缆 */
+#define MSG_ENABLE_FEC             0
+/* 前向纠错数据块长度, 每块附加 2 byte 校验, 可以纠正 1 byte 错误 */
+#define MSG_FEC_BLOCK              32
+
+/* 启用 CAN 传输, 需要在 CSP 中启用对应的 CAN */
+#define MSG_ENABLE_CAN             0
+/* CAN 标准帧 ID 起始值, 按 16 对齐, 消息 ID 为 n 的帧使用 MSG_CAN_ID_BASE + n */
+#define MSG_CAN_ID_BASE            0x700
+/* 使用每个 CAN 过滤器组范围内的第几组, CAN2 的范围从 CAN2SB 开始. CSP 在
+ * 第 0 组配置接收所有报文, 用其他组时需要另外关闭它, 否则硬件不会过滤 */
+#define MSG_CAN_FILTER_BANK        0
+/* CAN 发送邮箱满时的重试次数 */
+#define MSG_CAN_SEND_RETRY         100
+
+/* 启用 SPI 传输, 需要 SPI 配置收发 DMA */
+#define MSG_ENABLE_SPI             0
+/* SPI 每次传输的字节数, 包括 2 byte 长度 */
+#define MSG_SPI_SLOT_SIZE          512
+/* 主机等待 ready 翻转的超时时间, 超时后重新同步, 单位 ms */
+#define MSG_SPI_READY_TIMEOUT      100
+
+/* 启用以太网传输, 需要在 CSP 中启用 ETH */
+#define MSG_ENABLE_ETH             0
+/* 数据报攒够这么多字节后发出, 不能超过 1472 */
+#define MSG_ETH_FLUSH_SIZE         1024
+/* 数据报中第一帧最多等待的时间, 单位 us */
+#define MSG_ETH_FLUSH_US           500
+
+/* 启用多链路聚合, 一个 ID 的帧分散到多条链路发送, 接收端按序号重排,
+ * 需要启用帧序号 */
+#define MSG_ENABLE_BOND            0
+/* 一个聚合最多的链路数 */
+#define MSG_BOND_MAX_LINKS         4
+/* 重排时等待缺帧的超时时间, 单位与`MSG_GET_TICK`相同 */
+#define MSG_BOND_TIMEOUT           20
+
+/* 启用链路冗余, 一个 ID 在主备链路中选择健康的一条发送, 故障时自动切换,
+ * 需要启用帧序号 */
+#define MSG_ENABLE_FAILOVER        0
+/* 一个冗余组最多的链路数 */
+#define MSG_FAILOVER_MAX_LINKS     2
+/* 链路空闲这么久发送一次心跳, 单位与`MSG_GET_TICK`相同 */
+#define MSG_FAILOVER_HEARTBEAT     2
+/* 链路这么久没有收到任何帧认为已经断开, 单位与`MSG_GET_TICK`相同 */
+#define MSG_FAILOVER_TIMEOUT       6
+/* 健康度 (满分 100) 低于这个值时切换链路 */
+#define MSG_FAILOVER_HEALTH_MIN    50
+
+/* 启用组播, 一个 ID 的帧只编码一次, 从多个串口同时 DMA 发送 */
+#define MSG_ENABLE_MULTICAST       0
+/* 一个组播最多的串口数 */
+#define MSG_MULTICAST_MAX_UARTS    4
+
+/* 启用路由, 收到的帧按接收链路和 ID 直接转发到其他链路, 不回调也不重新编码 */
+#define MSG_ENABLE_ROUTE           0
+/* 一条路由最多的目的链路数 */
+#define MSG_ROUTE_MAX_DST          4
+
+/* 启用接收录制, 记录每次从链路读出的原始字节和时间戳, 用于回放复现解包问题 */
+#define MSG_ENABLE_RECORD          0
+
+/* 启用快速重新同步, 接收时检查帧头和长度, 噪声直接丢弃不写入队列 */
+#define MSG_ENABLE_RESYNC          0
+/* 重新同步时接受的数据类型, 第 n 位对应类型 n, 默认 0x0~0xB 和 0xF (应答帧) */
+#define MSG_RESYNC_TYPE_MASK       0x8FFFU
+
+/* 按注册的数据长度计算接收缓冲区和队列大小时, 能容纳多少个最长的帧 */
+#define MSG_SIZE_FRAMES            4
+
+/* 启用静态消息表, 在 msg_table.h 中声明每个 ID 的串口, 最大长度, 类型和回调,
+ * 实例, 缓冲区和队列都静态分配, 不再需要运行时注册 */
+#define MSG_ENABLE_STATIC_TABLE    0
+
+/* 启用扩展 ID, ID 不小于`MSG_ID_EXT`的帧在帧头后面多 1 byte 扩展 ID, 最多 256
+ * 个 ID. 小于`MSG_ID_EXT`的 ID 帧格式不变 */
+#define MSG_ENABLE_EXT_ID          0
 
 /* 内存分配相关 */
-#define MSG_MALLOC(x)         malloc(x)
-#define MSG_REALLOC(p, x)     realloc(p, x)
-#define MSG_FREE(p)           free(p)
+#define MSG_MALLOC(x)              malloc(x)
+#define MSG_REALLOC(p, x)          realloc(p, x)
+#define MSG_FREE(p)                free(p)
+
+/* 系统时基, 单位 ms */
+#define MSG_GET_TICK()             HAL_GetTick()
+
+/* 串口还没有发出的字节数, 多链路聚合按它选择链路. DMA 发送前会等上一次发完,
+ * 所以只需要读 DMA 剩余计数 */
+#define MSG_UART_TX_PENDING(huart)                                             \
+    (((huart)->hdmatx != NULL) ? __HAL_DMA_GET_COUNTER((huart)->hdmatx) : 0U)
+
+/* 高精度时间戳, 用于延迟测量, 默认使用 DWT 周期计数器 (单位: CPU 周期) */
+#define MSG_TIMESTAMP()            (DWT->CYCCNT)
+/* 每微秒的时间戳计数, 用于把微秒换算成时间戳 */
+#define MSG_TIMESTAMP_PER_US       (SystemCoreClock / 1000000U)
+#define MSG_TIMESTAMP_INIT()                                                   \
+    do {                                                                       \
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;                        \
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;                                   \
+    } while (0)
 
+#if MSG_ENABLE_DEFERRED
+#include "FreeRTOS.h"
+#include "queue.h"
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_STATIC_TABLE
+#include "msg_table.h"
+
+/**
+ * @brief 数据含义, 由消息表生成
+ */
+typedef enum {
+#define MSG_TABLE_ID(id, ...) id,
+    MSG_TABLE(MSG_TABLE_ID)
+#undef MSG_TABLE_ID
+
+    MSG_ID_RESERVE_LEN /*!< 保留位, 用于定义数据长度 */
+} msg_id_t;
+#else /* MSG_ENABLE_STATIC_TABLE */
 /**
  * @brief 数据含义
  */
@@ -74,6 +381,7 @@ typedef enum {
 
     MSG_ID_RESERVE_LEN /*!< 保留位, 用于定义数据长度 */
 } msg_id_t;
+#endif /* MSG_ENABLE_STATIC_TABLE */
 
 /**
  * @brief 数据类型
@@ -93,6 +401,7 @@ typedef enum {
     MSG_DATA_CUSTOM, /*!< 自定义数据类型 */
     /*!< 可以在下面加自定义的数据类型 */
 
+    MSG_DATA_CONTROL = 0x0FU, /*!< 保留, 可靠传输的应答帧使用 */
 } msg_type_t;
 
 /**
@@ -106,16 +415,356 @@ typedef void (*msg_recv_callback_t)(uint32_t /* msg_length */,
                                     uint8_t /* msg_id_type */,
                                     uint8_t * /* msg_data */);
 
+/**
+ * @brief 批量发送的一帧
+ */
+typedef struct {
+    msg_id_t msg_id;      /*!< 数据含义 */
+    msg_type_t data_type; /*!< 数据类型 */
+    uint8_t *data;        /*!< 数据内容 */
+    uint32_t data_len;    /*!< 数据长度 */
+} msg_batch_item_t;
+
+#if MSG_ENABLE_EXT_ID
+/* 帧头高四位为这个值时, 后面 1 byte 是扩展 ID, 回调收到的`msg_id_type`高四位
+ * 也是这个值 */
+#define MSG_ID_EXT     0x0FU
+#define MSG_ID_EXT_LEN 1U
+#else /* MSG_ENABLE_EXT_ID */
+#define MSG_ID_EXT_LEN 0U
+#endif /* MSG_ENABLE_EXT_ID */
+
+/* 一帧在接收队列中最多占用的字节数: 1 byte 元素大小, 1 byte 标识, 扩展 ID,
+ * 1 byte 长度, 1 byte 序号, 数据, 2 byte CRC8, 1 byte 结束符, 启用纠错时还有
+ * 纠错校验 */
+#if MSG_ENABLE_FEC
+#define MSG_FRAME_FIFO_SIZE(len)                                               \
+    ((len) + 7U + MSG_ID_EXT_LEN +                                             \
+     2U * (((len) + 5U + MSG_ID_EXT_LEN + MSG_FEC_BLOCK - 1U) / MSG_FEC_BLOCK))
+#else /* MSG_ENABLE_FEC */
+#define MSG_FRAME_FIFO_SIZE(len) ((len) + 7U + MSG_ID_EXT_LEN)
+#endif /* MSG_ENABLE_FEC */
+/* 一帧编码后最多占用的字节数, 元素大小以外的字节都按转义计算 */
+#define MSG_FRAME_WIRE_SIZE(len) (2U * MSG_FRAME_FIFO_SIZE(len) - 2U)
+
 void message_register_send_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
                                 uint32_t buf_size);
 void message_register_recv_callback(msg_id_t msg_id,
                                     msg_recv_callback_t msg_callback);
 void message_register_polling_uart(msg_id_t msg_id, UART_HandleTypeDef *huart,
                                    uint32_t buf_size, uint32_t fifo_size);
+uint8_t message_register_length(msg_id_t msg_id, uint32_t max_len,
+                                uint8_t exact);
 
-void message_send_data(msg_id_t msg_id, msg_type_t data_type, uint8_t *data,
-                       uint32_t data_len);
+#if MSG_ENABLE_STATIC_TABLE
+void message_table_init(void);
+#endif /* MSG_ENABLE_STATIC_TABLE */
+
+uint8_t message_send_data(msg_id_t msg_id, msg_type_t data_type,
+                          uint8_t *data, uint32_t data_len);
+uint32_t message_send_batch(const msg_batch_item_t *items, uint32_t count);
 
 void message_polling_data(void);
+void message_polling_id(msg_id_t msg_id);
+void message_set_dispatch_limit(msg_id_t msg_id, uint32_t limit);
+
+#if MSG_ENABLE_SEQUENCE
+void message_register_sequence(msg_id_t msg_id, uint8_t enable);
+#endif /* MSG_ENABLE_SEQUENCE */
+
+#if MSG_ENABLE_CAN
+uint8_t message_register_can(msg_id_t msg_id, can_selected_t can,
+                             uint32_t buf_size, uint32_t fifo_size);
+uint8_t message_can_receive(can_selected_t can, uint32_t can_id,
+                            const uint8_t *data, uint32_t len);
+#endif /* MSG_ENABLE_CAN */
+
+#if MSG_ENABLE_SPI
+/**
+ * @brief SPI 传输角色
+ */
+typedef enum {
+    MSG_SPI_MASTER, /*!< 主机, 产生时钟 */
+    MSG_SPI_SLAVE   /*!< 从机, 驱动握手引脚 */
+} msg_spi_role_t;
+
+/**
+ * @brief SPI 握手引脚
+ */
+typedef struct {
+    GPIO_TypeDef *port; /*!< 引脚端口 */
+    uint16_t pin;       /*!< 引脚编号 */
+} msg_spi_pin_t;
+
+uint8_t message_register_spi(msg_id_t msg_id, SPI_HandleTypeDef *hspi,
+                             msg_spi_role_t role, msg_spi_pin_t ready,
+                             msg_spi_pin_t attention, uint32_t buf_size,
+                             uint32_t fifo_size);
+void message_spi_transfer_callback(SPI_HandleTypeDef *hspi);
+void message_spi_ready_callback(uint16_t pin);
+#endif /* MSG_ENABLE_SPI */
+
+#if MSG_ENABLE_ETH
+/**
+ * @brief 以太网地址
+ */
+typedef struct {
+    uint8_t mac[6]; /*!< MAC 地址 */
+    uint8_t ip[4];  /*!< IPv4 地址 */
+    uint16_t port;  /*!< 起始 UDP 端口, 消息 ID 为 n 时使用 port + n */
+} msg_eth_addr_t;
+
+uint8_t message_eth_init(const msg_eth_addr_t *local,
+                         const msg_eth_addr_t *remote);
+uint8_t message_register_eth(msg_id_t msg_id, uint32_t buf_size,
+                             uint32_t fifo_size);
+void message_eth_flush(void);
+#endif /* MSG_ENABLE_ETH */
+
+#if MSG_ENABLE_BOND
+/**
+ * @brief 聚合中的一条链路
+ */
+typedef struct {
+    msg_id_t msg_id; /*!< 链路使用的 ID, 需要注册收发链路 */
+    uint32_t weight; /*!< 权重, 按链路速率设置 (如波特率), 0 按 1 计算 */
+} msg_bond_link_t;
+
+uint8_t message_register_bond(msg_id_t msg_id, const msg_bond_link_t *links,
+                              uint32_t count, uint32_t window,
+                              uint32_t frame_size);
+#endif /* MSG_ENABLE_BOND */
+
+#if MSG_ENABLE_FAILOVER
+/**
+ * @brief 链路冗余状态
+ */
+typedef struct {
+    uint8_t active; /*!< 正在使用的链路序号, 0 是主链路 */
+    uint8_t health[MSG_FAILOVER_MAX_LINKS]; /*!< 健康度, 本端和对端的较小值 */
+} msg_failover_status_t;
+
+uint8_t message_register_failover(msg_id_t msg_id, const msg_id_t *links,
+                                  uint32_t count, uint32_t window,
+                                  uint32_t frame_size);
+uint8_t message_get_failover_status(msg_id_t msg_id,
+                                    msg_failover_status_t *status);
+#endif /* MSG_ENABLE_FAILOVER */
+
+#if MSG_ENABLE_MULTICAST
+uint8_t message_register_multicast(msg_id_t msg_id,
+                                   UART_HandleTypeDef *const *uarts,
+                                   uint32_t count, uint32_t buf_num,
+                                   uint32_t frame_size);
+void message_uart_tx_callback(UART_HandleTypeDef *huart);
+#endif /* MSG_ENABLE_MULTICAST */
+
+#if MSG_ENABLE_ROUTE
+uint8_t message_register_route(msg_id_t src_id, msg_id_t frame_id,
+                               const msg_id_t *dst_ids, uint32_t count,
+                               uint8_t cut_through);
+#endif /* MSG_ENABLE_ROUTE */
+
+/* 录制日志格式: 文件头为"MSGR"和 1 byte 版本, 之后是连续的记录. 每条记录
+ * 4 byte 时间戳 (us, 小端), 2 byte 长度 (小端), 1 byte 消息 ID, 然后是
+ * 从链路读出的原始字节 */
+#define MSG_RECORD_MAGIC     "MSGR"
+#define MSG_RECORD_VERSION   1
+#define MSG_RECORD_HEAD_SIZE 7
+
+#if MSG_ENABLE_RECORD
+/**
+ * @brief 录制钩子
+ *
+ * @param msg_id 数据含义
+ * @param stamp_us 读出时刻, 单位 us
+ * @param[in] data 从链路读出的原始字节
+ * @param len 字节数
+ */
+typedef void (*msg_record_hook_t)(msg_id_t /* msg_id */,
+                                  uint32_t /* stamp_us */,
+                                  const uint8_t * /* data */,
+                                  uint32_t /* len */);
+
+void message_register_record_hook(msg_record_hook_t hook);
+uint8_t message_record_start(uint32_t size);
+void message_record_stop(void);
+uint32_t message_record_dump(UART_HandleTypeDef *huart);
+#endif /* MSG_ENABLE_RECORD */
+
+#if MSG_ENABLE_FEC
+void message_register_fec(msg_id_t msg_id, uint8_t enable);
+#endif /* MSG_ENABLE_FEC */
+
+#if MSG_ENABLE_RELIABLE
+uint8_t message_register_reliable(msg_id_t msg_id, uint32_t window,
+                                  uint32_t frame_size);
+#endif /* MSG_ENABLE_RELIABLE */
+
+#if MSG_ENABLE_STATISTICS
+
+/**
+ * @brief 消息统计快照
+ */
+typedef struct {
+    uint32_t send_count;  /*!< 发送帧计数 */
+    uint32_t send_bytes;  /*!< 发送字节数 (帧编码后的长度) */
+    uint32_t send_escape; /*!< 发送时插入的转义字节数 */
+    uint32_t send_rate;   /*!< 发送速率 (byte/s), 滑动窗口统计 */
+
+    uint32_t recv_success;    /*!< 接收成功计数 */
+    uint32_t recv_error;      /*!< 接收错误计数 */
+    uint32_t crc_check_error; /*!< CRC 校验错误计数 */
+    uint32_t recv_bytes;      /*!< 接收字节数 (串口原始字节) */
+    uint32_t recv_escape;     /*!< 接收时去掉的转义字节数 */
+    uint32_t recv_rate;       /*!< 接收速率 (byte/s), 滑动窗口统计 */
+    uint32_t recv_oversize;   /*!< 长度超出注册范围或 FIFO 元素大小而丢弃的帧数 */
+    uint32_t resync_count;    /*!< 检测到噪声开始重新同步的次数 */
+    uint32_t resync_discard;  /*!< 重新同步丢弃的字节数 */
+
+    uint32_t fifo_element_len;     /*!< 当前队列元素个数 */
+    uint32_t max_fifo_element_len; /*!< 最大队列元素个数 */
+    uint32_t fifo_overflow;        /*!< 队列溢出清空计数 */
+    uint32_t dispatch_limited;     /*!< 达到分发上限提前结束轮询的次数 */
+    uint32_t deferred_drop;        /*!< 延迟分发时帧池耗尽或队列已满丢弃的帧数 */
+    uint32_t conflate_skip;        /*!< 最新值模式接收时被新帧取代跳过的帧数 */
+    uint32_t conflate_replace;     /*!< 最新值模式发送时覆盖还没发出的帧数 */
+
+    uint32_t seq_lost;      /*!< 根据序号检测到的丢帧数 */
+    uint32_t seq_duplicate; /*!< 序号重复或回退的帧数 */
+    uint32_t seq_burst[MSG_SEQ_BURST_BUCKETS]; /*!< 连续丢帧长度直方图 */
+
+    uint32_t retransmit;  /*!< 可靠传输重传帧数 */
+    uint32_t window_full; /*!< 可靠传输发送窗口满拒绝发送的次数 */
+
+    uint32_t fec_corrected;     /*!< 前向纠错纠正的字节数 */
+    uint32_t fec_uncorrectable; /*!< 前向纠错无法纠正而丢弃的帧数 */
+
+    uint32_t can_drop;     /*!< CAN 分段丢失或接收缓冲区满丢弃的帧数 */
+    uint32_t can_tx_drop;  /*!< CAN 帧太长或发送失败丢弃的帧数 */
+    uint32_t spi_drop;     /*!< SPI 传输出错或缓冲区满丢弃的数据块数 */
+    uint32_t eth_datagram; /*!< 以太网发出的数据报数 */
+    uint32_t eth_drop;     /*!< 以太网发送失败或接收缓冲区满丢弃的数据报数 */
+
+    uint32_t bond_frames[MSG_BOND_MAX_LINKS]; /*!< 聚合时每条链路发送的帧数 */
+    uint32_t bond_reorder; /*!< 聚合接收时乱序到达缓存的帧数 */
+
+    uint32_t failover_switch; /*!< 链路冗余切换链路的次数 */
+    uint32_t failover_resent; /*!< 切换时在新链路上补发的帧数 */
+
+    uint32_t mcast_pool_full; /*!< 组播发送缓冲区用完拒绝发送的次数 */
+    uint32_t mcast_drop;      /*!< 组播时串口启动 DMA 发送失败丢弃的帧数 */
+
+    uint32_t route_frames; /*!< 路由转发的帧数, 每个目的链路算一帧 */
+    uint32_t route_bytes;  /*!< 路由转发的字节数 (转义后的长度) */
+    uint32_t route_rate;   /*!< 路由转发速率 (byte/s), 滑动窗口统计 */
+    uint32_t route_drop;   /*!< 目的链路没有注册发送丢弃的帧数 */
+} msg_stats_t;
+
+uint8_t message_get_stats(msg_id_t msg_id, msg_stats_t *stats);
+void message_reset_stats(msg_id_t msg_id);
+
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET
+
+/**
+ * @brief 延迟直方图
+ */
+typedef struct {
+    uint32_t count; /*!< 样本个数 */
+    uint32_t max;   /*!< 最大值 */
+    uint64_t total; /*!< 累计值, 除以 count 得到平均值 */
+    uint32_t hist[MSG_LATENCY_BUCKETS]; /*!< 对数分桶 */
+} msg_latency_hist_t;
+
+#endif /* MSG_ENABLE_LATENCY || MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_LATENCY
+
+/**
+ * @brief 消息延迟快照
+ */
+typedef struct {
+    msg_latency_hist_t decode;  /*!< 从串口读出到解出完整一帧 */
+    msg_latency_hist_t queue;   /*!< 解出完整一帧到进入回调 (在队列中等待) */
+    msg_latency_hist_t process; /*!< 回调函数执行时间 */
+    msg_latency_hist_t forward; /*!< 路由时从串口读出到转发完成 */
+    uint32_t lost_stamp;        /*!< 时间戳被覆盖, 未能统计的帧数 */
+} msg_latency_t;
+
+uint8_t message_get_latency(msg_id_t msg_id, msg_latency_t *latency);
+void message_reset_latency(msg_id_t msg_id);
+
+#endif /* MSG_ENABLE_LATENCY */
+
+#if MSG_ENABLE_CALLBACK_BUDGET
+
+/**
+ * @brief 回调超时钩子函数指针定义, 在轮询任务中调用
+ *
+ * @param msg_id 超时的消息 ID
+ * @param duration 本次回调耗时 (时间戳单位)
+ */
+typedef void (*msg_overrun_hook_t)(msg_id_t /* msg_id */,
+                                   uint32_t /* duration */);
+
+/**
+ * @brief 回调耗时统计快照
+ */
+typedef struct {
+    msg_latency_hist_t duration; /*!< 回调耗时 */
+    uint32_t budget;             /*!< 耗时预算, 0 为不检查 */
+    uint32_t overrun;            /*!< 超出预算次数 */
+} msg_callback_stats_t;
+
+void message_register_callback_budget(msg_id_t msg_id, uint32_t budget,
+                                      msg_overrun_hook_t hook);
+uint8_t message_get_callback_stats(msg_id_t msg_id,
+                                   msg_callback_stats_t *stats);
+void message_reset_callback_stats(msg_id_t msg_id);
+
+#endif /* MSG_ENABLE_CALLBACK_BUDGET */
+
+#if MSG_ENABLE_DEFERRED
+
+/**
+ * @brief 延迟分发的消息帧, 从帧池中分配
+ */
+typedef struct {
+    msg_id_t msg_id;     /*!< 消息 ID */
+    uint8_t msg_id_type; /*!< 消息 ID 和数据类型 (高四位为 ID, 低四位为类型) */
+    uint32_t msg_length; /*!< 消息长度 */
+    void *pool;          /*!< 所属帧池, 归还时使用 */
+    uint8_t msg_data[0]; /*!< 消息数据 */
+} msg_frame_t;
+
+QueueHandle_t message_register_deferred(msg_id_t msg_id, QueueHandle_t queue,
+                                        uint32_t frame_num,
+                                        uint32_t frame_size);
+void message_frame_release(msg_frame_t *frame);
+
+#endif /* MSG_ENABLE_DEFERRED */
+
+#if MSG_ENABLE_CONFLATE
+
+/**
+ * @brief 最新值模式, 可以按位或
+ */
+typedef enum {
+    MSG_CONFLATE_RECV = 0x01, /*!< 接收端只处理最新一帧, 并写入邮箱 */
+    MSG_CONFLATE_SEND = 0x02  /*!< 发送端用新帧覆盖还没发出的帧 */
+} msg_conflate_mode_t;
+
+uint8_t message_register_conflate(msg_id_t msg_id, uint8_t mode);
+uint32_t message_read_latest(msg_id_t msg_id, uint8_t *data, uint32_t size,
+                             uint8_t *msg_id_type, uint32_t *version);
+void message_conflate_flush(void);
+
+#endif /* MSG_ENABLE_CONFLATE */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
 
 #endif /* __MSG_PROTOCOL_H */
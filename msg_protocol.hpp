@@ -0,0 +1,366 @@
+/**
+ * @file    msg_protocol.hpp
+ * @author  Deadline039
+ * @brief   消息协议的 C++17 接口, 只有头文件
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 使用说明:
+ *   (#) `msg::Channel<ID, 元素类型, 最大元素个数>`对应一个消息 ID, 数据类型
+ *       由元素类型推导 (`uint8_t`->`MSG_DATA_UINT8`, `float`->`MSG_DATA_FP32`,
+ *       `char`->`MSG_DATA_STRING`...), 自定义结构体需要显式给出
+ *       `MSG_DATA_CUSTOM`. 通道只有静态成员, 不需要创建对象
+ *   (#) 调用`attach`注册串口, 同时按最大长度注册`message_register_length`,
+ *       发送缓冲区, 接收缓冲区和队列大小都在编译期算好
+ *   (#) `send`接受`msg::span<const T>`, 数组和单个元素, 数组长度超过通道的
+ *       最大长度时编译报错
+ *   (#) `on_receive`接受 lambda 或函数对象, 参数为`msg::span<const T>`.
+ *       每种处理函数类型实例化一个分发函数注册给协议层, 处理函数在其中直接
+ *       调用, 可以被内联, 不经过`void *`转换. 类型不符的帧不会交给处理函数
+ *   (#) 帧格式 (CRC, 序号, 纠错) 仍由 msg_protocol.h 的配置决定, 编解码
+ *       都在 C 协议层中完成, 与 C 接口收发的帧完全兼容. `msg::framing`只
+ *       按同样的配置在编译期计算缓冲区大小
+ *   (#) 轮询仍然调用`message_polling_data`
+ *****************************************************************************
+ */
+
+#ifndef __MSG_PROTOCOL_HPP
+#define __MSG_PROTOCOL_HPP
+
+#include "msg_protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#if (__cplusplus > 201703L) && __has_include(<span>)
+#include <span>
+#endif /* __cplusplus > 201703L */
+
+namespace msg {
+
+/**
+ * @brief 按 msg_protocol.h 的帧格式配置计算的缓冲区大小
+ */
+struct framing {
+    /**
+     * @brief 一帧在接收队列中最多占用的字节数
+     *
+     * @param len 数据长度
+     * @return 字节数
+     */
+    static constexpr std::size_t fifo_size(std::size_t len) {
+        return MSG_FRAME_FIFO_SIZE(len);
+    }
+
+    /**
+     * @brief 一帧编码后最多占用的字节数
+     *
+     * @param len 数据长度
+     * @return 字节数
+     */
+    static constexpr std::size_t wire_size(std::size_t len) {
+        return MSG_FRAME_WIRE_SIZE(len);
+    }
+};
+
+#if defined(__cpp_lib_span)
+template <typename T>
+using span = std::span<T>;
+#else  /* __cpp_lib_span */
+/**
+ * @brief C++17 没有`std::span`, 只实现收发用到的部分
+ */
+template <typename T>
+class span {
+  public:
+    constexpr span() noexcept = default;
+
+    constexpr span(T *data, std::size_t size) noexcept
+        : data_(data), size_(size) {
+    }
+
+    template <std::size_t N>
+    constexpr span(T (&array)[N]) noexcept : data_(array), size_(N) {
+    }
+
+    /* 连续容器 (`std::array`, `std::vector`, `std::string`...) */
+    template <typename C,
+              typename = std::enable_if_t<std::is_convertible_v<
+                  decltype(std::declval<C &>().data()), T *>>,
+              typename = decltype(std::declval<C &>().size())>
+    constexpr span(C &container) noexcept
+        : data_(container.data()), size_(container.size()) {
+    }
+
+    template <typename U,
+              typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    constexpr span(const span<U> &other) noexcept
+        : data_(other.data()), size_(other.size()) {
+    }
+
+    constexpr T *data() const noexcept {
+        return data_;
+    }
+
+    constexpr std::size_t size() const noexcept {
+        return size_;
+    }
+
+    constexpr std::size_t size_bytes() const noexcept {
+        return size_ * sizeof(T);
+    }
+
+    constexpr bool empty() const noexcept {
+        return size_ == 0;
+    }
+
+    constexpr T &operator[](std::size_t idx) const noexcept {
+        return data_[idx];
+    }
+
+    constexpr T *begin() const noexcept {
+        return data_;
+    }
+
+    constexpr T *end() const noexcept {
+        return data_ + size_;
+    }
+
+  private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+#endif /* __cpp_lib_span */
+
+/**
+ * @brief 元素类型对应的数据类型, 没有定义的类型需要显式给出
+ */
+template <typename T>
+struct data_type {};
+
+template <>
+struct data_type<std::uint8_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_UINT8> {};
+template <>
+struct data_type<std::int8_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_INT8> {};
+template <>
+struct data_type<std::uint16_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_UINT16> {};
+template <>
+struct data_type<std::int16_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_INT16> {};
+template <>
+struct data_type<std::int32_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_INT32> {};
+template <>
+struct data_type<std::uint32_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_UINT32> {};
+template <>
+struct data_type<std::int64_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_INT64> {};
+template <>
+struct data_type<std::uint64_t>
+    : std::integral_constant<msg_type_t, MSG_DATA_UINT64> {};
+template <>
+struct data_type<float> : std::integral_constant<msg_type_t, MSG_DATA_FP32> {
+};
+template <>
+struct data_type<double> : std::integral_constant<msg_type_t, MSG_DATA_FP64> {
+};
+template <>
+struct data_type<char> : std::integral_constant<msg_type_t, MSG_DATA_STRING> {
+};
+
+/**
+ * @brief 一个消息 ID 的收发通道
+ *
+ * @tparam Id 数据含义
+ * @tparam T 元素类型, 必须可以按字节复制
+ * @tparam MaxLen 一帧最多的元素个数
+ * @tparam Type 数据类型, 默认由元素类型推导
+ */
+template <msg_id_t Id, typename T, std::size_t MaxLen,
+          msg_type_t Type = data_type<T>::value>
+class Channel {
+  public:
+    static_assert(Id < MSG_ID_RESERVE_LEN, "msg id out of range");
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "element type must be trivially copyable");
+    static_assert(MaxLen > 0, "channel length must not be zero");
+    static_assert(framing::fifo_size(MaxLen * sizeof(T)) <= UINT8_MAX,
+                  "frame does not fit in the receive fifo element");
+
+    using value_type = T;
+
+    /* 一帧最多的数据字节数 */
+    static constexpr std::size_t max_bytes = MaxLen * sizeof(T);
+    /* 发送缓冲区大小 */
+    static constexpr std::size_t send_buf_size = framing::wire_size(max_bytes);
+
+    Channel() = delete;
+
+    /**
+     * @brief 注册收发串口, 并按最大长度限制收发的数据长度
+     *
+     * @param tx 发送串口, 为`nullptr`时不发送
+     * @param rx 接收串口, 为`nullptr`时不接收
+     * @param buf_size 接收缓冲区大小, 为 0 时按最大长度计算
+     * @param fifo_size 接收队列大小, 为 0 时按最大长度计算
+     */
+    static void attach(UART_HandleTypeDef *tx, UART_HandleTypeDef *rx,
+                       std::uint32_t buf_size = 0,
+                       std::uint32_t fifo_size = 0) {
+        message_register_length(Id, static_cast<std::uint32_t>(max_bytes), 0);
+
+        if (tx != nullptr) {
+            message_register_send_uart(Id, tx, send_buf_size);
+        }
+
+        if (rx != nullptr) {
+            message_register_polling_uart(Id, rx, buf_size, fifo_size);
+        }
+    }
+
+    /**
+     * @brief 发送数据
+     *
+     * @param data 数据
+     * @return 发送结果, 与`message_send_data`相同
+     * @retval - 0: 成功
+     * @retval - 1: 失败
+     */
+    static std::uint8_t send(span<const T> data) {
+        /* 协议层只读取数据 */
+        return message_send_data(
+            Id, Type,
+            const_cast<std::uint8_t *>(
+                reinterpret_cast<const std::uint8_t *>(data.data())),
+            static_cast<std::uint32_t>(data.size_bytes()));
+    }
+
+    /**
+     * @brief 发送数组, 长度在编译期检查
+     *
+     * @param data 数组
+     * @return 发送结果
+     */
+    template <std::size_t N>
+    static std::uint8_t send(const T (&data)[N]) {
+        static_assert(N <= MaxLen, "array longer than channel length");
+        return send(span<const T>(data, N));
+    }
+
+    /**
+     * @brief 发送单个元素
+     *
+     * @param value 元素
+     * @return 发送结果
+     */
+    static std::uint8_t send(const T &value) {
+        return send(span<const T>(&value, 1));
+    }
+
+    /**
+     * @brief 注册接收处理函数
+     *
+     * @param handler lambda 或函数对象, 参数为`msg::span<const T>`
+     * @note 处理函数保存在按类型实例化的静态变量中, 再次注册同一类型的处理函数
+     *       会覆盖之前的
+     */
+    template <typename F>
+    static void on_receive(F &&handler) {
+        using H = std::decay_t<F>;
+        static_assert(std::is_invocable_v<H &, span<const T>>,
+                      "handler must accept msg::span<const T>");
+
+        handler_slot<H>().emplace(std::forward<F>(handler));
+        message_register_recv_callback(Id, &dispatch<H>);
+    }
+
+#if MSG_ENABLE_STATISTICS
+    /**
+     * @brief 获取统计信息
+     *
+     * @return 统计信息
+     */
+    static msg_stats_t stats() {
+        msg_stats_t stats{};
+        message_get_stats(Id, &stats);
+        return stats;
+    }
+#endif /* MSG_ENABLE_STATISTICS */
+
+#if MSG_ENABLE_CONFLATE
+    /**
+     * @brief 读取最新收到的一帧, 需要用`MSG_CONFLATE_RECV`启用最新值模式
+     *
+     * @param[out] out 数据
+     * @return 元素个数, 0 表示还没有收到或类型不符
+     */
+    static std::size_t latest(T (&out)[MaxLen]) {
+        std::uint8_t id_type = 0;
+        std::uint32_t len = message_read_latest(
+            Id, reinterpret_cast<std::uint8_t *>(out),
+            static_cast<std::uint32_t>(max_bytes), &id_type, nullptr);
+
+        if (((id_type & 0x0FU) != static_cast<std::uint8_t>(Type)) ||
+            (len > max_bytes) || ((len % sizeof(T)) != 0)) {
+            return 0;
+        }
+
+        return len / sizeof(T);
+    }
+#endif /* MSG_ENABLE_CONFLATE */
+
+  private:
+    template <typename H>
+    static std::optional<H> &handler_slot() {
+        static std::optional<H> slot;
+        return slot;
+    }
+
+    /**
+     * @brief 注册给协议层的回调, 检查类型和长度后调用处理函数
+     *
+     * @param msg_length 消息长度
+     * @param msg_id_type 消息 ID 和数据类型
+     * @param[in] msg_data 消息数据
+     */
+    template <typename H>
+    static void dispatch(std::uint32_t msg_length, std::uint8_t msg_id_type,
+                         std::uint8_t *msg_data) {
+        if (((msg_id_type & 0x0FU) != static_cast<std::uint8_t>(Type)) ||
+            (msg_length > max_bytes) || ((msg_length % sizeof(T)) != 0)) {
+            return;
+        }
+
+        H &handler = *handler_slot<H>();
+        const std::size_t count = msg_length / sizeof(T);
+
+        if constexpr (alignof(T) == 1) {
+            handler(span<const T>(reinterpret_cast<const T *>(msg_data), count));
+        } else {
+            if ((reinterpret_cast<std::uintptr_t>(msg_data) % alignof(T)) ==
+                0) {
+                handler(
+                    span<const T>(reinterpret_cast<const T *>(msg_data), count));
+                return;
+            }
+
+            /* 队列中的数据不一定对齐, 复制到栈上 */
+            alignas(T) std::uint8_t aligned[max_bytes];
+            std::memcpy(aligned, msg_data, msg_length);
+            handler(span<const T>(reinterpret_cast<const T *>(aligned), count));
+        }
+    }
+};
+
+} // namespace msg
+
+#endif /* __MSG_PROTOCOL_HPP */
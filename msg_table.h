@@ -0,0 +1,29 @@
+/**
+ * @file    msg_table.h
+ * @author  Deadline039
+ * @brief   静态消息表, 启用`MSG_ENABLE_STATIC_TABLE`时使用
+ * @version 1.0
+ * @date    2026-10-18
+ *
+ *****************************************************************************
+ * 每个 ID 一行: X(ID, 发送串口, 接收串口, 最大数据长度, 数据类型, 接收回调)
+ *   (#) ID 按顺序生成`msg_id_t`
+ *   (#) 串口为`NULL`表示不发送或不接收
+ *   (#) 收发缓冲区和队列按最大数据长度静态分配, 超出长度的帧收发都会丢弃
+ *   (#) 只接受声明的数据类型和应答帧
+ *   (#) 回调为`NULL`时使用`message_register_recv_callback`注册的回调,
+ *       回调需要在这里声明
+ *****************************************************************************
+ */
+
+#ifndef __MSG_TABLE_H
+#define __MSG_TABLE_H
+
+/* demo: 与 rtos_tasks.c 中运行时注册的配置相同 */
+#define MSG_TABLE(X)                                                           \
+    X(MSG_ID_1, &usart2_handle, &usart3_handle, 20, MSG_DATA_UINT8, NULL)      \
+    X(MSG_ID_2, &usart3_handle, &uart4_handle, 50, MSG_DATA_UINT8, NULL)       \
+    X(MSG_ID_3, &uart4_handle, &uart5_handle, 100, MSG_DATA_UINT8, NULL)       \
+    X(MSG_ID_4, &uart5_handle, &usart2_handle, 200, MSG_DATA_UINT8, NULL)
+
+#endif /* __MSG_TABLE_H */